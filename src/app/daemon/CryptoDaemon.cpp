@@ -0,0 +1,833 @@
+#include "CryptoDaemon.hpp"
+#include "../processes/XtsEncryption.hpp"
+#include "../fileHandling/EnvConfig.hpp"
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <csignal>
+#include <cstring>
+#include <cerrno>
+#include <iostream>
+
+using namespace DaemonProtocol;
+
+static bool setNonBlocking(int fd)
+{
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags != -1 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) != -1;
+}
+
+// Compares every byte whatever the first mismatch, so timing says nothing
+static bool tokensMatch(const std::string &given, const std::string &expected)
+{
+    unsigned char difference = given.size() == expected.size() ? 0 : 1;
+    for (size_t i = 0; i < given.size(); i++)
+        difference |= static_cast<unsigned char>(given[i] ^ expected[i % std::max<size_t>(1, expected.size())]);
+    return difference == 0;
+}
+
+CryptoDaemon::CryptoDaemon(const std::string &socketPath, size_t runnerCount, size_t asyncExecutors)
+    : socketPath(socketPath), runnerCount(runnerCount), asyncExecutors(asyncExecutors), listenFd(-1), nodeFd(-1),
+      running(false),
+      nextClientId(1), nextSequence(0)
+{
+    wakePipe[0] = wakePipe[1] = -1;
+    if (this->runnerCount == 0)
+    {
+        size_t cores = std::thread::hardware_concurrency();
+        this->runnerCount = std::max<size_t>(2, cores / 2);
+    }
+}
+
+CryptoDaemon::~CryptoDaemon()
+{
+    stop();
+    // Before the runners, so its callbacks still find the reply queue
+    if (engine)
+        engine->stop();
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        running = false;
+    }
+    queueCondition.notify_all();
+    for (auto &runner : runners)
+    {
+        if (runner.joinable())
+            runner.join();
+    }
+
+    for (auto &entry : clients)
+        close(entry.second.fd);
+    if (listenFd != -1)
+    {
+        close(listenFd);
+        unlink(socketPath.c_str());
+    }
+    if (nodeFd != -1)
+        close(nodeFd);
+    if (wakePipe[0] != -1)
+        close(wakePipe[0]);
+    if (wakePipe[1] != -1)
+        close(wakePipe[1]);
+}
+
+bool CryptoDaemon::start()
+{
+    // A client closing its socket mid-reply must not kill the daemon
+    signal(SIGPIPE, SIG_IGN);
+
+    if (socketPath.size() >= sizeof(sockaddr_un::sun_path))
+    {
+        statusMessage = "Socket path too long: " + socketPath;
+        return false;
+    }
+
+    if (pipe(wakePipe) == -1 || !setNonBlocking(wakePipe[0]) || !setNonBlocking(wakePipe[1]))
+    {
+        statusMessage = "Failed to create wake pipe";
+        return false;
+    }
+
+    listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenFd == -1)
+    {
+        statusMessage = "Failed to create socket";
+        return false;
+    }
+
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, socketPath.c_str(), sizeof(addr.sun_path) - 1);
+    unlink(socketPath.c_str());
+
+    // Jobs run with the daemon's file permissions, so only its owner may
+    // connect. The socket is created with that mode rather than changed to
+    // it, so it is never open to others, even briefly. The runners start
+    // later, so none of them creates files under the narrowed umask.
+    mode_t previousMask = umask(S_IRWXG | S_IRWXO | S_IXUSR);
+    int bound = bind(listenFd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr));
+    int bindError = errno;
+    umask(previousMask);
+    if (bound == -1)
+    {
+        statusMessage = "Failed to bind " + socketPath + ": " + std::strerror(bindError);
+        return false;
+    }
+
+    if (listen(listenFd, 64) == -1 || !setNonBlocking(listenFd))
+    {
+        statusMessage = "Failed to listen on " + socketPath;
+        return false;
+    }
+    if (!nodeAddress.empty() && !openNodeListener())
+        return false;
+
+    if (asyncExecutors > 0)
+    {
+        engine = std::make_unique<AsyncEngine>(asyncExecutors);
+        if (!engine->start())
+        {
+            statusMessage = "Failed to start async engine: " + engine->getStatusMessage();
+            engine.reset();
+            return false;
+        }
+    }
+
+    running = true;
+    runnerManagers.resize(runnerCount);
+    for (size_t i = 0; i < runnerCount; i++)
+        runners.emplace_back(&CryptoDaemon::runnerLoop, this, i);
+
+    statusMessage = "Listening on " + socketPath;
+    if (nodeFd != -1)
+        statusMessage += " and " + nodeAddress;
+    statusMessage += " with " + std::to_string(runnerCount) + " runners";
+    if (engine)
+        statusMessage += " and an async engine (" + engine->getStatusMessage() + ")";
+    return true;
+}
+
+void CryptoDaemon::setNodeListener(const std::string &address)
+{
+    nodeAddress = address;
+}
+
+bool CryptoDaemon::openNodeListener()
+{
+    std::string host;
+    uint16_t port;
+    if (!splitHostPort(nodeAddress, host, port))
+    {
+        statusMessage = "Invalid node address: " + nodeAddress;
+        return false;
+    }
+
+    // The link carries plaintext and the nodes' keys transform anything sent
+    // to them, so every connection has to present the shared token. Loopback
+    // is no exception since any local user can reach it.
+    nodeToken = EnvConfig::get().nodeToken;
+    if (nodeToken.empty())
+    {
+        statusMessage = "Set CRYPTOCORE_NODE_TOKEN to listen on " + nodeAddress;
+        return false;
+    }
+    if (nodeToken.size() > MAX_TOKEN_LEN)
+    {
+        statusMessage = "CRYPTOCORE_NODE_TOKEN is longer than " + std::to_string(MAX_TOKEN_LEN) + " bytes";
+        return false;
+    }
+
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    addrinfo *found = nullptr;
+    if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &found) != 0 || !found)
+    {
+        statusMessage = "Cannot resolve " + host;
+        return false;
+    }
+
+    nodeFd = socket(found->ai_family, SOCK_STREAM, 0);
+    int reuse = 1;
+    bool ok = nodeFd != -1 && setsockopt(nodeFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) == 0 &&
+              bind(nodeFd, found->ai_addr, found->ai_addrlen) == 0 && listen(nodeFd, 64) == 0 &&
+              setNonBlocking(nodeFd);
+    freeaddrinfo(found);
+    if (!ok)
+    {
+        statusMessage = "Failed to listen on " + nodeAddress + ": " + std::strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+void CryptoDaemon::stop()
+{
+    // Only async-signal-safe calls here so stop() can be used from a signal handler
+    running = false;
+    if (wakePipe[1] != -1)
+    {
+        char byte = 'q';
+        ssize_t ignored = write(wakePipe[1], &byte, 1);
+        (void)ignored;
+    }
+}
+
+std::string CryptoDaemon::getStatusMessage() const
+{
+    return statusMessage;
+}
+
+void CryptoDaemon::run()
+{
+    std::vector<pollfd> fds;
+    std::vector<int> fdClients;
+
+    while (running)
+    {
+        fds.clear();
+        fdClients.clear();
+        fds.push_back({listenFd, POLLIN, 0});
+        fds.push_back({wakePipe[0], POLLIN, 0});
+        fds.push_back({nodeFd, POLLIN, 0}); // ignored by poll when -1
+        const size_t firstClient = fds.size();
+        for (auto &entry : clients)
+        {
+            short events = entry.second.closing ? 0 : POLLIN;
+            if (!entry.second.outbox.empty())
+                events |= POLLOUT;
+            fds.push_back({entry.second.fd, events, 0});
+            fdClients.push_back(entry.first);
+        }
+
+        int ready = poll(fds.data(), fds.size(), -1);
+        if (ready == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            statusMessage = "poll failed: " + std::string(std::strerror(errno));
+            break;
+        }
+
+        if (fds[1].revents & POLLIN)
+        {
+            char drain[256];
+            while (read(wakePipe[0], drain, sizeof(drain)) > 0)
+            {
+            }
+            deliverReplies();
+        }
+
+        for (size_t i = 0; i < fdClients.size(); i++)
+        {
+            const pollfd &pfd = fds[i + firstClient];
+            int clientId = fdClients[i];
+            auto it = clients.find(clientId);
+            if (it == clients.end() || pfd.revents == 0)
+                continue;
+
+            bool alive = true;
+            if (pfd.revents & (POLLIN | POLLHUP | POLLERR))
+                alive = readFromClient(clientId, it->second);
+            if (alive && (pfd.revents & POLLOUT))
+                alive = writeToClient(it->second);
+            if (alive && it->second.closing && it->second.outbox.empty())
+                alive = false;
+            if (!alive)
+                dropClient(clientId);
+        }
+
+        if (fds[0].revents & POLLIN)
+            acceptClients(listenFd, false);
+        if (fds[2].revents & POLLIN)
+            acceptClients(nodeFd, true);
+    }
+}
+
+void CryptoDaemon::acceptClients(int listener, bool remote)
+{
+    while (true)
+    {
+        int fd = accept(listener, nullptr, nullptr);
+        if (fd == -1)
+            return;
+        if (!setNonBlocking(fd))
+        {
+            close(fd);
+            continue;
+        }
+        if (remote)
+        {
+            // Replies are single frames; do not hold them back for more
+            int noDelay = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+        }
+        ClientConnection client;
+        client.fd = fd;
+        client.defaultPriority = 0;
+        client.remote = remote;
+        client.authenticated = !remote;
+        clients[nextClientId++] = std::move(client);
+    }
+}
+
+bool CryptoDaemon::readFromClient(int clientId, ClientConnection &client)
+{
+    char buffer[64 * 1024];
+    bool open = true;
+    while (open)
+    {
+        // Until a remote peer has sent the token, nothing past one HELLO of
+        // the largest token size is read, so it cannot make us buffer more
+        size_t room = sizeof(buffer);
+        if (!client.authenticated)
+        {
+            size_t limit = HEADER_SIZE + MAX_TOKEN_LEN;
+            room = client.inbox.size() < limit ? limit - client.inbox.size() : 0;
+            if (room == 0)
+                break;
+        }
+        ssize_t n = read(client.fd, buffer, room);
+        if (n > 0)
+            client.inbox.insert(client.inbox.end(), buffer, buffer + n);
+        else if (n == 0)
+            open = false;
+        else if (errno == EAGAIN || errno == EWOULDBLOCK)
+            break;
+        else if (errno != EINTR)
+            open = false;
+    }
+
+    // Several frames can arrive in one read, and a frame can span reads
+    size_t consumed = 0;
+    while (client.inbox.size() - consumed >= HEADER_SIZE && !client.closing)
+    {
+        FrameHeader header;
+        if (!decodeHeader(client.inbox.data() + consumed, header))
+            return false;
+        if (!client.authenticated && (header.opcode != Opcode::HELLO || header.payloadLength > MAX_TOKEN_LEN))
+            return false;
+        if (client.inbox.size() - consumed < HEADER_SIZE + header.payloadLength)
+            break;
+        handleFrame(clientId, client, header, client.inbox.data() + consumed + HEADER_SIZE);
+        consumed += HEADER_SIZE + header.payloadLength;
+    }
+    client.inbox.erase(client.inbox.begin(), client.inbox.begin() + consumed);
+    return open;
+}
+
+bool CryptoDaemon::writeToClient(ClientConnection &client)
+{
+    size_t written = 0;
+    while (written < client.outbox.size())
+    {
+        ssize_t n = write(client.fd, client.outbox.data() + written, client.outbox.size() - written);
+        if (n > 0)
+        {
+            written += n;
+            continue;
+        }
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        return false;
+    }
+    client.outbox.erase(client.outbox.begin(), client.outbox.begin() + written);
+    return true;
+}
+
+void CryptoDaemon::handleFrame(int clientId, ClientConnection &client, const FrameHeader &header,
+                               const char *payload)
+{
+    auto reply = [&](Opcode opcode, const std::string &message)
+    {
+        FrameHeader out;
+        out.opcode = opcode;
+        out.jobId = header.jobId;
+        std::vector<char> frame = encodeFrame(out, message.data(), message.size());
+        client.outbox.insert(client.outbox.end(), frame.begin(), frame.end());
+    };
+
+    switch (header.opcode)
+    {
+    case Opcode::HELLO:
+        // One try per connection
+        if (client.remote && !tokensMatch(std::string(payload, header.payloadLength), nodeToken))
+        {
+            reply(Opcode::FAILED, "Bad node token");
+            client.closing = true;
+            return;
+        }
+        client.authenticated = true;
+        reply(Opcode::ACCEPTED, "");
+        return;
+
+    case Opcode::SET_PRIORITY:
+        client.defaultPriority = header.priority;
+        return;
+
+    case Opcode::SET_LIMITS:
+    {
+        if (client.remote)
+        {
+            reply(Opcode::FAILED, "Limits are only accepted on the local socket");
+            return;
+        }
+        if (header.payloadLength != LIMITS_PAYLOAD_SIZE)
+        {
+            reply(Opcode::FAILED, "Malformed limits payload");
+            return;
+        }
+        RunLimits limits;
+        limits.readBytesPerSecond = getU64(payload);
+        limits.writeBytesPerSecond = getU64(payload + 8);
+        limits.cpuPercent = getU16(payload + 16);
+        limits.nice = static_cast<int8_t>(payload[18]);
+        limits.ioClass = static_cast<uint8_t>(payload[19]);
+        limits.ioLevel = static_cast<uint8_t>(payload[20]);
+
+        // A running job's manager takes the limits at once; its workers see
+        // them at their next block
+        std::string error;
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            if (header.jobId != 0)
+            {
+                auto it = liveJobs.find({clientId, header.jobId});
+                if (it == liveJobs.end())
+                {
+                    error = "Unknown job";
+                }
+                else if (it->second->engineTicket)
+                {
+                    error = "Job runs on the async engine, which does not throttle";
+                }
+                else
+                {
+                    it->second->limits = limits;
+                    if (it->second->manager)
+                        it->second->manager->setLimits(limits);
+                }
+            }
+            else if (header.flags & FLAG_ALL_JOBS)
+            {
+                defaultLimits = limits;
+                for (auto &entry : liveJobs)
+                {
+                    DaemonJob &job = *entry.second;
+                    if (job.engineTicket)
+                        continue;
+                    job.limits = limits;
+                    if (job.manager)
+                        job.manager->setLimits(limits);
+                }
+            }
+            else
+            {
+                client.hasLimits = true;
+                client.limits = limits;
+            }
+        }
+        if (error.empty())
+            reply(Opcode::ACCEPTED, "");
+        else
+            reply(Opcode::FAILED, error);
+        return;
+    }
+
+    case Opcode::CANCEL:
+    {
+        bool cancelled = false;
+        bool found = false;
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            auto it = liveJobs.find({clientId, header.jobId});
+            if (it != liveJobs.end())
+            {
+                found = true;
+                it->second->cancelled = true;
+                // A queued job is dropped by the runner that pops it; a job
+                // that is already running is stopped between blocks, rolled
+                // back and reports CANCELLED itself
+                if (!it->second->started)
+                {
+                    liveJobs.erase(it);
+                    cancelled = true;
+                }
+                else if (it->second->manager)
+                {
+                    it->second->manager->cancel();
+                }
+                else if (it->second->engineTicket)
+                {
+                    // The engine replies through the job's callback
+                    engine->cancel(it->second->engineTicket);
+                }
+            }
+        }
+        if (!found)
+            reply(Opcode::FAILED, "Unknown job");
+        else if (cancelled)
+            reply(Opcode::CANCELLED, "");
+        return;
+    }
+
+    case Opcode::SUBMIT_FILE:
+    case Opcode::SUBMIT_BLOB:
+    case Opcode::SUBMIT_RANGE:
+    {
+        size_t fixedSize = header.opcode == Opcode::SUBMIT_FILE ? 4 : header.opcode == Opcode::SUBMIT_RANGE ? 10 : 2;
+        if (header.payloadLength < fixedSize)
+        {
+            reply(Opcode::FAILED, "Malformed submit payload");
+            return;
+        }
+        if (client.remote && header.opcode == Opcode::SUBMIT_FILE)
+        {
+            reply(Opcode::FAILED, "File jobs are only accepted on the local socket");
+            return;
+        }
+        // Refused here rather than when the job runs, so a bad byte can never
+        // end up applied to a file with some other technique
+        if (payload[0] != 0 && payload[0] != 1)
+        {
+            reply(Opcode::FAILED, "Unknown action");
+            return;
+        }
+        if (!canBuild(static_cast<EncryptionType>(static_cast<uint8_t>(payload[1]))))
+        {
+            reply(Opcode::FAILED, "Unknown technique");
+            return;
+        }
+
+        auto job = std::make_shared<DaemonJob>();
+        job->jobId = header.jobId;
+        job->clientId = clientId;
+        job->priority = header.priority != 0 ? header.priority : client.defaultPriority;
+        job->kind = header.opcode;
+        job->isEncryption = payload[0] == 0;
+        job->technique = static_cast<EncryptionType>(static_cast<uint8_t>(payload[1]));
+        job->workers = 0;
+        if (header.opcode == Opcode::SUBMIT_FILE)
+        {
+            job->workers = getU16(payload + 2);
+            job->checkpoint = (header.flags & FLAG_CHECKPOINT) != 0;
+            job->pinWorkers = (header.flags & FLAG_PIN_WORKERS) != 0;
+            job->hashing = (header.flags & FLAG_HASH) != 0;
+            job->filePath.assign(payload + fixedSize, header.payloadLength - fixedSize);
+        }
+        else
+        {
+            if (header.opcode == Opcode::SUBMIT_RANGE)
+                job->fileOffset = getU64(payload + 2);
+            job->data.assign(payload + fixedSize, payload + header.payloadLength);
+        }
+
+        bool async;
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            if (liveJobs.count({clientId, header.jobId}))
+            {
+                reply(Opcode::FAILED, "Duplicate job id");
+                return;
+            }
+            job->limits = client.hasLimits ? client.limits : defaultLimits;
+            async = engine && header.opcode == Opcode::SUBMIT_FILE && !job->checkpoint && !job->pinWorkers &&
+                    !job->hashing && job->workers == 0 && !job->limits.any();
+            job->sequence = nextSequence++;
+            liveJobs[{clientId, header.jobId}] = job;
+            if (!async)
+                pendingJobs.push(job);
+        }
+        reply(Opcode::ACCEPTED, "");
+        if (async)
+            submitAsync(job);
+        else
+            queueCondition.notify_one();
+        return;
+    }
+
+    default:
+        reply(Opcode::FAILED, "Unsupported opcode");
+        return;
+    }
+}
+
+void CryptoDaemon::dropClient(int clientId)
+{
+    auto it = clients.find(clientId);
+    if (it == clients.end())
+        return;
+    close(it->second.fd);
+    clients.erase(it);
+
+    // Nobody is left to receive the results of this client's jobs, so queued
+    // ones are dropped and running ones are stopped and rolled back
+    std::lock_guard<std::mutex> lock(queueMutex);
+    for (auto it = liveJobs.begin(); it != liveJobs.end();)
+    {
+        if (it->first.first != clientId)
+        {
+            ++it;
+            continue;
+        }
+        it->second->cancelled = true;
+        if (!it->second->started)
+        {
+            it = liveJobs.erase(it);
+        }
+        else
+        {
+            if (it->second->manager)
+                it->second->manager->cancel();
+            else if (it->second->engineTicket)
+                engine->cancel(it->second->engineTicket);
+            ++it;
+        }
+    }
+}
+
+void CryptoDaemon::postReply(int clientId, Opcode opcode, uint64_t jobId, const char *payload, size_t length)
+{
+    FrameHeader header;
+    header.opcode = opcode;
+    header.jobId = jobId;
+    {
+        std::lock_guard<std::mutex> lock(replyMutex);
+        pendingReplies.emplace_back(clientId, encodeFrame(header, payload, length));
+    }
+    char byte = 'r';
+    ssize_t ignored = write(wakePipe[1], &byte, 1);
+    (void)ignored;
+}
+
+void CryptoDaemon::deliverReplies()
+{
+    std::vector<std::pair<int, std::vector<char>>> replies;
+    {
+        std::lock_guard<std::mutex> lock(replyMutex);
+        replies.swap(pendingReplies);
+    }
+
+    for (auto &reply : replies)
+    {
+        auto it = clients.find(reply.first);
+        if (it == clients.end())
+            continue;
+        auto &outbox = it->second.outbox;
+        outbox.insert(outbox.end(), reply.second.begin(), reply.second.end());
+    }
+}
+
+bool CryptoDaemon::canBuild(EncryptionType technique)
+{
+    if (technique == AES_XTS)
+        return true;
+    std::lock_guard<std::mutex> lock(factoryMutex);
+    return techniqueFactory.getTechnique(technique) != nullptr;
+}
+
+TaskManager &CryptoDaemon::warmManager(ManagerCache &managers, EncryptionType technique)
+{
+    auto it = managers.find(technique);
+    if (it != managers.end())
+        return *it->second;
+
+    auto manager = std::make_unique<TaskManager>();
+    if (technique == AES_XTS)
+    {
+        // Keyed from the daemon's own .env; a failure fails the job and
+        // leaves nothing cached, so a fixed config is picked up next time
+        std::string error;
+        std::unique_ptr<XtsEncryption> instance = XtsEncryption::fromConfig(error);
+        if (!instance)
+            throw std::runtime_error(error);
+        manager->setEncryptionTechnique(std::move(instance));
+    }
+    else
+    {
+        std::lock_guard<std::mutex> lock(factoryMutex);
+        std::unique_ptr<EncryptionTechnique> instance = techniqueFactory.getTechnique(technique);
+        if (!instance)
+            throw std::runtime_error("Unknown technique");
+        manager->setEncryptionTechnique(std::move(instance));
+    }
+    TaskManager &ref = *manager;
+    managers[technique] = std::move(manager);
+    return ref;
+}
+
+void CryptoDaemon::submitAsync(const std::shared_ptr<DaemonJob> &job)
+{
+    TaskManager *manager;
+    try
+    {
+        manager = &warmManager(asyncManagers, job->technique);
+    }
+    catch (const std::exception &e)
+    {
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            liveJobs.erase({job->clientId, job->jobId});
+        }
+        std::string error = e.what();
+        postReply(job->clientId, Opcode::FAILED, job->jobId, error.data(), error.size());
+        return;
+    }
+
+    auto done = [this, job](AsyncEngine::Outcome outcome, const std::string &error)
+    {
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            liveJobs.erase({job->clientId, job->jobId});
+        }
+        if (outcome == AsyncEngine::Outcome::COMPLETED)
+            postReply(job->clientId, Opcode::COMPLETED, job->jobId);
+        else if (outcome == AsyncEngine::Outcome::CANCELLED)
+            postReply(job->clientId, Opcode::CANCELLED, job->jobId);
+        else
+            postReply(job->clientId, Opcode::FAILED, job->jobId, error.data(), error.size());
+    };
+
+    // The engine never runs done inside submit or cancel, so holding the
+    // queue lock here is safe, and a CANCEL always finds the ticket
+    std::lock_guard<std::mutex> lock(queueMutex);
+    job->started = true;
+    job->engineTicket = engine->submit(job->filePath, job->isEncryption, *manager, job->priority, done);
+    if (job->engineTicket == 0)
+    {
+        liveJobs.erase({job->clientId, job->jobId});
+        const char error[] = "Daemon is shutting down";
+        postReply(job->clientId, Opcode::FAILED, job->jobId, error, sizeof(error) - 1);
+    }
+}
+
+void CryptoDaemon::runnerLoop(size_t runnerIndex)
+{
+    while (true)
+    {
+        std::shared_ptr<DaemonJob> job;
+        {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            queueCondition.wait(lock, [this]
+                                { return !running || !pendingJobs.empty(); });
+            if (!running)
+                return;
+            job = pendingJobs.top();
+            pendingJobs.pop();
+            if (job->cancelled)
+                continue;
+            job->started = true;
+        }
+
+        executeJob(runnerIndex, *job);
+
+        std::lock_guard<std::mutex> lock(queueMutex);
+        liveJobs.erase({job->clientId, job->jobId});
+    }
+}
+
+void CryptoDaemon::executeJob(size_t runnerIndex, DaemonJob &job)
+{
+    try
+    {
+        TaskManager &manager = warmManager(runnerManagers[runnerIndex], job.technique);
+
+        if (job.kind != Opcode::SUBMIT_FILE)
+        {
+            manager.processAt(job.data.data(), job.data.size(), job.fileOffset, job.isEncryption);
+            postReply(job.clientId, Opcode::COMPLETED, job.jobId, job.data.data(), job.data.size());
+            return;
+        }
+
+        {
+            // Publish the manager so CANCEL can reach the run; a cancel that
+            // arrived before this point is applied before the first block
+            std::lock_guard<std::mutex> lock(queueMutex);
+            job.manager = &manager;
+            manager.setLimits(job.limits);
+            if (job.cancelled)
+                manager.cancel();
+        }
+        manager.setCheckpointing(job.checkpoint);
+        manager.setWorkerPinning(job.pinWorkers);
+        manager.setHashing(job.hashing);
+        // A worker count of 0 leaves the choice to the auto-tuner
+        bool ok = manager.runWithThreads(job.filePath, job.isEncryption, job.workers);
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            job.manager = nullptr;
+            // A cancel that landed after the run finished must not leak into
+            // the next job on this manager
+            if (!manager.wasCancelled())
+                manager.resetControl();
+        }
+
+        if (ok)
+        {
+            postReply(job.clientId, Opcode::COMPLETED, job.jobId);
+        }
+        else if (manager.wasCancelled())
+        {
+            postReply(job.clientId, Opcode::CANCELLED, job.jobId);
+        }
+        else
+        {
+            std::string error = manager.getStatusMessage();
+            postReply(job.clientId, Opcode::FAILED, job.jobId, error.data(), error.size());
+        }
+    }
+    catch (const std::exception &e)
+    {
+        std::string error = e.what();
+        postReply(job.clientId, Opcode::FAILED, job.jobId, error.data(), error.size());
+    }
+}
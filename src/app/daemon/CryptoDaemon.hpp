@@ -0,0 +1,148 @@
+#ifndef CRYPTO_DAEMON_HPP
+#define CRYPTO_DAEMON_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+#include "DaemonProtocol.hpp"
+#include "../processes/TaskManager.hpp"
+#include "../processes/AsyncEngine.hpp"
+#include "../processes/BenchmarkManager.hpp"
+
+// A single queued or running request received from a client
+struct DaemonJob
+{
+    uint64_t jobId;
+    int clientId;
+    uint8_t priority;
+    uint64_t sequence;
+    DaemonProtocol::Opcode kind;
+    bool isEncryption;
+    EncryptionType technique;
+    size_t workers;
+    bool checkpoint = false;
+    bool pinWorkers = false;
+    bool hashing = false;
+    std::string filePath;
+    std::vector<char> data;
+    uint64_t fileOffset = 0; // SUBMIT_RANGE: where data sits in its file
+    RunLimits limits;        // guarded by CryptoDaemon::queueMutex
+    bool started = false; // guarded by CryptoDaemon::queueMutex
+    TaskManager *manager = nullptr; // set while running, guarded by queueMutex
+    uint64_t engineTicket = 0;      // set while the async engine has it, guarded by queueMutex
+    std::atomic<bool> cancelled{false};
+};
+
+// Long-running server that keeps TaskManagers and their encryption techniques
+// warm between jobs and accepts work over a Unix domain socket.
+//
+// With async executors, plain file jobs (no checkpoint, pinning, hashing or
+// worker count) go to an AsyncEngine shared by all of them instead of to a
+// runner, so any number of them can be in progress on a fixed set of threads.
+// The rest still go to the runners, as do jobs with limits: the throttling
+// lives in TaskManager's workers, which the engine does not use.
+//
+// With a node listener it also serves as a worker node for ShardCoordinator:
+// TCP clients may only send data to transform, never name local files.
+class CryptoDaemon
+{
+public:
+    CryptoDaemon(const std::string &socketPath, size_t runnerCount = 0, size_t asyncExecutors = 0);
+    ~CryptoDaemon();
+
+    // Also accept shard coordinators on TCP at "host:port"; call before
+    // start(). Refuses to start without CRYPTOCORE_NODE_TOKEN.
+    void setNodeListener(const std::string &address);
+    bool start();
+    void run();
+    void stop();
+    std::string getStatusMessage() const;
+
+private:
+    struct ClientConnection
+    {
+        int fd;
+        uint8_t defaultPriority;
+        std::vector<char> inbox;
+        std::vector<char> outbox;
+        bool remote = false;        // came in over TCP
+        bool authenticated = false; // sent the node token, or is local
+        bool closing = false;       // dropped once the outbox is written
+        bool hasLimits = false;     // limits below override the daemon's default
+        RunLimits limits;
+    };
+
+    // Highest priority first, FIFO within the same priority
+    struct JobOrder
+    {
+        bool operator()(const std::shared_ptr<DaemonJob> &a, const std::shared_ptr<DaemonJob> &b) const
+        {
+            if (a->priority != b->priority)
+                return a->priority < b->priority;
+            return a->sequence > b->sequence;
+        }
+    };
+
+    typedef std::map<EncryptionType, std::unique_ptr<TaskManager>> ManagerCache;
+
+    void runnerLoop(size_t runnerIndex);
+    void executeJob(size_t runnerIndex, DaemonJob &job);
+    // True for the techniques a job may name
+    bool canBuild(EncryptionType technique);
+    TaskManager &warmManager(ManagerCache &managers, EncryptionType technique);
+    void submitAsync(const std::shared_ptr<DaemonJob> &job);
+
+    bool openNodeListener();
+    void acceptClients(int listener, bool remote);
+    bool readFromClient(int clientId, ClientConnection &client);
+    bool writeToClient(ClientConnection &client);
+    void handleFrame(int clientId, ClientConnection &client, const DaemonProtocol::FrameHeader &header,
+                     const char *payload);
+    void dropClient(int clientId);
+    void postReply(int clientId, DaemonProtocol::Opcode opcode, uint64_t jobId,
+                   const char *payload = nullptr, size_t length = 0);
+    void deliverReplies();
+
+    std::string socketPath;
+    size_t runnerCount;
+    size_t asyncExecutors;
+    int listenFd;
+    std::string nodeAddress;
+    std::string nodeToken;
+    int nodeFd;
+    int wakePipe[2];
+    std::atomic<bool> running;
+    std::string statusMessage;
+
+    std::map<int, ClientConnection> clients;
+    int nextClientId;
+
+    std::priority_queue<std::shared_ptr<DaemonJob>, std::vector<std::shared_ptr<DaemonJob>>, JobOrder> pendingJobs;
+    std::map<std::pair<int, uint64_t>, std::shared_ptr<DaemonJob>> liveJobs;
+    uint64_t nextSequence;
+    std::mutex queueMutex;
+    std::condition_variable queueCondition;
+    RunLimits defaultLimits; // for jobs of connections without their own, guarded by queueMutex
+
+    std::vector<std::pair<int, std::vector<char>>> pendingReplies;
+    std::mutex replyMutex;
+
+    std::vector<std::thread> runners;
+    // One TaskManager per technique per runner, created on first use and
+    // reused so technique construction and key setup happen only once
+    std::vector<ManagerCache> runnerManagers;
+    BenchmarkManager techniqueFactory;
+    std::mutex factoryMutex;
+
+    std::unique_ptr<AsyncEngine> engine;
+    // Used only from the poll thread; the engine shares them between jobs
+    ManagerCache asyncManagers;
+};
+
+#endif
@@ -0,0 +1,168 @@
+#include "DaemonClient.hpp"
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cstring>
+#include <cerrno>
+
+using namespace DaemonProtocol;
+
+DaemonClient::DaemonClient() : fd(-1) {}
+
+DaemonClient::~DaemonClient()
+{
+    if (fd != -1)
+        close(fd);
+}
+
+bool DaemonClient::connectTo(const std::string &socketPath)
+{
+    if (socketPath.size() >= sizeof(sockaddr_un::sun_path))
+    {
+        statusMessage = "Socket path too long: " + socketPath;
+        return false;
+    }
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1)
+    {
+        statusMessage = "Failed to create socket";
+        return false;
+    }
+
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, socketPath.c_str(), sizeof(addr.sun_path) - 1);
+    if (connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == -1)
+    {
+        statusMessage = "Failed to connect to " + socketPath + ": " + std::strerror(errno);
+        close(fd);
+        fd = -1;
+        return false;
+    }
+    return true;
+}
+
+bool DaemonClient::submitFile(uint64_t jobId, const std::string &filePath, bool isEncryption,
+                              EncryptionType technique, uint16_t workers, uint8_t priority,
+                              uint8_t flags)
+{
+    std::vector<char> payload;
+    payload.push_back(isEncryption ? 0 : 1);
+    payload.push_back(static_cast<char>(technique));
+    putU16(payload, workers);
+    payload.insert(payload.end(), filePath.begin(), filePath.end());
+    return sendFrame(Opcode::SUBMIT_FILE, jobId, priority, payload, flags);
+}
+
+bool DaemonClient::submitBlob(uint64_t jobId, const char *data, size_t size, bool isEncryption,
+                              EncryptionType technique, uint8_t priority)
+{
+    if (size + 2 > MAX_PAYLOAD)
+    {
+        statusMessage = "Blob exceeds maximum payload size";
+        return false;
+    }
+    std::vector<char> payload;
+    payload.reserve(size + 2);
+    payload.push_back(isEncryption ? 0 : 1);
+    payload.push_back(static_cast<char>(technique));
+    payload.insert(payload.end(), data, data + size);
+    return sendFrame(Opcode::SUBMIT_BLOB, jobId, priority, payload);
+}
+
+bool DaemonClient::cancel(uint64_t jobId)
+{
+    return sendFrame(Opcode::CANCEL, jobId, 0, {});
+}
+
+bool DaemonClient::setPriority(uint8_t priority)
+{
+    return sendFrame(Opcode::SET_PRIORITY, 0, priority, {});
+}
+
+bool DaemonClient::setLimits(uint64_t jobId, const RunLimits &limits, bool allJobs)
+{
+    std::vector<char> payload;
+    putU64(payload, limits.readBytesPerSecond);
+    putU64(payload, limits.writeBytesPerSecond);
+    putU16(payload, static_cast<uint16_t>(limits.cpuPercent));
+    payload.push_back(static_cast<char>(limits.nice));
+    payload.push_back(static_cast<char>(limits.ioClass));
+    payload.push_back(static_cast<char>(limits.ioLevel));
+    return sendFrame(Opcode::SET_LIMITS, jobId, 0, payload, allJobs ? FLAG_ALL_JOBS : 0);
+}
+
+bool DaemonClient::readReply(DaemonReply &reply)
+{
+    char headerBytes[HEADER_SIZE];
+    if (!readExactly(headerBytes, HEADER_SIZE))
+        return false;
+
+    FrameHeader header;
+    if (!decodeHeader(headerBytes, header))
+    {
+        statusMessage = "Invalid reply header";
+        return false;
+    }
+
+    reply.jobId = header.jobId;
+    reply.opcode = header.opcode;
+    reply.payload.resize(header.payloadLength);
+    return readExactly(reply.payload.data(), header.payloadLength);
+}
+
+std::string DaemonClient::getStatusMessage() const
+{
+    return statusMessage;
+}
+
+bool DaemonClient::sendFrame(Opcode opcode, uint64_t jobId, uint8_t priority, const std::vector<char> &payload,
+                             uint8_t flags)
+{
+    if (fd == -1)
+    {
+        statusMessage = "Not connected";
+        return false;
+    }
+
+    FrameHeader header;
+    header.opcode = opcode;
+    header.priority = priority;
+    header.flags = flags;
+    header.jobId = jobId;
+    std::vector<char> frame = encodeFrame(header, payload.data(), payload.size());
+
+    size_t written = 0;
+    while (written < frame.size())
+    {
+        ssize_t n = write(fd, frame.data() + written, frame.size() - written);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n <= 0)
+        {
+            statusMessage = "Failed to send request: " + std::string(std::strerror(errno));
+            return false;
+        }
+        written += n;
+    }
+    return true;
+}
+
+bool DaemonClient::readExactly(char *buffer, size_t size)
+{
+    size_t received = 0;
+    while (received < size)
+    {
+        ssize_t n = read(fd, buffer + received, size - received);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n <= 0)
+        {
+            statusMessage = "Connection to daemon closed";
+            return false;
+        }
+        received += n;
+    }
+    return true;
+}
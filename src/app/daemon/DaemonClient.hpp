@@ -0,0 +1,48 @@
+#ifndef DAEMON_CLIENT_HPP
+#define DAEMON_CLIENT_HPP
+
+#include <string>
+#include <vector>
+#include "DaemonProtocol.hpp"
+#include "../processes/EncryptionTechnique.hpp"
+#include "../processes/Throttle.hpp"
+
+struct DaemonReply
+{
+    uint64_t jobId;
+    DaemonProtocol::Opcode opcode;
+    std::vector<char> payload;
+};
+
+// Blocking client for CryptoDaemon. Submissions return as soon as the frame
+// is written, so many jobs can be in flight before readReply() is called.
+class DaemonClient
+{
+public:
+    DaemonClient();
+    ~DaemonClient();
+
+    bool connectTo(const std::string &socketPath = DaemonProtocol::DEFAULT_SOCKET_PATH);
+    bool submitFile(uint64_t jobId, const std::string &filePath, bool isEncryption,
+                    EncryptionType technique, uint16_t workers = 0, uint8_t priority = 0,
+                    uint8_t flags = 0);
+    bool submitBlob(uint64_t jobId, const char *data, size_t size, bool isEncryption,
+                    EncryptionType technique, uint8_t priority = 0);
+    bool cancel(uint64_t jobId);
+    bool setPriority(uint8_t priority);
+    // jobId 0 sets the default for this connection's later jobs, or with
+    // allJobs for every job of the daemon; the daemon replies to the jobId
+    bool setLimits(uint64_t jobId, const RunLimits &limits, bool allJobs = false);
+    bool readReply(DaemonReply &reply);
+    std::string getStatusMessage() const;
+
+private:
+    bool sendFrame(DaemonProtocol::Opcode opcode, uint64_t jobId, uint8_t priority,
+                   const std::vector<char> &payload, uint8_t flags = 0);
+    bool readExactly(char *buffer, size_t size);
+
+    int fd;
+    std::string statusMessage;
+};
+
+#endif
@@ -0,0 +1,169 @@
+#ifndef DAEMON_PROTOCOL_HPP
+#define DAEMON_PROTOCOL_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Wire format shared by CryptoDaemon and DaemonClient.
+//
+// Every message is a fixed 20 byte little-endian header followed by
+// payloadLength bytes of payload:
+//
+//   u32 magic | u8 version | u8 opcode | u8 priority | u8 flags | u64 jobId | u32 payloadLength
+//
+// Job ids are chosen by the client and only need to be unique per connection,
+// which lets one connection keep many jobs in flight and match replies as they
+// arrive in completion order.
+//
+// The same frames run over TCP between a shard coordinator and daemons acting
+// as worker nodes. A TCP connection may only send HELLO, SUBMIT_BLOB,
+// SUBMIT_RANGE and CANCEL, and has to start with HELLO carrying the node
+// token. Anything else first, or a wrong token, closes the connection.
+namespace DaemonProtocol
+{
+    const uint32_t MAGIC = 0x524F4343; // "CCOR" on the wire
+    const uint8_t VERSION = 1;
+    const size_t HEADER_SIZE = 20;
+    const uint32_t MAX_PAYLOAD = 64 * 1024 * 1024;
+    const uint32_t MAX_TOKEN_LEN = 256; // largest HELLO payload a node reads
+    const char DEFAULT_SOCKET_PATH[] = "/tmp/cryptocore.sock";
+    const uint16_t DEFAULT_NODE_PORT = 7341;
+
+    enum class Opcode : uint8_t
+    {
+        // Client -> daemon
+        SUBMIT_FILE = 1, // payload: u8 action | u8 technique | u16 workers | path bytes
+        SUBMIT_BLOB = 2, // payload: u8 action | u8 technique | data bytes
+        CANCEL = 3,      // no payload; the job replies CANCELLED, a running file job after rolling back
+        SET_PRIORITY = 4, // no payload, header priority becomes the connection default
+        SUBMIT_RANGE = 5, // payload: u8 action | u8 technique | u64 file offset | data bytes
+        HELLO = 6,        // payload: node token; replied to with ACCEPTED or FAILED
+        SET_LIMITS = 7,   // payload: u64 read B/s | u64 write B/s | u16 cpu % | i8 nice | u8 io class | u8 io level;
+                          // jobId 0 sets the connection default, otherwise that job's limits, now;
+                          // replied to with ACCEPTED or FAILED
+
+        // Daemon -> client
+        ACCEPTED = 64,  // no payload
+        COMPLETED = 65, // payload: result bytes for blobs, empty for files
+        FAILED = 66,    // payload: error message
+        CANCELLED = 67  // no payload
+    };
+
+    // Header flag bits
+    const uint8_t FLAG_CHECKPOINT = 0x01; // SUBMIT_FILE: keep a resumable checkpoint journal
+    const uint8_t FLAG_PIN_WORKERS = 0x02; // SUBMIT_FILE: pin workers to cores, NUMA-local buffers
+    const uint8_t FLAG_HASH = 0x04;        // SUBMIT_FILE: record BLAKE3 digests of both forms in FILE.b3
+    const uint8_t FLAG_ALL_JOBS = 0x08;    // SET_LIMITS with jobId 0: every job of the daemon, and its default
+
+    const size_t LIMITS_PAYLOAD_SIZE = 21;
+
+    struct FrameHeader
+    {
+        uint32_t magic = MAGIC;
+        uint8_t version = VERSION;
+        Opcode opcode = Opcode::ACCEPTED;
+        uint8_t priority = 0;
+        uint8_t flags = 0;
+        uint64_t jobId = 0;
+        uint32_t payloadLength = 0;
+    };
+
+    inline void putU16(std::vector<char> &out, uint16_t v)
+    {
+        out.push_back(static_cast<char>(v & 0xFF));
+        out.push_back(static_cast<char>((v >> 8) & 0xFF));
+    }
+
+    inline void putU32(std::vector<char> &out, uint32_t v)
+    {
+        for (int i = 0; i < 4; i++)
+            out.push_back(static_cast<char>((v >> (8 * i)) & 0xFF));
+    }
+
+    inline void putU64(std::vector<char> &out, uint64_t v)
+    {
+        for (int i = 0; i < 8; i++)
+            out.push_back(static_cast<char>((v >> (8 * i)) & 0xFF));
+    }
+
+    inline uint16_t getU16(const char *p)
+    {
+        const unsigned char *u = reinterpret_cast<const unsigned char *>(p);
+        return static_cast<uint16_t>(u[0] | (u[1] << 8));
+    }
+
+    inline uint32_t getU32(const char *p)
+    {
+        const unsigned char *u = reinterpret_cast<const unsigned char *>(p);
+        return static_cast<uint32_t>(u[0]) | (static_cast<uint32_t>(u[1]) << 8) |
+               (static_cast<uint32_t>(u[2]) << 16) | (static_cast<uint32_t>(u[3]) << 24);
+    }
+
+    inline uint64_t getU64(const char *p)
+    {
+        return static_cast<uint64_t>(getU32(p)) | (static_cast<uint64_t>(getU32(p + 4)) << 32);
+    }
+
+    // Serialize header + payload into a single buffer ready for write()
+    inline std::vector<char> encodeFrame(const FrameHeader &header, const char *payload, size_t length)
+    {
+        std::vector<char> frame;
+        frame.reserve(HEADER_SIZE + length);
+        putU32(frame, header.magic);
+        frame.push_back(static_cast<char>(header.version));
+        frame.push_back(static_cast<char>(header.opcode));
+        frame.push_back(static_cast<char>(header.priority));
+        frame.push_back(static_cast<char>(header.flags));
+        putU64(frame, header.jobId);
+        putU32(frame, static_cast<uint32_t>(length));
+        if (length > 0)
+            frame.insert(frame.end(), payload, payload + length);
+        return frame;
+    }
+
+    // "host:port", "host" or "[v6 address]:port"; false if the port is not a number
+    inline bool splitHostPort(const std::string &address, std::string &host, uint16_t &port)
+    {
+        port = DEFAULT_NODE_PORT;
+        size_t colon = address.rfind(':');
+        if (!address.empty() && address[0] == '[')
+        {
+            size_t close = address.find(']');
+            if (close == std::string::npos)
+                return false;
+            host = address.substr(1, close - 1);
+            colon = close + 1 < address.size() && address[close + 1] == ':' ? close + 1 : std::string::npos;
+        }
+        else
+        {
+            host = address.substr(0, colon);
+        }
+        if (colon == std::string::npos)
+            return !host.empty();
+        std::string digits = address.substr(colon + 1);
+        if (digits.empty() || digits.size() > 5 || digits.find_first_not_of("0123456789") != std::string::npos)
+            return false;
+        unsigned long value = std::stoul(digits);
+        if (value == 0 || value > 65535)
+            return false;
+        port = static_cast<uint16_t>(value);
+        return !host.empty();
+    }
+
+    // Returns false if the bytes do not start with a valid header
+    inline bool decodeHeader(const char *data, FrameHeader &header)
+    {
+        header.magic = getU32(data);
+        header.version = static_cast<uint8_t>(data[4]);
+        header.opcode = static_cast<Opcode>(static_cast<uint8_t>(data[5]));
+        header.priority = static_cast<uint8_t>(data[6]);
+        header.flags = static_cast<uint8_t>(data[7]);
+        header.jobId = getU64(data + 8);
+        header.payloadLength = getU32(data + 16);
+        return header.magic == MAGIC && header.version == VERSION && header.payloadLength <= MAX_PAYLOAD;
+    }
+}
+
+#endif
@@ -0,0 +1,567 @@
+#include "ShardCoordinator.hpp"
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+
+using namespace DaemonProtocol;
+
+namespace
+{
+    const uint64_t HELLO_JOB_ID = 0;
+    const int POLL_INTERVAL_MS = 200;
+    const int64_t MAX_BACKOFF_MS = 30000;
+
+    int64_t nowMs()
+    {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    }
+}
+
+ShardCoordinator::ShardCoordinator(const std::vector<std::string> &addresses, EncryptionType technique,
+                                   size_t rangeSize, size_t window)
+    : technique(technique), rangeSize(rangeSize), window(std::max<size_t>(1, window)), isEncryption(true),
+      nextFile(0), nextJobId(1)
+{
+    // Ranges are whole 64 KiB transform units, like TaskManager blocks, so a
+    // node transforms exactly what a local run would
+    const size_t unit = SparseMap::UNIT;
+    this->rangeSize = std::max<size_t>(1, (rangeSize + unit - 1) / unit) * unit;
+    // Leave room for the header and the fixed part of the payload
+    this->rangeSize = std::min<size_t>(this->rangeSize, MAX_PAYLOAD / unit * unit - unit);
+
+    for (const std::string &address : addresses)
+    {
+        Node node;
+        NodeStats nodeStats;
+        nodeStats.address = address;
+        if (!splitHostPort(address, node.host, node.port))
+        {
+            node.retired = true;
+            statusMessage = "Invalid node address: " + address;
+        }
+        nodes.push_back(std::move(node));
+        stats.push_back(nodeStats);
+    }
+}
+
+ShardCoordinator::~ShardCoordinator()
+{
+    for (Node &node : nodes)
+    {
+        if (node.fd != -1)
+            close(node.fd);
+    }
+    for (FileState &file : files)
+    {
+        if (file.fd != -1)
+            close(file.fd);
+    }
+}
+
+void ShardCoordinator::setToken(const std::string &value)
+{
+    token = value;
+}
+
+bool ShardCoordinator::run(const std::vector<std::string> &filePaths, bool encrypt)
+{
+    isEncryption = encrypt;
+    paths = filePaths;
+    files.assign(paths.size(), FileState());
+    results.assign(paths.size(), ShardFileResult());
+    for (size_t i = 0; i < paths.size(); i++)
+        results[i].path = paths[i];
+    nextFile = 0;
+    retries.clear();
+    blockSpans.clear();
+
+    int64_t now = nowMs();
+    for (Node &node : nodes)
+    {
+        if (!node.retired)
+            connectNode(node, now);
+    }
+
+    std::vector<pollfd> fds;
+    std::vector<size_t> fdNodes;
+    while (!allDone())
+    {
+        now = nowMs();
+        bool anyLeft = false;
+        for (size_t i = 0; i < nodes.size(); i++)
+        {
+            Node &node = nodes[i];
+            if (node.retired)
+                continue;
+            anyLeft = true;
+            if (node.fd == -1 && now >= node.retryAtMs)
+                connectNode(node, now);
+            if (node.ready)
+                fillWindow(i);
+
+            // A node that sits on a range this long is treated as gone
+            for (const auto &entry : node.inFlight)
+            {
+                if (now - entry.second.second > static_cast<int64_t>(RANGE_TIMEOUT_SECONDS) * 1000)
+                {
+                    dropNode(i, "range timed out", now);
+                    break;
+                }
+            }
+        }
+        if (!anyLeft)
+        {
+            for (size_t i = 0; i < files.size(); i++)
+                finishFile(i, "No worker nodes left");
+            break;
+        }
+
+        fds.clear();
+        fdNodes.clear();
+        for (size_t i = 0; i < nodes.size(); i++)
+        {
+            Node &node = nodes[i];
+            if (node.fd == -1)
+                continue;
+            short events = POLLIN;
+            if (node.connecting || node.outboxSent < node.outbox.size())
+                events |= POLLOUT;
+            fds.push_back({node.fd, events, 0});
+            fdNodes.push_back(i);
+        }
+
+        int ready = poll(fds.data(), fds.size(), POLL_INTERVAL_MS);
+        if (ready == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            statusMessage = "poll failed: " + std::string(std::strerror(errno));
+            break;
+        }
+
+        now = nowMs();
+        for (size_t k = 0; k < fds.size(); k++)
+        {
+            size_t i = fdNodes[k];
+            Node &node = nodes[i];
+            short revents = fds[k].revents;
+            if (revents == 0 || node.fd != fds[k].fd)
+                continue;
+
+            if (node.connecting)
+            {
+                int error = 0;
+                socklen_t length = sizeof(error);
+                getsockopt(node.fd, SOL_SOCKET, SO_ERROR, &error, &length);
+                if (error != 0)
+                {
+                    dropNode(i, std::strerror(error), now);
+                    continue;
+                }
+                node.connecting = false;
+            }
+            if ((revents & (POLLIN | POLLHUP | POLLERR)) && !readNode(i, now))
+            {
+                dropNode(i, "connection closed", now);
+                continue;
+            }
+            if ((revents & POLLOUT) && !writeNode(node))
+                dropNode(i, "connection closed", now);
+        }
+    }
+
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+        account(i, nowMs());
+        if (nodes[i].fd != -1)
+            close(nodes[i].fd);
+        nodes[i].fd = -1;
+        nodes[i].ready = false;
+        NodeStats &nodeStats = stats[i];
+        nodeStats.throughputMBps =
+            nodeStats.seconds > 0 ? nodeStats.bytes / (1024.0 * 1024.0) / nodeStats.seconds : 0.0;
+    }
+
+    bool ok = true;
+    for (const ShardFileResult &result : results)
+        ok = ok && result.ok;
+    return ok;
+}
+
+bool ShardCoordinator::allDone() const
+{
+    for (const FileState &file : files)
+    {
+        if (!file.finished)
+            return false;
+    }
+    return true;
+}
+
+bool ShardCoordinator::openFile(size_t index)
+{
+    FileState &file = files[index];
+    file.opened = true;
+    file.fd = ::open(paths[index].c_str(), O_RDWR | O_CLOEXEC);
+    if (file.fd < 0)
+    {
+        finishFile(index, (errno == ENOENT ? "File does not exist: " : "Could not open file: ") + paths[index]);
+        return false;
+    }
+    struct stat info;
+    if (fstat(file.fd, &info) != 0 || info.st_size == 0)
+    {
+        finishFile(index, "File is empty: " + paths[index]);
+        return false;
+    }
+    file.size = static_cast<uint64_t>(info.st_size);
+    file.blockCount = (file.size + rangeSize - 1) / rangeSize;
+    file.sparse.build(file.fd, file.size);
+    return true;
+}
+
+void ShardCoordinator::finishFile(size_t index, const std::string &error)
+{
+    FileState &file = files[index];
+    if (file.finished)
+        return;
+    file.finished = true;
+    file.failed = !error.empty();
+    results[index].ok = error.empty();
+    results[index].error = error;
+    if (file.fd != -1)
+        close(file.fd);
+    file.fd = -1;
+}
+
+bool ShardCoordinator::nextRange(Range &range)
+{
+    while (true)
+    {
+        std::deque<Range> &queue = !retries.empty() ? retries : blockSpans;
+        if (!queue.empty())
+        {
+            range = queue.front();
+            queue.pop_front();
+            // Ranges of a file that already failed are not worth sending
+            if (files[range.file].finished)
+                continue;
+            return true;
+        }
+
+        if (nextFile == files.size())
+            return false;
+        FileState &file = files[nextFile];
+        if (!file.opened && !openFile(nextFile))
+        {
+            nextFile++;
+            continue;
+        }
+        if (file.finished || file.nextBlock == file.blockCount)
+        {
+            // All of it cut; done now if nothing is still out
+            if (file.outstanding == 0)
+                finishFile(nextFile, "");
+            nextFile++;
+            continue;
+        }
+
+        // Only the data extents of the block are sent; holes stay holes
+        std::vector<SparseMap::Extent> spans;
+        uint64_t offset = file.nextBlock * rangeSize;
+        file.sparse.dataIn(offset, std::min<uint64_t>(rangeSize, file.size - offset), spans);
+        file.nextBlock++;
+        for (const SparseMap::Extent &span : spans)
+        {
+            blockSpans.push_back({nextFile, span.offset, span.length, 0});
+            file.outstanding++;
+        }
+    }
+}
+
+void ShardCoordinator::connectNode(Node &node, int64_t now)
+{
+    node.inbox.clear();
+    node.outbox.clear();
+    node.outboxSent = 0;
+    node.ready = false;
+    node.connecting = false;
+
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *found = nullptr;
+    if (getaddrinfo(node.host.c_str(), std::to_string(node.port).c_str(), &hints, &found) != 0 || !found)
+    {
+        node.retryAtMs = now + MAX_BACKOFF_MS;
+        return;
+    }
+
+    node.fd = socket(found->ai_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (node.fd != -1)
+    {
+        int noDelay = 1;
+        setsockopt(node.fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+        if (connect(node.fd, found->ai_addr, found->ai_addrlen) == 0)
+        {
+            node.connecting = false;
+        }
+        else if (errno == EINPROGRESS)
+        {
+            node.connecting = true;
+        }
+        else
+        {
+            close(node.fd);
+            node.fd = -1;
+        }
+    }
+    freeaddrinfo(found);
+    if (node.fd == -1)
+    {
+        node.retryAtMs = now + std::min<int64_t>(MAX_BACKOFF_MS, 1000LL << std::min(node.reconnects, 5u));
+        node.reconnects++;
+        if (node.reconnects > MAX_RECONNECTS)
+            node.retired = true;
+        return;
+    }
+
+    // Always say hello; ranges are only sent once the node accepts it
+    FrameHeader header;
+    header.opcode = Opcode::HELLO;
+    header.jobId = HELLO_JOB_ID;
+    std::vector<char> frame = encodeFrame(header, token.data(), token.size());
+    node.outbox.insert(node.outbox.end(), frame.begin(), frame.end());
+}
+
+void ShardCoordinator::dropNode(size_t index, const std::string &reason, int64_t now)
+{
+    Node &node = nodes[index];
+    account(index, now);
+    if (node.fd != -1)
+        close(node.fd);
+    node.fd = -1;
+    node.ready = false;
+    node.connecting = false;
+    node.inbox.clear();
+    node.outbox.clear();
+    node.outboxSent = 0;
+
+    // Nothing a node sent back was written, so its ranges can go elsewhere
+    std::vector<Range> lost;
+    for (auto &entry : node.inFlight)
+        lost.push_back(entry.second.first);
+    node.inFlight.clear();
+    for (const Range &range : lost)
+        retry(range, stats[index].address + ": " + reason);
+
+    stats[index].failures++;
+    node.reconnects++;
+    if (node.reconnects > MAX_RECONNECTS)
+        node.retired = true;
+    node.retryAtMs = now + std::min<int64_t>(MAX_BACKOFF_MS, 1000LL << std::min(node.reconnects - 1, 5u));
+}
+
+void ShardCoordinator::retry(Range range, const std::string &error)
+{
+    if (++range.attempts >= MAX_ATTEMPTS)
+    {
+        finishFile(range.file, "Range at " + std::to_string(range.offset) + " failed " +
+                                   std::to_string(range.attempts) + " times, last on " + error);
+        return;
+    }
+    retries.push_back(range);
+}
+
+bool ShardCoordinator::sendRange(size_t index, Range &range)
+{
+    Node &node = nodes[index];
+    FileState &file = files[range.file];
+
+    std::vector<char> payload;
+    payload.reserve(10 + range.length);
+    payload.push_back(isEncryption ? 0 : 1);
+    payload.push_back(static_cast<char>(technique));
+    putU64(payload, range.offset);
+    payload.resize(10 + range.length);
+    size_t done = 0;
+    while (done < range.length)
+    {
+        ssize_t n = pread(file.fd, payload.data() + 10 + done, range.length - done,
+                          static_cast<off_t>(range.offset + done));
+        if (n <= 0)
+        {
+            if (n == -1 && errno == EINTR)
+                continue;
+            finishFile(range.file, "Error reading " + paths[range.file]);
+            return false;
+        }
+        done += static_cast<size_t>(n);
+    }
+
+    FrameHeader header;
+    header.opcode = Opcode::SUBMIT_RANGE;
+    header.jobId = nextJobId++;
+    std::vector<char> frame = encodeFrame(header, payload.data(), payload.size());
+    node.outbox.insert(node.outbox.end(), frame.begin(), frame.end());
+
+    int64_t now = nowMs();
+    if (node.inFlight.empty())
+        node.busySinceMs = now;
+    node.inFlight[header.jobId] = {range, now};
+    return true;
+}
+
+void ShardCoordinator::fillWindow(size_t index)
+{
+    Node &node = nodes[index];
+    Range range;
+    while (node.inFlight.size() < window && nextRange(range))
+        sendRange(index, range);
+    if (!writeNode(node))
+        dropNode(index, "connection closed", nowMs());
+}
+
+bool ShardCoordinator::writeNode(Node &node)
+{
+    while (node.outboxSent < node.outbox.size())
+    {
+        ssize_t n = send(node.fd, node.outbox.data() + node.outboxSent, node.outbox.size() - node.outboxSent,
+                         MSG_NOSIGNAL);
+        if (n > 0)
+        {
+            node.outboxSent += static_cast<size_t>(n);
+            continue;
+        }
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || (errno == ENOTCONN && node.connecting)))
+            return true;
+        return false;
+    }
+    node.outbox.clear();
+    node.outboxSent = 0;
+    return true;
+}
+
+bool ShardCoordinator::readNode(size_t index, int64_t now)
+{
+    Node &node = nodes[index];
+    char buffer[64 * 1024];
+    bool open = true;
+    while (open)
+    {
+        ssize_t n = read(node.fd, buffer, sizeof(buffer));
+        if (n > 0)
+            node.inbox.insert(node.inbox.end(), buffer, buffer + n);
+        else if (n == 0)
+            open = false;
+        else if (errno == EAGAIN || errno == EWOULDBLOCK)
+            break;
+        else if (errno != EINTR)
+            open = false;
+    }
+
+    size_t consumed = 0;
+    while (node.inbox.size() - consumed >= HEADER_SIZE)
+    {
+        FrameHeader header;
+        if (!decodeHeader(node.inbox.data() + consumed, header))
+            return false;
+        if (node.inbox.size() - consumed < HEADER_SIZE + header.payloadLength)
+            break;
+        handleReply(index, header, node.inbox.data() + consumed + HEADER_SIZE, now);
+        consumed += HEADER_SIZE + header.payloadLength;
+        // The reply may have dropped or retired the node
+        if (nodes[index].fd == -1)
+            return true;
+    }
+    node.inbox.erase(node.inbox.begin(), node.inbox.begin() + consumed);
+    return open;
+}
+
+void ShardCoordinator::handleReply(size_t index, const FrameHeader &header, const char *payload, int64_t now)
+{
+    Node &node = nodes[index];
+    std::string message(payload, header.opcode == Opcode::COMPLETED ? 0 : header.payloadLength);
+
+    if (header.jobId == HELLO_JOB_ID)
+    {
+        if (header.opcode == Opcode::ACCEPTED)
+        {
+            node.ready = true;
+            stats[index].reached = true;
+        }
+        else if (header.opcode == Opcode::FAILED)
+        {
+            // A wrong token does not get better by trying again
+            statusMessage = stats[index].address + ": " + message;
+            dropNode(index, message, now);
+            node.retired = true;
+        }
+        return;
+    }
+
+    auto it = node.inFlight.find(header.jobId);
+    if (it == node.inFlight.end() || header.opcode == Opcode::ACCEPTED)
+        return;
+    Range range = it->second.first;
+    node.inFlight.erase(it);
+    if (node.inFlight.empty())
+        account(index, now);
+
+    if (header.opcode != Opcode::COMPLETED)
+    {
+        stats[index].failures++;
+        retry(range, stats[index].address + ": " + (message.empty() ? "cancelled" : message));
+        return;
+    }
+    if (header.payloadLength != range.length)
+    {
+        stats[index].failures++;
+        retry(range, stats[index].address + ": reply of the wrong size");
+        return;
+    }
+
+    FileState &file = files[range.file];
+    if (file.finished)
+        return;
+    size_t done = 0;
+    while (done < range.length)
+    {
+        ssize_t n = pwrite(file.fd, payload + done, range.length - done, static_cast<off_t>(range.offset + done));
+        if (n <= 0)
+        {
+            if (n == -1 && errno == EINTR)
+                continue;
+            finishFile(range.file, "Error writing " + paths[range.file]);
+            return;
+        }
+        done += static_cast<size_t>(n);
+    }
+
+    node.reconnects = 0;
+    stats[index].ranges++;
+    stats[index].bytes += range.length;
+    if (--file.outstanding == 0 && file.nextBlock == file.blockCount)
+        finishFile(range.file, "");
+}
+
+void ShardCoordinator::account(size_t index, int64_t now)
+{
+    Node &node = nodes[index];
+    if (node.busySinceMs != 0)
+        stats[index].seconds += (now - node.busySinceMs) / 1000.0;
+    node.busySinceMs = node.inFlight.empty() ? 0 : now;
+}
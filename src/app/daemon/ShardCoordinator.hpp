@@ -0,0 +1,142 @@
+#ifndef SHARD_COORDINATOR_HPP
+#define SHARD_COORDINATOR_HPP
+
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+#include "DaemonProtocol.hpp"
+#include "../processes/EncryptionTechnique.hpp"
+#include "../processes/SparseMap.hpp"
+
+// How one worker node did during a sharded run
+struct NodeStats
+{
+    std::string address;
+    bool reached = false;  // accepted a HELLO at least once
+    uint64_t ranges = 0;
+    uint64_t bytes = 0;
+    uint64_t failures = 0; // dropped connections, timeouts and failed ranges
+    double seconds = 0.0;  // time connected with ranges in flight
+    double throughputMBps = 0.0;
+};
+
+struct ShardFileResult
+{
+    std::string path;
+    bool ok = false;
+    std::string error;
+};
+
+// Encrypts or decrypts files in place across daemons running as worker nodes
+// on other machines, or several on one machine.
+//
+// Files are cut into ranges of whole blocks, as TaskManager cuts them into
+// worker shares, and only the data extents of sparse files are sent. The
+// coordinator reads each range, ships it to a node as SUBMIT_RANGE and writes
+// the transformed bytes back, so nodes need the same key but no access to the
+// files. Every node keeps a window of ranges in flight, so sending, work on
+// the node and the reply overlap, and gets a new range each time one comes
+// back, so faster nodes end up with more of the work.
+//
+// A range whose node drops, times out or fails it is sent again elsewhere;
+// nodes that drop are reconnected with backoff. A range that fails on every
+// try fails its file, which like a failed run is left partly transformed.
+class ShardCoordinator
+{
+public:
+    static const size_t DEFAULT_RANGE_SIZE = 1024 * 1024;
+    static const size_t DEFAULT_WINDOW = 4;
+    static const unsigned MAX_ATTEMPTS = 4;       // per range
+    static const unsigned MAX_RECONNECTS = 5;     // per node, in a row
+    static const unsigned RANGE_TIMEOUT_SECONDS = 120;
+
+    ShardCoordinator(const std::vector<std::string> &nodes, EncryptionType technique,
+                     size_t rangeSize = DEFAULT_RANGE_SIZE, size_t window = DEFAULT_WINDOW);
+    ~ShardCoordinator();
+
+    // Sent in HELLO; nodes refuse everything until it matches theirs
+    void setToken(const std::string &token);
+    // True if every file was transformed
+    bool run(const std::vector<std::string> &files, bool isEncryption);
+
+    const std::vector<ShardFileResult> &getFileResults() const { return results; }
+    const std::vector<NodeStats> &getNodeStats() const { return stats; }
+    std::string getStatusMessage() const { return statusMessage; }
+
+private:
+    struct Range
+    {
+        size_t file;
+        uint64_t offset;
+        uint64_t length;
+        unsigned attempts;
+    };
+
+    struct FileState
+    {
+        int fd = -1;
+        uint64_t size = 0;
+        uint64_t nextBlock = 0;
+        uint64_t blockCount = 0;
+        SparseMap sparse;
+        size_t outstanding = 0; // ranges issued and not yet written back
+        bool opened = false;
+        bool finished = false; // result recorded
+        bool failed = false;
+    };
+
+    struct Node
+    {
+        std::string host;
+        uint16_t port = 0;
+        int fd = -1;
+        bool connecting = false;
+        bool ready = false; // connected, and the token accepted
+        bool retired = false;
+        unsigned reconnects = 0;
+        int64_t retryAtMs = 0;
+        int64_t busySinceMs = 0;
+        std::vector<char> inbox;
+        std::vector<char> outbox;
+        size_t outboxSent = 0;
+        std::map<uint64_t, std::pair<Range, int64_t>> inFlight; // job id -> range, time sent
+    };
+
+    bool openFile(size_t index);
+    void finishFile(size_t index, const std::string &error);
+    // Next range to send: retries first, then the next blocks of the files
+    bool nextRange(Range &range);
+    bool allDone() const;
+
+    void connectNode(Node &node, int64_t nowMs);
+    void dropNode(size_t index, const std::string &reason, int64_t nowMs);
+    bool sendRange(size_t index, Range &range);
+    void fillWindow(size_t index);
+    bool readNode(size_t index, int64_t nowMs);
+    bool writeNode(Node &node);
+    void handleReply(size_t index, const DaemonProtocol::FrameHeader &header, const char *payload,
+                     int64_t nowMs);
+    void retry(Range range, const std::string &error);
+    void account(size_t index, int64_t nowMs);
+
+    std::vector<Node> nodes;
+    std::vector<NodeStats> stats;
+    EncryptionType technique;
+    size_t rangeSize;
+    size_t window;
+    std::string token;
+    bool isEncryption;
+
+    std::vector<std::string> paths;
+    std::vector<FileState> files;
+    std::vector<ShardFileResult> results;
+    size_t nextFile;
+    std::deque<Range> retries;
+    std::deque<Range> blockSpans; // the rest of the block being cut
+    uint64_t nextJobId;
+    std::string statusMessage;
+};
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef COMMAND_LINE_HPP
+#define COMMAND_LINE_HPP
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Checked parsing of numeric option values. Anything but a plain decimal
+// within range, signs and trailing characters included, throws UsageError
+// naming the option, which main() reports along with the usage text.
+namespace CommandLine
+{
+    struct UsageError : std::runtime_error
+    {
+        explicit UsageError(const std::string &message) : std::runtime_error(message) {}
+    };
+
+    inline uint64_t number(const std::string &option, const std::string &text, uint64_t low, uint64_t high)
+    {
+        bool digits = !text.empty() && text.find_first_not_of("0123456789") == std::string::npos;
+        errno = 0;
+        unsigned long long value = digits ? std::strtoull(text.c_str(), nullptr, 10) : 0;
+        if (!digits || errno == ERANGE || value < low || value > high)
+            throw UsageError(option + " takes a whole number from " + std::to_string(low) + " to " +
+                             std::to_string(high) + ", not \"" + text + "\"");
+        return value;
+    }
+
+    inline double decimal(const std::string &option, const std::string &text, double low, double high)
+    {
+        char *end = nullptr;
+        errno = 0;
+        double value = text.empty() ? 0.0 : std::strtod(text.c_str(), &end);
+        // The comparison also turns away nan
+        if (text.empty() || *end != '\0' || errno == ERANGE || !(value >= low && value <= high))
+        {
+            char range[64];
+            std::snprintf(range, sizeof(range), "%g to %g", low, high);
+            throw UsageError(option + " takes a number from " + range + ", not \"" + text + "\"");
+        }
+        return value;
+    }
+
+    // The value following the option at args[i], which the caller has
+    // checked exists; leaves i on the value
+    inline uint64_t number(const std::vector<std::string> &args, size_t &i, uint64_t low, uint64_t high)
+    {
+        const std::string &option = args[i++];
+        return number(option, args[i], low, high);
+    }
+
+    inline double decimal(const std::vector<std::string> &args, size_t &i, double low, double high)
+    {
+        const std::string &option = args[i++];
+        return decimal(option, args[i], low, high);
+    }
+}
+
+#endif
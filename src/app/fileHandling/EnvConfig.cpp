@@ -0,0 +1,83 @@
+#include "EnvConfig.hpp"
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+EnvConfig::EnvConfig() : kdfCost(0), kdfBlockSize(0), kdfLanes(0), xtsSectorSize(0), memoryBudget(0)
+{
+}
+
+const EnvConfig &EnvConfig::get()
+{
+    static const EnvConfig config = []
+    {
+        std::ifstream file(".env", std::ios::binary);
+        std::stringstream buffer;
+        buffer << file.rdbuf();
+        return parse(buffer.str());
+    }();
+    return config;
+}
+
+EnvConfig EnvConfig::parse(const std::string &text)
+{
+    EnvConfig config;
+    config.content = text;
+
+    std::istringstream lines(text);
+    std::string line;
+    while (std::getline(lines, line))
+    {
+        size_t start = line.find_first_not_of(" \t");
+        if (start == std::string::npos || line[start] == '#')
+            continue;
+        if (line.compare(start, 7, "export ") == 0)
+            start += 7;
+        size_t equals = line.find('=', start);
+        if (equals == std::string::npos)
+            continue;
+
+        std::string name = line.substr(start, equals - start);
+        name.erase(name.find_last_not_of(" \t") + 1);
+        std::string value = line.substr(equals + 1);
+        value.erase(0, value.find_first_not_of(" \t"));
+        value.erase(value.find_last_not_of(" \t\r") + 1);
+        if (value.size() >= 2 && (value[0] == '"' || value[0] == '\'') && value.back() == value[0])
+            value = value.substr(1, value.size() - 2);
+        config.values[name] = value;
+    }
+
+    config.loadTyped();
+    return config;
+}
+
+void EnvConfig::loadTyped()
+{
+    passphrase = value("CRYPTOCORE_PASSPHRASE");
+    oldPassphrase = value("CRYPTOCORE_OLD_PASSPHRASE");
+    salt = value("CRYPTOCORE_SALT", "cryptocore");
+    kdfCost = number("CRYPTOCORE_KDF_N", 1 << 15);
+    kdfBlockSize = static_cast<uint32_t>(number("CRYPTOCORE_KDF_R", 8));
+    kdfLanes = static_cast<uint32_t>(number("CRYPTOCORE_KDF_P", 4));
+    xtsSectorSize = static_cast<size_t>(number("CRYPTOCORE_XTS_SECTOR", 4096));
+    nodeToken = value("CRYPTOCORE_NODE_TOKEN");
+    memoryBudget = number("CRYPTOCORE_MEMORY_BUDGET_MB", 0) * 1024 * 1024;
+}
+
+std::string EnvConfig::value(const std::string &name, const std::string &fallback) const
+{
+    if (const char *environment = std::getenv(name.c_str()))
+        return environment;
+    auto it = values.find(name);
+    return it == values.end() ? fallback : it->second;
+}
+
+uint64_t EnvConfig::number(const std::string &name, uint64_t fallback) const
+{
+    std::string text = value(name);
+    if (text.empty())
+        return fallback;
+    char *end = nullptr;
+    unsigned long long parsed = std::strtoull(text.c_str(), &end, 0);
+    return *end == '\0' ? parsed : fallback;
+}
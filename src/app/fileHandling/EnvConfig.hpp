@@ -0,0 +1,40 @@
+#ifndef ENV_CONFIG_HPP
+#define ENV_CONFIG_HPP
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+// Settings from .env, read and parsed once per process. A variable set in the
+// real environment wins over the same name in the file.
+class EnvConfig
+{
+public:
+    // Loaded from .env in the working directory on first use
+    static const EnvConfig &get();
+    // KEY=VALUE lines; blank lines, # comments, "export " and quotes allowed
+    static EnvConfig parse(const std::string &content);
+
+    std::string value(const std::string &name, const std::string &fallback = "") const;
+    uint64_t number(const std::string &name, uint64_t fallback) const;
+    const std::string &raw() const { return content; }
+
+    std::string passphrase;    // CRYPTOCORE_PASSPHRASE, empty for the built-in key
+    std::string oldPassphrase; // CRYPTOCORE_OLD_PASSPHRASE, the one a rekey moves away from
+    std::string salt;          // CRYPTOCORE_SALT
+    uint64_t kdfCost;          // CRYPTOCORE_KDF_N
+    uint32_t kdfBlockSize;     // CRYPTOCORE_KDF_R
+    uint32_t kdfLanes;         // CRYPTOCORE_KDF_P
+    size_t xtsSectorSize;      // CRYPTOCORE_XTS_SECTOR
+    std::string nodeToken;     // CRYPTOCORE_NODE_TOKEN, shared by a shard coordinator and its nodes
+    uint64_t memoryBudget;     // CRYPTOCORE_MEMORY_BUDGET_MB in bytes, 0 for no budget
+
+private:
+    EnvConfig();
+    void loadTyped();
+
+    std::string content;
+    std::map<std::string, std::string> values;
+};
+
+#endif
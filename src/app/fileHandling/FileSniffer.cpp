@@ -0,0 +1,206 @@
+#include "FileSniffer.hpp"
+#include "IO.hpp"
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+    struct Signature
+    {
+        size_t offset;
+        const char *magic;
+        size_t length;
+        FileKind kind;
+        const char *description;
+    };
+
+    // Checked in order, so longer and more specific signatures come first
+    const Signature SIGNATURES[] = {
+        {0, "CCX1\x01\0\0\0", 8, FileKind::CONTAINER, "CryptoCore container"},
+        {0, "\x89PNG\r\n\x1a\n", 8, FileKind::MEDIA, "PNG image"},
+        {0, "\xff\xd8\xff", 3, FileKind::MEDIA, "JPEG image"},
+        {0, "GIF87a", 6, FileKind::MEDIA, "GIF image"},
+        {0, "GIF89a", 6, FileKind::MEDIA, "GIF image"},
+        {8, "WEBP", 4, FileKind::MEDIA, "WebP image"},
+        {8, "WAVE", 4, FileKind::MEDIA, "WAV audio"},
+        {8, "AVI ", 4, FileKind::MEDIA, "AVI video"},
+        {4, "ftyp", 4, FileKind::MEDIA, "MP4/QuickTime media"},
+        {0, "ID3", 3, FileKind::MEDIA, "MP3 audio"},
+        {0, "OggS", 4, FileKind::MEDIA, "Ogg media"},
+        {0, "fLaC", 4, FileKind::MEDIA, "FLAC audio"},
+        {0, "\x1a\x45\xdf\xa3", 4, FileKind::MEDIA, "Matroska/WebM video"},
+        {0, "%PDF-", 5, FileKind::DOCUMENT, "PDF document"},
+        {0, "SQLite format 3", 16, FileKind::DOCUMENT, "SQLite database"},
+        {0, "\xd0\xcf\x11\xe0\xa1\xb1\x1a\xe1", 8, FileKind::DOCUMENT, "OLE2 document (legacy Office)"},
+        {0, "PK\x03\x04", 4, FileKind::COMPRESSED, "Zip archive (or Office/JAR/APK)"},
+        {0, "PK\x05\x06", 4, FileKind::COMPRESSED, "Zip archive (empty)"},
+        {0, "\x1f\x8b", 2, FileKind::COMPRESSED, "gzip compressed data"},
+        {0, "BZh", 3, FileKind::COMPRESSED, "bzip2 compressed data"},
+        {0, "\xfd" "7zXZ\0", 6, FileKind::COMPRESSED, "xz compressed data"},
+        {0, "\x28\xb5\x2f\xfd", 4, FileKind::COMPRESSED, "Zstandard compressed data"},
+        {0, "\x04\x22\x4d\x18", 4, FileKind::COMPRESSED, "LZ4 compressed data"},
+        {0, "\x78\x01", 2, FileKind::COMPRESSED, "zlib compressed data"},
+        {0, "\x78\x9c", 2, FileKind::COMPRESSED, "zlib compressed data"},
+        {0, "\x78\xda", 2, FileKind::COMPRESSED, "zlib compressed data"},
+        {0, "7z\xbc\xaf\x27\x1c", 6, FileKind::COMPRESSED, "7-Zip archive"},
+        {0, "Rar!\x1a\x07", 6, FileKind::COMPRESSED, "RAR archive"},
+        {257, "ustar", 5, FileKind::DATA, "tar archive"},
+        {0, "\x7f" "ELF", 4, FileKind::EXECUTABLE, "ELF executable"},
+        {0, "\xcf\xfa\xed\xfe", 4, FileKind::EXECUTABLE, "Mach-O 64-bit executable"},
+        {0, "\xce\xfa\xed\xfe", 4, FileKind::EXECUTABLE, "Mach-O executable"},
+        {0, "\xca\xfe\xba\xbe", 4, FileKind::EXECUTABLE, "Mach-O universal binary or Java class"},
+        {0, "MZ", 2, FileKind::EXECUTABLE, "DOS/Windows executable"},
+        {0, "\0asm", 4, FileKind::EXECUTABLE, "WebAssembly module"},
+    };
+
+    // Length of the UTF-8 sequence starting at p, 0 if it is malformed; a
+    // sequence cut off by the end of the sample counts as valid
+    size_t utf8Length(const unsigned char *p, const unsigned char *end)
+    {
+        size_t length;
+        if (*p < 0x80)
+            return 1;
+        else if (*p >= 0xC2 && *p <= 0xDF)
+            length = 2;
+        else if (*p >= 0xE0 && *p <= 0xEF)
+            length = 3;
+        else if (*p >= 0xF0 && *p <= 0xF4)
+            length = 4;
+        else
+            return 0;
+        for (size_t i = 1; i < length; i++)
+        {
+            if (p + i >= end)
+                return end - p;
+            if ((p[i] & 0xC0) != 0x80)
+                return 0;
+        }
+        return length;
+    }
+
+    bool looksLikeText(const char *data, size_t size)
+    {
+        const unsigned char *p = reinterpret_cast<const unsigned char *>(data);
+        const unsigned char *end = p + size;
+        size_t control = 0;
+        while (p < end)
+        {
+            if (*p == 0)
+                return false;
+            if (*p < 0x20 && *p != '\t' && *p != '\n' && *p != '\r' && *p != '\f' && *p != '\v' &&
+                *p != '\b' && *p != 0x1b)
+                control++;
+            size_t length = utf8Length(p, end);
+            if (length == 0)
+                return false;
+            p += length;
+        }
+        // Allow the odd stray control byte, as file(1) does
+        return control * 100 <= size;
+    }
+}
+
+bool FileType::compressible() const
+{
+    return kind == FileKind::TEXT || kind == FileKind::DOCUMENT || kind == FileKind::EXECUTABLE ||
+           kind == FileKind::DATA;
+}
+
+double FileSniffer::entropy(const char *data, size_t size)
+{
+    if (size == 0)
+        return 0;
+    size_t counts[256] = {};
+    for (size_t i = 0; i < size; i++)
+        counts[static_cast<unsigned char>(data[i])]++;
+
+    double bits = 0;
+    for (size_t count : counts)
+    {
+        if (count == 0)
+            continue;
+        double p = static_cast<double>(count) / size;
+        bits -= p * std::log2(p);
+    }
+    return bits;
+}
+
+FileType FileSniffer::classify(const char *data, size_t sampled, uint64_t size)
+{
+    FileType type;
+    type.size = size;
+    type.sampled = sampled;
+    if (sampled == 0)
+    {
+        type.kind = FileKind::EMPTY;
+        type.description = "empty";
+        return type;
+    }
+    type.entropy = entropy(data, sampled);
+
+    for (const Signature &signature : SIGNATURES)
+    {
+        if (signature.offset + signature.length <= sampled &&
+            std::memcmp(data + signature.offset, signature.magic, signature.length) == 0)
+        {
+            type.kind = signature.kind;
+            type.description = signature.description;
+            return type;
+        }
+    }
+
+    if (looksLikeText(data, sampled))
+    {
+        type.kind = FileKind::TEXT;
+        type.description = "text";
+    }
+    // A short sample cannot reach the threshold even when it is random
+    else if (sampled >= 512 && type.entropy >= OPAQUE_ENTROPY)
+    {
+        type.kind = FileKind::OPAQUE;
+        type.description = "high-entropy data (encrypted or compressed)";
+    }
+    else
+    {
+        type.kind = FileKind::DATA;
+        type.description = "data";
+    }
+    return type;
+}
+
+bool FileSniffer::sniff(const std::string &filePath, FileType &type)
+{
+    char sample[SAMPLE_SIZE];
+    uint64_t size = 0;
+    long sampled = IO::readHead(filePath, sample, sizeof(sample), size);
+    if (sampled < 0)
+        return false;
+    type = classify(sample, static_cast<size_t>(sampled), size);
+    return true;
+}
+
+const char *FileSniffer::kindName(FileKind kind)
+{
+    switch (kind)
+    {
+    case FileKind::EMPTY:
+        return "empty";
+    case FileKind::TEXT:
+        return "text";
+    case FileKind::CONTAINER:
+        return "container";
+    case FileKind::COMPRESSED:
+        return "compressed";
+    case FileKind::MEDIA:
+        return "media";
+    case FileKind::DOCUMENT:
+        return "document";
+    case FileKind::EXECUTABLE:
+        return "executable";
+    case FileKind::DATA:
+        return "data";
+    case FileKind::OPAQUE:
+        return "opaque";
+    }
+    return "unknown";
+}
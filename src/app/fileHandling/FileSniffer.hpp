@@ -0,0 +1,51 @@
+#ifndef FILE_SNIFFER_HPP
+#define FILE_SNIFFER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+enum class FileKind
+{
+    EMPTY,
+    TEXT,
+    CONTAINER,  // CryptoCore chunked container
+    COMPRESSED, // archives and compressed streams
+    MEDIA,      // images, audio and video, already compressed
+    DOCUMENT,
+    EXECUTABLE,
+    DATA,       // binary with no known signature
+    OPAQUE      // no signature and near-random bytes: encrypted or compressed
+};
+
+struct FileType
+{
+    FileKind kind = FileKind::EMPTY;
+    std::string description;
+    uint64_t size = 0;
+    size_t sampled = 0; // bytes the verdict is based on
+    double entropy = 0; // bits per byte of the sample, 0..8
+
+    // Worth skipping when encrypting a batch
+    bool likelyEncrypted() const { return kind == FileKind::CONTAINER || kind == FileKind::OPAQUE; }
+    // Worth running through the block compressor
+    bool compressible() const;
+};
+
+// Classifies a file from its first few KiB: magic bytes first, then text
+// versus binary, then Shannon entropy. One small read per file and no child
+// process, so it is cheap enough to run over a whole tree before a batch.
+class FileSniffer
+{
+public:
+    static const size_t SAMPLE_SIZE = 4096;
+    // Entropy above which a sample with no signature is taken as random
+    static constexpr double OPAQUE_ENTROPY = 7.5;
+
+    static bool sniff(const std::string &filePath, FileType &type);
+    static FileType classify(const char *data, size_t sampled, uint64_t size);
+    static double entropy(const char *data, size_t size);
+    static const char *kindName(FileKind kind);
+};
+
+#endif
@@ -0,0 +1,198 @@
+#include "FolderWatcher.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <poll.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+namespace
+{
+    int64_t nowMs()
+    {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    }
+}
+
+FolderWatcher::FolderWatcher() : fd(-1), wakePipe{-1, -1}, settleMs(0)
+{
+}
+
+FolderWatcher::~FolderWatcher()
+{
+    if (fd != -1)
+        close(fd);
+    for (int end : wakePipe)
+    {
+        if (end != -1)
+            close(end);
+    }
+}
+
+void FolderWatcher::wake()
+{
+    char byte = 'w';
+    ssize_t ignored = write(wakePipe[1], &byte, 1);
+    (void)ignored;
+}
+
+#ifdef __linux__
+
+bool FolderWatcher::open(const std::vector<std::string> &directories, int settle)
+{
+    settleMs = std::max(settle, 0);
+    fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0)
+    {
+        statusMessage = "inotify_init1 failed: " + std::string(std::strerror(errno));
+        return false;
+    }
+    if (pipe(wakePipe) != 0)
+    {
+        statusMessage = "pipe failed: " + std::string(std::strerror(errno));
+        return false;
+    }
+    for (int end : wakePipe)
+        fcntl(end, F_SETFL, fcntl(end, F_GETFL) | O_NONBLOCK);
+
+    // Watch first, then scan, so nothing dropped in between is missed; a
+    // file seen both ways is coalesced like any other repeat
+    int64_t now = nowMs();
+    for (const std::string &directory : directories)
+    {
+        int wd = inotify_add_watch(fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF);
+        if (wd < 0)
+        {
+            statusMessage = "Cannot watch " + directory + ": " + std::strerror(errno);
+            return false;
+        }
+        watches[wd] = directory;
+    }
+    for (const auto &watch : watches)
+        scan(watch.second, now);
+    return true;
+}
+
+bool FolderWatcher::readEvents(int64_t now)
+{
+    alignas(inotify_event) char buffer[64 * 1024];
+    while (true)
+    {
+        ssize_t length = read(fd, buffer, sizeof(buffer));
+        if (length < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return true;
+            statusMessage = "Reading inotify events failed: " + std::string(std::strerror(errno));
+            return false;
+        }
+
+        for (char *at = buffer; at < buffer + length;)
+        {
+            const inotify_event *event = reinterpret_cast<const inotify_event *>(at);
+            at += sizeof(inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW)
+            {
+                // Some events were lost; whatever is in the spools now is new
+                for (const auto &watch : watches)
+                    scan(watch.second, now);
+                continue;
+            }
+            auto watch = watches.find(event->wd);
+            if (watch == watches.end())
+                continue;
+            if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED))
+            {
+                statusMessage = "Spool directory went away: " + watch->second;
+                return false;
+            }
+            if (event->len == 0 || (event->mask & IN_ISDIR) || event->name[0] == '.')
+                continue;
+            note(watch->second + "/" + event->name, now);
+        }
+    }
+}
+
+#else
+
+bool FolderWatcher::open(const std::vector<std::string> &, int)
+{
+    statusMessage = "Watching folders needs inotify, which only Linux has";
+    return false;
+}
+
+bool FolderWatcher::readEvents(int64_t)
+{
+    return false;
+}
+
+#endif
+
+bool FolderWatcher::poll(int timeoutMs, std::vector<std::string> &ready)
+{
+    // Wake no later than the oldest pending file settles
+    int64_t now = nowMs();
+    if (!events.empty())
+        timeoutMs = static_cast<int>(std::max<int64_t>(0, std::min<int64_t>(timeoutMs, events.front().second + settleMs - now)));
+
+    pollfd entries[2] = {{fd, POLLIN, 0}, {wakePipe[0], POLLIN, 0}};
+    int result = ::poll(entries, 2, timeoutMs);
+    if (result < 0 && errno != EINTR)
+    {
+        statusMessage = "poll failed: " + std::string(std::strerror(errno));
+        return false;
+    }
+    if (result > 0 && (entries[1].revents & POLLIN))
+    {
+        char drain[64];
+        while (read(wakePipe[0], drain, sizeof(drain)) > 0)
+        {
+        }
+    }
+    now = nowMs();
+    if (result > 0 && (entries[0].revents & POLLIN) && !readEvents(now))
+        return false;
+
+    while (!events.empty() && events.front().second + settleMs <= now)
+    {
+        auto it = lastEvent.find(events.front().first);
+        // A later event for the same file is further back in the queue
+        if (it != lastEvent.end() && it->second == events.front().second)
+        {
+            ready.push_back(it->first);
+            lastEvent.erase(it);
+        }
+        events.pop_front();
+    }
+    return true;
+}
+
+void FolderWatcher::scan(const std::string &directory, int64_t now)
+{
+    std::error_code error;
+    for (const auto &entry : std::filesystem::directory_iterator(directory, error))
+    {
+        std::string name = entry.path().filename().string();
+        if (!name.empty() && name[0] != '.' && entry.is_regular_file(error))
+            note(directory + "/" + name, now);
+    }
+}
+
+void FolderWatcher::note(const std::string &path, int64_t now)
+{
+    auto it = lastEvent.find(path);
+    if (it != lastEvent.end() && it->second == now)
+        return;
+    lastEvent[path] = now;
+    events.emplace_back(path, now);
+}
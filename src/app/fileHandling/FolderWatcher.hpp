@@ -0,0 +1,53 @@
+#ifndef FOLDER_WATCHER_HPP
+#define FOLDER_WATCHER_HPP
+
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Reports files that were written and closed in, or moved into, a set of
+// spool directories, using inotify (Linux only).
+//
+// Events are coalesced per file until it has been quiet for the settle time,
+// so a file written in bursts, or opened and closed several times, comes out
+// once. Files already in the directories when watching starts, and all of
+// them again after the kernel's event queue overflowed, are reported as if
+// they had just arrived. Names starting with a dot are ignored, so producers
+// can write to a dot file and rename it into place.
+class FolderWatcher
+{
+public:
+    FolderWatcher();
+    ~FolderWatcher();
+    FolderWatcher(const FolderWatcher &) = delete;
+    FolderWatcher &operator=(const FolderWatcher &) = delete;
+
+    bool open(const std::vector<std::string> &directories, int settleMs);
+    // Waits at most timeoutMs for events, then appends every file that has
+    // settled to ready. False if watching broke down.
+    bool poll(int timeoutMs, std::vector<std::string> &ready);
+    // Makes the current or next poll return at once; safe from any thread
+    void wake();
+    size_t settlingCount() const { return lastEvent.size(); }
+    std::string getStatusMessage() const { return statusMessage; }
+
+private:
+    void scan(const std::string &directory, int64_t nowMs);
+    void note(const std::string &path, int64_t nowMs);
+    bool readEvents(int64_t nowMs);
+
+    int fd;
+    int wakePipe[2];
+    int settleMs;
+    std::map<int, std::string> watches; // watch descriptor -> directory
+    // Every event in arrival order; only the last one of a file counts
+    std::deque<std::pair<std::string, int64_t>> events;
+    std::unordered_map<std::string, int64_t> lastEvent;
+    std::string statusMessage;
+};
+
+#endif
@@ -1,6 +1,9 @@
 #include <iostream>
 #include "IO.hpp"
 #include <fstream>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 IO::IO(const std::string &file_path)
 {
@@ -18,4 +21,34 @@ IO::~IO()
 {
     if (file_stream.is_open())
         file_stream.close();
-}
\ No newline at end of file
+}
+
+long IO::readHead(const std::string &file_path, char *buffer, size_t size, uint64_t &file_size)
+{
+    int fd = ::open(file_path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return -1;
+    struct stat info;
+    if (fstat(fd, &info) != 0)
+    {
+        ::close(fd);
+        return -1;
+    }
+    file_size = static_cast<uint64_t>(info.st_size);
+
+    size_t done = 0;
+    while (done < size)
+    {
+        ssize_t got = ::read(fd, buffer + done, size - done);
+        if (got < 0)
+        {
+            ::close(fd);
+            return -1;
+        }
+        if (got == 0)
+            break;
+        done += static_cast<size_t>(got);
+    }
+    ::close(fd);
+    return static_cast<long>(done);
+}
@@ -4,12 +4,17 @@
 #include <fstream>
 #include <string>
 #include <iostream>
+#include <cstddef>
+#include <cstdint>
 class IO
 {
     public:
         IO(const std::string &file_path);
         ~IO();
         std::fstream getFileStream();
+        // Reads up to size bytes from the start of a file, read-only and
+        // without buffering the rest; returns the bytes read or -1
+        static long readHead(const std::string &file_path, char *buffer, size_t size, uint64_t &file_size);
 
     private:
         std::fstream file_stream;
@@ -0,0 +1,208 @@
+#include "IoRing.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define CRYPTOCORE_IO_URING 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+IoRing::IoRing()
+    : ringFd(-1), sqEntries(0), toSubmit(0), sqRing(nullptr), sqRingSize(0), cqRing(nullptr), cqRingSize(0),
+      sqes(nullptr), sqesSize(0), sqHead(nullptr), sqTail(nullptr), sqMask(0), sqArray(nullptr),
+      cqHead(nullptr), cqTail(nullptr), cqMask(0), cqes(nullptr)
+{
+}
+
+IoRing::~IoRing()
+{
+    close();
+}
+
+#ifdef CRYPTOCORE_IO_URING
+
+bool IoRing::open(unsigned entries)
+{
+    close();
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    int fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+    if (fd < 0)
+        return false;
+    // IORING_OP_READ/WRITE came with the same kernel as this feature bit
+    if (!(params.features & IORING_FEAT_RW_CUR_POS))
+    {
+        ::close(fd);
+        return false;
+    }
+    ringFd = fd;
+
+    sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single)
+        sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+
+    sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (sqRing == MAP_FAILED)
+    {
+        sqRing = nullptr;
+        close();
+        return false;
+    }
+    if (single)
+    {
+        cqRing = sqRing;
+    }
+    else
+    {
+        cqRing = mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (cqRing == MAP_FAILED)
+        {
+            cqRing = nullptr;
+            close();
+            return false;
+        }
+    }
+    sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    sqes = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED)
+    {
+        sqes = nullptr;
+        close();
+        return false;
+    }
+
+    char *sq = static_cast<char *>(sqRing);
+    char *cq = static_cast<char *>(cqRing);
+    sqHead = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+    sqTail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    sqMask = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    sqArray = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    cqHead = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    cqTail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    cqMask = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    cqes = cq + params.cq_off.cqes;
+    sqEntries = params.sq_entries;
+    toSubmit = 0;
+    return true;
+}
+
+void IoRing::close()
+{
+    if (sqes)
+        munmap(sqes, sqesSize);
+    if (cqRing && cqRing != sqRing)
+        munmap(cqRing, cqRingSize);
+    if (sqRing)
+        munmap(sqRing, sqRingSize);
+    sqes = sqRing = cqRing = nullptr;
+    if (ringFd != -1)
+        ::close(ringFd);
+    ringFd = -1;
+    sqEntries = 0;
+    toSubmit = 0;
+}
+
+bool IoRing::prepare(uint8_t opcode, int fd, uint64_t address, uint32_t length, uint64_t offset, uint64_t userData)
+{
+    // The kernel moves the head as it consumes entries; only we move the tail
+    unsigned tail = *sqTail;
+    if (tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries)
+        return false;
+
+    unsigned index = tail & sqMask;
+    io_uring_sqe *sqe = static_cast<io_uring_sqe *>(sqes) + index;
+    std::memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->addr = address;
+    sqe->len = length;
+    sqe->off = offset;
+    sqe->user_data = userData;
+    sqArray[index] = index;
+    __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+    toSubmit++;
+    return true;
+}
+
+bool IoRing::prepareRead(int fd, void *buffer, uint32_t length, uint64_t offset, uint64_t userData)
+{
+    return prepare(IORING_OP_READ, fd, reinterpret_cast<uintptr_t>(buffer), length, offset, userData);
+}
+
+bool IoRing::prepareWrite(int fd, const void *buffer, uint32_t length, uint64_t offset, uint64_t userData)
+{
+    return prepare(IORING_OP_WRITE, fd, reinterpret_cast<uintptr_t>(buffer), length, offset, userData);
+}
+
+bool IoRing::enter(unsigned minComplete)
+{
+    while (true)
+    {
+        unsigned flags = minComplete > 0 ? IORING_ENTER_GETEVENTS : 0;
+        long submitted = syscall(__NR_io_uring_enter, ringFd, toSubmit, minComplete, flags, nullptr, 0);
+        if (submitted >= 0)
+        {
+            toSubmit -= static_cast<unsigned>(submitted);
+            return true;
+        }
+        if (errno != EINTR)
+            return false;
+    }
+}
+
+bool IoRing::pop(Completion &out)
+{
+    unsigned head = *cqHead;
+    if (head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE))
+        return false;
+    const io_uring_cqe *cqe = static_cast<const io_uring_cqe *>(cqes) + (head & cqMask);
+    out.userData = cqe->user_data;
+    out.result = cqe->res;
+    __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+#else
+
+bool IoRing::open(unsigned)
+{
+    return false;
+}
+
+void IoRing::close()
+{
+}
+
+bool IoRing::prepare(uint8_t, int, uint64_t, uint32_t, uint64_t, uint64_t)
+{
+    return false;
+}
+
+bool IoRing::prepareRead(int, void *, uint32_t, uint64_t, uint64_t)
+{
+    return false;
+}
+
+bool IoRing::prepareWrite(int, const void *, uint32_t, uint64_t, uint64_t)
+{
+    return false;
+}
+
+bool IoRing::enter(unsigned)
+{
+    errno = ENOSYS;
+    return false;
+}
+
+bool IoRing::pop(Completion &)
+{
+    return false;
+}
+
+#endif
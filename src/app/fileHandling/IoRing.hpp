@@ -0,0 +1,67 @@
+#ifndef IO_RING_HPP
+#define IO_RING_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+// Minimal io_uring instance driven through the raw system calls, so there is
+// no liburing dependency: one submission and one completion queue mapped from
+// the kernel, positional reads and writes, and nothing else.
+//
+// Not thread-safe. One thread prepares, enters and pops; other threads hand it
+// work through their own queue. open() fails where the kernel has no io_uring
+// or no IORING_OP_READ/WRITE (before 5.6), and callers fall back to blocking
+// I/O on threads of their own.
+class IoRing
+{
+public:
+    struct Completion
+    {
+        uint64_t userData;
+        int32_t result; // bytes transferred, or -errno
+    };
+
+    IoRing();
+    ~IoRing();
+    IoRing(const IoRing &) = delete;
+    IoRing &operator=(const IoRing &) = delete;
+
+    bool open(unsigned entries);
+    void close();
+    bool isOpen() const { return ringFd != -1; }
+    unsigned getEntries() const { return sqEntries; }
+
+    // Queue a request for the next enter(); false when the submission queue
+    // is full
+    bool prepareRead(int fd, void *buffer, uint32_t length, uint64_t offset, uint64_t userData);
+    bool prepareWrite(int fd, const void *buffer, uint32_t length, uint64_t offset, uint64_t userData);
+    // Submits everything prepared and waits until at least minComplete
+    // completions are ready. Returns false on an error other than EINTR.
+    bool enter(unsigned minComplete);
+    bool pop(Completion &out);
+
+private:
+    bool prepare(uint8_t opcode, int fd, uint64_t address, uint32_t length, uint64_t offset, uint64_t userData);
+
+    int ringFd;
+    unsigned sqEntries;
+    unsigned toSubmit;
+
+    void *sqRing;
+    size_t sqRingSize;
+    void *cqRing;
+    size_t cqRingSize;
+    void *sqes;
+    size_t sqesSize;
+
+    unsigned *sqHead;
+    unsigned *sqTail;
+    unsigned sqMask;
+    unsigned *sqArray;
+    unsigned *cqHead;
+    unsigned *cqTail;
+    unsigned cqMask;
+    void *cqes;
+};
+
+#endif
@@ -0,0 +1,464 @@
+#include "Aes.hpp"
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CRYPTOCORE_AESNI 1
+#endif
+
+#define CRYPTOCORE_PRAGMA(text) _Pragma(#text)
+#if defined(__clang__)
+#define CRYPTOCORE_UNROLL(count) CRYPTOCORE_PRAGMA(unroll count)
+#elif defined(__GNUC__)
+#define CRYPTOCORE_UNROLL(count) CRYPTOCORE_PRAGMA(GCC unroll count)
+#else
+#define CRYPTOCORE_UNROLL(count)
+#endif
+
+namespace
+{
+    uint8_t mul(uint8_t a, uint8_t b)
+    {
+        uint8_t product = 0;
+        while (b)
+        {
+            if (b & 1)
+                product ^= a;
+            a = static_cast<uint8_t>((a << 1) ^ ((a & 0x80) ? 0x1b : 0));
+            b >>= 1;
+        }
+        return product;
+    }
+
+    inline uint32_t rotr8(uint32_t x)
+    {
+        return (x >> 8) | (x << 24);
+    }
+
+    inline uint32_t load32(const uint8_t *p)
+    {
+        return static_cast<uint32_t>(p[0]) << 24 | static_cast<uint32_t>(p[1]) << 16 |
+               static_cast<uint32_t>(p[2]) << 8 | p[3];
+    }
+
+    inline void store32(uint8_t *p, uint32_t v)
+    {
+        p[0] = static_cast<uint8_t>(v >> 24);
+        p[1] = static_cast<uint8_t>(v >> 16);
+        p[2] = static_cast<uint8_t>(v >> 8);
+        p[3] = static_cast<uint8_t>(v);
+    }
+
+    // S-boxes and round tables, built once from the field arithmetic
+    struct Tables
+    {
+        uint8_t sbox[256];
+        uint8_t inverse[256];
+        uint32_t te[4][256];
+        uint32_t td[4][256];
+
+        Tables()
+        {
+            for (int x = 0; x < 256; x++)
+            {
+                // Multiplicative inverse, then the affine transform
+                uint8_t inv = 0;
+                for (int y = 1; y < 256 && x; y++)
+                {
+                    if (mul(static_cast<uint8_t>(x), static_cast<uint8_t>(y)) == 1)
+                    {
+                        inv = static_cast<uint8_t>(y);
+                        break;
+                    }
+                }
+                uint8_t s = inv;
+                for (int i = 1; i < 5; i++)
+                    s ^= static_cast<uint8_t>((inv << i) | (inv >> (8 - i)));
+                s ^= 0x63;
+                sbox[x] = s;
+                inverse[s] = static_cast<uint8_t>(x);
+            }
+            for (int x = 0; x < 256; x++)
+            {
+                uint8_t s = sbox[x];
+                uint8_t i = inverse[x];
+                te[0][x] = static_cast<uint32_t>(mul(s, 2)) << 24 | static_cast<uint32_t>(s) << 16 |
+                           static_cast<uint32_t>(s) << 8 | mul(s, 3);
+                td[0][x] = static_cast<uint32_t>(mul(i, 14)) << 24 | static_cast<uint32_t>(mul(i, 9)) << 16 |
+                           static_cast<uint32_t>(mul(i, 13)) << 8 | mul(i, 11);
+                for (int t = 1; t < 4; t++)
+                {
+                    te[t][x] = rotr8(te[t - 1][x]);
+                    td[t][x] = rotr8(td[t - 1][x]);
+                }
+            }
+        }
+    };
+
+    const Tables &tables()
+    {
+        static const Tables instance;
+        return instance;
+    }
+
+    // Kernels are instantiated per round count (10 for AES-128, 14 for
+    // AES-256) so the round loops have constant trip counts and unroll; a
+    // Rounds of 0 takes the count at run time and is kept as the reference
+    template <int Rounds>
+    void encryptPortable(const uint8_t *keys, int runtimeRounds, const uint8_t *in, uint8_t *out)
+    {
+        const int rounds = Rounds ? Rounds : runtimeRounds;
+        const Tables &t = tables();
+        uint32_t s0 = load32(in) ^ load32(keys);
+        uint32_t s1 = load32(in + 4) ^ load32(keys + 4);
+        uint32_t s2 = load32(in + 8) ^ load32(keys + 8);
+        uint32_t s3 = load32(in + 12) ^ load32(keys + 12);
+        for (int r = 1; r < rounds; r++)
+        {
+            const uint8_t *k = keys + 16 * r;
+            uint32_t t0 = t.te[0][s0 >> 24] ^ t.te[1][(s1 >> 16) & 0xff] ^ t.te[2][(s2 >> 8) & 0xff] ^
+                          t.te[3][s3 & 0xff] ^ load32(k);
+            uint32_t t1 = t.te[0][s1 >> 24] ^ t.te[1][(s2 >> 16) & 0xff] ^ t.te[2][(s3 >> 8) & 0xff] ^
+                          t.te[3][s0 & 0xff] ^ load32(k + 4);
+            uint32_t t2 = t.te[0][s2 >> 24] ^ t.te[1][(s3 >> 16) & 0xff] ^ t.te[2][(s0 >> 8) & 0xff] ^
+                          t.te[3][s1 & 0xff] ^ load32(k + 8);
+            uint32_t t3 = t.te[0][s3 >> 24] ^ t.te[1][(s0 >> 16) & 0xff] ^ t.te[2][(s1 >> 8) & 0xff] ^
+                          t.te[3][s2 & 0xff] ^ load32(k + 12);
+            s0 = t0;
+            s1 = t1;
+            s2 = t2;
+            s3 = t3;
+        }
+        const uint8_t *k = keys + 16 * rounds;
+        const uint8_t *sb = t.sbox;
+        store32(out, (static_cast<uint32_t>(sb[s0 >> 24]) << 24 | static_cast<uint32_t>(sb[(s1 >> 16) & 0xff]) << 16 |
+                      static_cast<uint32_t>(sb[(s2 >> 8) & 0xff]) << 8 | sb[s3 & 0xff]) ^ load32(k));
+        store32(out + 4, (static_cast<uint32_t>(sb[s1 >> 24]) << 24 | static_cast<uint32_t>(sb[(s2 >> 16) & 0xff]) << 16 |
+                          static_cast<uint32_t>(sb[(s3 >> 8) & 0xff]) << 8 | sb[s0 & 0xff]) ^ load32(k + 4));
+        store32(out + 8, (static_cast<uint32_t>(sb[s2 >> 24]) << 24 | static_cast<uint32_t>(sb[(s3 >> 16) & 0xff]) << 16 |
+                          static_cast<uint32_t>(sb[(s0 >> 8) & 0xff]) << 8 | sb[s1 & 0xff]) ^ load32(k + 8));
+        store32(out + 12, (static_cast<uint32_t>(sb[s3 >> 24]) << 24 | static_cast<uint32_t>(sb[(s0 >> 16) & 0xff]) << 16 |
+                           static_cast<uint32_t>(sb[(s1 >> 8) & 0xff]) << 8 | sb[s2 & 0xff]) ^ load32(k + 12));
+    }
+
+    template <int Rounds>
+    void decryptPortable(const uint8_t *keys, int runtimeRounds, const uint8_t *in, uint8_t *out)
+    {
+        const int rounds = Rounds ? Rounds : runtimeRounds;
+        const Tables &t = tables();
+        uint32_t s0 = load32(in) ^ load32(keys);
+        uint32_t s1 = load32(in + 4) ^ load32(keys + 4);
+        uint32_t s2 = load32(in + 8) ^ load32(keys + 8);
+        uint32_t s3 = load32(in + 12) ^ load32(keys + 12);
+        for (int r = 1; r < rounds; r++)
+        {
+            const uint8_t *k = keys + 16 * r;
+            uint32_t t0 = t.td[0][s0 >> 24] ^ t.td[1][(s3 >> 16) & 0xff] ^ t.td[2][(s2 >> 8) & 0xff] ^
+                          t.td[3][s1 & 0xff] ^ load32(k);
+            uint32_t t1 = t.td[0][s1 >> 24] ^ t.td[1][(s0 >> 16) & 0xff] ^ t.td[2][(s3 >> 8) & 0xff] ^
+                          t.td[3][s2 & 0xff] ^ load32(k + 4);
+            uint32_t t2 = t.td[0][s2 >> 24] ^ t.td[1][(s1 >> 16) & 0xff] ^ t.td[2][(s0 >> 8) & 0xff] ^
+                          t.td[3][s3 & 0xff] ^ load32(k + 8);
+            uint32_t t3 = t.td[0][s3 >> 24] ^ t.td[1][(s2 >> 16) & 0xff] ^ t.td[2][(s1 >> 8) & 0xff] ^
+                          t.td[3][s0 & 0xff] ^ load32(k + 12);
+            s0 = t0;
+            s1 = t1;
+            s2 = t2;
+            s3 = t3;
+        }
+        const uint8_t *k = keys + 16 * rounds;
+        const uint8_t *ib = t.inverse;
+        store32(out, (static_cast<uint32_t>(ib[s0 >> 24]) << 24 | static_cast<uint32_t>(ib[(s3 >> 16) & 0xff]) << 16 |
+                      static_cast<uint32_t>(ib[(s2 >> 8) & 0xff]) << 8 | ib[s1 & 0xff]) ^ load32(k));
+        store32(out + 4, (static_cast<uint32_t>(ib[s1 >> 24]) << 24 | static_cast<uint32_t>(ib[(s0 >> 16) & 0xff]) << 16 |
+                          static_cast<uint32_t>(ib[(s3 >> 8) & 0xff]) << 8 | ib[s2 & 0xff]) ^ load32(k + 4));
+        store32(out + 8, (static_cast<uint32_t>(ib[s2 >> 24]) << 24 | static_cast<uint32_t>(ib[(s1 >> 16) & 0xff]) << 16 |
+                          static_cast<uint32_t>(ib[(s0 >> 8) & 0xff]) << 8 | ib[s3 & 0xff]) ^ load32(k + 8));
+        store32(out + 12, (static_cast<uint32_t>(ib[s3 >> 24]) << 24 | static_cast<uint32_t>(ib[(s2 >> 16) & 0xff]) << 16 |
+                           static_cast<uint32_t>(ib[(s1 >> 8) & 0xff]) << 8 | ib[s0 & 0xff]) ^ load32(k + 12));
+    }
+
+    template <int Rounds>
+    void encryptPortableBlocks(const uint8_t *keys, int rounds, const uint8_t *in, uint8_t *out, size_t blocks)
+    {
+        for (size_t i = 0; i < blocks; i++)
+            encryptPortable<Rounds>(keys, rounds, in + Aes::BLOCK_LEN * i, out + Aes::BLOCK_LEN * i);
+    }
+
+    template <int Rounds>
+    void decryptPortableBlocks(const uint8_t *keys, int rounds, const uint8_t *in, uint8_t *out, size_t blocks)
+    {
+        for (size_t i = 0; i < blocks; i++)
+            decryptPortable<Rounds>(keys, rounds, in + Aes::BLOCK_LEN * i, out + Aes::BLOCK_LEN * i);
+    }
+
+#ifdef CRYPTOCORE_AESNI
+    const size_t LANES = 8;
+
+    // Reference kernels: round count at run time, loops left to the compiler,
+    // which keeps the lanes in memory between rounds
+    __attribute__((target("aes,sse2"))) void encryptNiGeneric(const uint8_t *keys, int rounds, const uint8_t *in,
+                                                               uint8_t *out, size_t blocks)
+    {
+        __m128i k[15];
+        for (int r = 0; r <= rounds; r++)
+            k[r] = _mm_load_si128(reinterpret_cast<const __m128i *>(keys + 16 * r));
+
+        size_t i = 0;
+        for (; i + LANES <= blocks; i += LANES)
+        {
+            __m128i b[LANES];
+            for (size_t j = 0; j < LANES; j++)
+                b[j] = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(in + 16 * (i + j))), k[0]);
+            for (int r = 1; r < rounds; r++)
+                for (size_t j = 0; j < LANES; j++)
+                    b[j] = _mm_aesenc_si128(b[j], k[r]);
+            for (size_t j = 0; j < LANES; j++)
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 16 * (i + j)), _mm_aesenclast_si128(b[j], k[rounds]));
+        }
+        for (; i < blocks; i++)
+        {
+            __m128i b = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(in + 16 * i)), k[0]);
+            for (int r = 1; r < rounds; r++)
+                b = _mm_aesenc_si128(b, k[r]);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 16 * i), _mm_aesenclast_si128(b, k[rounds]));
+        }
+    }
+
+    __attribute__((target("aes,sse2"))) void decryptNiGeneric(const uint8_t *keys, int rounds, const uint8_t *in,
+                                                               uint8_t *out, size_t blocks)
+    {
+        __m128i k[15];
+        for (int r = 0; r <= rounds; r++)
+            k[r] = _mm_load_si128(reinterpret_cast<const __m128i *>(keys + 16 * r));
+
+        size_t i = 0;
+        for (; i + LANES <= blocks; i += LANES)
+        {
+            __m128i b[LANES];
+            for (size_t j = 0; j < LANES; j++)
+                b[j] = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(in + 16 * (i + j))), k[0]);
+            for (int r = 1; r < rounds; r++)
+                for (size_t j = 0; j < LANES; j++)
+                    b[j] = _mm_aesdec_si128(b[j], k[r]);
+            for (size_t j = 0; j < LANES; j++)
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 16 * (i + j)), _mm_aesdeclast_si128(b[j], k[rounds]));
+        }
+        for (; i < blocks; i++)
+        {
+            __m128i b = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(in + 16 * i)), k[0]);
+            for (int r = 1; r < rounds; r++)
+                b = _mm_aesdec_si128(b, k[r]);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 16 * i), _mm_aesdeclast_si128(b, k[rounds]));
+        }
+    }
+
+    // Specialized kernels: every loop has a constant trip count and is fully
+    // unrolled, so the eight lanes live in registers and each round key is
+    // loaded once per batch. Encrypt and decrypt differ only in the round
+    // instructions, passed as template arguments.
+    template <int Rounds, __m128i (*Round)(__m128i, __m128i), __m128i (*LastRound)(__m128i, __m128i)>
+    __attribute__((target("aes,sse2"), always_inline)) inline void niBlocks(const uint8_t *keys, const uint8_t *in,
+                                                                           uint8_t *out, size_t blocks)
+    {
+        const __m128i *k = reinterpret_cast<const __m128i *>(keys);
+        size_t i = 0;
+        for (; i + LANES <= blocks; i += LANES)
+        {
+            __m128i b[LANES];
+            __m128i key = _mm_load_si128(k);
+            CRYPTOCORE_UNROLL(8)
+            for (size_t j = 0; j < LANES; j++)
+                b[j] = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(in + 16 * (i + j))), key);
+            CRYPTOCORE_UNROLL(14)
+            for (int r = 1; r < Rounds; r++)
+            {
+                key = _mm_load_si128(k + r);
+                CRYPTOCORE_UNROLL(8)
+                for (size_t j = 0; j < LANES; j++)
+                    b[j] = Round(b[j], key);
+            }
+            key = _mm_load_si128(k + Rounds);
+            CRYPTOCORE_UNROLL(8)
+            for (size_t j = 0; j < LANES; j++)
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 16 * (i + j)), LastRound(b[j], key));
+        }
+        for (; i < blocks; i++)
+        {
+            __m128i b = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(in + 16 * i)), _mm_load_si128(k));
+            CRYPTOCORE_UNROLL(14)
+            for (int r = 1; r < Rounds; r++)
+                b = Round(b, _mm_load_si128(k + r));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 16 * i), LastRound(b, _mm_load_si128(k + Rounds)));
+        }
+    }
+
+    __attribute__((target("aes,sse2"), always_inline)) inline __m128i aesEnc(__m128i b, __m128i k)
+    {
+        return _mm_aesenc_si128(b, k);
+    }
+    __attribute__((target("aes,sse2"), always_inline)) inline __m128i aesEncLast(__m128i b, __m128i k)
+    {
+        return _mm_aesenclast_si128(b, k);
+    }
+    __attribute__((target("aes,sse2"), always_inline)) inline __m128i aesDec(__m128i b, __m128i k)
+    {
+        return _mm_aesdec_si128(b, k);
+    }
+    __attribute__((target("aes,sse2"), always_inline)) inline __m128i aesDecLast(__m128i b, __m128i k)
+    {
+        return _mm_aesdeclast_si128(b, k);
+    }
+
+    template <int Rounds>
+    __attribute__((target("aes,sse2"))) void encryptNi(const uint8_t *keys, int, const uint8_t *in, uint8_t *out,
+                                                        size_t blocks)
+    {
+        niBlocks<Rounds, aesEnc, aesEncLast>(keys, in, out, blocks);
+    }
+
+    template <int Rounds>
+    __attribute__((target("aes,sse2"))) void decryptNi(const uint8_t *keys, int, const uint8_t *in, uint8_t *out,
+                                                        size_t blocks)
+    {
+        niBlocks<Rounds, aesDec, aesDecLast>(keys, in, out, blocks);
+    }
+#endif
+
+    struct KernelPair
+    {
+        Aes::BlockKernel encrypt;
+        Aes::BlockKernel decrypt;
+        const char *name;
+    };
+
+    // Indexed by [variant]: run-time rounds, AES-128, AES-256
+    const KernelPair PORTABLE_KERNELS[3] = {
+        {encryptPortableBlocks<0>, decryptPortableBlocks<0>, "portable, generic rounds"},
+        {encryptPortableBlocks<10>, decryptPortableBlocks<10>, "portable, AES-128"},
+        {encryptPortableBlocks<14>, decryptPortableBlocks<14>, "portable, AES-256"},
+    };
+#ifdef CRYPTOCORE_AESNI
+    const KernelPair NI_KERNELS[3] = {
+        {encryptNiGeneric, decryptNiGeneric, "AES-NI, generic rounds"},
+        {encryptNi<10>, decryptNi<10>, "AES-NI, AES-128"},
+        {encryptNi<14>, decryptNi<14>, "AES-NI, AES-256"},
+    };
+#endif
+}
+
+Aes::Aes()
+    : rounds(0), keys(&own), encryptKernel(PORTABLE_KERNELS[0].encrypt), decryptKernel(PORTABLE_KERNELS[0].decrypt),
+      kernel("none")
+{
+    std::memset(&own, 0, sizeof(own));
+}
+
+Aes::~Aes()
+{
+    volatile uint8_t *bytes = reinterpret_cast<uint8_t *>(&own);
+    for (size_t i = 0; i < sizeof(own); i++)
+        bytes[i] = 0;
+}
+
+bool Aes::hardwareAccelerated()
+{
+#ifdef CRYPTOCORE_AESNI
+    static const bool supported = __builtin_cpu_supports("aes");
+    return supported;
+#else
+    return false;
+#endif
+}
+
+bool Aes::setKey(const uint8_t *key, size_t keyLen, bool specialized)
+{
+    return expandKey(key, keyLen, own) && useSchedule(own, keyLen, specialized);
+}
+
+bool Aes::expandKey(const uint8_t *key, size_t keyLen, Schedule &schedule)
+{
+    if (keyLen != 16 && keyLen != 32)
+        return false;
+    const Tables &t = tables();
+    int nk = static_cast<int>(keyLen / 4);
+    int rounds = nk + 6;
+    int words = 4 * (rounds + 1);
+
+    uint32_t w[60];
+    for (int i = 0; i < nk; i++)
+        w[i] = load32(key + 4 * i);
+    uint8_t rcon = 1;
+    for (int i = nk; i < words; i++)
+    {
+        uint32_t temp = w[i - 1];
+        if (i % nk == 0)
+        {
+            temp = (temp << 8) | (temp >> 24);
+            temp = static_cast<uint32_t>(t.sbox[temp >> 24]) << 24 | static_cast<uint32_t>(t.sbox[(temp >> 16) & 0xff]) << 16 |
+                   static_cast<uint32_t>(t.sbox[(temp >> 8) & 0xff]) << 8 | t.sbox[temp & 0xff];
+            temp ^= static_cast<uint32_t>(rcon) << 24;
+            rcon = mul(rcon, 2);
+        }
+        else if (nk > 6 && i % nk == 4)
+        {
+            temp = static_cast<uint32_t>(t.sbox[temp >> 24]) << 24 | static_cast<uint32_t>(t.sbox[(temp >> 16) & 0xff]) << 16 |
+                   static_cast<uint32_t>(t.sbox[(temp >> 8) & 0xff]) << 8 | t.sbox[temp & 0xff];
+        }
+        w[i] = w[i - nk] ^ temp;
+    }
+
+    // Decryption uses the round keys in reverse, with InvMixColumns applied
+    // to all but the outer two
+    for (int r = 0; r <= rounds; r++)
+    {
+        for (int c = 0; c < 4; c++)
+        {
+            store32(schedule.encryptKeys + 16 * r + 4 * c, w[4 * r + c]);
+            uint32_t k = w[4 * (rounds - r) + c];
+            if (r > 0 && r < rounds)
+                k = t.td[0][t.sbox[k >> 24]] ^ t.td[1][t.sbox[(k >> 16) & 0xff]] ^ t.td[2][t.sbox[(k >> 8) & 0xff]] ^
+                    t.td[3][t.sbox[k & 0xff]];
+            store32(schedule.decryptKeys + 16 * r + 4 * c, k);
+        }
+    }
+    volatile uint32_t *expanded = w;
+    for (int i = 0; i < words; i++)
+        expanded[i] = 0;
+    return true;
+}
+
+bool Aes::useSchedule(const Schedule &schedule, size_t keyLen, bool specialized)
+{
+    if (keyLen != 16 && keyLen != 32)
+        return false;
+    rounds = static_cast<int>(keyLen / 4) + 6;
+    keys = &schedule;
+
+    // Chosen once here, so batches pay one indirect call and no branches
+    const KernelPair *kernels = PORTABLE_KERNELS;
+#ifdef CRYPTOCORE_AESNI
+    if (hardwareAccelerated())
+        kernels = NI_KERNELS;
+#endif
+    const KernelPair &chosen = kernels[specialized ? (keyLen == 16 ? 1 : 2) : 0];
+    encryptKernel = chosen.encrypt;
+    decryptKernel = chosen.decrypt;
+    kernel = chosen.name;
+    return true;
+}
+
+const char *Aes::kernelName() const
+{
+    return kernel;
+}
+
+void Aes::encryptBlocks(const uint8_t *in, uint8_t *out, size_t blocks) const
+{
+    encryptKernel(keys->encryptKeys, rounds, in, out, blocks);
+}
+
+void Aes::decryptBlocks(const uint8_t *in, uint8_t *out, size_t blocks) const
+{
+    decryptKernel(keys->decryptKeys, rounds, in, out, blocks);
+}
@@ -0,0 +1,59 @@
+#ifndef AES_HPP
+#define AES_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+// AES block cipher (FIPS-197) with 128- or 256-bit keys.
+//
+// Blocks are processed in batches: on x86 CPUs with AES-NI eight independent
+// blocks are kept in flight to hide the instruction latency; elsewhere a
+// portable table implementation is used. Both share one key schedule.
+//
+// Each (instruction set, key size, direction) has its own kernel with the
+// round count fixed at compile time; setKey picks the pair for the key.
+class Aes
+{
+public:
+    static const size_t BLOCK_LEN = 16;
+
+    typedef void (*BlockKernel)(const uint8_t *keys, int rounds, const uint8_t *in, uint8_t *out, size_t blocks);
+
+    // Round keys in byte order; decryption keys are in the order and form of
+    // the equivalent inverse cipher, which is also what AESDEC expects
+    struct Schedule
+    {
+        alignas(16) uint8_t encryptKeys[15 * BLOCK_LEN];
+        alignas(16) uint8_t decryptKeys[15 * BLOCK_LEN];
+    };
+
+    Aes();
+    ~Aes();
+    Aes(const Aes &) = delete;
+    Aes &operator=(const Aes &) = delete;
+
+    // keyLen is 16 or 32 bytes. specialized = false selects the kernels that
+    // take the round count at run time, for comparing against.
+    bool setKey(const uint8_t *key, size_t keyLen, bool specialized = true);
+    // Expands key into schedule, wherever that lives, e.g. in locked memory
+    static bool expandKey(const uint8_t *key, size_t keyLen, Schedule &schedule);
+    // Runs on a schedule expanded elsewhere instead of a copy of its own. The
+    // schedule is not wiped by this object and has to outlive it.
+    bool useSchedule(const Schedule &schedule, size_t keyLen, bool specialized = true);
+    // in and out may be the same buffer
+    void encryptBlocks(const uint8_t *in, uint8_t *out, size_t blocks) const;
+    void decryptBlocks(const uint8_t *in, uint8_t *out, size_t blocks) const;
+
+    static bool hardwareAccelerated();
+    const char *kernelName() const;
+
+private:
+    int rounds;
+    Schedule own;          // filled by setKey
+    const Schedule *keys;  // own, or the one passed to useSchedule
+    BlockKernel encryptKernel;
+    BlockKernel decryptKernel;
+    const char *kernel;
+};
+
+#endif
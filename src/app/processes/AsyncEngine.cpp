@@ -0,0 +1,583 @@
+#include "AsyncEngine.hpp"
+#include "TaskManager.hpp"
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+
+namespace
+{
+    // user_data of the wake pipe read; tasks are never at address 0
+    const uint64_t WAKE_TAG = 0;
+    const size_t MAX_IO_THREADS = 8;
+}
+
+char *AsyncEngine::BlockTask::ioBuffer(size_t &length, uint64_t &fileOffset)
+{
+    if (step == READ)
+    {
+        length = size - transferred;
+        fileOffset = offset + transferred;
+        return buffer.data() + transferred;
+    }
+    const SparseMap::Extent &extent = spans[span];
+    length = static_cast<size_t>(extent.length) - transferred;
+    fileOffset = extent.offset + transferred;
+    return buffer.data() + (extent.offset - offset) + transferred;
+}
+
+AsyncEngine::AsyncEngine(size_t executorCount, size_t maxInFlight, size_t blockSize)
+    : executorCount(executorCount), maxInFlight(maxInFlight), running(false), stopping(false),
+      callbacksRunning(0), inFlight(0), nextTicket(1), nextSequence(0), jobsDone(0), blocksDone(0),
+      ioSubmitted(0)
+{
+    wakePipe[0] = wakePipe[1] = -1;
+    if (this->executorCount == 0)
+        this->executorCount = std::max<size_t>(1, std::thread::hardware_concurrency());
+    if (this->maxInFlight == 0)
+        this->maxInFlight = 2 * this->executorCount;
+    // Whole transform units, so a block never splits one
+    size_t units = std::max<size_t>(1, (blockSize + TaskManager::TRANSFORM_UNIT - 1) / TaskManager::TRANSFORM_UNIT);
+    this->blockSize = units * TaskManager::TRANSFORM_UNIT;
+}
+
+AsyncEngine::~AsyncEngine()
+{
+    stop();
+}
+
+bool AsyncEngine::start()
+{
+    if (running)
+        return true;
+
+    // The blocks in flight are all the buffer memory the engine uses, held
+    // for as long as it runs; under a budget they take at most half of it so
+    // thread runs can still be admitted
+    size_t capacity = BufferPool::classSize(blockSize);
+    uint64_t limit = MemoryBudget::shared().getLimit();
+    if (limit > 0)
+        maxInFlight = static_cast<size_t>(std::max<uint64_t>(1, std::min<uint64_t>(maxInFlight, limit / 2 / capacity)));
+    int64_t waitedNs = 0;
+    reservation.reserve(static_cast<uint64_t>(maxInFlight) * capacity, waitedNs);
+
+    if (ring.open(static_cast<unsigned>(maxInFlight + 1)))
+    {
+        // The read end stays blocking, so the ring waits on it instead of
+        // completing the read at once with EAGAIN
+        if (pipe(wakePipe) == -1 || fcntl(wakePipe[1], F_SETFL, O_NONBLOCK) == -1)
+        {
+            statusMessage = "Failed to create wake pipe";
+            ring.close();
+            reservation.release();
+            return false;
+        }
+    }
+
+    running = true;
+    stopping = false;
+    if (ring.isOpen())
+    {
+        ioThreads.emplace_back(&AsyncEngine::reactorLoop, this);
+    }
+    else
+    {
+        for (size_t i = 0; i < std::min(maxInFlight, MAX_IO_THREADS); i++)
+            ioThreads.emplace_back(&AsyncEngine::ioThreadLoop, this);
+    }
+    for (size_t i = 0; i < executorCount; i++)
+        executors.emplace_back(&AsyncEngine::executorLoop, this);
+
+    statusMessage = std::to_string(executorCount) + " executors, " + std::to_string(maxInFlight) +
+                    " blocks in flight, I/O through " +
+                    (ring.isOpen() ? std::string("io_uring") : std::to_string(ioThreads.size()) + " I/O threads");
+    return true;
+}
+
+void AsyncEngine::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!running || stopping)
+            return;
+        stopping = true;
+        // Queued jobs never touched their file, so they are simply dropped
+        for (auto &entry : pending)
+        {
+            entry.second->cancelled = true;
+            byTicket.erase(entry.second->ticket);
+            finished.push_back(entry.second);
+        }
+        pending.clear();
+    }
+    wake.notify_all();
+
+    // Open jobs run to the end, like a runner finishing its current job
+    while (true)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (active.empty() && finished.empty() && callbacksRunning == 0)
+                break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    running = false;
+    wake.notify_all();
+    ioWake.notify_all();
+    if (ring.isOpen())
+        wakeReactor();
+    for (auto &thread : executors)
+        thread.join();
+    for (auto &thread : ioThreads)
+        thread.join();
+    executors.clear();
+    ioThreads.clear();
+
+    ring.close();
+    for (int &fd : wakePipe)
+    {
+        if (fd != -1)
+            close(fd);
+        fd = -1;
+    }
+    reservation.release();
+}
+
+uint64_t AsyncEngine::submit(const std::string &filePath, bool isEncryption, TaskManager &transformer,
+                             uint8_t priority, DoneCallback done)
+{
+    auto *job = new Job;
+    job->filePath = filePath;
+    job->isEncryption = isEncryption;
+    job->transformer = &transformer;
+    job->priority = priority;
+    job->done = std::move(done);
+
+    // The job can be done and gone by the time submit returns
+    uint64_t ticket;
+    std::vector<BlockTask *> issued;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!running || stopping)
+        {
+            delete job;
+            return 0;
+        }
+        ticket = nextTicket++;
+        job->ticket = ticket;
+        job->sequence = nextSequence++;
+        pending[{-static_cast<int>(priority), job->sequence}] = job;
+        byTicket[job->ticket] = job;
+        fill(issued);
+    }
+    wake.notify_all();
+    for (BlockTask *task : issued)
+        submitIo(task);
+    return ticket;
+}
+
+bool AsyncEngine::cancel(uint64_t ticket)
+{
+    std::vector<BlockTask *> issued;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = byTicket.find(ticket);
+        if (it == byTicket.end())
+            return false;
+        Job *job = it->second;
+        job->cancelled = true;
+        auto queued = pending.find({-static_cast<int>(job->priority), job->sequence});
+        if (queued != pending.end())
+        {
+            pending.erase(queued);
+            byTicket.erase(it);
+            finished.push_back(job);
+        }
+        // An open job stops issuing blocks and settles once its last one is
+        // back; one that was waiting for a slot settles here
+        fill(issued);
+    }
+    wake.notify_all();
+    for (BlockTask *task : issued)
+        submitIo(task);
+    return true;
+}
+
+AsyncEngineStats AsyncEngine::getStats() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    AsyncEngineStats stats;
+    stats.jobsDone = jobsDone;
+    stats.blocksDone = blocksDone;
+    stats.ioSubmitted = ioSubmitted.load(std::memory_order_relaxed);
+    stats.pendingJobs = pending.size();
+    stats.activeJobs = active.size();
+    stats.blocksInFlight = inFlight;
+    return stats;
+}
+
+std::string AsyncEngine::getStatusMessage() const
+{
+    return statusMessage;
+}
+
+void AsyncEngine::executorLoop()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        wake.wait(lock, [this]
+                  { return !running || !ready.empty() || !finished.empty(); });
+        if (!finished.empty())
+        {
+            std::vector<Job *> jobs;
+            jobs.swap(finished);
+            callbacksRunning++;
+            lock.unlock();
+            runCallbacks(jobs);
+            lock.lock();
+            callbacksRunning--;
+            continue;
+        }
+        if (!ready.empty())
+        {
+            BlockTask *task = ready.front();
+            ready.pop_front();
+            lock.unlock();
+            resume(task);
+            lock.lock();
+            continue;
+        }
+        if (!running)
+            return;
+    }
+}
+
+void AsyncEngine::reactorLoop()
+{
+    IoRing::Completion completion;
+    bool armed = ring.prepareRead(wakePipe[0], wakeBuffer, sizeof(wakeBuffer), static_cast<uint64_t>(-1), WAKE_TAG);
+    while (armed)
+    {
+        {
+            // The ring has room for every block in flight plus the wake read
+            std::lock_guard<std::mutex> lock(ioMutex);
+            while (!ioQueue.empty())
+            {
+                BlockTask *task = ioQueue.front();
+                size_t length;
+                uint64_t offset;
+                char *buffer = task->ioBuffer(length, offset);
+                uint64_t tag = reinterpret_cast<uintptr_t>(task);
+                uint32_t size = static_cast<uint32_t>(length);
+                if (!(task->step == BlockTask::READ ? ring.prepareRead(task->job->fd, buffer, size, offset, tag)
+                                                    : ring.prepareWrite(task->job->fd, buffer, size, offset, tag)))
+                    break;
+                ioQueue.pop_front();
+            }
+        }
+
+        if (!ring.enter(1))
+        {
+            // Nothing can be submitted or reaped any more; fail what is queued
+            // so its jobs settle instead of hanging
+            int error = errno;
+            std::deque<BlockTask *> stranded;
+            {
+                std::lock_guard<std::mutex> lock(ioMutex);
+                stranded.swap(ioQueue);
+            }
+            for (BlockTask *task : stranded)
+                complete(task, -error);
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        while (ring.pop(completion))
+        {
+            if (completion.userData == WAKE_TAG)
+            {
+                if (!running)
+                    return;
+                armed = ring.prepareRead(wakePipe[0], wakeBuffer, sizeof(wakeBuffer), static_cast<uint64_t>(-1),
+                                         WAKE_TAG);
+                continue;
+            }
+            complete(reinterpret_cast<BlockTask *>(static_cast<uintptr_t>(completion.userData)), completion.result);
+        }
+    }
+}
+
+void AsyncEngine::ioThreadLoop()
+{
+    while (true)
+    {
+        BlockTask *task;
+        {
+            std::unique_lock<std::mutex> lock(ioMutex);
+            ioWake.wait(lock, [this]
+                        { return !running || !ioQueue.empty(); });
+            if (ioQueue.empty())
+                return;
+            task = ioQueue.front();
+            ioQueue.pop_front();
+        }
+
+        size_t length;
+        uint64_t offset;
+        char *buffer = task->ioBuffer(length, offset);
+        ssize_t n = task->step == BlockTask::READ ? pread(task->job->fd, buffer, length, static_cast<off_t>(offset))
+                                                  : pwrite(task->job->fd, buffer, length, static_cast<off_t>(offset));
+        complete(task, n < 0 ? -errno : static_cast<int32_t>(n));
+    }
+}
+
+void AsyncEngine::wakeReactor()
+{
+    char byte = 'w';
+    // A full pipe already has a wake-up pending
+    ssize_t ignored = write(wakePipe[1], &byte, 1);
+    (void)ignored;
+}
+
+void AsyncEngine::submitIo(BlockTask *task)
+{
+    {
+        std::lock_guard<std::mutex> lock(ioMutex);
+        ioQueue.push_back(task);
+    }
+    ioSubmitted.fetch_add(1, std::memory_order_relaxed);
+    if (ring.isOpen())
+        wakeReactor();
+    else
+        ioWake.notify_one();
+}
+
+void AsyncEngine::complete(BlockTask *task, int32_t result)
+{
+    task->result = result;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ready.push_back(task);
+    }
+    wake.notify_one();
+}
+
+void AsyncEngine::resume(BlockTask *task)
+{
+    Job &job = *task->job;
+    bool reading = task->step == BlockTask::READ;
+    if (task->result <= 0)
+    {
+        std::string reason = task->result < 0 ? std::strerror(-task->result)
+                                              : std::string(reading ? "unexpected end of file" : "nothing written");
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            fail(job, std::string(reading ? "Error reading " : "Error writing ") + job.filePath + ": " + reason);
+        }
+        finishBlock(task);
+        return;
+    }
+
+    // Short transfers carry on from where they stopped
+    task->transferred += static_cast<size_t>(task->result);
+    if (reading)
+    {
+        if (task->transferred < task->size)
+        {
+            submitIo(task);
+            return;
+        }
+        // Only the data spans are transformed and written, so holes stay
+        bool encrypt = task->forward == job.isEncryption;
+        for (const SparseMap::Extent &extent : task->spans)
+            job.transformer->processAt(task->buffer.data() + (extent.offset - task->offset),
+                                       static_cast<size_t>(extent.length), extent.offset, encrypt);
+        task->step = BlockTask::WRITE;
+        task->span = 0;
+        task->transferred = 0;
+        submitIo(task);
+        return;
+    }
+
+    if (task->transferred < task->spans[task->span].length)
+    {
+        submitIo(task);
+        return;
+    }
+    if (++task->span < task->spans.size())
+    {
+        task->transferred = 0;
+        submitIo(task);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        job.written[task->block] = task->forward ? 1 : 0;
+        blocksDone++;
+    }
+    finishBlock(task);
+}
+
+void AsyncEngine::finishBlock(BlockTask *task)
+{
+    std::vector<BlockTask *> issued;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        task->job->inFlight--;
+        inFlight--;
+        fill(issued);
+    }
+    // Back to the pool outside the lock
+    delete task;
+    wake.notify_all();
+    for (BlockTask *next : issued)
+        submitIo(next);
+}
+
+void AsyncEngine::fill(std::vector<BlockTask *> &issued)
+{
+    // Open jobs get slots first, oldest first, so each finishes before the
+    // next is opened and only a few files are open at a time
+    size_t i = 0;
+    while (true)
+    {
+        if (i == active.size())
+        {
+            if (stopping || pending.empty() || inFlight >= maxInFlight)
+                return;
+            Job *job = pending.begin()->second;
+            pending.erase(pending.begin());
+            active.push_back(job);
+            openJob(*job);
+        }
+
+        Job &job = *active[i];
+        while (inFlight < maxInFlight && hasTask(job))
+        {
+            issued.push_back(nextTask(job));
+            job.inFlight++;
+            inFlight++;
+        }
+        // settle() either starts a rollback, which the next pass issues, or
+        // removes the job, which moves the next one into slot i
+        if (job.inFlight == 0 && !hasTask(job))
+            settle(job);
+        else
+            i++;
+    }
+}
+
+bool AsyncEngine::hasTask(Job &job)
+{
+    if (job.fd == -1)
+        return false;
+    if (job.rollingBack)
+    {
+        while (job.nextRollback < job.blockCount && !job.written[job.nextRollback])
+            job.nextRollback++;
+        return job.nextRollback < job.blockCount;
+    }
+    if (job.cancelled || job.failed)
+        return false;
+
+    // Blocks that are all hole need no I/O at all
+    std::vector<SparseMap::Extent> spans;
+    while (job.nextBlock < job.blockCount)
+    {
+        uint64_t offset = job.nextBlock * blockSize;
+        job.sparse.dataIn(offset, std::min<uint64_t>(blockSize, job.fileSize - offset), spans);
+        if (!spans.empty())
+            return true;
+        job.nextBlock++;
+    }
+    return false;
+}
+
+AsyncEngine::BlockTask *AsyncEngine::nextTask(Job &job)
+{
+    auto *task = new BlockTask;
+    task->job = &job;
+    task->forward = !job.rollingBack;
+    task->block = job.rollingBack ? job.nextRollback++ : job.nextBlock++;
+    task->offset = task->block * blockSize;
+    task->size = static_cast<size_t>(std::min<uint64_t>(blockSize, job.fileSize - task->offset));
+    task->buffer = BufferPool::shared().acquire(task->size);
+    job.sparse.dataIn(task->offset, task->size, task->spans);
+    return task;
+}
+
+bool AsyncEngine::openJob(Job &job)
+{
+    int fd = ::open(job.filePath.c_str(), O_RDWR | O_CLOEXEC);
+    if (fd < 0)
+    {
+        fail(job, (errno == ENOENT ? "File does not exist: " : "Could not open file: ") + job.filePath);
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0)
+    {
+        close(fd);
+        fail(job, "File is empty: " + job.filePath);
+        return false;
+    }
+
+    job.fd = fd;
+    job.fileSize = static_cast<uint64_t>(info.st_size);
+    job.blockCount = (job.fileSize + blockSize - 1) / blockSize;
+    job.written.assign(job.blockCount, 0);
+    job.sparse.build(fd, job.fileSize);
+    return true;
+}
+
+void AsyncEngine::fail(Job &job, const std::string &error)
+{
+    // The first error is the one reported
+    if (!job.failed)
+        job.error = error;
+    job.failed = true;
+}
+
+void AsyncEngine::settle(Job &job)
+{
+    // A cancelled job puts back what it wrote, as a cancelled run rolls back.
+    // A failed one is left as it is, like a failed run.
+    if (job.cancelled && !job.failed && !job.rollingBack && job.fd != -1 &&
+        std::find(job.written.begin(), job.written.end(), 1) != job.written.end())
+    {
+        job.rollingBack = true;
+        job.nextRollback = 0;
+        return;
+    }
+
+    if (job.fd != -1)
+        close(job.fd);
+    job.fd = -1;
+    active.erase(std::find(active.begin(), active.end(), &job));
+    byTicket.erase(job.ticket);
+    jobsDone++;
+    finished.push_back(&job);
+}
+
+void AsyncEngine::runCallbacks(std::vector<Job *> &jobs)
+{
+    for (Job *job : jobs)
+    {
+        if (job->done)
+        {
+            if (job->failed)
+                job->done(Outcome::FAILED, job->error);
+            else if (job->cancelled)
+                job->done(Outcome::CANCELLED, "");
+            else
+                job->done(Outcome::COMPLETED, "");
+        }
+        delete job;
+    }
+}
@@ -0,0 +1,193 @@
+#ifndef ASYNC_ENGINE_HPP
+#define ASYNC_ENGINE_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "BufferPool.hpp"
+#include "MemoryBudget.hpp"
+#include "SparseMap.hpp"
+#include "IoRing.hpp"
+
+class TaskManager;
+
+struct AsyncEngineStats
+{
+    uint64_t jobsDone = 0;
+    uint64_t blocksDone = 0;
+    uint64_t ioSubmitted = 0;
+    size_t pendingJobs = 0;
+    size_t activeJobs = 0;
+    size_t blocksInFlight = 0;
+};
+
+// Runs many in-place file jobs at once on a fixed set of executor threads
+// instead of a thread per job and per chunk.
+//
+// Every block of a job is a small resumable task, read -> transform -> write.
+// A task gives up its thread whenever it waits for I/O and is resumed on an
+// executor thread by the completion, so the executors only ever transform
+// and N cores serve any number of queued jobs. I/O goes through io_uring
+// where the kernel has it, otherwise through a few blocking I/O threads.
+//
+// Memory is bounded by the number of blocks in flight, not by the number of
+// jobs: a queued job is a path and a callback until a block slot frees up for
+// it, and jobs are fed in priority order, oldest first, so only a handful are
+// open at a time. That memory is reserved from the MemoryBudget while the
+// engine runs. Output is byte for byte what TaskManager::runWithThreads
+// gives, holes in sparse files included. A cancelled job puts back the
+// blocks it already wrote.
+class AsyncEngine
+{
+public:
+    enum class Outcome
+    {
+        COMPLETED,
+        CANCELLED,
+        FAILED
+    };
+    // Called once per job on an executor thread, never from submit or cancel
+    typedef std::function<void(Outcome outcome, const std::string &error)> DoneCallback;
+
+    // 0 executors means one per CPU; 0 blocks in flight means two per executor
+    AsyncEngine(size_t executorCount = 0, size_t maxInFlight = 0, size_t blockSize = 1024 * 1024);
+    ~AsyncEngine();
+    AsyncEngine(const AsyncEngine &) = delete;
+    AsyncEngine &operator=(const AsyncEngine &) = delete;
+
+    bool start();
+    // Drops queued jobs as CANCELLED, lets open ones finish, then joins
+    void stop();
+
+    // Queues filePath to be transformed in place with transformer's current
+    // technique, which has to outlive the job. Returns a ticket for cancel().
+    uint64_t submit(const std::string &filePath, bool isEncryption, TaskManager &transformer, uint8_t priority,
+                    DoneCallback done);
+    // False if the ticket is unknown or already finished
+    bool cancel(uint64_t ticket);
+
+    bool usesIoRing() const { return ring.isOpen(); }
+    size_t getExecutorCount() const { return executorCount; }
+    AsyncEngineStats getStats() const;
+    std::string getStatusMessage() const;
+
+private:
+    struct Job;
+    // One block of a job. Suspended while its read or write is in flight;
+    // step and transferred say where it resumes.
+    struct BlockTask
+    {
+        enum Step
+        {
+            READ,
+            WRITE
+        };
+
+        Job *job = nullptr;
+        bool forward = true; // false while putting a cancelled job back
+        uint64_t block = 0;
+        uint64_t offset = 0;
+        size_t size = 0;
+        PooledBuffer buffer;
+        std::vector<SparseMap::Extent> spans; // data to transform and write
+        Step step = READ;
+        size_t span = 0;        // span being written
+        size_t transferred = 0; // of the current read or span
+        int32_t result = 0;     // of the last completion
+
+        // Where the rest of the current read or write goes
+        char *ioBuffer(size_t &length, uint64_t &fileOffset);
+    };
+
+    struct Job
+    {
+        uint64_t ticket = 0;
+        uint8_t priority = 0;
+        uint64_t sequence = 0;
+        std::string filePath;
+        bool isEncryption = true;
+        TaskManager *transformer = nullptr;
+        DoneCallback done;
+
+        int fd = -1;
+        uint64_t fileSize = 0;
+        uint64_t blockCount = 0;
+        SparseMap sparse;
+        uint64_t nextBlock = 0;     // next block to issue
+        size_t inFlight = 0;
+        std::vector<uint8_t> written; // per block, for putting back on cancel
+        bool rollingBack = false;
+        uint64_t nextRollback = 0;
+        bool cancelled = false;
+        bool failed = false;
+        std::string error;
+    };
+
+    // Highest priority first, FIFO within the same priority
+    typedef std::pair<int, uint64_t> JobKey;
+
+    void executorLoop();
+    void reactorLoop();
+    void ioThreadLoop();
+
+    // Runs a task up to its next I/O, or to its end
+    void resume(BlockTask *task);
+    void submitIo(BlockTask *task);
+    void complete(BlockTask *task, int32_t result);
+    void finishBlock(BlockTask *task);
+    // Hands free block slots to jobs; the caller holds mutex
+    void fill(std::vector<BlockTask *> &issued);
+    // Skips blocks that need no I/O; true if the job has one left to issue
+    bool hasTask(Job &job);
+    BlockTask *nextTask(Job &job);
+    bool openJob(Job &job);
+    // Moves a job that has nothing left to do on to rollback or to done
+    void settle(Job &job);
+    void fail(Job &job, const std::string &error);
+    void runCallbacks(std::vector<Job *> &jobs);
+    void wakeReactor();
+
+    size_t executorCount;
+    size_t maxInFlight;
+    size_t blockSize;
+    std::atomic<bool> running;
+    bool stopping; // guarded by mutex
+    MemoryReservation reservation;
+    std::string statusMessage;
+
+    mutable std::mutex mutex;
+    std::condition_variable wake;
+    std::map<JobKey, Job *> pending; // not opened yet
+    std::vector<Job *> active;       // opened, in the order they were opened
+    std::map<uint64_t, Job *> byTicket;
+    std::deque<BlockTask *> ready;   // I/O done, waiting for an executor
+    std::vector<Job *> finished;     // waiting for their callback
+    size_t callbacksRunning;
+    size_t inFlight;
+    uint64_t nextTicket;
+    uint64_t nextSequence;
+    uint64_t jobsDone;
+    uint64_t blocksDone;
+    std::atomic<uint64_t> ioSubmitted;
+
+    // io_uring, fed through ioQueue; the reactor keeps a read of wakePipe
+    // in the ring so a write to it brings new work in
+    IoRing ring;
+    int wakePipe[2];
+    char wakeBuffer[64];
+    std::mutex ioMutex;
+    std::condition_variable ioWake; // for the fallback I/O threads
+    std::deque<BlockTask *> ioQueue;
+
+    std::vector<std::thread> executors;
+    std::vector<std::thread> ioThreads;
+};
+
+#endif
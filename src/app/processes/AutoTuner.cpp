@@ -0,0 +1,292 @@
+#include "AutoTuner.hpp"
+#include "TaskManager.hpp"
+#include "CpuTopology.hpp"
+#include "BufferPool.hpp"
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#ifdef __linux__
+#include <sys/sysmacros.h>
+#endif
+
+namespace
+{
+    const double MIB = 1024.0 * 1024.0;
+    // A worker should have at least this much kernel work to cover its start-up
+    const double MIN_WORKER_SECONDS = 0.005;
+    // Below this much total work a fork per worker costs more than the shared
+    // I/O lock of the thread path
+    const double PROCESS_MODE_SECONDS = 0.1;
+    const size_t ROTATIONAL_BLOCK_SIZE = 4 * 1024 * 1024;
+
+    std::string readFirstLine(const std::string &path)
+    {
+        std::ifstream in(path);
+        std::string line;
+        std::getline(in, line);
+        return line;
+    }
+
+    std::string hostName()
+    {
+        char name[256] = {};
+        if (gethostname(name, sizeof(name) - 1) != 0 || name[0] == '\0')
+            return "localhost";
+        return name;
+    }
+}
+
+AutoTuner &AutoTuner::shared()
+{
+    static AutoTuner tuner;
+    return tuner;
+}
+
+AutoTuner::AutoTuner() : cacheLoaded(false)
+{
+    const CpuTopology &topology = CpuTopology::host();
+    host.cores = topology.getCpus().size();
+    host.numaNodes = topology.getNodeCount();
+}
+
+HostProfile AutoTuner::getHostProfile()
+{
+    return host;
+}
+
+StorageKind AutoTuner::getStorageKind(const std::string &filePath) const
+{
+#ifdef __linux__
+    struct stat info;
+    if (stat(filePath.c_str(), &info) != 0)
+        return StorageKind::UNKNOWN;
+
+    // Partitions have no queue of their own; their parent disk does
+    std::string device = "/sys/dev/block/" + std::to_string(major(info.st_dev)) + ":" +
+                         std::to_string(minor(info.st_dev));
+    for (const char *queue : {"/queue/rotational", "/../queue/rotational"})
+    {
+        std::string value = readFirstLine(device + queue);
+        if (value == "1")
+            return StorageKind::ROTATIONAL;
+        if (value == "0")
+            return StorageKind::SOLID_STATE;
+    }
+#else
+    (void)filePath;
+#endif
+    return StorageKind::UNKNOWN;
+}
+
+std::string AutoTuner::getCachePath() const
+{
+    std::string base;
+    if (const char *cache = std::getenv("XDG_CACHE_HOME"))
+        base = cache;
+    else if (const char *home = std::getenv("HOME"))
+        base = std::string(home) + "/.cache";
+    else
+        base = "/tmp";
+    return base + "/cryptocore/calibration-" + hostName();
+}
+
+// Cache format, one entry per line:
+//   cores <n> | numa <n> | kernel <EncryptionType> <MB/s>
+// A file written for a different core or node count is ignored.
+void AutoTuner::loadCache()
+{
+    cacheLoaded = true;
+    std::ifstream in(getCachePath());
+    std::string line;
+    std::map<int, double> loaded;
+    size_t cores = 0;
+    size_t nodes = 0;
+    while (std::getline(in, line))
+    {
+        std::istringstream fields(line);
+        std::string key;
+        fields >> key;
+        if (key == "cores")
+            fields >> cores;
+        else if (key == "numa")
+            fields >> nodes;
+        else if (key == "kernel")
+        {
+            int type;
+            double mbps;
+            if (fields >> type >> mbps && mbps > 0)
+                loaded[type] = mbps;
+        }
+    }
+    if (cores == host.cores && nodes == host.numaNodes)
+        kernelMBps = loaded;
+}
+
+void AutoTuner::saveCache() const
+{
+    std::string path = getCachePath();
+    std::error_code error;
+    std::filesystem::create_directories(std::filesystem::path(path).parent_path(), error);
+
+    // Write then rename so concurrent runs never read a half-written file
+    std::string temp = path + "." + std::to_string(getpid());
+    {
+        std::ofstream out(temp, std::ios::trunc);
+        if (!out)
+            return;
+        out << "cores " << host.cores << "\n";
+        out << "numa " << host.numaNodes << "\n";
+        for (const auto &entry : kernelMBps)
+            out << "kernel " << entry.first << " " << entry.second << "\n";
+    }
+    std::filesystem::rename(temp, path, error);
+}
+
+double AutoTuner::getKernelThroughput(EncryptionTechnique &technique)
+{
+    std::lock_guard<std::mutex> lock(tunerMutex);
+    if (!cacheLoaded)
+        loadCache();
+
+    int type = static_cast<int>(technique.getType());
+    auto found = kernelMBps.find(type);
+    if (found != kernelMBps.end())
+        return found->second;
+
+    // Run the kernel the way workers do, one transform unit at a time, until
+    // the measurement is long enough to be stable
+    PooledBuffer buffer = BufferPool::shared().acquire(8 * 1024 * 1024);
+    for (size_t i = 0; i < buffer.size(); i++)
+        buffer.data()[i] = static_cast<char>(i * 131 + 7);
+
+    size_t bytes = 0;
+    auto start = std::chrono::steady_clock::now();
+    double seconds = 0.0;
+    while (seconds < 0.05)
+    {
+        for (size_t offset = 0; offset < buffer.size(); offset += TaskManager::TRANSFORM_UNIT)
+            technique.encryptChunk(buffer.data() + offset, TaskManager::TRANSFORM_UNIT);
+        bytes += buffer.size();
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    double mbps = bytes / MIB / seconds;
+    kernelMBps[type] = mbps;
+    saveCache();
+    return mbps;
+}
+
+TuningPlan AutoTuner::plan(const std::string &filePath, size_t fileSize, EncryptionTechnique &technique)
+{
+    TuningPlan result;
+    result.kernelMBps = getKernelThroughput(technique);
+    result.storage = getStorageKind(filePath);
+
+    // Only as many workers as there is work to amortize their start-up
+    double kernelSeconds = fileSize / MIB / result.kernelMBps;
+    size_t byWork = static_cast<size_t>(kernelSeconds / MIN_WORKER_SECONDS);
+    result.workers = std::min(std::max<size_t>(1, byWork), std::min(host.cores, MAX_WORKERS));
+
+    std::ostringstream reason;
+    reason << host.cores << " cores, " << host.numaNodes << " NUMA node(s), kernel "
+           << static_cast<long>(result.kernelMBps) << " MB/s per core";
+
+    // Parallel streams on a spinning disk turn sequential I/O into seeks
+    result.blockSize = TaskManager::DEFAULT_BLOCK_SIZE;
+    if (result.storage == StorageKind::ROTATIONAL)
+    {
+        result.workers = std::min<size_t>(result.workers, 2);
+        result.blockSize = ROTATIONAL_BLOCK_SIZE;
+        reason << ", rotational disk";
+    }
+    else if (result.storage == StorageKind::SOLID_STATE)
+    {
+        reason << ", solid-state storage";
+    }
+
+    // Keep several blocks per worker so progress and cancellation stay responsive
+    size_t share = (fileSize + result.workers - 1) / result.workers;
+    while (result.blockSize > TaskManager::TRANSFORM_UNIT && result.blockSize * 4 > share)
+        result.blockSize /= 2;
+
+    // Threads serialize their I/O on one lock; processes do not but pay for a
+    // fork each. Spreading over several NUMA nodes also favours processes,
+    // whose buffers are first touched on the node they run on.
+    result.useThreads = result.workers < 4 ||
+                        (kernelSeconds < PROCESS_MODE_SECONDS && host.numaNodes == 1);
+
+    reason << " -> " << result.workers << (result.useThreads ? " thread(s)" : " process(es)")
+           << ", " << result.blockSize / 1024 << " KiB blocks";
+    result.reason = reason.str();
+    return result;
+}
+
+std::vector<SweepResult> AutoTuner::sweep(const std::string &filePath, bool isEncryption,
+                                          const std::function<std::unique_ptr<EncryptionTechnique>()> &makeTechnique,
+                                          bool countPerf)
+{
+    std::vector<SweepResult> results;
+    std::error_code error;
+    std::string scratch = filePath + ".sweep";
+    if (!std::filesystem::copy_file(filePath, scratch, std::filesystem::copy_options::overwrite_existing, error))
+        return results;
+    size_t fileSize = std::filesystem::file_size(scratch, error);
+
+    std::vector<size_t> workerCounts;
+    for (size_t n = 1; n < host.cores && n < MAX_WORKERS; n *= 2)
+        workerCounts.push_back(n);
+    workerCounts.push_back(std::min(host.cores, MAX_WORKERS));
+    const size_t blockSizes[] = {256 * 1024, TaskManager::DEFAULT_BLOCK_SIZE, ROTATIONAL_BLOCK_SIZE};
+
+    TaskManager manager;
+    manager.setEncryptionTechnique(makeTechnique());
+    manager.setPerfCounters(countPerf);
+    for (bool threads : {true, false})
+    {
+        for (size_t workers : workerCounts)
+        {
+            for (size_t blockSize : blockSizes)
+            {
+                // Best of two runs hides one-off page cache and scheduling noise
+                manager.setBlockSize(blockSize);
+                double best = 0.0;
+                PerfSample perf;
+                for (int run = 0; run < 2; run++)
+                {
+                    auto start = std::chrono::steady_clock::now();
+                    bool ok = threads ? manager.runWithThreads(scratch, isEncryption, workers)
+                                      : manager.runWithProcesses(scratch, isEncryption, workers);
+                    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                    if (ok && (best == 0.0 || seconds < best))
+                    {
+                        best = seconds;
+                        perf = manager.getRunStats().perf;
+                    }
+                }
+                if (best > 0.0)
+                {
+                    SweepResult result;
+                    result.useThreads = threads;
+                    result.workers = workers;
+                    result.blockSize = blockSize;
+                    result.seconds = best;
+                    result.throughputMBps = fileSize / MIB / best;
+                    result.perf = perf;
+                    results.push_back(result);
+                }
+            }
+        }
+    }
+
+    std::filesystem::remove(scratch, error);
+    std::sort(results.begin(), results.end(), [](const SweepResult &a, const SweepResult &b)
+              { return a.seconds < b.seconds; });
+    return results;
+}
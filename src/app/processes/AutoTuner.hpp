@@ -0,0 +1,84 @@
+#ifndef AUTO_TUNER_HPP
+#define AUTO_TUNER_HPP
+
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "EncryptionTechnique.hpp"
+#include "PerfCounters.hpp"
+
+enum class StorageKind
+{
+    UNKNOWN,
+    SOLID_STATE,
+    ROTATIONAL
+};
+
+struct HostProfile
+{
+    size_t cores = 1;
+    size_t numaNodes = 1;
+};
+
+// Settings chosen for one file, with a short explanation for logs and the CLI
+struct TuningPlan
+{
+    bool useThreads = true;
+    size_t workers = 1;
+    size_t blockSize = 0;
+    double kernelMBps = 0.0; // single-core throughput of the technique
+    StorageKind storage = StorageKind::UNKNOWN;
+    std::string reason;
+};
+
+struct SweepResult
+{
+    bool useThreads;
+    size_t workers;
+    size_t blockSize;
+    double seconds;
+    double throughputMBps;
+    PerfSample perf; // of the faster run, when counted
+};
+
+// Picks execution mode, worker count and block size from the host's core and
+// NUMA layout, the storage behind the file and the measured per-core speed of
+// the technique. Kernel calibrations are cached per host on disk, so only the
+// first run of each technique on a machine pays for them.
+class AutoTuner
+{
+public:
+    // Process-wide instance shared by every TaskManager
+    static AutoTuner &shared();
+
+    HostProfile getHostProfile();
+    StorageKind getStorageKind(const std::string &filePath) const;
+    double getKernelThroughput(EncryptionTechnique &technique);
+    TuningPlan plan(const std::string &filePath, size_t fileSize, EncryptionTechnique &technique);
+
+    // Times every mode / worker count / block size combination on a scratch
+    // copy of filePath, fastest first, so a plan can be checked against the
+    // real optimum. countPerf adds the workers' hardware counters where the
+    // host has them.
+    std::vector<SweepResult> sweep(const std::string &filePath, bool isEncryption,
+                                   const std::function<std::unique_ptr<EncryptionTechnique>()> &makeTechnique,
+                                   bool countPerf = false);
+
+    std::string getCachePath() const;
+
+private:
+    AutoTuner();
+    void loadCache();
+    void saveCache() const;
+
+    std::mutex tunerMutex;
+    HostProfile host;
+    bool cacheLoaded;
+    std::map<int, double> kernelMBps; // keyed by EncryptionType
+};
+
+#endif
@@ -0,0 +1,179 @@
+#include "Blake3.hpp"
+#include <cstring>
+
+namespace
+{
+    const uint32_t IV[8] = {0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A,
+                            0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19};
+    // Message word order of each round: the identity, then the BLAKE3
+    // permutation {2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8} applied
+    // once more per round
+    const uint8_t SCHEDULE[7][16] = {
+        {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+        {2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8},
+        {3, 4, 10, 12, 13, 2, 7, 14, 6, 5, 9, 0, 11, 15, 8, 1},
+        {10, 7, 12, 9, 14, 3, 13, 15, 4, 0, 11, 2, 5, 8, 1, 6},
+        {12, 13, 9, 11, 15, 10, 14, 8, 7, 2, 5, 3, 0, 1, 6, 4},
+        {9, 14, 11, 5, 8, 12, 15, 1, 13, 3, 0, 10, 2, 6, 4, 7},
+        {11, 15, 5, 0, 1, 9, 8, 6, 14, 10, 2, 12, 3, 4, 7, 13}};
+
+    const uint32_t CHUNK_START = 1;
+    const uint32_t CHUNK_END = 2;
+    const uint32_t PARENT = 4;
+    const uint32_t ROOT = 8;
+    const size_t BLOCK_LEN = 64;
+
+    inline uint32_t rotr(uint32_t x, int n)
+    {
+        return (x >> n) | (x << (32 - n));
+    }
+
+    inline void g(uint32_t *s, int a, int b, int c, int d, uint32_t mx, uint32_t my)
+    {
+        s[a] = s[a] + s[b] + mx;
+        s[d] = rotr(s[d] ^ s[a], 16);
+        s[c] = s[c] + s[d];
+        s[b] = rotr(s[b] ^ s[c], 12);
+        s[a] = s[a] + s[b] + my;
+        s[d] = rotr(s[d] ^ s[a], 8);
+        s[c] = s[c] + s[d];
+        s[b] = rotr(s[b] ^ s[c], 7);
+    }
+
+    void compress(const uint32_t cv[8], const uint32_t block[16], uint64_t counter, uint32_t blockLen,
+                  uint32_t flags, uint32_t out[16])
+    {
+        uint32_t s[16] = {cv[0], cv[1], cv[2], cv[3], cv[4], cv[5], cv[6], cv[7],
+                          IV[0], IV[1], IV[2], IV[3],
+                          static_cast<uint32_t>(counter), static_cast<uint32_t>(counter >> 32), blockLen, flags};
+
+        for (int round = 0; round < 7; round++)
+        {
+            const uint8_t *w = SCHEDULE[round];
+            g(s, 0, 4, 8, 12, block[w[0]], block[w[1]]);
+            g(s, 1, 5, 9, 13, block[w[2]], block[w[3]]);
+            g(s, 2, 6, 10, 14, block[w[4]], block[w[5]]);
+            g(s, 3, 7, 11, 15, block[w[6]], block[w[7]]);
+            g(s, 0, 5, 10, 15, block[w[8]], block[w[9]]);
+            g(s, 1, 6, 11, 12, block[w[10]], block[w[11]]);
+            g(s, 2, 7, 8, 13, block[w[12]], block[w[13]]);
+            g(s, 3, 4, 9, 14, block[w[14]], block[w[15]]);
+        }
+
+        for (int i = 0; i < 8; i++)
+        {
+            out[i] = s[i] ^ s[i + 8];
+            out[i + 8] = s[i + 8] ^ cv[i];
+        }
+    }
+
+    void loadBlock(const char *data, size_t size, uint32_t block[16])
+    {
+        uint8_t bytes[BLOCK_LEN] = {};
+        std::memcpy(bytes, data, size);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        std::memcpy(block, bytes, BLOCK_LEN);
+#else
+        for (int i = 0; i < 16; i++)
+        {
+            block[i] = static_cast<uint32_t>(bytes[4 * i]) | static_cast<uint32_t>(bytes[4 * i + 1]) << 8 |
+                       static_cast<uint32_t>(bytes[4 * i + 2]) << 16 | static_cast<uint32_t>(bytes[4 * i + 3]) << 24;
+        }
+#endif
+    }
+
+    // Every block but the last is compressed; the last one stays open so the
+    // caller can finalize it as a chaining value or as the root
+    Blake3::Output chunkOutput(const char *data, size_t size, uint64_t counter)
+    {
+        Blake3::Output output;
+        std::memcpy(output.cv, IV, sizeof(IV));
+        output.counter = counter;
+
+        uint32_t flags = CHUNK_START;
+        while (size > BLOCK_LEN)
+        {
+            uint32_t block[16];
+            uint32_t out[16];
+            loadBlock(data, BLOCK_LEN, block);
+            compress(output.cv, block, counter, BLOCK_LEN, flags, out);
+            std::memcpy(output.cv, out, sizeof(output.cv));
+            data += BLOCK_LEN;
+            size -= BLOCK_LEN;
+            flags = 0;
+        }
+
+        loadBlock(data, size, output.block);
+        output.blockLen = static_cast<uint32_t>(size);
+        output.flags = flags | CHUNK_END;
+        return output;
+    }
+}
+
+void Blake3::Output::chainingValue(uint32_t out[8]) const
+{
+    uint32_t words[16];
+    compress(cv, block, counter, blockLen, flags, words);
+    std::memcpy(out, words, 8 * sizeof(uint32_t));
+}
+
+void Blake3::Output::rootDigest(uint8_t out[DIGEST_LEN]) const
+{
+    uint32_t words[16];
+    compress(cv, block, 0, blockLen, flags | ROOT, words);
+    for (size_t i = 0; i < DIGEST_LEN; i++)
+        out[i] = static_cast<uint8_t>(words[i / 4] >> (8 * (i % 4)));
+}
+
+uint64_t Blake3::leftSubtreeChunks(uint64_t chunks)
+{
+    uint64_t left = 1;
+    while (left * 2 < chunks)
+        left *= 2;
+    return left;
+}
+
+Blake3::Output Blake3::subtree(const char *data, size_t size, uint64_t firstChunk)
+{
+    if (size <= CHUNK_LEN)
+        return chunkOutput(data, size, firstChunk);
+
+    uint64_t chunks = (size + CHUNK_LEN - 1) / CHUNK_LEN;
+    size_t leftSize = leftSubtreeChunks(chunks) * CHUNK_LEN;
+    uint32_t left[8];
+    uint32_t right[8];
+    subtree(data, leftSize, firstChunk).chainingValue(left);
+    subtree(data + leftSize, size - leftSize, firstChunk + leftSize / CHUNK_LEN).chainingValue(right);
+    return parent(left, right);
+}
+
+Blake3::Output Blake3::parent(const uint32_t left[8], const uint32_t right[8])
+{
+    Output output;
+    std::memcpy(output.cv, IV, sizeof(IV));
+    std::memcpy(output.block, left, 8 * sizeof(uint32_t));
+    std::memcpy(output.block + 8, right, 8 * sizeof(uint32_t));
+    output.counter = 0;
+    output.blockLen = BLOCK_LEN;
+    output.flags = PARENT;
+    return output;
+}
+
+std::string Blake3::hash(const char *data, size_t size)
+{
+    uint8_t digest[DIGEST_LEN];
+    subtree(data, size, 0).rootDigest(digest);
+    return toHex(digest);
+}
+
+std::string Blake3::toHex(const uint8_t digest[DIGEST_LEN])
+{
+    static const char digits[] = "0123456789abcdef";
+    std::string hex;
+    for (size_t i = 0; i < DIGEST_LEN; i++)
+    {
+        hex += digits[digest[i] >> 4];
+        hex += digits[digest[i] & 15];
+    }
+    return hex;
+}
@@ -0,0 +1,47 @@
+#ifndef BLAKE3_HPP
+#define BLAKE3_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// BLAKE3 (unkeyed, 32-byte output), portable implementation.
+//
+// BLAKE3 hashes 1 KiB chunks independently and joins them in a binary tree,
+// so any aligned run of a power-of-two number of chunks hashes on its own to
+// a subtree chaining value. Workers hash their blocks that way while the data
+// is in cache and the run joins the values afterwards; the result is the same
+// digest b3sum prints for the whole file.
+class Blake3
+{
+public:
+    static const size_t CHUNK_LEN = 1024;
+    static const size_t DIGEST_LEN = 32;
+
+    // A node that has not been finalized yet: it becomes a chaining value for
+    // its parent, or the digest if it is the root
+    struct Output
+    {
+        uint32_t cv[8];
+        uint32_t block[16];
+        uint64_t counter;
+        uint32_t blockLen;
+        uint32_t flags;
+
+        void chainingValue(uint32_t out[8]) const;
+        void rootDigest(uint8_t out[DIGEST_LEN]) const;
+    };
+
+    // Hashes size bytes starting at chunk firstChunk of the input. size must
+    // be a power-of-two number of chunks, or the input must end within it.
+    static Output subtree(const char *data, size_t size, uint64_t firstChunk);
+    static Output parent(const uint32_t left[8], const uint32_t right[8]);
+    // Digest of a whole buffer
+    static std::string hash(const char *data, size_t size);
+    static std::string toHex(const uint8_t digest[DIGEST_LEN]);
+    // Largest power of two strictly below n, for n > 1: the chunk count of a
+    // left subtree
+    static uint64_t leftSubtreeChunks(uint64_t chunks);
+};
+
+#endif
@@ -0,0 +1,186 @@
+#include "BlockCodec.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+    const int HASH_LOG = 14;
+    const size_t MIN_MATCH = 4;
+    const size_t MAX_OFFSET = 65535;
+    // Format rules: the last match starts at least 12 bytes before the end
+    // and the last 5 bytes are always literals
+    const size_t MATCH_LIMIT = 12;
+    const size_t LAST_LITERALS = 5;
+
+    uint32_t read32(const unsigned char *p)
+    {
+        uint32_t v;
+        std::memcpy(&v, p, 4);
+        return v;
+    }
+
+    uint32_t hashOf(uint32_t sequence)
+    {
+        return (sequence * 2654435761U) >> (32 - HASH_LOG);
+    }
+
+    // Writes the 255-run extension of a length whose nibble was saturated
+    bool putLength(unsigned char *&op, unsigned char *oend, size_t length)
+    {
+        while (length >= 255)
+        {
+            if (op >= oend)
+                return false;
+            *op++ = 255;
+            length -= 255;
+        }
+        if (op >= oend)
+            return false;
+        *op++ = static_cast<unsigned char>(length);
+        return true;
+    }
+
+    bool getLength(const unsigned char *&ip, const unsigned char *iend, size_t &length)
+    {
+        unsigned char byte;
+        do
+        {
+            if (ip >= iend)
+                return false;
+            byte = *ip++;
+            length += byte;
+        } while (byte == 255);
+        return true;
+    }
+
+    bool putSequence(unsigned char *&op, unsigned char *oend, const unsigned char *literals, size_t literalLength,
+                     size_t offset, size_t matchLength)
+    {
+        if (op >= oend)
+            return false;
+        unsigned char *token = op++;
+        *token = static_cast<unsigned char>(std::min<size_t>(literalLength, 15) << 4);
+        if (literalLength >= 15 && !putLength(op, oend, literalLength - 15))
+            return false;
+        if (literalLength > static_cast<size_t>(oend - op))
+            return false;
+        if (literalLength > 0)
+            std::memcpy(op, literals, literalLength);
+        op += literalLength;
+
+        // The closing sequence has literals only
+        if (matchLength == 0)
+            return true;
+        if (oend - op < 2)
+            return false;
+        *op++ = static_cast<unsigned char>(offset & 0xFF);
+        *op++ = static_cast<unsigned char>(offset >> 8);
+        size_t code = matchLength - MIN_MATCH;
+        *token |= static_cast<unsigned char>(std::min<size_t>(code, 15));
+        return code < 15 || putLength(op, oend, code - 15);
+    }
+}
+
+size_t BlockCodec::compress(const char *source, size_t size, char *destination, size_t capacity)
+{
+    const unsigned char *src = reinterpret_cast<const unsigned char *>(source);
+    const unsigned char *end = src + size;
+    const unsigned char *anchor = src;
+    unsigned char *op = reinterpret_cast<unsigned char *>(destination);
+    unsigned char *oend = op + capacity;
+
+    if (size > MATCH_LIMIT)
+    {
+        uint32_t table[1 << HASH_LOG] = {};
+        const unsigned char *matchLimit = end - MATCH_LIMIT;
+        const unsigned char *ip = src + 1;
+
+        while (ip < matchLimit)
+        {
+            uint32_t sequence = read32(ip);
+            uint32_t &slot = table[hashOf(sequence)];
+            const unsigned char *ref = src + slot;
+            slot = static_cast<uint32_t>(ip - src);
+
+            if (ref >= ip || static_cast<size_t>(ip - ref) > MAX_OFFSET || read32(ref) != sequence)
+            {
+                // Step faster through data that keeps missing
+                ip += 1 + ((ip - anchor) >> 6);
+                continue;
+            }
+
+            while (ip > anchor && ref > src && ip[-1] == ref[-1])
+            {
+                ip--;
+                ref--;
+            }
+            size_t length = MIN_MATCH;
+            while (ip + length < end - LAST_LITERALS && ip[length] == ref[length])
+                length++;
+
+            if (!putSequence(op, oend, anchor, ip - anchor, ip - ref, length))
+                return 0;
+            ip += length;
+            anchor = ip;
+            if (ip < matchLimit)
+                table[hashOf(read32(ip - 2))] = static_cast<uint32_t>(ip - 2 - src);
+        }
+    }
+
+    if (!putSequence(op, oend, anchor, end - anchor, 0, 0))
+        return 0;
+    return op - reinterpret_cast<unsigned char *>(destination);
+}
+
+bool BlockCodec::decompress(const char *source, size_t size, char *destination, size_t expected)
+{
+    const unsigned char *ip = reinterpret_cast<const unsigned char *>(source);
+    const unsigned char *iend = ip + size;
+    unsigned char *dst = reinterpret_cast<unsigned char *>(destination);
+    unsigned char *op = dst;
+    unsigned char *oend = dst + expected;
+
+    // The input is untrusted: every length and offset is checked before use
+    while (ip < iend)
+    {
+        unsigned char token = *ip++;
+        size_t literalLength = token >> 4;
+        if (literalLength == 15 && !getLength(ip, iend, literalLength))
+            return false;
+        if (literalLength > static_cast<size_t>(iend - ip) || literalLength > static_cast<size_t>(oend - op))
+            return false;
+        if (literalLength > 0)
+            std::memcpy(op, ip, literalLength);
+        op += literalLength;
+        ip += literalLength;
+        if (ip == iend)
+            return op == oend;
+
+        if (iend - ip < 2)
+            return false;
+        size_t offset = ip[0] | (static_cast<size_t>(ip[1]) << 8);
+        ip += 2;
+        if (offset == 0 || offset > static_cast<size_t>(op - dst))
+            return false;
+        size_t matchLength = token & 15;
+        if (matchLength == 15 && !getLength(ip, iend, matchLength))
+            return false;
+        matchLength += MIN_MATCH;
+        if (matchLength > static_cast<size_t>(oend - op))
+            return false;
+
+        const unsigned char *match = op - offset;
+        if (offset >= matchLength)
+        {
+            std::memcpy(op, match, matchLength);
+            op += matchLength;
+        }
+        else
+        {
+            // Overlapping copy repeats the last offset bytes
+            for (size_t i = 0; i < matchLength; i++)
+                *op++ = match[i];
+        }
+    }
+    return false;
+}
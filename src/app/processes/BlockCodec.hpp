@@ -0,0 +1,25 @@
+#ifndef BLOCK_CODEC_HPP
+#define BLOCK_CODEC_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+// Fast LZ77 compressor writing the LZ4 block format, so compressed chunks can
+// also be read by any standard LZ4 block decoder. Every call is independent,
+// which lets workers compress and decompress chunks in parallel and in any
+// order. Thread-safe; the match table lives on the caller's stack.
+class BlockCodec
+{
+public:
+    // Worst case size of incompressible input
+    static size_t maxCompressedSize(size_t size) { return size + size / 255 + 16; }
+
+    // Compresses src into dst. Returns the compressed size, or 0 if it would
+    // not be smaller than capacity (callers then store the chunk as it is).
+    static size_t compress(const char *src, size_t size, char *dst, size_t capacity);
+    // Decompresses exactly expected bytes into dst. Returns false on input that
+    // is malformed or does not decode to exactly expected bytes.
+    static bool decompress(const char *src, size_t size, char *dst, size_t expected);
+};
+
+#endif
@@ -0,0 +1,103 @@
+#include "BlockManifest.hpp"
+#include "BinaryIO.hpp"
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+std::string BlockManifest::pathFor(const std::string &outputPath)
+{
+    return outputPath + ".ccmanifest";
+}
+
+bool BlockManifest::stampOf(const std::string &path, uint64_t &size, int64_t &mtime)
+{
+    std::error_code error;
+    size = std::filesystem::file_size(path, error);
+    if (error)
+        return false;
+    auto written = std::filesystem::last_write_time(path, error);
+    if (error)
+        return false;
+    mtime = static_cast<int64_t>(written.time_since_epoch().count());
+    return true;
+}
+
+void BlockManifest::digestBlock(const char *data, size_t size, uint8_t out[DIGEST_LEN])
+{
+    Blake3::subtree(data, size, 0).rootDigest(out);
+}
+
+void BlockManifest::reset(uint8_t techniqueType, uint64_t blockBytes, uint64_t sourceBytes)
+{
+    technique = techniqueType;
+    blockSize = blockBytes;
+    sourceSize = sourceBytes;
+    sourceMtime = 0;
+    outputSize = 0;
+    outputMtime = 0;
+    digests.assign(blockCount() * DIGEST_LEN, 0);
+}
+
+uint64_t BlockManifest::blockCount() const
+{
+    return blockSize == 0 ? 0 : (sourceSize + blockSize - 1) / blockSize;
+}
+
+uint8_t *BlockManifest::digest(uint64_t block)
+{
+    return digests.data() + block * DIGEST_LEN;
+}
+
+const uint8_t *BlockManifest::digest(uint64_t block) const
+{
+    return digests.data() + block * DIGEST_LEN;
+}
+
+bool BlockManifest::load(const std::string &outputPath)
+{
+    std::ifstream in(pathFor(outputPath), std::ios::binary);
+    char header[HEADER_SIZE];
+    if (!in.read(header, HEADER_SIZE) || loadLE32(header) != MAGIC || loadLE32(header + 4) != VERSION)
+        return false;
+
+    technique = static_cast<uint8_t>(header[8]);
+    blockSize = loadLE64(header + 16);
+    sourceSize = loadLE64(header + 24);
+    sourceMtime = static_cast<int64_t>(loadLE64(header + 32));
+    outputSize = loadLE64(header + 40);
+    outputMtime = static_cast<int64_t>(loadLE64(header + 48));
+    std::memcpy(keyCheck, header + 56, DIGEST_LEN);
+    if (blockSize == 0)
+        return false;
+
+    digests.resize(blockCount() * DIGEST_LEN);
+    in.read(reinterpret_cast<char *>(digests.data()), static_cast<std::streamsize>(digests.size()));
+    return static_cast<bool>(in);
+}
+
+bool BlockManifest::save(const std::string &outputPath) const
+{
+    char header[HEADER_SIZE] = {};
+    storeLE32(header, MAGIC);
+    storeLE32(header + 4, VERSION);
+    header[8] = static_cast<char>(technique);
+    storeLE64(header + 16, blockSize);
+    storeLE64(header + 24, sourceSize);
+    storeLE64(header + 32, static_cast<uint64_t>(sourceMtime));
+    storeLE64(header + 40, outputSize);
+    storeLE64(header + 48, static_cast<uint64_t>(outputMtime));
+    std::memcpy(header + 56, keyCheck, DIGEST_LEN);
+
+    // Write then rename so a refresh never reads half a manifest
+    std::string path = pathFor(outputPath);
+    std::string temp = path + ".tmp";
+    {
+        std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+        out.write(header, HEADER_SIZE);
+        out.write(reinterpret_cast<const char *>(digests.data()), static_cast<std::streamsize>(digests.size()));
+        if (!out)
+            return false;
+    }
+    return std::rename(temp.c_str(), path.c_str()) == 0;
+}
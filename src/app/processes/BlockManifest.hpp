@@ -0,0 +1,54 @@
+#ifndef BLOCK_MANIFEST_HPP
+#define BLOCK_MANIFEST_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Blake3.hpp"
+
+// What an incrementally refreshed output was made from, kept next to it as
+// <output>.ccmanifest: the technique, a check value of its key and the block
+// size, the size and modification time of the source and of the output, and a
+// BLAKE3 digest of every plaintext block. A later refresh rewrites only the blocks whose
+// digest changed, and skips the source entirely when its stamp is the same.
+//
+// Layout (little-endian):
+//   header (64 bytes) | 32 byte digest per block
+//
+// The manifest is replaced by rename after the output has been synced. A block
+// whose digest is all zeroes is unknown and always rewritten.
+struct BlockManifest
+{
+    static const uint32_t MAGIC = 0x314D4343; // "CCM1" on disk
+    static const uint32_t VERSION = 2;
+    static const size_t HEADER_SIZE = 96;
+    static const size_t DIGEST_LEN = Blake3::DIGEST_LEN;
+
+    uint8_t technique = 0;
+    // Digest of what the technique makes of a unit of zeros, so an output
+    // written under another key is never patched under this one
+    uint8_t keyCheck[DIGEST_LEN] = {};
+    uint64_t blockSize = 0;
+    uint64_t sourceSize = 0;
+    int64_t sourceMtime = 0; // 0 when the last refresh did not finish
+    uint64_t outputSize = 0;
+    int64_t outputMtime = 0;
+    std::vector<uint8_t> digests;
+
+    static std::string pathFor(const std::string &outputPath);
+    // Size and modification time of a file; false if it cannot be found
+    static bool stampOf(const std::string &path, uint64_t &size, int64_t &mtime);
+    static void digestBlock(const char *data, size_t size, uint8_t out[DIGEST_LEN]);
+
+    // Empty manifest for a source of sourceSize bytes, every block unknown
+    void reset(uint8_t techniqueType, uint64_t blockBytes, uint64_t sourceBytes);
+    uint64_t blockCount() const;
+    uint8_t *digest(uint64_t block);
+    const uint8_t *digest(uint64_t block) const;
+
+    bool load(const std::string &outputPath);
+    bool save(const std::string &outputPath) const;
+};
+
+#endif
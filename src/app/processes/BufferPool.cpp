@@ -0,0 +1,241 @@
+#include "BufferPool.hpp"
+#include "CpuTopology.hpp"
+#include <sys/mman.h>
+#include <pthread.h>
+#include <stdexcept>
+
+namespace
+{
+    // Buffers released while other thread_locals are torn down must bypass
+    // the cache, which may already be gone
+    thread_local bool threadCacheDestroyed = false;
+}
+
+// Buffers a thread released recently, handed out again without any locking
+struct BufferPool::ThreadCache
+{
+    std::vector<FreeBuffer> entries;
+
+    ~ThreadCache()
+    {
+        threadCacheDestroyed = true;
+        for (const FreeBuffer &entry : entries)
+            BufferPool::shared().release(entry.bytes, entry.capacity, entry.node);
+    }
+};
+
+BufferPool::ThreadCache *BufferPool::localCache()
+{
+    if (threadCacheDestroyed)
+        return nullptr;
+    static thread_local ThreadCache cache;
+    return &cache;
+}
+
+BufferPool &BufferPool::shared()
+{
+    // Never destroyed, so buffers released by late thread exits stay valid
+    static BufferPool *pool = new BufferPool();
+    return *pool;
+}
+
+BufferPool::BufferPool()
+    : cachedBytes(0), acquires(0), threadCacheHits(0), sharedHits(0), freshMappings(0),
+      hugePageMappings(0), bytesMapped(0), bytesInUse(0), peakBytesInUse(0)
+{
+    // Process-mode workers fork; never let a child inherit the lock held
+    pthread_atfork(lockForFork, unlockAfterFork, unlockAfterFork);
+}
+
+void BufferPool::lockForFork()
+{
+    shared().poolMutex.lock();
+}
+
+void BufferPool::unlockAfterFork()
+{
+    shared().poolMutex.unlock();
+}
+
+size_t BufferPool::classSize(size_t size)
+{
+    size_t capacity = MIN_CLASS_SIZE;
+    while (capacity < size)
+        capacity <<= 1;
+    return capacity;
+}
+
+PooledBuffer BufferPool::acquire(size_t size, int node)
+{
+    acquires.fetch_add(1, std::memory_order_relaxed);
+    if (size == 0)
+        return PooledBuffer();
+
+    size_t capacity = classSize(size);
+    char *bytes = nullptr;
+
+    ThreadCache *cache = localCache();
+    for (size_t i = 0; cache && i < cache->entries.size(); i++)
+    {
+        if (cache->entries[i].capacity == capacity && cache->entries[i].node == node)
+        {
+            bytes = cache->entries[i].bytes;
+            cache->entries.erase(cache->entries.begin() + i);
+            threadCacheHits.fetch_add(1, std::memory_order_relaxed);
+            break;
+        }
+    }
+
+    if (!bytes)
+    {
+        std::lock_guard<std::mutex> lock(poolMutex);
+        for (size_t i = 0; i < freeBuffers.size(); i++)
+        {
+            if (freeBuffers[i].capacity == capacity && freeBuffers[i].node == node)
+            {
+                bytes = freeBuffers[i].bytes;
+                freeBuffers[i] = freeBuffers.back();
+                freeBuffers.pop_back();
+                cachedBytes -= capacity;
+                sharedHits.fetch_add(1, std::memory_order_relaxed);
+                break;
+            }
+        }
+    }
+
+    if (!bytes)
+    {
+        bytes = mapBuffer(capacity, node);
+    }
+
+    uint64_t inUse = bytesInUse.fetch_add(capacity, std::memory_order_relaxed) + capacity;
+    uint64_t peak = peakBytesInUse.load(std::memory_order_relaxed);
+    while (inUse > peak && !peakBytesInUse.compare_exchange_weak(peak, inUse, std::memory_order_relaxed))
+    {
+    }
+    return PooledBuffer(bytes, size, capacity, node);
+}
+
+char *BufferPool::mapBuffer(size_t capacity, int node)
+{
+    void *memory = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    // Explicit huge pages only exist if the administrator reserved some
+    if (capacity >= HUGE_PAGE_SIZE && capacity % HUGE_PAGE_SIZE == 0)
+    {
+        memory = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (memory != MAP_FAILED)
+            hugePageMappings.fetch_add(1, std::memory_order_relaxed);
+    }
+#endif
+    if (memory == MAP_FAILED)
+    {
+        memory = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED)
+            throw std::runtime_error("Failed to map pooled buffer");
+#ifdef MADV_HUGEPAGE
+        // Otherwise ask for transparent huge pages
+        if (capacity >= HUGE_PAGE_SIZE)
+            madvise(memory, capacity, MADV_HUGEPAGE);
+#endif
+    }
+
+    char *bytes = static_cast<char *>(memory);
+    if (node >= 0)
+    {
+        CpuTopology::bindMemory(bytes, capacity, node);
+        // Fault the pages in from the caller, which runs on that node
+        for (size_t offset = 0; offset < capacity; offset += MIN_CLASS_SIZE)
+            bytes[offset] = 0;
+    }
+
+    freshMappings.fetch_add(1, std::memory_order_relaxed);
+    bytesMapped.fetch_add(capacity, std::memory_order_relaxed);
+    return bytes;
+}
+
+void BufferPool::unmapBuffer(char *bytes, size_t capacity)
+{
+    munmap(bytes, capacity);
+    bytesMapped.fetch_sub(capacity, std::memory_order_relaxed);
+}
+
+void BufferPool::recycle(char *bytes, size_t capacity, int node)
+{
+    bytesInUse.fetch_sub(capacity, std::memory_order_relaxed);
+    ThreadCache *cache = localCache();
+    if (cache && cache->entries.size() < THREAD_CACHE_ENTRIES)
+    {
+        cache->entries.push_back({bytes, capacity, node});
+        return;
+    }
+    release(bytes, capacity, node);
+}
+
+void BufferPool::release(char *bytes, size_t capacity, int node)
+{
+    std::lock_guard<std::mutex> lock(poolMutex);
+    if (cachedBytes + capacity > MAX_CACHED_BYTES)
+    {
+        unmapBuffer(bytes, capacity);
+        return;
+    }
+    freeBuffers.push_back({bytes, capacity, node});
+    cachedBytes += capacity;
+}
+
+void BufferPool::trim()
+{
+    std::lock_guard<std::mutex> lock(poolMutex);
+    for (const FreeBuffer &entry : freeBuffers)
+        unmapBuffer(entry.bytes, entry.capacity);
+    freeBuffers.clear();
+    cachedBytes = 0;
+}
+
+BufferPoolStats BufferPool::getStats() const
+{
+    BufferPoolStats stats;
+    stats.acquires = acquires.load(std::memory_order_relaxed);
+    stats.threadCacheHits = threadCacheHits.load(std::memory_order_relaxed);
+    stats.sharedHits = sharedHits.load(std::memory_order_relaxed);
+    stats.freshMappings = freshMappings.load(std::memory_order_relaxed);
+    stats.hugePageMappings = hugePageMappings.load(std::memory_order_relaxed);
+    stats.bytesMapped = bytesMapped.load(std::memory_order_relaxed);
+    stats.bytesInUse = bytesInUse.load(std::memory_order_relaxed);
+    stats.peakBytesInUse = peakBytesInUse.load(std::memory_order_relaxed);
+    return stats;
+}
+
+PooledBuffer::PooledBuffer(PooledBuffer &&other) noexcept
+    : bytes(other.bytes), length(other.length), capacity(other.capacity), node(other.node)
+{
+    other.bytes = nullptr;
+}
+
+PooledBuffer &PooledBuffer::operator=(PooledBuffer &&other) noexcept
+{
+    if (this != &other)
+    {
+        release();
+        bytes = other.bytes;
+        length = other.length;
+        capacity = other.capacity;
+        node = other.node;
+        other.bytes = nullptr;
+    }
+    return *this;
+}
+
+PooledBuffer::~PooledBuffer()
+{
+    release();
+}
+
+void PooledBuffer::release()
+{
+    if (!bytes)
+        return;
+    BufferPool::shared().recycle(bytes, capacity, node);
+    bytes = nullptr;
+}
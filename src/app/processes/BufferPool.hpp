@@ -0,0 +1,112 @@
+#ifndef BUFFER_POOL_HPP
+#define BUFFER_POOL_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+struct BufferPoolStats
+{
+    uint64_t acquires = 0;
+    uint64_t threadCacheHits = 0; // served from the calling thread's cache
+    uint64_t sharedHits = 0;      // served from the process-wide free lists
+    uint64_t freshMappings = 0;   // had to map new memory
+    uint64_t hugePageMappings = 0;
+    uint64_t bytesMapped = 0;     // currently mapped, in use or cached
+    uint64_t bytesInUse = 0;
+    uint64_t peakBytesInUse = 0;
+};
+
+class BufferPool;
+
+// A pooled buffer, returned to the pool when destroyed. Contents are not
+// cleared between uses.
+class PooledBuffer
+{
+public:
+    PooledBuffer() : bytes(nullptr), length(0), capacity(0), node(-1) {}
+    PooledBuffer(PooledBuffer &&other) noexcept;
+    PooledBuffer &operator=(PooledBuffer &&other) noexcept;
+    PooledBuffer(const PooledBuffer &) = delete;
+    PooledBuffer &operator=(const PooledBuffer &) = delete;
+    ~PooledBuffer();
+
+    char *data() { return bytes; }
+    const char *data() const { return bytes; }
+    size_t size() const { return length; }
+
+private:
+    friend class BufferPool;
+    PooledBuffer(char *bytes, size_t length, size_t capacity, int node)
+        : bytes(bytes), length(length), capacity(capacity), node(node) {}
+    void release();
+
+    char *bytes;
+    size_t length;
+    size_t capacity;
+    int node;
+};
+
+// Process-wide pool of page-aligned buffers in power-of-two size classes,
+// so repeated jobs reuse memory that is already faulted in instead of paying
+// for page faults and zeroing on every chunk. Each thread keeps a few buffers
+// of its own in front of the shared, locked free lists. Buffers of 2 MiB and
+// up are backed by huge pages where the OS has them. Buffers requested for a
+// NUMA node are bound to it and are only reused on that node.
+class BufferPool
+{
+public:
+    static const size_t MIN_CLASS_SIZE = 4096;
+    static const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+    static const size_t THREAD_CACHE_ENTRIES = 4;
+    static const uint64_t MAX_CACHED_BYTES = 256ULL * 1024 * 1024;
+
+    static BufferPool &shared();
+
+    PooledBuffer acquire(size_t size, int node = -1);
+    // Capacity a request of size bytes is served with
+    static size_t classSize(size_t size);
+    BufferPoolStats getStats() const;
+    // Unmaps every cached buffer that is not in use
+    void trim();
+
+private:
+    friend class PooledBuffer;
+
+    struct FreeBuffer
+    {
+        char *bytes;
+        size_t capacity;
+        int node;
+    };
+
+    struct ThreadCache;
+
+    BufferPool();
+    static ThreadCache *localCache();
+    // Called by PooledBuffer: thread cache first, then the shared free lists
+    void recycle(char *bytes, size_t capacity, int node);
+    void release(char *bytes, size_t capacity, int node);
+    char *mapBuffer(size_t capacity, int node);
+    void unmapBuffer(char *bytes, size_t capacity);
+
+    static void lockForFork();
+    static void unlockAfterFork();
+
+    std::mutex poolMutex;
+    std::vector<FreeBuffer> freeBuffers; // guarded by poolMutex
+    uint64_t cachedBytes;                // guarded by poolMutex
+
+    std::atomic<uint64_t> acquires;
+    std::atomic<uint64_t> threadCacheHits;
+    std::atomic<uint64_t> sharedHits;
+    std::atomic<uint64_t> freshMappings;
+    std::atomic<uint64_t> hugePageMappings;
+    std::atomic<uint64_t> bytesMapped;
+    std::atomic<uint64_t> bytesInUse;
+    std::atomic<uint64_t> peakBytesInUse;
+};
+
+#endif
@@ -0,0 +1,320 @@
+#include "CheckpointJournal.hpp"
+#include "JobProgress.hpp"
+#include "BufferPool.hpp"
+#include "BinaryIO.hpp"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <random>
+#include <vector>
+
+namespace
+{
+    const size_t SHARED_HEADER = 64; // keeps the bitmap off the control cache line
+}
+
+CheckpointJournal::CheckpointJournal()
+    : journalFd(-1), dataFd(-1), technique(0), rekeyTag(0), isEncryption(true), resumed(false), nonce(0),
+      fileSize(0), blockSize(0), blockCount(0), wordCount(0), sharedBytes(0), shared(nullptr)
+{
+}
+
+CheckpointJournal::~CheckpointJournal()
+{
+    close();
+}
+
+std::string CheckpointJournal::journalPathFor(const std::string &filePath)
+{
+    return filePath + ".ccjournal";
+}
+
+bool CheckpointJournal::open(const std::string &filePath, uint8_t techniqueType, bool encrypt,
+                             uint64_t size, uint64_t requestedBlockSize, int sourceTechnique)
+{
+    close();
+    journalPath = journalPathFor(filePath);
+    technique = techniqueType;
+    rekeyTag = static_cast<uint8_t>(sourceTechnique + 1);
+    isEncryption = encrypt;
+    fileSize = size;
+    resumed = false;
+
+    dataFd = ::open(filePath.c_str(), O_RDONLY);
+    journalFd = ::open(journalPath.c_str(), O_RDWR | O_CREAT, 0600);
+    if (dataFd < 0 || journalFd < 0)
+    {
+        statusMessage = "Could not open checkpoint journal " + journalPath + ": " + std::strerror(errno);
+        close();
+        return false;
+    }
+
+    struct stat info;
+    fstat(journalFd, &info);
+    if (info.st_size > 0)
+    {
+        char header[HEADER_SIZE];
+        if (static_cast<size_t>(info.st_size) < HEADER_SIZE || !readFully(journalFd, header, HEADER_SIZE, 0) ||
+            loadLE32(header) != MAGIC || loadLE32(header + 4) != VERSION)
+        {
+            statusMessage = journalPath + " is not a CryptoCore checkpoint journal";
+            close();
+            return false;
+        }
+        if (static_cast<uint8_t>(header[8]) != technique || (header[9] != 0) != isEncryption ||
+            static_cast<uint8_t>(header[10]) != rekeyTag || loadLE64(header + 24) != fileSize)
+        {
+            statusMessage = journalPath + " belongs to a different job on this file; finish that job or delete the journal";
+            close();
+            return false;
+        }
+        nonce = loadLE64(header + 16);
+        blockSize = loadLE64(header + 32);
+        resumed = true;
+    }
+    else
+    {
+        std::random_device random;
+        nonce = (static_cast<uint64_t>(random()) << 32) | random();
+        blockSize = requestedBlockSize;
+    }
+
+    blockCount = blockSize == 0 ? 0 : (fileSize + blockSize - 1) / blockSize;
+    wordCount = (blockCount + 63) / 64;
+    uint64_t journalSize = HEADER_SIZE + wordCount * 8 + blockCount * 16;
+    if (blockSize == 0 || (resumed && static_cast<uint64_t>(info.st_size) != journalSize))
+    {
+        statusMessage = journalPath + " is damaged";
+        close();
+        return false;
+    }
+
+    // The bitmap is shared with forked workers, like the progress counters
+    sharedBytes = SHARED_HEADER + wordCount * sizeof(std::atomic<uint64_t>);
+    void *memory = mmap(nullptr, sharedBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED)
+    {
+        statusMessage = "Failed to map checkpoint bitmap";
+        sharedBytes = 0;
+        close();
+        return false;
+    }
+    shared = new (memory) Shared();
+    shared->lastCheckpointNs.store(progressClockNs(), std::memory_order_relaxed);
+    shared->busy.store(false, std::memory_order_relaxed);
+    for (size_t i = 0; i < wordCount; i++)
+        new (&words()[i]) std::atomic<uint64_t>(0);
+
+    if (!resumed)
+    {
+        // Size the whole file up front so fingerprint writes never extend it
+        if (ftruncate(journalFd, static_cast<off_t>(journalSize)) != 0 || !writeHeader() || syncData(journalFd) != 0)
+        {
+            statusMessage = "Could not create checkpoint journal " + journalPath;
+            close();
+            unlink(journalPath.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    std::vector<char> bitmap(wordCount * 8);
+    if (!readFully(journalFd, bitmap.data(), bitmap.size(), HEADER_SIZE))
+    {
+        statusMessage = journalPath + " is damaged";
+        close();
+        return false;
+    }
+    for (size_t i = 0; i < wordCount; i++)
+        words()[i].store(loadLE64(bitmap.data() + i * 8), std::memory_order_relaxed);
+
+    return verifyPending();
+}
+
+bool CheckpointJournal::writeHeader()
+{
+    char header[HEADER_SIZE] = {};
+    storeLE32(header, MAGIC);
+    storeLE32(header + 4, VERSION);
+    header[8] = static_cast<char>(technique);
+    header[9] = isEncryption ? 1 : 0;
+    header[10] = static_cast<char>(rekeyTag);
+    storeLE64(header + 16, nonce);
+    storeLE64(header + 24, fileSize);
+    storeLE64(header + 32, blockSize);
+    storeLE64(header + 40, blockCount);
+    storeLE64(header + 48, getCompletedBlocks());
+    return writeFully(journalFd, header, HEADER_SIZE, 0);
+}
+
+// Blocks that finished after the last checkpoint have fingerprints but no bit.
+// Their current contents say whether the write reached the file.
+bool CheckpointJournal::verifyPending()
+{
+    std::vector<char> table(blockCount * 16);
+    if (!readFully(journalFd, table.data(), table.size(), HEADER_SIZE + wordCount * 8))
+    {
+        statusMessage = journalPath + " is damaged";
+        return false;
+    }
+
+    PooledBuffer buffer = BufferPool::shared().acquire(blockSize);
+    for (uint64_t block = 0; block < blockCount; block++)
+    {
+        uint64_t input = loadLE64(table.data() + block * 16);
+        uint64_t output = loadLE64(table.data() + block * 16 + 8);
+        if (isDone(block) || input == 0)
+            continue;
+
+        uint64_t offset = block * blockSize;
+        size_t size = static_cast<size_t>(std::min<uint64_t>(blockSize, fileSize - offset));
+        if (!readFully(dataFd, buffer.data(), size, static_cast<off_t>(offset)))
+        {
+            statusMessage = "Could not read block " + std::to_string(block) + " while resuming";
+            return false;
+        }
+
+        uint64_t current = fingerprint(buffer.data(), size, block);
+        if (current == output)
+        {
+            markDone(block);
+        }
+        else if (current != input)
+        {
+            statusMessage = "Block " + std::to_string(block) + " was only partly written before the interruption; "
+                                                               "it cannot be resumed safely";
+            return false;
+        }
+    }
+    return true;
+}
+
+std::atomic<uint64_t> *CheckpointJournal::words() const
+{
+    return reinterpret_cast<std::atomic<uint64_t> *>(reinterpret_cast<char *>(shared) + SHARED_HEADER);
+}
+
+uint64_t CheckpointJournal::getCompletedBlocks() const
+{
+    uint64_t count = 0;
+    for (size_t i = 0; shared && i < wordCount; i++)
+        count += static_cast<uint64_t>(__builtin_popcountll(words()[i].load(std::memory_order_relaxed)));
+    return count;
+}
+
+bool CheckpointJournal::isDone(uint64_t block) const
+{
+    return (words()[block / 64].load(std::memory_order_acquire) >> (block % 64)) & 1;
+}
+
+// Seeded with the journal nonce and block index so fingerprints from another
+// job or another block never match by accident. Never returns 0, which marks
+// a block that has not been recorded yet.
+uint64_t CheckpointJournal::fingerprint(const char *data, size_t size, uint64_t block) const
+{
+    return hashBytes(data, size, nonce ^ (block * 0x9E3779B97F4A7C15ULL) ^ size) | 1;
+}
+
+void CheckpointJournal::recordFingerprints(uint64_t block, uint64_t input, uint64_t output)
+{
+    char pair[16];
+    storeLE64(pair, input);
+    storeLE64(pair + 8, output);
+    // Synced before the caller writes the block: the page cache may write the
+    // block out at any time, and after a power loss a block on disk without
+    // its pair on disk could be transformed a second time. The journal is
+    // sized up front, so only the pair's page goes out.
+    if (!writeFully(journalFd, pair, sizeof(pair), static_cast<off_t>(HEADER_SIZE + wordCount * 8 + block * 16)) ||
+        syncData(journalFd) != 0)
+        throw std::runtime_error("Could not write checkpoint journal");
+}
+
+void CheckpointJournal::markDone(uint64_t block)
+{
+    words()[block / 64].fetch_or(uint64_t(1) << (block % 64), std::memory_order_release);
+}
+
+void CheckpointJournal::maybeCheckpoint()
+{
+    int64_t now = progressClockNs();
+    if (now - shared->lastCheckpointNs.load(std::memory_order_relaxed) < CHECKPOINT_INTERVAL_NS)
+        return;
+
+    bool expected = false;
+    if (!shared->busy.compare_exchange_strong(expected, true, std::memory_order_acq_rel))
+        return;
+    checkpoint();
+    shared->busy.store(false, std::memory_order_release);
+}
+
+void CheckpointJournal::checkpoint()
+{
+    if (!shared)
+        return;
+
+    // Snapshot first: every bit in it was set after its block was written, so
+    // the data sync below covers all of them
+    std::vector<char> bitmap(wordCount * 8);
+    for (size_t i = 0; i < wordCount; i++)
+        storeLE64(bitmap.data() + i * 8, words()[i].load(std::memory_order_acquire));
+
+    // A failed step simply leaves the previous checkpoint in force
+    if (syncData(dataFd) == 0 && writeFully(journalFd, bitmap.data(), bitmap.size(), HEADER_SIZE) &&
+        writeHeader())
+    {
+        syncData(journalFd);
+    }
+    shared->lastCheckpointNs.store(progressClockNs(), std::memory_order_relaxed);
+}
+
+bool CheckpointJournal::finish()
+{
+    if (!shared)
+        return false;
+
+    if (getCompletedBlocks() != blockCount)
+    {
+        checkpoint();
+        statusMessage = std::to_string(getCompletedBlocks()) + " of " + std::to_string(blockCount) +
+                        " blocks are checkpointed in " + journalPath;
+        return false;
+    }
+
+    // The journal may only disappear once the data it vouches for is durable
+    if (syncData(dataFd) != 0)
+    {
+        checkpoint();
+        statusMessage = "Could not sync data; keeping " + journalPath;
+        return false;
+    }
+    std::string path = journalPath;
+    close();
+    unlink(path.c_str());
+    return true;
+}
+
+void CheckpointJournal::close()
+{
+    if (shared)
+    {
+        munmap(shared, sharedBytes);
+        shared = nullptr;
+        sharedBytes = 0;
+    }
+    if (journalFd >= 0)
+    {
+        ::close(journalFd);
+        journalFd = -1;
+    }
+    if (dataFd >= 0)
+    {
+        ::close(dataFd);
+        dataFd = -1;
+    }
+}
@@ -0,0 +1,92 @@
+#ifndef CHECKPOINT_JOURNAL_HPP
+#define CHECKPOINT_JOURNAL_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Crash-safe record of which blocks of an in-place job are finished, kept next
+// to the data file as <file>.ccjournal so an interrupted job can resume.
+//
+// Layout (little-endian):
+//   header (64 bytes) | done bitmap, one bit per block | 16 byte fingerprint pair per block
+//
+// The bitmap lives in shared memory while a job runs so that threads and forked
+// workers mark blocks with a single atomic OR. It is written out by a periodic
+// checkpoint that first syncs the data file, so a bit on disk always refers to
+// a block that is on disk too. The fingerprints of each block's input and
+// output are written and synced just before the block itself, which lets a
+// resume work out the state of blocks that finished after the last checkpoint,
+// after a power loss as well as a crash.
+class CheckpointJournal
+{
+public:
+    static const uint32_t MAGIC = 0x314A4343; // "CCJ1" on disk
+    static const uint32_t VERSION = 1;
+    static const size_t HEADER_SIZE = 64;
+    static const int64_t CHECKPOINT_INTERVAL_NS = 1000LL * 1000 * 1000;
+
+    CheckpointJournal();
+    ~CheckpointJournal();
+
+    static std::string journalPathFor(const std::string &filePath);
+
+    // Opens the journal for filePath, creating it if there is none. An existing
+    // journal must describe the same job; its block size then wins over
+    // blockSize and every unfinished block with a fingerprint is checked
+    // against the data file. A rekey job passes the technique it decrypts
+    // with as sourceTechnique; it is -1 for plain encryption and decryption.
+    bool open(const std::string &filePath, uint8_t technique, bool isEncryption,
+              uint64_t fileSize, uint64_t blockSize, int sourceTechnique = -1);
+
+    bool isResumed() const { return resumed; }
+    uint64_t getBlockSize() const { return blockSize; }
+    uint64_t getBlockCount() const { return blockCount; }
+    uint64_t getCompletedBlocks() const;
+    const std::string &getPath() const { return journalPath; }
+    const std::string &getStatusMessage() const { return statusMessage; }
+
+    // Called by workers. Safe from threads and from forked children.
+    bool isDone(uint64_t block) const;
+    uint64_t fingerprint(const char *data, size_t size, uint64_t block) const;
+    void recordFingerprints(uint64_t block, uint64_t input, uint64_t output);
+    void markDone(uint64_t block);
+    // Runs a checkpoint if the interval has passed and nobody else is running one
+    void maybeCheckpoint();
+
+    // Persists the bitmap; the journal stays on disk for a later resume
+    void checkpoint();
+    // Syncs the data file and deletes the journal once every block is done
+    bool finish();
+    void close();
+
+private:
+    struct Shared
+    {
+        std::atomic<int64_t> lastCheckpointNs;
+        std::atomic<bool> busy;
+    };
+
+    bool writeHeader();
+    bool verifyPending();
+    std::atomic<uint64_t> *words() const;
+
+    std::string journalPath;
+    std::string statusMessage;
+    int journalFd;
+    int dataFd;
+    uint8_t technique;
+    uint8_t rekeyTag; // sourceTechnique + 1, so 0 in journals of other jobs
+    bool isEncryption;
+    bool resumed;
+    uint64_t nonce;
+    uint64_t fileSize;
+    uint64_t blockSize;
+    uint64_t blockCount;
+    size_t wordCount;
+    size_t sharedBytes;
+    Shared *shared;
+};
+
+#endif
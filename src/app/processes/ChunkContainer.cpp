@@ -0,0 +1,265 @@
+#include "ChunkContainer.hpp"
+#include "BinaryIO.hpp"
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <random>
+#include <stdexcept>
+
+ChunkContainer::ChunkContainer() : fd(-1), writable(false), appendOffset(0)
+{
+}
+
+ChunkContainer::~ChunkContainer()
+{
+    close();
+}
+
+bool ChunkContainer::isContainer(const std::string &path)
+{
+    int file = ::open(path.c_str(), O_RDONLY);
+    if (file < 0)
+        return false;
+    char magic[8];
+    bool found = readFully(file, magic, sizeof(magic), 0) && loadLE32(magic) == MAGIC &&
+                 loadLE32(magic + 4) == VERSION;
+    ::close(file);
+    return found;
+}
+
+bool ChunkContainer::create(const std::string &containerPath, uint8_t technique, uint64_t plainSize,
+                            uint32_t chunkSize, uint8_t flags)
+{
+    close();
+    path = containerPath;
+    // open() turns down any other chunk size
+    if (chunkSize == 0 || chunkSize % CHUNK_UNIT != 0 || chunkSize > MAX_CHUNK_SIZE)
+    {
+        statusMessage = "Container chunk size must be a whole number of 64 KiB units up to 1 GiB";
+        return false;
+    }
+
+    std::random_device random;
+    header = ContainerHeader();
+    header.version = VERSION;
+    header.technique = technique;
+    header.flags = flags;
+    header.chunkSize = chunkSize;
+    header.nonce = (static_cast<uint64_t>(random()) << 32) | random();
+    header.plainSize = plainSize;
+    header.chunkCount = (plainSize + chunkSize - 1) / chunkSize;
+    header.indexOffset = HEADER_SIZE;
+    header.dataOffset = HEADER_SIZE + header.chunkCount * INDEX_ENTRY_SIZE;
+
+    chunks.assign(header.chunkCount, ContainerChunk());
+    for (uint64_t i = 0; i < header.chunkCount; i++)
+    {
+        chunks[i].offset = header.dataOffset + i * chunkSize;
+        chunks[i].plainSize = plainSizeOf(i);
+    }
+
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        statusMessage = "Could not create " + path + ": " + std::strerror(errno);
+        return false;
+    }
+    // Zero header until finish(), so a half-written container is never accepted.
+    // Compressed chunks are appended, so only the index is reserved up front.
+    appendOffset.store(header.dataOffset, std::memory_order_relaxed);
+    uint64_t reserved = header.dataOffset + ((flags & FLAG_COMPRESSED) ? 0 : plainSize);
+    if (ftruncate(fd, static_cast<off_t>(reserved)) != 0)
+    {
+        statusMessage = "Could not size " + path + ": " + std::strerror(errno);
+        close();
+        return false;
+    }
+    writable = true;
+    return true;
+}
+
+bool ChunkContainer::open(const std::string &containerPath)
+{
+    close();
+    path = containerPath;
+    fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        statusMessage = "Could not open " + path + ": " + std::strerror(errno);
+        return false;
+    }
+
+    struct stat info;
+    fstat(fd, &info);
+    uint64_t fileSize = static_cast<uint64_t>(info.st_size);
+
+    char raw[HEADER_SIZE];
+    if (fileSize < HEADER_SIZE || !readFully(fd, raw, HEADER_SIZE, 0) || loadLE32(raw) != MAGIC)
+    {
+        statusMessage = path + " is not a CryptoCore container";
+        close();
+        return false;
+    }
+
+    header.version = loadLE32(raw + 4);
+    header.technique = static_cast<uint8_t>(raw[8]);
+    header.flags = static_cast<uint8_t>(raw[9]);
+    header.chunkSize = loadLE32(raw + 12);
+    header.nonce = loadLE64(raw + 16);
+    header.plainSize = loadLE64(raw + 24);
+    header.chunkCount = loadLE64(raw + 32);
+    header.indexOffset = loadLE64(raw + 40);
+    header.dataOffset = loadLE64(raw + 48);
+    if (header.version != VERSION)
+    {
+        statusMessage = path + " uses container version " + std::to_string(header.version) +
+                        ", this build reads version " + std::to_string(VERSION);
+        close();
+        return false;
+    }
+    // The header comes from the file, so it is checked without any sum or
+    // product that could wrap, and the chunk size, which sizes the workers'
+    // buffers, has to be one the tools could have written
+    if (header.chunkSize == 0 || header.chunkSize % CHUNK_UNIT != 0 || header.chunkSize > MAX_CHUNK_SIZE ||
+        header.indexOffset > fileSize || header.chunkCount > (fileSize - header.indexOffset) / INDEX_ENTRY_SIZE ||
+        header.chunkCount != header.plainSize / header.chunkSize + (header.plainSize % header.chunkSize != 0 ? 1 : 0))
+    {
+        statusMessage = path + " has a damaged header";
+        close();
+        return false;
+    }
+
+    std::vector<char> index(header.chunkCount * INDEX_ENTRY_SIZE);
+    if (!readFully(fd, index.data(), index.size(), static_cast<off_t>(header.indexOffset)))
+    {
+        statusMessage = path + " has a damaged chunk index";
+        close();
+        return false;
+    }
+
+    chunks.assign(header.chunkCount, ContainerChunk());
+    for (uint64_t i = 0; i < header.chunkCount; i++)
+    {
+        const char *entry = index.data() + i * INDEX_ENTRY_SIZE;
+        ContainerChunk &chunk = chunks[i];
+        chunk.offset = loadLE64(entry);
+        chunk.storedSize = loadLE32(entry + 8);
+        chunk.plainSize = loadLE32(entry + 12);
+        chunk.flags = loadLE32(entry + 16);
+        chunk.checksum = loadLE64(entry + 24);
+        bool compressed = chunk.flags & CHUNK_COMPRESSED;
+        if (chunk.plainSize != plainSizeOf(i) || chunk.offset > fileSize || chunk.storedSize > fileSize - chunk.offset ||
+            (compressed ? !(header.flags & FLAG_COMPRESSED) || chunk.storedSize >= chunk.plainSize
+                        : chunk.storedSize != chunk.plainSize))
+        {
+            statusMessage = path + " has a damaged index entry for chunk " + std::to_string(i);
+            close();
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ChunkContainer::finish()
+{
+    if (fd < 0 || !writable)
+        return false;
+
+    std::vector<char> index(header.chunkCount * INDEX_ENTRY_SIZE, 0);
+    for (uint64_t i = 0; i < header.chunkCount; i++)
+    {
+        char *entry = index.data() + i * INDEX_ENTRY_SIZE;
+        const ContainerChunk &chunk = chunks[i];
+        storeLE64(entry, chunk.offset);
+        storeLE32(entry + 8, chunk.storedSize);
+        storeLE32(entry + 12, chunk.plainSize);
+        storeLE32(entry + 16, chunk.flags);
+        storeLE64(entry + 24, chunk.checksum);
+    }
+
+    char raw[HEADER_SIZE] = {};
+    storeLE32(raw, MAGIC);
+    storeLE32(raw + 4, header.version);
+    raw[8] = static_cast<char>(header.technique);
+    raw[9] = static_cast<char>(header.flags);
+    storeLE32(raw + 12, header.chunkSize);
+    storeLE64(raw + 16, header.nonce);
+    storeLE64(raw + 24, header.plainSize);
+    storeLE64(raw + 32, header.chunkCount);
+    storeLE64(raw + 40, header.indexOffset);
+    storeLE64(raw + 48, header.dataOffset);
+
+    // Payloads and index must be durable before the header makes them valid
+    if (((header.flags & FLAG_COMPRESSED) &&
+         ftruncate(fd, static_cast<off_t>(appendOffset.load(std::memory_order_relaxed))) != 0) ||
+        !writeFully(fd, index.data(), index.size(), static_cast<off_t>(header.indexOffset)) ||
+        syncData(fd) != 0 || !writeFully(fd, raw, HEADER_SIZE, 0) || syncData(fd) != 0)
+    {
+        statusMessage = "Could not write the index of " + path + ": " + std::strerror(errno);
+        return false;
+    }
+    close();
+    return true;
+}
+
+void ChunkContainer::close()
+{
+    if (fd >= 0)
+    {
+        ::close(fd);
+        fd = -1;
+    }
+    writable = false;
+}
+
+void ChunkContainer::chunksCovering(uint64_t offset, uint64_t length, uint64_t &first, uint64_t &last) const
+{
+    uint64_t end = std::min(header.plainSize, offset + length);
+    if (offset >= end)
+    {
+        first = last = 0;
+        return;
+    }
+    first = offset / header.chunkSize;
+    last = (end + header.chunkSize - 1) / header.chunkSize;
+}
+
+uint32_t ChunkContainer::plainSizeOf(uint64_t index) const
+{
+    uint64_t start = plainOffsetOf(index);
+    return static_cast<uint32_t>(std::min<uint64_t>(header.chunkSize, header.plainSize - start));
+}
+
+// Seeded with the container nonce and chunk index, so a chunk copied from
+// another container or another position is caught as well as a corrupt one
+uint64_t ChunkContainer::checksum(const char *data, size_t size, uint64_t index) const
+{
+    return hashBytes(data, size, header.nonce ^ (index * 0x9E3779B97F4A7C15ULL) ^ size) | 1;
+}
+
+void ChunkContainer::writeChunk(uint64_t index, const char *data, uint32_t storedSize, uint32_t chunkFlags)
+{
+    ContainerChunk &chunk = chunks[index];
+    if (storedSize > header.chunkSize)
+        throw std::runtime_error("Chunk " + std::to_string(index) + " does not fit its slot");
+    if (header.flags & FLAG_COMPRESSED)
+        chunk.offset = appendOffset.fetch_add(storedSize, std::memory_order_relaxed);
+    if (!writeFully(fd, data, storedSize, static_cast<off_t>(chunk.offset)))
+        throw std::runtime_error("Could not write chunk " + std::to_string(index) + " of " + path);
+    // Each worker owns its own entries, so no lock is needed
+    chunk.storedSize = storedSize;
+    chunk.flags = chunkFlags;
+    chunk.checksum = checksum(data, storedSize, index);
+}
+
+void ChunkContainer::readChunk(uint64_t index, char *data) const
+{
+    const ContainerChunk &chunk = chunks[index];
+    if (!readFully(fd, data, chunk.storedSize, static_cast<off_t>(chunk.offset)))
+        throw std::runtime_error("Could not read chunk " + std::to_string(index) + " of " + path);
+    if (checksum(data, chunk.storedSize, index) != chunk.checksum)
+        throw std::runtime_error("Chunk " + std::to_string(index) + " of " + path + " is corrupt");
+}
@@ -0,0 +1,102 @@
+#ifndef CHUNK_CONTAINER_HPP
+#define CHUNK_CONTAINER_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct ContainerHeader
+{
+    uint32_t version = 0;
+    uint8_t technique = 0;  // EncryptionType the chunks were written with
+    uint8_t flags = 0;
+    uint32_t chunkSize = 0; // plaintext bytes per chunk, a whole number of transform units
+    uint64_t nonce = 0;
+    uint64_t plainSize = 0;
+    uint64_t chunkCount = 0;
+    uint64_t indexOffset = 0;
+    uint64_t dataOffset = 0;
+};
+
+struct ContainerChunk
+{
+    uint64_t offset = 0;     // where the stored bytes start in the container
+    uint32_t storedSize = 0;
+    uint32_t plainSize = 0;
+    uint32_t flags = 0;
+    uint64_t checksum = 0;   // of the stored bytes, 0 until the chunk is written
+};
+
+// Self-describing encrypted file that can be decrypted a chunk at a time.
+//
+// Layout (little-endian):
+//   header (64 bytes) | chunk index, 32 bytes per chunk | chunk payloads
+//
+// Chunk i holds plaintext bytes [i * chunkSize, (i + 1) * chunkSize), so the
+// chunks covering any byte range are known from the header alone. Workers
+// write their chunks with positional I/O, without any shared lock: into a
+// fixed slot per chunk, or, in a compressed container, at the next free
+// offset of an atomic append cursor. The index and then the header are written
+// last, so an interrupted write never leaves a file that looks valid.
+//
+// A compressed chunk holds its BlockCodec output, encrypted; a chunk that did
+// not shrink is stored as it is and has no CHUNK_COMPRESSED flag.
+class ChunkContainer
+{
+public:
+    static const uint32_t MAGIC = 0x31584343; // "CCX1" on disk
+    static const uint32_t VERSION = 1;
+    static const size_t HEADER_SIZE = 64;
+    static const size_t INDEX_ENTRY_SIZE = 32;
+    static const uint8_t FLAG_COMPRESSED = 0x01;   // header: chunks may be compressed
+    static const uint32_t CHUNK_COMPRESSED = 0x01; // index entry: this chunk is compressed
+    // Chunks are blocks: whole transform units (TaskManager.hpp checks the
+    // unit), no larger than the largest block size the tools accept
+    static const uint32_t CHUNK_UNIT = 64 * 1024;
+    static const uint32_t MAX_CHUNK_SIZE = 1024 * 1024 * 1024;
+
+    ChunkContainer();
+    ~ChunkContainer();
+    ChunkContainer(const ChunkContainer &) = delete;
+    ChunkContainer &operator=(const ChunkContainer &) = delete;
+
+    // True if path starts with a complete container header
+    static bool isContainer(const std::string &path);
+
+    // Creates (or truncates) path for plainSize bytes of plaintext
+    bool create(const std::string &path, uint8_t technique, uint64_t plainSize, uint32_t chunkSize,
+                uint8_t flags = 0);
+    // Opens an existing container and loads its index
+    bool open(const std::string &path);
+    // Writes the index and header of a created container and syncs it
+    bool finish();
+    void close();
+
+    const ContainerHeader &getHeader() const { return header; }
+    const ContainerChunk &getChunk(uint64_t index) const { return chunks[index]; }
+    // Chunks [first, last) cover plaintext bytes [offset, offset + length)
+    void chunksCovering(uint64_t offset, uint64_t length, uint64_t &first, uint64_t &last) const;
+    uint64_t plainOffsetOf(uint64_t index) const { return index * header.chunkSize; }
+    uint32_t plainSizeOf(uint64_t index) const;
+    const std::string &getStatusMessage() const { return statusMessage; }
+
+    // Safe to call from several threads for different chunks
+    void writeChunk(uint64_t index, const char *data, uint32_t storedSize, uint32_t chunkFlags = 0);
+    // Reads the stored bytes of a chunk and checks them against the index
+    void readChunk(uint64_t index, char *data) const;
+
+private:
+    uint64_t checksum(const char *data, size_t size, uint64_t index) const;
+
+    std::string path;
+    std::string statusMessage;
+    int fd;
+    bool writable;
+    ContainerHeader header;
+    std::vector<ContainerChunk> chunks;
+    std::atomic<uint64_t> appendOffset; // next free byte of a compressed container
+};
+
+#endif
@@ -0,0 +1,229 @@
+#include "CpuTopology.hpp"
+#include <unistd.h>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <thread>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#endif
+
+namespace
+{
+    // Parses the kernel's list format, e.g. "0-3,8-11"
+    std::vector<int> parseCpuList(const std::string &text)
+    {
+        std::vector<int> result;
+        std::stringstream ranges(text);
+        std::string range;
+        while (std::getline(ranges, range, ','))
+        {
+            if (range.empty())
+                continue;
+            size_t dash = range.find('-');
+            try
+            {
+                int first = std::stoi(range.substr(0, dash));
+                int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+                for (int cpu = first; cpu <= last; cpu++)
+                    result.push_back(cpu);
+            }
+            catch (const std::exception &)
+            {
+            }
+        }
+        return result;
+    }
+
+    int readInt(const std::string &path, int fallback)
+    {
+        std::ifstream in(path);
+        int value;
+        return in >> value ? value : fallback;
+    }
+
+    std::string readLine(const std::string &path)
+    {
+        std::ifstream in(path);
+        std::string line;
+        std::getline(in, line);
+        return line;
+    }
+}
+
+const CpuTopology &CpuTopology::host()
+{
+    static CpuTopology topology;
+    return topology;
+}
+
+CpuTopology::CpuTopology() : nodeCount(1)
+{
+#ifdef __linux__
+    // Only CPUs we are allowed on, so pinning works inside cpusets and containers
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    bool haveMask = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+
+    std::map<int, int> nodeOfCpu;
+    std::set<int> nodes;
+    std::error_code error;
+    for (const auto &entry : std::filesystem::directory_iterator("/sys/devices/system/node", error))
+    {
+        std::string name = entry.path().filename().string();
+        if (name.size() <= 4 || name.compare(0, 4, "node") != 0 ||
+            !std::all_of(name.begin() + 4, name.end(), ::isdigit))
+            continue;
+        int node = std::stoi(name.substr(4));
+        for (int cpu : parseCpuList(readLine(entry.path().string() + "/cpulist")))
+            nodeOfCpu[cpu] = node;
+    }
+
+    std::vector<int> online = parseCpuList(readLine("/sys/devices/system/cpu/online"));
+    for (int cpu : online)
+    {
+        if (haveMask && (cpu >= CPU_SETSIZE || !CPU_ISSET(cpu, &allowed)))
+            continue;
+        std::string base = "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/";
+        CpuInfo info;
+        info.cpu = cpu;
+        info.core = readInt(base + "core_id", cpu);
+        info.package = readInt(base + "physical_package_id", 0);
+        auto found = nodeOfCpu.find(cpu);
+        info.node = found != nodeOfCpu.end() ? found->second : 0;
+        cpus.push_back(info);
+        nodes.insert(info.node);
+    }
+    nodeCount = std::max<size_t>(1, nodes.size());
+#endif
+
+    if (cpus.empty())
+    {
+        unsigned count = std::max(1u, std::thread::hardware_concurrency());
+        for (unsigned cpu = 0; cpu < count; cpu++)
+            cpus.push_back({static_cast<int>(cpu), static_cast<int>(cpu), 0, 0});
+        nodeCount = 1;
+    }
+}
+
+int CpuTopology::nodeOf(int cpu) const
+{
+    for (const CpuInfo &info : cpus)
+    {
+        if (info.cpu == cpu)
+            return info.node;
+    }
+    return -1;
+}
+
+std::string CpuTopology::describe() const
+{
+    std::map<int, std::vector<int>> byNode;
+    for (const CpuInfo &info : cpus)
+        byNode[info.node].push_back(info.cpu);
+
+    std::ostringstream out;
+    out << cpus.size() << " CPU(s) on " << byNode.size() << " NUMA node(s)";
+    for (const auto &node : byNode)
+    {
+        out << "; node " << node.first << ": cpus";
+        for (size_t i = 0; i < node.second.size(); i++)
+        {
+            // Collapse runs back into the kernel's a-b form
+            size_t j = i;
+            while (j + 1 < node.second.size() && node.second[j + 1] == node.second[j] + 1)
+                j++;
+            out << (i == 0 ? " " : ",") << node.second[i];
+            if (j > i)
+                out << "-" << node.second[j];
+            i = j;
+        }
+    }
+    return out.str();
+}
+
+std::vector<WorkerPlacement> CpuTopology::place(size_t workers) const
+{
+    // Per node: first one CPU for each physical core, then the SMT siblings
+    std::map<int, std::vector<int>> ordered;
+    std::map<int, std::set<std::pair<int, int>>> coresSeen;
+    std::map<int, std::vector<int>> siblings;
+    for (const CpuInfo &info : cpus)
+    {
+        if (coresSeen[info.node].insert({info.package, info.core}).second)
+            ordered[info.node].push_back(info.cpu);
+        else
+            siblings[info.node].push_back(info.cpu);
+    }
+    for (auto &node : ordered)
+        node.second.insert(node.second.end(), siblings[node.first].begin(), siblings[node.first].end());
+
+    // Share of workers per node, proportional to its CPUs
+    std::vector<std::pair<int, size_t>> shares;
+    size_t assigned = 0;
+    for (const auto &node : ordered)
+    {
+        size_t share = workers * node.second.size() / cpus.size();
+        shares.push_back({node.first, share});
+        assigned += share;
+    }
+    for (size_t i = 0; assigned < workers; i = (i + 1) % shares.size(), assigned++)
+        shares[i].second++;
+
+    std::vector<WorkerPlacement> placement;
+    for (const auto &share : shares)
+    {
+        const std::vector<int> &nodeCpus = ordered[share.first];
+        for (size_t j = 0; j < share.second; j++)
+            placement.push_back({nodeCpus[j % nodeCpus.size()], share.first});
+    }
+    return placement;
+}
+
+bool CpuTopology::pinCurrentThread(int cpu)
+{
+#ifdef __linux__
+    if (cpu < 0 || cpu >= CPU_SETSIZE)
+        return false;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void)cpu;
+    return false;
+#endif
+}
+
+bool CpuTopology::bindMemory(void *address, size_t length, int node)
+{
+#if defined(__linux__) && defined(SYS_mbind)
+    // Preferred rather than strict binding, so a full node falls back to
+    // another one instead of failing the allocation
+    const int MPOL_PREFERRED_MODE = 1;
+    if (node < 0 || node >= 1024)
+        return false;
+    unsigned long mask[1024 / (8 * sizeof(unsigned long))] = {};
+    mask[node / (8 * sizeof(unsigned long))] |= 1UL << (node % (8 * sizeof(unsigned long)));
+    return syscall(SYS_mbind, address, length, MPOL_PREFERRED_MODE, mask, 1024UL, 0) == 0;
+#else
+    (void)address;
+    (void)length;
+    (void)node;
+    return false;
+#endif
+}
+
+int CpuTopology::currentCpu()
+{
+#ifdef __linux__
+    return sched_getcpu();
+#else
+    return -1;
+#endif
+}
@@ -0,0 +1,51 @@
+#ifndef CPU_TOPOLOGY_HPP
+#define CPU_TOPOLOGY_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+struct CpuInfo
+{
+    int cpu;
+    int core;    // physical core id within the package
+    int package; // socket
+    int node;    // NUMA node
+};
+
+// Where one worker should run; -1 means no preference
+struct WorkerPlacement
+{
+    int cpu = -1;
+    int node = -1;
+};
+
+// CPUs this process may run on, grouped by NUMA node. Read once from /sys on
+// Linux; elsewhere every CPU is reported on node 0 and pinning is unavailable.
+class CpuTopology
+{
+public:
+    static const CpuTopology &host();
+
+    const std::vector<CpuInfo> &getCpus() const { return cpus; }
+    size_t getNodeCount() const { return nodeCount; }
+    int nodeOf(int cpu) const;
+    std::string describe() const;
+
+    // Spreads workers over the nodes in proportion to their CPUs, one worker
+    // per physical core before any SMT sibling is used. Workers on the same
+    // node get consecutive indices, so their chunks are adjacent in the file.
+    std::vector<WorkerPlacement> place(size_t workers) const;
+
+    static bool pinCurrentThread(int cpu);
+    static bool bindMemory(void *address, size_t length, int node);
+    static int currentCpu();
+
+private:
+    CpuTopology();
+
+    std::vector<CpuInfo> cpus;
+    size_t nodeCount;
+};
+
+#endif
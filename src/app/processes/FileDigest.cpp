@@ -0,0 +1,51 @@
+#include "FileDigest.hpp"
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+std::string FileDigest::pathFor(const std::string &filePath)
+{
+    return filePath + ".b3";
+}
+
+bool FileDigest::load(const std::string &filePath)
+{
+    std::ifstream in(pathFor(filePath));
+    std::string line;
+    if (!std::getline(in, line) || line != "cryptocore-digest 1")
+        return false;
+
+    while (std::getline(in, line))
+    {
+        std::istringstream fields(line);
+        std::string key;
+        fields >> key;
+        if (key == "size")
+            fields >> size;
+        else if (key == "technique")
+            fields >> technique;
+        else if (key == "plaintext")
+            fields >> plaintext;
+        else if (key == "ciphertext")
+            fields >> ciphertext;
+    }
+    return !plaintext.empty() && !ciphertext.empty();
+}
+
+bool FileDigest::save(const std::string &filePath) const
+{
+    // Write then rename so a reader never sees half a record
+    std::string path = pathFor(filePath);
+    std::string temp = path + ".tmp";
+    {
+        std::ofstream out(temp, std::ios::trunc);
+        out << "cryptocore-digest 1\n";
+        out << "size " << size << "\n";
+        out << "technique " << technique << "\n";
+        out << "plaintext " << plaintext << "\n";
+        out << "ciphertext " << ciphertext << "\n";
+        if (!out)
+            return false;
+    }
+    return std::rename(temp.c_str(), path.c_str()) == 0;
+}
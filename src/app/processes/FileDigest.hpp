@@ -0,0 +1,22 @@
+#ifndef FILE_DIGEST_HPP
+#define FILE_DIGEST_HPP
+
+#include <cstdint>
+#include <string>
+
+// BLAKE3 digests of both forms of a file, recorded by a hashed run next to
+// the file as FILE.b3 so a later verify can tell which form is on disk and
+// whether it is intact. Plain text, one "key value" pair per line.
+struct FileDigest
+{
+    uint64_t size = 0;
+    int technique = 0;
+    std::string plaintext;
+    std::string ciphertext;
+
+    static std::string pathFor(const std::string &filePath);
+    bool load(const std::string &filePath);
+    bool save(const std::string &filePath) const;
+};
+
+#endif
@@ -0,0 +1,100 @@
+#ifndef JOB_PROGRESS_HPP
+#define JOB_PROGRESS_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+const size_t MAX_WORKERS = 64;
+
+// Per-worker counters, updated by the worker once per block. Each slot has its
+// own cache line so workers never contend with each other, and readers such as
+// the GUI render loop only perform relaxed atomic loads.
+struct alignas(64) WorkerProgress
+{
+    std::atomic<uint64_t> bytesTotal;
+    std::atomic<uint64_t> bytesDone;
+    std::atomic<uint64_t> blocksTotal;
+    std::atomic<uint64_t> blocksDone;
+    std::atomic<int64_t> startedNs;
+    std::atomic<int64_t> updatedNs;
+    std::atomic<uint64_t> osId; // pid for processes, pthread_t bits for threads
+    std::atomic<int32_t> cpu;      // CPU the worker last ran a block on, -1 if unknown
+    std::atomic<int32_t> homeNode; // NUMA node the worker was placed on, -1 if floating
+    std::atomic<bool> finished;
+    std::atomic<bool> failed;
+    // Hardware counters over the worker's transforms, published when it
+    // stops, if the run counts them and the worker could open them
+    std::atomic<bool> perfCounted;
+    std::atomic<uint64_t> perfCycles;
+    std::atomic<uint64_t> perfInstructions;
+    std::atomic<uint64_t> perfLlcMisses;
+    std::atomic<uint64_t> perfBranchMisses;
+    std::atomic<uint64_t> perfBytes;
+};
+
+// Cooperative run control, checked by every worker between blocks
+enum JobControl : int
+{
+    JOB_RUNNING = 0,
+    JOB_PAUSED = 1,
+    JOB_CANCELLED = 2
+};
+
+// Rate, CPU and priority limits of a TaskManager's runs. Kept next to the
+// control word so a change reaches forked workers as well as threads while
+// they run. Zero means no limit throughout.
+struct alignas(64) ThrottleState
+{
+    std::atomic<uint64_t> readBytesPerSecond;
+    std::atomic<uint64_t> writeBytesPerSecond;
+    std::atomic<uint32_t> cpuPercent; // of one core, shared by all workers
+    std::atomic<int32_t> nice;
+    std::atomic<int32_t> ioPriority;  // as passed to ioprio_set
+    std::atomic<uint32_t> generation; // bumped on every change
+    // Token buckets, each kept as the time its next byte may go
+    std::atomic<int64_t> readReadyNs;
+    std::atomic<int64_t> writeReadyNs;
+};
+
+// All progress for one run. TaskManager places this in a MAP_SHARED mapping so
+// forked children publish into the same counters, and observe the same control
+// word, as threads do.
+struct SharedProgress
+{
+    std::atomic<size_t> workerCount;
+    std::atomic<int> control;
+    ThrottleState throttle;
+    WorkerProgress workers[MAX_WORKERS];
+};
+
+// Forked children write through this memory, so the counters must not fall
+// back to a lock that lives in one process only
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "progress counters must be lock-free");
+
+// Plain copy of a WorkerProgress slot plus derived rates
+struct ProgressSnapshot
+{
+    uint64_t bytesDone = 0;
+    uint64_t bytesTotal = 0;
+    uint64_t blocksDone = 0;
+    uint64_t blocksTotal = 0;
+    uint64_t osId = 0;
+    int cpu = -1;
+    int homeNode = -1;
+    float fraction = 0.0f;
+    double throughputMBps = 0.0;
+    double etaSeconds = 0.0;
+    bool finished = false;
+    bool failed = false;
+};
+
+inline int64_t progressClockNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+#endif
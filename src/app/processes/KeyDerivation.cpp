@@ -0,0 +1,349 @@
+#include "KeyDerivation.hpp"
+#include "BinaryIO.hpp"
+#include "CpuTopology.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+namespace
+{
+    const uint32_t K[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+    const uint64_t MAX_COST = 1ULL << 24;
+    const size_t MAX_LANE_BYTES = 1ULL << 30;
+
+    inline uint32_t rotr(uint32_t x, int n)
+    {
+        return (x >> n) | (x << (32 - n));
+    }
+
+    inline uint32_t rotl(uint32_t x, int n)
+    {
+        return (x << n) | (x >> (32 - n));
+    }
+
+    struct Sha256
+    {
+        uint32_t state[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                             0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+        uint8_t buffer[64];
+        uint64_t length = 0;
+        size_t used = 0;
+
+        void compress(const uint8_t *block)
+        {
+            uint32_t w[64];
+            for (int i = 0; i < 16; i++)
+                w[i] = static_cast<uint32_t>(block[4 * i]) << 24 | static_cast<uint32_t>(block[4 * i + 1]) << 16 |
+                       static_cast<uint32_t>(block[4 * i + 2]) << 8 | block[4 * i + 3];
+            for (int i = 16; i < 64; i++)
+            {
+                uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+                uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+                w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+            }
+
+            uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+            uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+            for (int i = 0; i < 64; i++)
+            {
+                uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + K[i] + w[i];
+                uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+                h = g;
+                g = f;
+                f = e;
+                e = d + t1;
+                d = c;
+                c = b;
+                b = a;
+                a = t1 + t2;
+            }
+            state[0] += a;
+            state[1] += b;
+            state[2] += c;
+            state[3] += d;
+            state[4] += e;
+            state[5] += f;
+            state[6] += g;
+            state[7] += h;
+        }
+
+        void update(const uint8_t *data, size_t size)
+        {
+            length += size;
+            while (size > 0)
+            {
+                if (used == 0 && size >= 64)
+                {
+                    compress(data);
+                    data += 64;
+                    size -= 64;
+                    continue;
+                }
+                size_t take = std::min(size, 64 - used);
+                std::memcpy(buffer + used, data, take);
+                used += take;
+                data += take;
+                size -= take;
+                if (used == 64)
+                {
+                    compress(buffer);
+                    used = 0;
+                }
+            }
+        }
+
+        void finish(uint8_t out[32])
+        {
+            uint64_t bits = length * 8;
+            uint8_t pad[72] = {0x80};
+            size_t padLength = (used < 56 ? 56 : 120) - used;
+            for (int i = 0; i < 8; i++)
+                pad[padLength + i] = static_cast<uint8_t>(bits >> (56 - 8 * i));
+            update(pad, padLength + 8);
+            for (int i = 0; i < 8; i++)
+            {
+                out[4 * i] = static_cast<uint8_t>(state[i] >> 24);
+                out[4 * i + 1] = static_cast<uint8_t>(state[i] >> 16);
+                out[4 * i + 2] = static_cast<uint8_t>(state[i] >> 8);
+                out[4 * i + 3] = static_cast<uint8_t>(state[i]);
+            }
+        }
+    };
+
+    // Inner and outer states are keyed once and copied for every message
+    struct HmacSha256
+    {
+        Sha256 inner;
+        Sha256 outer;
+
+        HmacSha256(const uint8_t *key, size_t keyLen)
+        {
+            uint8_t block[64] = {};
+            if (keyLen > 64)
+            {
+                Sha256 hashed;
+                hashed.update(key, keyLen);
+                hashed.finish(block);
+            }
+            else if (keyLen > 0)
+                std::memcpy(block, key, keyLen);
+
+            uint8_t pad[64];
+            for (int i = 0; i < 64; i++)
+                pad[i] = block[i] ^ 0x36;
+            inner.update(pad, 64);
+            for (int i = 0; i < 64; i++)
+                pad[i] = block[i] ^ 0x5c;
+            outer.update(pad, 64);
+        }
+
+        void mac(const uint8_t *data, size_t size, const uint8_t *tail, size_t tailSize, uint8_t out[32]) const
+        {
+            Sha256 message = inner;
+            message.update(data, size);
+            message.update(tail, tailSize);
+            uint8_t digest[32];
+            message.finish(digest);
+            Sha256 result = outer;
+            result.update(digest, 32);
+            result.finish(out);
+        }
+    };
+
+    void salsa208(uint32_t b[16])
+    {
+        uint32_t x[16];
+        std::memcpy(x, b, sizeof(x));
+        for (int i = 0; i < 8; i += 2)
+        {
+            // Columns
+            x[4] ^= rotl(x[0] + x[12], 7);
+            x[8] ^= rotl(x[4] + x[0], 9);
+            x[12] ^= rotl(x[8] + x[4], 13);
+            x[0] ^= rotl(x[12] + x[8], 18);
+            x[9] ^= rotl(x[5] + x[1], 7);
+            x[13] ^= rotl(x[9] + x[5], 9);
+            x[1] ^= rotl(x[13] + x[9], 13);
+            x[5] ^= rotl(x[1] + x[13], 18);
+            x[14] ^= rotl(x[10] + x[6], 7);
+            x[2] ^= rotl(x[14] + x[10], 9);
+            x[6] ^= rotl(x[2] + x[14], 13);
+            x[10] ^= rotl(x[6] + x[2], 18);
+            x[3] ^= rotl(x[15] + x[11], 7);
+            x[7] ^= rotl(x[3] + x[15], 9);
+            x[11] ^= rotl(x[7] + x[3], 13);
+            x[15] ^= rotl(x[11] + x[7], 18);
+            // Rows
+            x[1] ^= rotl(x[0] + x[3], 7);
+            x[2] ^= rotl(x[1] + x[0], 9);
+            x[3] ^= rotl(x[2] + x[1], 13);
+            x[0] ^= rotl(x[3] + x[2], 18);
+            x[6] ^= rotl(x[5] + x[4], 7);
+            x[7] ^= rotl(x[6] + x[5], 9);
+            x[4] ^= rotl(x[7] + x[6], 13);
+            x[5] ^= rotl(x[4] + x[7], 18);
+            x[11] ^= rotl(x[10] + x[9], 7);
+            x[8] ^= rotl(x[11] + x[10], 9);
+            x[9] ^= rotl(x[8] + x[11], 13);
+            x[10] ^= rotl(x[9] + x[8], 18);
+            x[12] ^= rotl(x[15] + x[14], 7);
+            x[13] ^= rotl(x[12] + x[15], 9);
+            x[14] ^= rotl(x[13] + x[12], 13);
+            x[15] ^= rotl(x[14] + x[13], 18);
+        }
+        for (int i = 0; i < 16; i++)
+            b[i] += x[i];
+    }
+
+    // BlockMix: in holds 2r 64-byte blocks; out gets the even outputs, then the odd ones
+    void blockMix(const uint32_t *in, uint32_t *out, uint32_t r)
+    {
+        uint32_t x[16];
+        std::memcpy(x, in + (2 * r - 1) * 16, sizeof(x));
+        for (uint32_t i = 0; i < 2 * r; i++)
+        {
+            for (int j = 0; j < 16; j++)
+                x[j] ^= in[i * 16 + j];
+            salsa208(x);
+            std::memcpy(out + ((i & 1) * r + i / 2) * 16, x, sizeof(x));
+        }
+    }
+
+    // ROMix on one lane; v has room for cost * 32r words
+    void roMix(char *lane, uint32_t r, uint64_t cost, uint32_t *v)
+    {
+        size_t words = 32 * r;
+        std::vector<uint32_t> xy(2 * words);
+        uint32_t *x = xy.data();
+        uint32_t *y = x + words;
+        for (size_t i = 0; i < words; i++)
+            x[i] = loadLE32(lane + 4 * i);
+
+        for (uint64_t i = 0; i < cost; i += 2)
+        {
+            std::memcpy(v + i * words, x, words * 4);
+            blockMix(x, y, r);
+            std::memcpy(v + (i + 1) * words, y, words * 4);
+            blockMix(y, x, r);
+        }
+        for (uint64_t i = 0; i < cost; i += 2)
+        {
+            uint64_t j = x[(2 * r - 1) * 16] & (cost - 1);
+            for (size_t k = 0; k < words; k++)
+                x[k] ^= v[j * words + k];
+            blockMix(x, y, r);
+            j = y[(2 * r - 1) * 16] & (cost - 1);
+            for (size_t k = 0; k < words; k++)
+                y[k] ^= v[j * words + k];
+            blockMix(y, x, r);
+        }
+
+        for (size_t i = 0; i < words; i++)
+            storeLE32(lane + 4 * i, x[i]);
+    }
+}
+
+void KeyDerivation::pbkdf2Sha256(const uint8_t *password, size_t passwordLen, const uint8_t *salt, size_t saltLen,
+                                 uint64_t iterations, uint8_t *out, size_t outLen)
+{
+    HmacSha256 hmac(password, passwordLen);
+    for (uint32_t block = 1; outLen > 0; block++)
+    {
+        uint8_t index[4] = {static_cast<uint8_t>(block >> 24), static_cast<uint8_t>(block >> 16),
+                            static_cast<uint8_t>(block >> 8), static_cast<uint8_t>(block)};
+        uint8_t u[32];
+        uint8_t t[32];
+        hmac.mac(salt, saltLen, index, 4, u);
+        std::memcpy(t, u, 32);
+        for (uint64_t i = 1; i < iterations; i++)
+        {
+            hmac.mac(u, 32, nullptr, 0, u);
+            for (int j = 0; j < 32; j++)
+                t[j] ^= u[j];
+        }
+        size_t take = std::min<size_t>(outLen, 32);
+        std::memcpy(out, t, take);
+        out += take;
+        outLen -= take;
+    }
+}
+
+bool KeyDerivation::validParams(const KdfParams &params)
+{
+    return params.cost > 1 && params.cost <= MAX_COST && (params.cost & (params.cost - 1)) == 0 &&
+           params.blockSize > 0 && params.lanes > 0 &&
+           static_cast<uint64_t>(params.blockSize) * params.lanes < (1ULL << 30) &&
+           128ULL * params.blockSize * params.cost <= MAX_LANE_BYTES;
+}
+
+bool KeyDerivation::scrypt(const std::string &passphrase, const std::string &salt, const KdfParams &params,
+                           uint8_t *out, size_t outLen, size_t numThreads)
+{
+    if (!validParams(params))
+        return false;
+
+    const uint8_t *password = reinterpret_cast<const uint8_t *>(passphrase.data());
+    size_t laneSize = 128 * params.blockSize;
+    std::vector<char> lanes(laneSize * params.lanes);
+    pbkdf2Sha256(password, passphrase.size(), reinterpret_cast<const uint8_t *>(salt.data()), salt.size(), 1,
+                 reinterpret_cast<uint8_t *>(lanes.data()), lanes.size());
+
+    // Lanes only meet again in the final PBKDF2, so each thread works through
+    // its share with one scratch table of its own
+    if (numThreads == 0)
+        numThreads = CpuTopology::host().getCpus().size();
+    size_t threadCount = std::max<size_t>(1, std::min<size_t>(numThreads, params.lanes));
+    auto worker = [&](size_t t)
+    {
+        std::vector<uint32_t> v(params.cost * 32 * params.blockSize);
+        for (size_t lane = t; lane < params.lanes; lane += threadCount)
+            roMix(lanes.data() + lane * laneSize, params.blockSize, params.cost, v.data());
+    };
+    std::vector<std::thread> threads;
+    for (size_t t = 1; t < threadCount; t++)
+        threads.emplace_back(worker, t);
+    worker(0);
+    for (std::thread &thread : threads)
+        thread.join();
+
+    pbkdf2Sha256(password, passphrase.size(), reinterpret_cast<const uint8_t *>(lanes.data()), lanes.size(), 1,
+                 out, outLen);
+    std::fill(lanes.begin(), lanes.end(), 0);
+    return true;
+}
+
+KdfParams KeyDerivation::calibrate(double targetMs, uint32_t lanes, uint32_t blockSize,
+                                   std::vector<std::pair<uint64_t, double>> *samples)
+{
+    KdfParams best;
+    best.blockSize = blockSize;
+    best.lanes = lanes;
+    best.cost = 1 << 10;
+
+    // Time doubles with the cost, so stop at the first one over the target
+    KdfParams trial = best;
+    uint8_t key[32];
+    while (validParams(trial))
+    {
+        auto start = std::chrono::steady_clock::now();
+        scrypt("calibration", "calibration", trial, key, sizeof(key));
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if (samples)
+            samples->emplace_back(trial.cost, ms);
+        if (ms > targetMs)
+            break;
+        best.cost = trial.cost;
+        trial.cost *= 2;
+    }
+    return best;
+}
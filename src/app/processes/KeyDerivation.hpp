@@ -0,0 +1,39 @@
+#ifndef KEY_DERIVATION_HPP
+#define KEY_DERIVATION_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// scrypt cost parameters (RFC 7914): memory per lane is 128 * blockSize * cost
+// bytes, and the lanes are independent, so they run on separate cores
+struct KdfParams
+{
+    uint64_t cost = 1 << 15; // N, a power of two
+    uint32_t blockSize = 8;  // r
+    uint32_t lanes = 4;      // p
+
+    size_t laneBytes() const { return static_cast<size_t>(128 * blockSize * cost); }
+};
+
+class KeyDerivation
+{
+public:
+    // Derives outLen bytes from a passphrase. Lanes run on up to numThreads
+    // threads (0 = one per core). Returns false if params are out of range.
+    static bool scrypt(const std::string &passphrase, const std::string &salt, const KdfParams &params,
+                       uint8_t *out, size_t outLen, size_t numThreads = 0);
+    static bool validParams(const KdfParams &params);
+    static void pbkdf2Sha256(const uint8_t *password, size_t passwordLen, const uint8_t *salt, size_t saltLen,
+                             uint64_t iterations, uint8_t *out, size_t outLen);
+
+    // Largest power-of-two cost whose derivation takes at most targetMs on
+    // this machine, found by timing doubling costs; each timing is appended
+    // to samples as (cost, milliseconds) when given
+    static KdfParams calibrate(double targetMs, uint32_t lanes, uint32_t blockSize = 8,
+                               std::vector<std::pair<uint64_t, double>> *samples = nullptr);
+};
+
+#endif
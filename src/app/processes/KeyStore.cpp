@@ -0,0 +1,176 @@
+#include "KeyStore.hpp"
+#include "Blake3.hpp"
+#include "BinaryIO.hpp"
+#include "../fileHandling/EnvConfig.hpp"
+#include <sys/mman.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+KeyStore &KeyStore::shared()
+{
+    // Never destroyed, so a job still holding a key at exit never touches
+    // unmapped memory
+    static KeyStore *store = new KeyStore();
+    return *store;
+}
+
+KeyStore::KeyStore() : memory(nullptr), mappedBytes(0), useClock(0)
+{
+    size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    mappedBytes = (CAPACITY * sizeof(KeyMaterial) + pageSize - 1) / pageSize * pageSize;
+    void *mapped = mmap(nullptr, mappedBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapped == MAP_FAILED)
+    {
+        mappedBytes = 0;
+        statusMessage = "Could not map key memory";
+        return;
+    }
+    memory = static_cast<KeyMaterial *>(mapped);
+
+    // Keys still work unlocked when RLIMIT_MEMLOCK is too low; getStats says so
+    stats.locked = mlock(memory, mappedBytes) == 0;
+#ifdef MADV_DONTDUMP
+    madvise(memory, mappedBytes, MADV_DONTDUMP);
+#endif
+}
+
+void KeyStore::wipe(void *data, size_t size)
+{
+    volatile uint8_t *bytes = static_cast<volatile uint8_t *>(data);
+    for (size_t i = 0; i < size; i++)
+        bytes[i] = 0;
+}
+
+std::shared_ptr<const KeyMaterial> KeyStore::get(const std::string &passphrase, const std::string &salt,
+                                                 const KdfParams &params)
+{
+    if (!KeyDerivation::validParams(params))
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        statusMessage = "Invalid key derivation parameters";
+        return nullptr;
+    }
+
+    // Length-prefixed so that ("ab", "c") and ("a", "bc") differ
+    std::vector<char> identity(28 + passphrase.size() + salt.size());
+    storeLE64(identity.data(), params.cost);
+    storeLE32(identity.data() + 8, params.blockSize);
+    storeLE32(identity.data() + 12, params.lanes);
+    storeLE64(identity.data() + 16, passphrase.size());
+    storeLE32(identity.data() + 24, static_cast<uint32_t>(salt.size()));
+    std::memcpy(identity.data() + 28, passphrase.data(), passphrase.size());
+    std::memcpy(identity.data() + 28 + passphrase.size(), salt.data(), salt.size());
+    uint8_t id[32];
+    Blake3::subtree(identity.data(), identity.size(), 0).rootDigest(id);
+    wipe(identity.data(), identity.size());
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (Slot &slot : slots)
+        {
+            if (slot.material && std::memcmp(slot.id, id, sizeof(id)) == 0)
+            {
+                slot.lastUse = ++useClock;
+                stats.hits++;
+                return slot.material;
+            }
+        }
+    }
+
+    // Derive without holding the lock; concurrent misses on the same key
+    // both derive it, which costs time but nothing else. The schedules are
+    // expanded later, in the locked slot.
+    const size_t derivedLen = offsetof(KeyMaterial, keySchedule);
+    KeyMaterial derived;
+    auto start = std::chrono::steady_clock::now();
+    KeyDerivation::scrypt(passphrase, salt, params, reinterpret_cast<uint8_t *>(&derived), derivedLen);
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    stats.misses++;
+    stats.deriveMs += ms;
+    if (!memory)
+    {
+        wipe(&derived, sizeof(derived));
+        return nullptr;
+    }
+
+    // Reuse a free slot, or else the least recently used one no job holds
+    Slot *victim = nullptr;
+    for (Slot &slot : slots)
+    {
+        if (!slot.material)
+        {
+            victim = &slot;
+            break;
+        }
+        if (slot.material.use_count() == 1 && (!victim || slot.lastUse < victim->lastUse))
+            victim = &slot;
+    }
+    if (!victim)
+    {
+        wipe(&derived, sizeof(derived));
+        statusMessage = "All " + std::to_string(CAPACITY) + " key slots are in use";
+        return nullptr;
+    }
+    if (victim->material)
+    {
+        victim->material.reset();
+        stats.evictions++;
+    }
+
+    KeyMaterial *entry = memory + (victim - slots);
+    std::memcpy(entry, &derived, derivedLen);
+    wipe(&derived, sizeof(derived));
+    Aes::expandKey(entry->key, KeyMaterial::KEY_LEN, entry->keySchedule);
+    Aes::expandKey(entry->tweakKey, KeyMaterial::KEY_LEN, entry->tweakSchedule);
+    victim->material = std::shared_ptr<KeyMaterial>(entry, [](KeyMaterial *material)
+                                                    { wipe(material, sizeof(KeyMaterial)); });
+    std::memcpy(victim->id, id, sizeof(id));
+    victim->lastUse = ++useClock;
+    return victim->material;
+}
+
+std::shared_ptr<const KeyMaterial> KeyStore::forConfiguredPassphrase()
+{
+    return forPassphrase(EnvConfig::get().passphrase);
+}
+
+std::shared_ptr<const KeyMaterial> KeyStore::forPassphrase(const std::string &passphrase)
+{
+    const EnvConfig &config = EnvConfig::get();
+    KdfParams params;
+    params.cost = config.kdfCost;
+    params.blockSize = config.kdfBlockSize;
+    params.lanes = config.kdfLanes;
+    return get(passphrase, config.salt, params);
+}
+
+void KeyStore::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    for (Slot &slot : slots)
+    {
+        if (slot.material && slot.material.use_count() == 1)
+            slot.material.reset();
+    }
+}
+
+KeyStoreStats KeyStore::getStats() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    KeyStoreStats snapshot = stats;
+    snapshot.cached = 0;
+    for (const Slot &slot : slots)
+        snapshot.cached += slot.material ? 1 : 0;
+    return snapshot;
+}
+
+std::string KeyStore::getStatusMessage() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return statusMessage;
+}
@@ -0,0 +1,90 @@
+#ifndef KEY_STORE_HPP
+#define KEY_STORE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "Aes.hpp"
+#include "KeyDerivation.hpp"
+
+// Everything a job needs from a passphrase: the cipher key, the keystream
+// pad and the tweak key, all produced by one scrypt call. New derived fields
+// go before the schedules, so the bytes of the existing ones stay the same for
+// a passphrase.
+struct KeyMaterial
+{
+    static const size_t KEY_LEN = 32;
+    static const size_t PAD_LEN = 4096;
+
+    uint8_t key[KEY_LEN];
+    uint8_t pad[PAD_LEN]; // repeating XOR pad of the console, obfuscation only
+    uint8_t tweakKey[KEY_LEN]; // second key of two-key modes such as XTS
+    // Expanded from key and tweakKey rather than derived, so that the AES
+    // round keys XTS runs on are as locked as the keys themselves
+    Aes::Schedule keySchedule;
+    Aes::Schedule tweakSchedule;
+};
+
+struct KeyStoreStats
+{
+    uint64_t hits = 0;
+    uint64_t misses = 0;    // each one cost a full derivation
+    uint64_t evictions = 0;
+    double deriveMs = 0;    // total time spent deriving
+    size_t cached = 0;
+    bool locked = false;    // slots are pinned in RAM
+};
+
+// Process-wide cache of derived keys, so repeated jobs with the same
+// passphrase skip the deliberately slow KDF.
+//
+// Entries live in one mapping that is mlock'd (never swapped) and excluded
+// from core dumps; an entry is wiped when it is evicted or cleared and no job
+// still holds it. Lookups are keyed by a BLAKE3 hash of the passphrase, salt
+// and parameters, so the passphrase itself is never kept.
+class KeyStore
+{
+public:
+    static const size_t CAPACITY = 8;
+
+    static KeyStore &shared();
+
+    // Cached or freshly derived key material, or nullptr (see getStatusMessage)
+    std::shared_ptr<const KeyMaterial> get(const std::string &passphrase, const std::string &salt,
+                                           const KdfParams &params);
+    // Key for CRYPTOCORE_PASSPHRASE with the KDF settings from .env
+    std::shared_ptr<const KeyMaterial> forConfiguredPassphrase();
+    // Key for another passphrase with the same salt and KDF settings
+    std::shared_ptr<const KeyMaterial> forPassphrase(const std::string &passphrase);
+    // Wipes every entry no job is using
+    void clear();
+    KeyStoreStats getStats() const;
+    std::string getStatusMessage() const;
+
+    // Overwrites memory in a way the compiler may not drop
+    static void wipe(void *data, size_t size);
+
+private:
+    KeyStore();
+    KeyStore(const KeyStore &) = delete;
+    KeyStore &operator=(const KeyStore &) = delete;
+
+    struct Slot
+    {
+        uint8_t id[32];
+        uint64_t lastUse = 0;
+        std::shared_ptr<KeyMaterial> material; // empty when the slot is free
+    };
+
+    mutable std::mutex mutex;
+    KeyMaterial *memory;
+    size_t mappedBytes;
+    Slot slots[CAPACITY];
+    uint64_t useClock;
+    KeyStoreStats stats;
+    std::string statusMessage;
+};
+
+#endif
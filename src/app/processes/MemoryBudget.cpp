@@ -0,0 +1,125 @@
+#include "MemoryBudget.hpp"
+#include "../fileHandling/EnvConfig.hpp"
+#include <algorithm>
+#include <chrono>
+
+MemoryBudget &MemoryBudget::shared()
+{
+    static MemoryBudget *budget = new MemoryBudget();
+    return *budget;
+}
+
+MemoryBudget::MemoryBudget()
+    : nextTicket(0), limit(EnvConfig::get().memoryBudget), reserved(0), peakReserved(0), waits(0), waitNs(0)
+{
+}
+
+void MemoryBudget::setLimit(uint64_t bytes)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    limit = bytes;
+    released.notify_all();
+}
+
+uint64_t MemoryBudget::getLimit() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return limit;
+}
+
+bool MemoryBudget::fits(uint64_t bytes) const
+{
+    return limit == 0 || reserved == 0 || reserved + bytes <= limit;
+}
+
+void MemoryBudget::grant(uint64_t bytes)
+{
+    reserved += bytes;
+    peakReserved = std::max(peakReserved, reserved);
+}
+
+bool MemoryBudget::reserve(uint64_t bytes, int64_t &waitedNs, const std::function<bool()> &abandon)
+{
+    waitedNs = 0;
+    std::unique_lock<std::mutex> lock(mutex);
+    if (queue.empty() && fits(bytes))
+    {
+        grant(bytes);
+        return true;
+    }
+
+    // Strictly in arrival order, so a large reservation is not starved by a
+    // stream of small ones slipping into every gap
+    uint64_t ticket = nextTicket++;
+    queue.push_back(ticket);
+    auto start = std::chrono::steady_clock::now();
+    bool granted = false;
+    while (true)
+    {
+        if (queue.front() == ticket && fits(bytes))
+        {
+            granted = true;
+            break;
+        }
+        if (abandon && abandon())
+            break;
+        released.wait_for(lock, std::chrono::milliseconds(POLL_MS));
+    }
+    queue.erase(std::find(queue.begin(), queue.end(), ticket));
+
+    waitedNs = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start)
+                   .count();
+    waits++;
+    waitNs += waitedNs;
+    if (granted)
+        grant(bytes);
+    // The next in line may fit now, or may have been blocked only by us
+    released.notify_all();
+    return granted;
+}
+
+void MemoryBudget::release(uint64_t bytes)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    reserved -= std::min(bytes, reserved);
+    released.notify_all();
+}
+
+MemoryBudgetStats MemoryBudget::getStats() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    MemoryBudgetStats stats;
+    stats.limit = limit;
+    stats.reserved = reserved;
+    stats.peakReserved = peakReserved;
+    stats.waits = waits;
+    stats.waitNs = waitNs;
+    return stats;
+}
+
+MemoryReservation &MemoryReservation::operator=(MemoryReservation &&other) noexcept
+{
+    if (this != &other)
+    {
+        release();
+        bytes = other.bytes;
+        other.bytes = 0;
+    }
+    return *this;
+}
+
+bool MemoryReservation::reserve(uint64_t size, int64_t &waitedNs, const std::function<bool()> &abandon)
+{
+    release();
+    if (!MemoryBudget::shared().reserve(size, waitedNs, abandon))
+        return false;
+    bytes = size;
+    return true;
+}
+
+void MemoryReservation::release()
+{
+    if (bytes > 0)
+        MemoryBudget::shared().release(bytes);
+    bytes = 0;
+}
@@ -0,0 +1,83 @@
+#ifndef MEMORY_BUDGET_HPP
+#define MEMORY_BUDGET_HPP
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+
+struct MemoryBudgetStats
+{
+    uint64_t limit = 0;        // 0 when there is no budget
+    uint64_t reserved = 0;
+    uint64_t peakReserved = 0;
+    uint64_t waits = 0;        // reservations that had to wait
+    int64_t waitNs = 0;        // summed over all of them
+};
+
+// Process-wide cap on the buffer memory of all runs at once, so concurrent
+// jobs in the daemon or the GUI cannot add up past what the machine has.
+//
+// Workers reserve their buffers before they acquire them and a reservation
+// that does not fit waits, in arrival order, until others release enough.
+// A reservation larger than the whole budget is let through once nothing
+// else is reserved, so any job can still run, alone.
+class MemoryBudget
+{
+public:
+    static constexpr int64_t POLL_MS = 50;
+
+    // Limit from CRYPTOCORE_MEMORY_BUDGET_MB, unlimited if unset or 0
+    static MemoryBudget &shared();
+
+    void setLimit(uint64_t bytes);
+    uint64_t getLimit() const;
+
+    // Blocks until bytes fit. Gives up and returns false as soon as abandon,
+    // polled every POLL_MS with the budget locked, returns true. waitedNs
+    // gets the time spent waiting.
+    bool reserve(uint64_t bytes, int64_t &waitedNs, const std::function<bool()> &abandon = nullptr);
+    void release(uint64_t bytes);
+
+    MemoryBudgetStats getStats() const;
+
+private:
+    MemoryBudget();
+    // The caller holds mutex
+    bool fits(uint64_t bytes) const;
+    void grant(uint64_t bytes);
+
+    mutable std::mutex mutex;
+    std::condition_variable released;
+    std::deque<uint64_t> queue; // tickets of waiting reservations, oldest first
+    uint64_t nextTicket;
+    uint64_t limit;
+    uint64_t reserved;
+    uint64_t peakReserved;
+    uint64_t waits;
+    int64_t waitNs;
+};
+
+// A reservation held for as long as the object lives
+class MemoryReservation
+{
+public:
+    MemoryReservation() : bytes(0) {}
+    MemoryReservation(MemoryReservation &&other) noexcept : bytes(other.bytes) { other.bytes = 0; }
+    MemoryReservation &operator=(MemoryReservation &&other) noexcept;
+    MemoryReservation(const MemoryReservation &) = delete;
+    MemoryReservation &operator=(const MemoryReservation &) = delete;
+    ~MemoryReservation() { release(); }
+
+    // Same as MemoryBudget::reserve on the shared budget. Whatever was held
+    // is released first, so nothing is held while waiting.
+    bool reserve(uint64_t bytes, int64_t &waitedNs, const std::function<bool()> &abandon = nullptr);
+    void release();
+    uint64_t size() const { return bytes; }
+
+private:
+    uint64_t bytes;
+};
+
+#endif
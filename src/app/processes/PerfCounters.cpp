@@ -0,0 +1,147 @@
+#include "PerfCounters.hpp"
+#include <cerrno>
+#include <cstring>
+
+#if defined(__linux__) && __has_include(<linux/perf_event.h>)
+#define CRYPTOCORE_PERF_EVENTS 1
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+void PerfSample::add(const PerfSample &other)
+{
+    cycles += other.cycles;
+    instructions += other.instructions;
+    llcMisses += other.llcMisses;
+    branchMisses += other.branchMisses;
+    bytes += other.bytes;
+}
+
+double PerfSample::cyclesPerByte() const
+{
+    return bytes > 0 ? static_cast<double>(cycles) / bytes : 0.0;
+}
+
+double PerfSample::instructionsPerCycle() const
+{
+    return cycles > 0 ? static_cast<double>(instructions) / cycles : 0.0;
+}
+
+PerfCounters::PerfCounters() : members(0)
+{
+    for (int i = 0; i < EVENT_COUNT; i++)
+        fds[i] = order[i] = -1;
+}
+
+PerfCounters::~PerfCounters()
+{
+    close();
+}
+
+#ifdef CRYPTOCORE_PERF_EVENTS
+
+bool PerfCounters::open()
+{
+    close();
+    const uint64_t configs[EVENT_COUNT] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                                           PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+    for (int event = 0; event < EVENT_COUNT; event++)
+    {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = configs[event];
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        // Members follow the leader, which starts stopped
+        attr.disabled = event == CYCLES ? 1 : 0;
+        int fd = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, event == CYCLES ? -1 : fds[CYCLES], 0));
+        if (fd < 0)
+        {
+            if (event != CYCLES)
+                continue;
+            statusMessage = errno == EACCES || errno == EPERM
+                                ? "Hardware counters not permitted (see /proc/sys/kernel/perf_event_paranoid)"
+                                : std::string("No hardware counters: ") + std::strerror(errno);
+            return false;
+        }
+        fds[event] = fd;
+        order[members++] = event;
+    }
+    statusMessage.clear();
+    return true;
+}
+
+void PerfCounters::close()
+{
+    // Members before the leader
+    for (int event = EVENT_COUNT - 1; event >= 0; event--)
+    {
+        if (fds[event] != -1)
+            ::close(fds[event]);
+        fds[event] = order[event] = -1;
+    }
+    members = 0;
+}
+
+void PerfCounters::start()
+{
+    if (isOpen())
+        ioctl(fds[CYCLES], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+void PerfCounters::stop()
+{
+    if (isOpen())
+        ioctl(fds[CYCLES], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+}
+
+PerfSample PerfCounters::read() const
+{
+    PerfSample sample;
+    if (!isOpen())
+        return sample;
+
+    // nr, time enabled, time running, then one value per member
+    uint64_t values[3 + EVENT_COUNT];
+    ssize_t got = ::read(fds[CYCLES], values, sizeof(values));
+    if (got < static_cast<ssize_t>(3 * sizeof(uint64_t)) || values[0] > static_cast<uint64_t>(members))
+        return sample;
+    double scale = values[2] > 0 && values[2] < values[1] ? static_cast<double>(values[1]) / values[2] : 1.0;
+
+    uint64_t *fields[EVENT_COUNT] = {&sample.cycles, &sample.instructions, &sample.llcMisses, &sample.branchMisses};
+    for (uint64_t i = 0; i < values[0]; i++)
+        *fields[order[i]] = static_cast<uint64_t>(values[3 + i] * scale);
+    return sample;
+}
+
+#else
+
+bool PerfCounters::open()
+{
+    statusMessage = "Hardware counters need Linux perf events";
+    return false;
+}
+
+void PerfCounters::close()
+{
+}
+
+void PerfCounters::start()
+{
+}
+
+void PerfCounters::stop()
+{
+}
+
+PerfSample PerfCounters::read() const
+{
+    return PerfSample();
+}
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef PERF_COUNTERS_HPP
+#define PERF_COUNTERS_HPP
+
+#include <cstdint>
+#include <string>
+
+// Hardware counter totals over some phase of work
+struct PerfSample
+{
+    uint64_t cycles = 0;
+    uint64_t instructions = 0;
+    uint64_t llcMisses = 0;    // last-level cache
+    uint64_t branchMisses = 0;
+    uint64_t bytes = 0;        // processed while counting
+
+    void add(const PerfSample &other);
+    // 0 when there is nothing to divide by
+    double cyclesPerByte() const;
+    double instructionsPerCycle() const;
+};
+
+// One perf_event_open group of cycles, instructions, LLC misses and branch
+// misses for the calling thread, user space only, counting only between
+// start() and stop(). Where the kernel, a container or perf_event_paranoid
+// gives no hardware counters open() fails and everything else is a no-op.
+// Events other than cycles that the CPU lacks read as 0, and counts are
+// scaled up if the kernel had to multiplex the group.
+class PerfCounters
+{
+public:
+    PerfCounters();
+    ~PerfCounters();
+    PerfCounters(const PerfCounters &) = delete;
+    PerfCounters &operator=(const PerfCounters &) = delete;
+
+    bool open();
+    void close();
+    bool isOpen() const { return fds[0] != -1; }
+    void start();
+    void stop();
+    // Totals so far; bytes is left to the caller
+    PerfSample read() const;
+    std::string getStatusMessage() const { return statusMessage; }
+
+private:
+    enum Event
+    {
+        CYCLES,
+        INSTRUCTIONS,
+        LLC_MISSES,
+        BRANCH_MISSES,
+        EVENT_COUNT
+    };
+
+    int fds[EVENT_COUNT];
+    // Group read order: members that failed to open are left out of it
+    int order[EVENT_COUNT];
+    int members;
+    std::string statusMessage;
+};
+
+#endif
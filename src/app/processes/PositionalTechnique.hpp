@@ -0,0 +1,23 @@
+#ifndef POSITIONAL_TECHNIQUE_HPP
+#define POSITIONAL_TECHNIQUE_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+// A technique whose output depends on where the bytes sit in the file, such
+// as a tweakable sector cipher. TaskManager passes every span together with
+// its file offset; spans always start on a unit boundary and hold whole
+// units, except for the last unit of the file.
+class PositionalTechnique
+{
+public:
+    virtual ~PositionalTechnique() = default;
+
+    virtual void encryptAt(char *data, size_t size, uint64_t fileOffset) = 0;
+    virtual void decryptAt(char *data, size_t size, uint64_t fileOffset) = 0;
+    // Bytes that must be transformed together; a power of two that divides
+    // TaskManager::TRANSFORM_UNIT
+    virtual size_t unitSize() const = 0;
+};
+
+#endif
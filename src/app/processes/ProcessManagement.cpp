@@ -1,4 +1,8 @@
 #include "ProcessManagement.hpp"
+#include "BufferPool.hpp"
+#include "KeyStore.hpp"
+#include "../fileHandling/EnvConfig.hpp"
+#include <algorithm>
 #include <iostream>
 #include <string>
 #include <sys/wait.h>
@@ -6,10 +10,12 @@
 #include <sstream>
 #include <fstream>
 
-// Simple XOR encryption/decryption key
-const char CRYPTO_KEY = 0x42; // You can change this key
+// Simple XOR encryption/decryption key, used when .env sets no passphrase
+const char CRYPTO_KEY = 0x42;
+const size_t CHUNK_SIZE = 1024 * 1024;
 
-static void executeCryption(const std::string &taskStr)
+// Returns false with error set if the task could not be done
+static bool executeCryption(const std::string &taskStr, std::string &error)
 {
     std::istringstream iss(taskStr);
     std::string filePath;
@@ -20,45 +26,165 @@ static void executeCryption(const std::string &taskStr)
         std::fstream file(filePath, std::ios::in | std::ios::out | std::ios::binary);
         if (!file)
         {
-            std::cout << "Failed to open file: " << filePath << std::endl;
-            return;
+            error = "Failed to open file: " + filePath;
+            return false;
         }
 
-        // Read entire file
-        std::vector<char> buffer(std::istreambuf_iterator<char>(file), {});
-
-        // XOR each byte with the key
-        for (char &byte : buffer)
+        // The KeyStore caches the derived pad, so only the first task of a
+        // session pays for the derivation.
+        //
+        // This is obfuscation, not encryption: the same 4 KiB pad repeats over
+        // every file, so two bytes at equal offsets modulo 4096, in one file or
+        // two, XOR to the XOR of their plaintexts. Anything that has to stay
+        // secret goes through cryptocore with the xts technique.
+        std::shared_ptr<const KeyMaterial> key;
+        if (!EnvConfig::get().passphrase.empty())
         {
-            byte ^= CRYPTO_KEY;
+            key = KeyStore::shared().forConfiguredPassphrase();
+            if (!key)
+            {
+                error = "Could not derive the key: " + KeyStore::shared().getStatusMessage();
+                return false;
+            }
         }
 
-        // Write back to file
-        file.seekp(0);
-        file.write(buffer.data(), buffer.size());
-        file.flush();
+        // Stream the file through one pooled chunk instead of reading it whole
+        PooledBuffer buffer = BufferPool::shared().acquire(CHUNK_SIZE);
+        std::streamoff offset = 0;
+        while (true)
+        {
+            file.seekg(offset);
+            file.read(buffer.data(), buffer.size());
+            std::streamsize size = file.gcount();
+            if (size <= 0)
+                break;
+
+            // XOR each byte with the key, or with the pad byte for its file offset
+            if (key)
+            {
+                for (std::streamsize i = 0; i < size; i++)
+                    buffer.data()[i] ^= key->pad[(offset + i) % KeyMaterial::PAD_LEN];
+            }
+            else
+            {
+                for (std::streamsize i = 0; i < size; i++)
+                {
+                    buffer.data()[i] ^= CRYPTO_KEY;
+                }
+            }
 
-        std::cout << "Successfully " << (actionStr == "ENCRYPT" ? "encrypted" : "decrypted")
-                  << " file: " << filePath << std::endl;
+            // Write the chunk back in place
+            file.clear();
+            file.seekp(offset);
+            file.write(buffer.data(), size);
+            offset += size;
+        }
+        file.flush();
+        return true;
     }
+    error = "Invalid task data format";
+    return false;
 }
 
-ProcessManagement::ProcessManagement() {}
+ProcessManagement::ProcessManagement() : capacity(0), stopping(false) {}
+
+ProcessManagement::~ProcessManagement()
+{
+    stopWorkers();
+}
 
 bool ProcessManagement::submitToQueue(std::unique_ptr<Task> task)
 {
-    taskQueue.push(std::move(task));
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        if (!workers.empty() && taskQueue.size() >= capacity)
+            return false;
+        taskQueue.push(std::move(task));
+    }
+    queueReady.notify_one();
     return true;
 }
 
 void ProcessManagement::executeTasks()
 {
-    while (!taskQueue.empty())
+    while (true)
     {
         // Move the unique_ptr out of the queue's front
-        std::unique_ptr<Task> tasktoExecute = std::move(taskQueue.front());
-        taskQueue.pop();
+        std::unique_ptr<Task> tasktoExecute;
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            if (taskQueue.empty())
+                break;
+            tasktoExecute = std::move(taskQueue.front());
+            taskQueue.pop();
+        }
         std::cout << "Executing Task: " << tasktoExecute->toString() << std::endl;
-        executeCryption(tasktoExecute->toString());
+        std::string error;
+        if (executeCryption(tasktoExecute->toString(), error))
+        {
+            std::cout << "Successfully " << (tasktoExecute->action == Action::ENCRYPT ? "encrypted" : "decrypted")
+                      << " file: " << tasktoExecute->filePath << std::endl;
+        }
+        else
+        {
+            std::cout << error << std::endl;
+        }
+    }
+}
+
+void ProcessManagement::startWorkers(size_t count, size_t queueCapacity, TaskDoneCallback done)
+{
+    stopWorkers();
+    std::lock_guard<std::mutex> lock(queueMutex);
+    capacity = std::max<size_t>(queueCapacity, 1);
+    stopping = false;
+    onDone = std::move(done);
+    for (size_t i = 0; i < std::max<size_t>(count, 1); i++)
+        workers.emplace_back(&ProcessManagement::workerLoop, this);
+}
+
+void ProcessManagement::stopWorkers()
+{
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        if (workers.empty())
+            return;
+        stopping = true;
+    }
+    queueReady.notify_all();
+    for (std::thread &worker : workers)
+        worker.join();
+    std::lock_guard<std::mutex> lock(queueMutex);
+    workers.clear();
+}
+
+size_t ProcessManagement::queuedTasks() const
+{
+    std::lock_guard<std::mutex> lock(queueMutex);
+    return taskQueue.size();
+}
+
+void ProcessManagement::workerLoop()
+{
+    while (true)
+    {
+        std::unique_ptr<Task> task;
+        {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            queueReady.wait(lock, [this]
+                            { return stopping || !taskQueue.empty(); });
+            if (taskQueue.empty())
+                return;
+            task = std::move(taskQueue.front());
+            taskQueue.pop();
+        }
+
+        std::string filePath = task->filePath;
+        std::string error;
+        bool ok = executeCryption(task->toString(), error);
+        // The task's own stream is closed before anyone hears the file is done
+        task.reset();
+        if (onDone)
+            onDone(filePath, ok, error);
     }
 }
\ No newline at end of file
@@ -1,18 +1,44 @@
 #ifndef PROCESS_MANAGEMENT_HPP
 #define PROCESS_MANAGEMENT_HPP
 #include "Task.hpp"
+#include <condition_variable>
+#include <functional>
 #include <queue>
 #include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Called on a worker thread once a task is done and its file closed
+typedef std::function<void(const std::string &filePath, bool ok, const std::string &error)> TaskDoneCallback;
 
 class ProcessManagement
 {
     public:
         ProcessManagement();
+        ~ProcessManagement();
+        // False while workers run and the queue already holds its capacity
         bool submitToQueue(std::unique_ptr<Task> task);
-        void executeTasks();   
-        
+        // Runs the queued tasks one after another on the calling thread
+        void executeTasks();
+        // Runs tasks on count threads as they are submitted instead, with at
+        // most capacity of them waiting, so a burst of submissions cannot
+        // hold more open files than that
+        void startWorkers(size_t count, size_t capacity, TaskDoneCallback done);
+        // Lets the workers finish what is queued, then joins them
+        void stopWorkers();
+        size_t queuedTasks() const;
+
     private:
+        void workerLoop();
+
         std::queue<std::unique_ptr<Task>> taskQueue;
+        mutable std::mutex queueMutex;
+        std::condition_variable queueReady;
+        std::vector<std::thread> workers;
+        size_t capacity;
+        bool stopping;
+        TaskDoneCallback onDone;
 };
 
-#endif
\ No newline at end of file
+#endif
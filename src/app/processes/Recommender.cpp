@@ -0,0 +1,193 @@
+#include "Recommender.hpp"
+#include "XtsEncryption.hpp"
+#include "../fileHandling/EnvConfig.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+
+namespace
+{
+    const double MIB = 1024.0 * 1024.0;
+
+    // Below this, a container's index and chunk headers eat into the savings
+    const uint64_t COMPRESS_MIN_SIZE = 1024 * 1024;
+
+    const EncryptionType CANDIDATES[] = {EncryptionType::XOR, EncryptionType::SIMPLE_SUBSTITUTION,
+                                         EncryptionType::CAESAR_CIPHER, EncryptionType::REVERSE,
+                                         EncryptionType::ROT13, AES_XTS};
+
+    std::string format(const char *pattern, double value)
+    {
+        char text[64];
+        std::snprintf(text, sizeof(text), pattern, value);
+        return text;
+    }
+}
+
+Recommender::Recommender(BenchmarkManager &techniques) : factory(techniques) {}
+
+void Recommender::setMeasuredThroughput(EncryptionType type, double mbps)
+{
+    if (mbps > 0)
+        measuredMBps[static_cast<int>(type)] = mbps;
+}
+
+std::string Recommender::getStatusMessage() const
+{
+    return statusMessage;
+}
+
+int Recommender::strengthOf(EncryptionType type)
+{
+    if (type == AES_XTS)
+        return 5;
+    switch (type)
+    {
+    case EncryptionType::XOR:
+    case EncryptionType::SIMPLE_SUBSTITUTION:
+    case EncryptionType::CAESAR_CIPHER:
+        return 1;
+    default:
+        // REVERSE only reorders bytes; ROT13 leaves everything but letters
+        return 0;
+    }
+}
+
+const char *Recommender::nameOf(EncryptionType type)
+{
+    if (type == AES_XTS)
+        return "xts";
+    switch (type)
+    {
+    case EncryptionType::XOR:
+        return "xor";
+    case EncryptionType::SIMPLE_SUBSTITUTION:
+        return "substitution";
+    case EncryptionType::CAESAR_CIPHER:
+        return "caesar";
+    case EncryptionType::REVERSE:
+        return "reverse";
+    case EncryptionType::ROT13:
+        return "rot13";
+    }
+    return "unknown";
+}
+
+double Recommender::storageMBps(StorageKind storage)
+{
+    switch (storage)
+    {
+    case StorageKind::SOLID_STATE:
+        return 1500.0;
+    case StorageKind::ROTATIONAL:
+        return 150.0;
+    default:
+        return 500.0;
+    }
+}
+
+double Recommender::estimateSeconds(uint64_t bytes, EncryptionType type, double kernelMBps, size_t workers,
+                                    StorageKind storage) const
+{
+    // Every byte is read and written back, so storage does two passes
+    double rate = std::min(kernelMBps * workers, storageMBps(storage) / 2);
+    auto measured = measuredMBps.find(static_cast<int>(type));
+    if (measured != measuredMBps.end())
+        rate = std::min(rate, measured->second);
+    return bytes / MIB / rate;
+}
+
+bool Recommender::recommend(const std::string &filePath, Recommendation &out)
+{
+    auto start = std::chrono::steady_clock::now();
+    out = Recommendation();
+    if (!FileSniffer::sniff(filePath, out.type))
+    {
+        statusMessage = "Could not read " + filePath;
+        return false;
+    }
+    const FileType &type = out.type;
+    out.reasons.push_back(type.description + ", " + format("%.1f MB", type.size / MIB) + ", entropy " +
+                          format("%.2f bits/byte", type.entropy));
+
+    if (type.kind == FileKind::EMPTY || type.likelyEncrypted())
+    {
+        out.skip = true;
+        out.reasons.push_back(type.kind == FileKind::EMPTY
+                                  ? "Nothing to encrypt"
+                                  : "Already looks encrypted or compressed; another pass would protect nothing");
+        out.decideMicros = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+        return true;
+    }
+
+    AutoTuner &tuner = AutoTuner::shared();
+    size_t cores = tuner.getHostProfile().cores;
+    StorageKind storage = tuner.getStorageKind(filePath);
+
+    // XTS is timed with a throwaway key so no passphrase has to be derived
+    const EnvConfig &config = EnvConfig::get();
+    bool xtsReady = !config.passphrase.empty() && XtsEncryption::validSectorSize(config.xtsSectorSize);
+    const uint8_t probeKey[XtsEncryption::KEY_LEN] = {};
+
+    // Strongest technique first; among equals the fastest
+    std::unique_ptr<EncryptionTechnique> chosen;
+    double chosenSeconds = 0;
+    for (EncryptionType candidate : CANDIDATES)
+    {
+        std::unique_ptr<EncryptionTechnique> instance;
+        if (candidate == AES_XTS)
+        {
+            if (xtsReady)
+                instance = std::make_unique<XtsEncryption>(probeKey, probeKey, config.xtsSectorSize);
+        }
+        else
+            instance = factory.getTechnique(candidate);
+        if (!instance)
+            continue;
+
+        double seconds = estimateSeconds(type.size, candidate, tuner.getKernelThroughput(*instance), cores, storage);
+        int strength = strengthOf(candidate);
+        int chosenStrength = chosen ? strengthOf(chosen->getType()) : -1;
+        if (strength > chosenStrength || (strength == chosenStrength && seconds < chosenSeconds))
+        {
+            chosen = std::move(instance);
+            chosenSeconds = seconds;
+        }
+    }
+    if (!chosen)
+    {
+        statusMessage = "No encryption technique is available";
+        return false;
+    }
+    out.technique = chosen->getType();
+    out.techniqueName = nameOf(out.technique);
+
+    if (out.technique == AES_XTS)
+        out.reasons.push_back("xts: the only technique keyed by a secret (CRYPTOCORE_PASSPHRASE)");
+    else
+        out.reasons.push_back(std::string(out.techniqueName) +
+                              ": fastest of the fixed-key techniques; set CRYPTOCORE_PASSPHRASE to get AES-XTS");
+
+    // Text shrinks a lot and containers keep chunked random access
+    if (type.compressible() && type.size >= COMPRESS_MIN_SIZE)
+    {
+        out.packCompressed = true;
+        out.reasons.push_back("Compressible content: pack --compress stores it smaller and reads ranges by chunk");
+    }
+    else if (out.technique == AES_XTS && type.kind == FileKind::DATA)
+    {
+        out.reasons.push_back("In place: every sector stays readable and patchable on its own");
+    }
+
+    out.plan = tuner.plan(filePath, static_cast<size_t>(type.size), *chosen);
+    out.reasons.push_back(out.plan.reason);
+    out.expectedSeconds = estimateSeconds(type.size, out.technique, out.plan.kernelMBps, out.plan.workers, storage);
+    if (out.plan.kernelMBps * out.plan.workers > storageMBps(storage) / 2)
+        out.reasons.push_back("Storage-bound: the disk, not the cipher, sets the pace");
+    out.reasons.push_back(out.expectedSeconds < 1 ? format("Expected about %.0f ms", out.expectedSeconds * 1000)
+                                                  : format("Expected about %.1f s", out.expectedSeconds));
+
+    out.decideMicros = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    return true;
+}
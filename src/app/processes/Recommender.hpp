@@ -0,0 +1,61 @@
+#ifndef RECOMMENDER_HPP
+#define RECOMMENDER_HPP
+
+#include <map>
+#include <string>
+#include <vector>
+#include "EncryptionTechnique.hpp"
+#include "AutoTuner.hpp"
+#include "BenchmarkManager.hpp"
+#include "../fileHandling/FileSniffer.hpp"
+
+// Settings suggested for one file, with one line of explanation per decision
+struct Recommendation
+{
+    bool skip = false;           // already encrypted, compressed or empty
+    EncryptionType technique = EncryptionType::XOR;
+    std::string techniqueName;
+    bool packCompressed = false; // pack --compress instead of encrypting in place
+    TuningPlan plan;             // mode, workers and block size
+    double expectedSeconds = 0;
+    FileType type;
+    std::vector<std::string> reasons;
+    double decideMicros = 0;     // time spent deciding
+};
+
+// Offline replacement for asking a remote model which settings to use.
+//
+// A small cost model over what is already known locally: the sniffed kind,
+// entropy and size of the file, the storage behind it, the host's cores and
+// the per-core kernel throughput the AutoTuner calibrated and cached. Results
+// of a benchmark run, when given, cap a technique's estimate with what was
+// actually measured. Once the kernels are calibrated a recommendation takes
+// microseconds and reads only the file's first few KiB.
+class Recommender
+{
+public:
+    explicit Recommender(BenchmarkManager &factory);
+
+    // Whole-run throughput a benchmark measured for a technique on this host
+    void setMeasuredThroughput(EncryptionType type, double mbps);
+    bool recommend(const std::string &filePath, Recommendation &out);
+    std::string getStatusMessage() const;
+
+    // Rough strength of a technique: 0 leaves the bytes readable, 1 is a
+    // fixed-key obfuscation, 5 a standard cipher under a secret key
+    static int strengthOf(EncryptionType type);
+    // Name the CLI accepts for --technique
+    static const char *nameOf(EncryptionType type);
+
+private:
+    // Sustained MB/s of reading and writing back a file on this storage
+    static double storageMBps(StorageKind storage);
+    double estimateSeconds(uint64_t bytes, EncryptionType type, double kernelMBps, size_t workers,
+                           StorageKind storage) const;
+
+    BenchmarkManager &factory;
+    std::map<int, double> measuredMBps; // keyed by EncryptionType
+    std::string statusMessage;
+};
+
+#endif
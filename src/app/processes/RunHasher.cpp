@@ -0,0 +1,125 @@
+#include "RunHasher.hpp"
+#include <sys/mman.h>
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+const size_t RunHasher::UNIT;
+
+namespace
+{
+    const uint64_t UNIT_CHUNKS = RunHasher::UNIT / Blake3::CHUNK_LEN;
+}
+
+RunHasher::RunHasher() : fileSize(0), unitCount(0), sharedBytes(0), shared(nullptr)
+{
+}
+
+RunHasher::~RunHasher()
+{
+    close();
+}
+
+bool RunHasher::open(uint64_t size)
+{
+    close();
+    fileSize = size;
+    unitCount = std::max<uint64_t>(1, (size + UNIT - 1) / UNIT);
+
+    // 32 bytes per unit and side: 1 MiB of chaining values per 1 GiB of file
+    sharedBytes = sizeof(Shared) + unitCount * 2 * 8 * sizeof(uint32_t);
+    void *memory = mmap(nullptr, sharedBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED)
+    {
+        sharedBytes = 0;
+        return false;
+    }
+    shared = new (memory) Shared();
+    shared->hashedUnits[PLAINTEXT].store(0, std::memory_order_relaxed);
+    shared->hashedUnits[CIPHERTEXT].store(0, std::memory_order_relaxed);
+    // An empty file has no blocks to hash but still has a digest
+    if (size == 0)
+    {
+        for (int side = PLAINTEXT; side <= CIPHERTEXT; side++)
+            hashEmpty(static_cast<Side>(side));
+    }
+    return true;
+}
+
+void RunHasher::close()
+{
+    if (shared)
+    {
+        munmap(shared, sharedBytes);
+        shared = nullptr;
+        sharedBytes = 0;
+    }
+}
+
+uint32_t *RunHasher::chainingValue(uint64_t unit, Side side) const
+{
+    uint32_t *values = reinterpret_cast<uint32_t *>(reinterpret_cast<char *>(shared) + sizeof(Shared));
+    return values + (unit * 2 + side) * 8;
+}
+
+void RunHasher::hashRange(const char *data, size_t size, uint64_t offset, Side side)
+{
+    for (size_t done = 0; done < size; done += UNIT)
+    {
+        uint64_t unit = (offset + done) / UNIT;
+        size_t length = std::min(UNIT, size - done);
+        Blake3::Output output = Blake3::subtree(data + done, length, unit * UNIT_CHUNKS);
+        if (unit == 0)
+            shared->firstUnit[side] = output;
+        output.chainingValue(chainingValue(unit, side));
+        shared->hashedUnits[side].fetch_add(1, std::memory_order_release);
+    }
+}
+
+void RunHasher::hashEmpty(Side side)
+{
+    shared->firstUnit[side] = Blake3::subtree("", 0, 0);
+    shared->firstUnit[side].chainingValue(chainingValue(0, side));
+    shared->hashedUnits[side].store(1, std::memory_order_release);
+}
+
+bool RunHasher::isComplete(Side side) const
+{
+    return shared && shared->hashedUnits[side].load(std::memory_order_acquire) == unitCount;
+}
+
+// Joins units the way BLAKE3 splits chunks: the left subtree always holds the
+// largest power of two chunks below the total, a whole number of units
+void RunHasher::merge(uint64_t firstUnit, uint64_t chunks, Side side, uint32_t out[8]) const
+{
+    if (chunks <= UNIT_CHUNKS)
+    {
+        std::memcpy(out, chainingValue(firstUnit, side), 8 * sizeof(uint32_t));
+        return;
+    }
+    uint64_t left = Blake3::leftSubtreeChunks(chunks);
+    uint32_t leftValue[8];
+    uint32_t rightValue[8];
+    merge(firstUnit, left, side, leftValue);
+    merge(firstUnit + left / UNIT_CHUNKS, chunks - left, side, rightValue);
+    Blake3::parent(leftValue, rightValue).chainingValue(out);
+}
+
+std::string RunHasher::digest(Side side) const
+{
+    uint8_t bytes[Blake3::DIGEST_LEN];
+    uint64_t chunks = std::max<uint64_t>(1, (fileSize + Blake3::CHUNK_LEN - 1) / Blake3::CHUNK_LEN);
+    if (chunks <= UNIT_CHUNKS)
+    {
+        shared->firstUnit[side].rootDigest(bytes);
+        return Blake3::toHex(bytes);
+    }
+
+    uint64_t left = Blake3::leftSubtreeChunks(chunks);
+    uint32_t leftValue[8];
+    uint32_t rightValue[8];
+    merge(0, left, side, leftValue);
+    merge(left / UNIT_CHUNKS, chunks - left, side, rightValue);
+    Blake3::parent(leftValue, rightValue).rootDigest(bytes);
+    return Blake3::toHex(bytes);
+}
@@ -0,0 +1,60 @@
+#ifndef RUN_HASHER_HPP
+#define RUN_HASHER_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "Blake3.hpp"
+
+// Whole-file BLAKE3 digests of a run's input and output, built from the
+// blocks workers already hold, so hashing costs no extra I/O.
+//
+// Every aligned 64 KiB unit is a BLAKE3 subtree of its own. Workers store the
+// chaining value of each unit they transform in shared memory (threads and
+// forked children alike); the digests are joined from those values once the
+// run is over.
+class RunHasher
+{
+public:
+    enum Side
+    {
+        PLAINTEXT = 0,
+        CIPHERTEXT = 1
+    };
+
+    static const size_t UNIT = 64 * 1024;
+
+    RunHasher();
+    ~RunHasher();
+    RunHasher(const RunHasher &) = delete;
+    RunHasher &operator=(const RunHasher &) = delete;
+
+    bool open(uint64_t fileSize);
+    void close();
+
+    // Hashes data found at file offset offset, which must be a multiple of
+    // UNIT. Safe from threads and from forked workers.
+    void hashRange(const char *data, size_t size, uint64_t offset, Side side);
+    // True once every unit of the file has been hashed for that side
+    bool isComplete(Side side) const;
+    std::string digest(Side side) const;
+
+private:
+    struct Shared
+    {
+        std::atomic<uint64_t> hashedUnits[2];
+        Blake3::Output firstUnit[2]; // the root itself when the file is one unit
+    };
+
+    uint32_t *chainingValue(uint64_t unit, Side side) const;
+    void hashEmpty(Side side);
+    void merge(uint64_t firstUnit, uint64_t chunks, Side side, uint32_t out[8]) const;
+
+    uint64_t fileSize;
+    uint64_t unitCount;
+    size_t sharedBytes;
+    Shared *shared;
+};
+
+#endif
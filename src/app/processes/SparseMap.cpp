@@ -0,0 +1,97 @@
+#include "SparseMap.hpp"
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+
+SparseMap::SparseMap() : fileSize(0), totalData(0) {}
+
+void SparseMap::reset(uint64_t size)
+{
+    fileSize = size;
+    extents.clear();
+    if (size > 0)
+        extents.push_back({0, size});
+    index();
+}
+
+void SparseMap::build(int fd, uint64_t size)
+{
+    fileSize = size;
+    scan(fd, 0, size, extents);
+    index();
+}
+
+bool SparseMap::scan(int fd, uint64_t from, uint64_t to, std::vector<Extent> &out)
+{
+    out.clear();
+    if (from >= to)
+        return true;
+#ifdef SEEK_DATA
+    // Start at the unit's beginning, so data earlier in it still counts
+    uint64_t position = from / UNIT * UNIT;
+    while (position < to)
+    {
+        off_t data = lseek(fd, static_cast<off_t>(position), SEEK_DATA);
+        if (data < 0)
+        {
+            if (errno == ENXIO)
+                break; // a hole runs to the end of the file
+            out.assign(1, Extent{from, to - from});
+            return false;
+        }
+        off_t hole = lseek(fd, data, SEEK_HOLE);
+        uint64_t holeAt = hole < 0 ? to : static_cast<uint64_t>(hole);
+
+        uint64_t start = std::max(from, static_cast<uint64_t>(data) / UNIT * UNIT);
+        uint64_t end = std::min(to, (holeAt + UNIT - 1) / UNIT * UNIT);
+        if (start >= to)
+            break;
+        if (!out.empty() && start <= out.back().offset + out.back().length)
+            out.back().length = std::max(out.back().offset + out.back().length, end) - out.back().offset;
+        else if (start < end)
+            out.push_back({start, end - start});
+        position = std::max(holeAt, position + 1);
+    }
+    return true;
+#else
+    (void)fd;
+    out.push_back({from, to - from});
+    return false;
+#endif
+}
+
+void SparseMap::index()
+{
+    dataBefore.resize(extents.size());
+    totalData = 0;
+    for (size_t i = 0; i < extents.size(); i++)
+    {
+        dataBefore[i] = totalData;
+        totalData += extents[i].length;
+    }
+}
+
+void SparseMap::dataIn(uint64_t offset, uint64_t length, std::vector<Extent> &out) const
+{
+    out.clear();
+    uint64_t end = offset + length;
+    // First extent that ends after offset
+    auto it = std::upper_bound(extents.begin(), extents.end(), offset, [](uint64_t value, const Extent &extent)
+                               { return value < extent.offset + extent.length; });
+    for (; it != extents.end() && it->offset < end; ++it)
+    {
+        uint64_t start = std::max(offset, it->offset);
+        out.push_back({start, std::min(end, it->offset + it->length) - start});
+    }
+}
+
+uint64_t SparseMap::offsetOfData(uint64_t target) const
+{
+    if (target == 0)
+        return 0;
+    if (target >= totalData)
+        return fileSize;
+    // Last extent that starts with less than target bytes ahead of it
+    size_t i = static_cast<size_t>(std::lower_bound(dataBefore.begin(), dataBefore.end(), target) - dataBefore.begin()) - 1;
+    return extents[i].offset + (target - dataBefore[i]);
+}
@@ -0,0 +1,55 @@
+#ifndef SPARSE_MAP_HPP
+#define SPARSE_MAP_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Where a file actually holds data, found with SEEK_DATA/SEEK_HOLE and
+// widened to whole 64 KiB transform units.
+//
+// A unit that lies entirely in a hole is never read, transformed or written,
+// so holes in VM images and database files survive a run in either direction
+// and cost no I/O. Such a unit stands for plaintext zeros in both forms of the
+// file, which range reads and patches honour as well. Where holes cannot be
+// found the whole file is one extent and nothing changes.
+class SparseMap
+{
+public:
+    // TaskManager::TRANSFORM_UNIT, which TaskManager.hpp checks
+    static const uint64_t UNIT = 64 * 1024;
+
+    struct Extent
+    {
+        uint64_t offset;
+        uint64_t length;
+    };
+
+    SparseMap();
+
+    // Treats all of a file of fileSize bytes as data
+    void reset(uint64_t fileSize);
+    void build(int fd, uint64_t fileSize);
+    // Data extents of fd overlapping [from, to), clipped to it. Returns false,
+    // with the whole range as data, when the file system cannot report holes.
+    static bool scan(int fd, uint64_t from, uint64_t to, std::vector<Extent> &out);
+
+    bool isSparse() const { return totalData < fileSize; }
+    uint64_t getFileSize() const { return fileSize; }
+    uint64_t dataBytes() const { return totalData; }
+    size_t extentCount() const { return extents.size(); }
+    // Extents overlapping [offset, offset + length), clipped to it
+    void dataIn(uint64_t offset, uint64_t length, std::vector<Extent> &out) const;
+    // Smallest offset with at least target bytes of data before it
+    uint64_t offsetOfData(uint64_t target) const;
+
+private:
+    void index();
+
+    std::vector<Extent> extents;
+    std::vector<uint64_t> dataBefore; // data bytes ahead of each extent
+    uint64_t fileSize;
+    uint64_t totalData;
+};
+
+#endif
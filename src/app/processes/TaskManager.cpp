@@ -1,16 +1,30 @@
 #include "TaskManager.hpp"
+#include "BinaryIO.hpp"
+#include "BlockCodec.hpp"
+#include "BlockManifest.hpp"
 #include "../fileHandling/IO.hpp"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
 #include <sys/wait.h>
+#include <sys/resource.h>
 #include <unistd.h>
 #include <iostream>
+#include <cerrno>
 #include <cstring>
 #include <chrono>
 #include <thread>
 #include <fstream>
 #include <filesystem>
 #include <algorithm>
-
-TaskManager::TaskManager() : semaphore_count(4)
+#include <new>
+#include <csignal>
+
+TaskManager::TaskManager()
+    : semaphore_count(4), blockSize(DEFAULT_BLOCK_SIZE), configuredBlockSize(DEFAULT_BLOCK_SIZE),
+      rollbackOnCancel(true), lastRunCancelled(false),
+      checkpointing(false), compressContainers(false), hashing(false), perfCounting(false), pinWorkers(false),
+      runStartNs(0), reservationWaitNs(0)
 {
     // Initialize mutexes
     if (pthread_mutex_init(&mutex, nullptr) != 0 ||
@@ -18,33 +32,345 @@ TaskManager::TaskManager() : semaphore_count(4)
     {
         throw std::runtime_error("Mutex initialization failed");
     }
+
+    // Progress counters live in shared memory so forked workers can update them
+    void *shared = mmap(nullptr, sizeof(SharedProgress), PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED)
+    {
+        throw std::runtime_error("Failed to map shared progress memory");
+    }
+    progress = new (shared) SharedProgress();
+
     // Default to XOR encryption
-    currentTechnique = std::make_unique<XOREncryption>();
+    fillSlot(current, std::make_unique<XOREncryption>());
 }
 
 TaskManager::~TaskManager()
 {
+    progress->~SharedProgress();
+    munmap(progress, sizeof(SharedProgress));
     pthread_mutex_destroy(&mutex);
     pthread_mutex_destroy(&semaphore_mutex);
 }
 
-// Encryption/decryption using current technique
-void encryptDecryptChunk(char *buffer, size_t size, bool isEncryption, EncryptionTechnique *technique)
+static uint64_t threadToken(pthread_t thread)
+{
+    uint64_t token = 0;
+    std::memcpy(&token, &thread, std::min(sizeof(thread), sizeof(token)));
+    return token;
+}
+
+template <bool Encrypt>
+void TaskManager::chunkKernel(const TechniqueSlot &slot, char *data, size_t size, uint64_t fileOffset)
 {
-    if (technique)
+    // Split at TRANSFORM_UNIT boundaries of the file, not of the buffer
+    EncryptionTechnique *technique = slot.technique.get();
+    size_t done = 0;
+    while (done < size)
     {
-        if (isEncryption)
-            technique->encryptChunk(buffer, size);
+        uint64_t unitEnd = ((fileOffset + done) / TRANSFORM_UNIT + 1) * TRANSFORM_UNIT;
+        size_t length = static_cast<size_t>(std::min<uint64_t>(size - done, unitEnd - (fileOffset + done)));
+        if (Encrypt)
+            technique->encryptChunk(data + done, length);
         else
-            technique->decryptChunk(buffer, size);
+            technique->decryptChunk(data + done, length);
+        done += length;
+    }
+}
+
+template <bool Encrypt>
+void TaskManager::positionalKernel(const TechniqueSlot &slot, char *data, size_t size, uint64_t fileOffset)
+{
+    // Positional techniques key every unit by its place in the file
+    if (Encrypt)
+        slot.positional->encryptAt(data, size, fileOffset);
+    else
+        slot.positional->decryptAt(data, size, fileOffset);
+}
+
+void TaskManager::fallbackKernel(const TechniqueSlot &, char *data, size_t size, uint64_t)
+{
+    // XOR with a fixed key when no technique is set; its own inverse
+    const char key = 0x2A;
+    for (size_t i = 0; i < size; ++i)
+        data[i] ^= key;
+}
+
+void TaskManager::fillSlot(TechniqueSlot &slot, std::unique_ptr<EncryptionTechnique> technique)
+{
+    slot.technique = std::move(technique);
+    slot.positional = dynamic_cast<PositionalTechnique *>(slot.technique.get());
+    if (slot.positional)
+    {
+        slot.kernels[0] = positionalKernel<false>;
+        slot.kernels[1] = positionalKernel<true>;
+    }
+    else if (slot.technique)
+    {
+        slot.kernels[0] = chunkKernel<false>;
+        slot.kernels[1] = chunkKernel<true>;
     }
     else
     {
-        // Fallback to XOR if no technique set
-        const char key = 0x2A;
-        for (size_t i = 0; i < size; ++i)
-            buffer[i] ^= key;
+        slot.kernels[0] = fallbackKernel;
+        slot.kernels[1] = fallbackKernel;
+    }
+}
+
+void TaskManager::transformRange(char *data, size_t size, uint64_t fileOffset, bool isEncryption)
+{
+    current.kernels[isEncryption](current, data, size, fileOffset);
+}
+
+void TaskManager::keyCheck(uint8_t out[Blake3::DIGEST_LEN])
+{
+    std::vector<char> probe(TRANSFORM_UNIT, 0);
+    transformRange(probe.data(), probe.size(), 0, true);
+    Blake3::subtree(probe.data(), probe.size(), 0).rootDigest(out);
+}
+
+void TaskManager::applySpans(const TechniqueSlot &slot, bool encrypt, char *data, uint64_t fileOffset,
+                             const std::vector<SparseMap::Extent> &spans)
+{
+    for (const SparseMap::Extent &span : spans)
+        slot.kernels[encrypt](slot, data + (span.offset - fileOffset), static_cast<size_t>(span.length), span.offset);
+}
+
+void TaskManager::transformBlock(char *data, size_t size, uint64_t fileOffset, bool isEncryption,
+                                 const std::vector<SparseMap::Extent> &spans)
+{
+    if (rekeySource.technique)
+    {
+        rekeyBlock(data, size, fileOffset, true, spans);
+        return;
+    }
+    if (hasher)
+        hasher->hashRange(data, size, fileOffset, isEncryption ? RunHasher::PLAINTEXT : RunHasher::CIPHERTEXT);
+    applySpans(current, isEncryption, data, fileOffset, spans);
+    if (hasher)
+        hasher->hashRange(data, size, fileOffset, isEncryption ? RunHasher::CIPHERTEXT : RunHasher::PLAINTEXT);
+}
+
+void TaskManager::rekeyBlock(char *data, size_t size, uint64_t fileOffset, bool forward,
+                             const std::vector<SparseMap::Extent> &spans)
+{
+    // Decrypt and re-encrypt while the block is in cache. The plaintext only
+    // ever exists here, where it is hashed for FILE.b3.
+    const TechniqueSlot &from = forward ? rekeySource : current;
+    const TechniqueSlot &to = forward ? current : rekeySource;
+    applySpans(from, false, data, fileOffset, spans);
+    if (hasher && forward)
+        hasher->hashRange(data, size, fileOffset, RunHasher::PLAINTEXT);
+    applySpans(to, true, data, fileOffset, spans);
+    if (hasher && forward)
+        hasher->hashRange(data, size, fileOffset, RunHasher::CIPHERTEXT);
+}
+
+bool TaskManager::waitWhilePaused() const
+{
+    int state;
+    while ((state = progress->control.load(std::memory_order_acquire)) == JOB_PAUSED)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    return state != JOB_CANCELLED;
+}
+
+// Returns false if the run was cancelled before the whole range was done; the
+// slot's bytesDone then covers exactly the prefix that was transformed
+bool TaskManager::processRange(std::fstream &file, size_t workerId, uint64_t startOffset, uint64_t length,
+                               bool isEncryption, bool threaded)
+{
+    WorkerProgress &slot = progress->workers[workerId];
+    slot.startedNs.store(progressClockNs(), std::memory_order_relaxed);
+
+    // Pin first so a fresh buffer is faulted in on this worker's node
+    int node = applyPlacement(workerId);
+    PooledBuffer buffer = BufferPool::shared().acquire(static_cast<size_t>(std::min<uint64_t>(length, blockSize)), node);
+    uint64_t offset = startOffset;
+    uint64_t end = startOffset + length;
+    std::vector<SparseMap::Extent> spans;
+    Throttle throttle(progress->throttle, progress->control, progress->workerCount.load(std::memory_order_acquire));
+    // Opened per thread, and in a forked worker by the child itself
+    PerfCounters counters;
+    if (perfCounting)
+        counters.open();
+    uint64_t countedBytes = 0;
+
+    while (offset < end)
+    {
+        if (!waitWhilePaused())
+        {
+            file.flush();
+            publishPerf(slot, counters, countedBytes);
+            return false;
+        }
+
+        size_t size = static_cast<size_t>(std::min<uint64_t>(blockSize, end - offset));
+        uint64_t block = offset / blockSize;
+        sparse.dataIn(offset, size, spans);
+
+        if (spans.empty() && (!journal || !journal->isDone(block)))
+        {
+            // All hole: nothing is read or written and the hole stays. Hashed
+            // runs still need the zeros it reads as on both sides.
+            if (hasher)
+            {
+                std::memset(buffer.data(), 0, size);
+                hasher->hashRange(buffer.data(), size, offset, RunHasher::PLAINTEXT);
+                hasher->hashRange(buffer.data(), size, offset, RunHasher::CIPHERTEXT);
+            }
+            if (journal)
+                journal->markDone(block);
+        }
+        // Blocks finished by an earlier, interrupted run are only counted
+        else if (!journal || !journal->isDone(block))
+        {
+            if (!throttle.beforeRead(size))
+            {
+                file.flush();
+                publishPerf(slot, counters, countedBytes);
+                return false;
+            }
+            if (threaded)
+            {
+                SyncStats::recordMutexLock(workerId);
+                pthread_mutex_lock(&mutex);
+            }
+            file.seekg(static_cast<std::streamoff>(offset));
+            file.read(buffer.data(), size);
+            if (threaded)
+            {
+                pthread_mutex_unlock(&mutex);
+                SyncStats::recordMutexUnlock(workerId);
+            }
+
+            if (!file)
+            {
+                throw std::runtime_error("Error reading file chunk");
+            }
+
+            uint64_t inputPrint = journal ? journal->fingerprint(buffer.data(), size, block) : 0;
+            counters.start();
+            transformBlock(buffer.data(), size, offset, isEncryption, spans);
+            counters.stop();
+            countedBytes += size;
+            if (journal)
+            {
+                // Must reach the journal before the block reaches the file
+                journal->recordFingerprints(block, inputPrint, journal->fingerprint(buffer.data(), size, block));
+            }
+
+            // Once transformed the block goes out; a cancel stops at the next one
+            uint64_t dataBytes = 0;
+            for (const SparseMap::Extent &span : spans)
+                dataBytes += span.length;
+            throttle.beforeWrite(dataBytes);
+            if (threaded)
+            {
+                SyncStats::recordMutexLock(workerId);
+                pthread_mutex_lock(&mutex);
+            }
+            // Only the data extents, so holes inside the block are not filled
+            for (const SparseMap::Extent &span : spans)
+            {
+                file.seekp(static_cast<std::streamoff>(span.offset));
+                file.write(buffer.data() + (span.offset - offset), static_cast<std::streamsize>(span.length));
+            }
+            if (journal)
+            {
+                // The block has to be out of the stream buffer before it is
+                // marked done, or a checkpoint could persist the bit without it
+                file.flush();
+            }
+            if (threaded)
+            {
+                pthread_mutex_unlock(&mutex);
+                SyncStats::recordMutexUnlock(workerId);
+            }
+
+            if (!file)
+            {
+                throw std::runtime_error("Error writing file chunk");
+            }
+
+            if (journal)
+            {
+                journal->markDone(block);
+                journal->maybeCheckpoint();
+            }
+        }
+
+        offset += size;
+        slot.bytesDone.fetch_add(size, std::memory_order_relaxed);
+        slot.blocksDone.fetch_add(1, std::memory_order_relaxed);
+        slot.cpu.store(CpuTopology::currentCpu(), std::memory_order_relaxed);
+        slot.updatedNs.store(progressClockNs(), std::memory_order_release);
+        throttle.afterBlock();
+    }
+
+    file.flush();
+    publishPerf(slot, counters, countedBytes);
+    return true;
+}
+
+void TaskManager::publishPerf(WorkerProgress &slot, const PerfCounters &counters, uint64_t bytes)
+{
+    if (!counters.isOpen())
+        return;
+    PerfSample sample = counters.read();
+    slot.perfCycles.store(sample.cycles, std::memory_order_relaxed);
+    slot.perfInstructions.store(sample.instructions, std::memory_order_relaxed);
+    slot.perfLlcMisses.store(sample.llcMisses, std::memory_order_relaxed);
+    slot.perfBranchMisses.store(sample.branchMisses, std::memory_order_relaxed);
+    slot.perfBytes.store(bytes, std::memory_order_relaxed);
+    slot.perfCounted.store(true, std::memory_order_release);
+}
+
+// Applies the inverse transform to a prefix this worker already processed.
+// Ignores pause/cancel so a cancelled run always ends in a consistent state.
+void TaskManager::rollbackRange(std::fstream &file, size_t workerId, uint64_t startOffset, uint64_t length,
+                                bool isEncryption)
+{
+    WorkerProgress &slot = progress->workers[workerId];
+    PooledBuffer buffer = BufferPool::shared().acquire(static_cast<size_t>(std::min<uint64_t>(length, blockSize)));
+    uint64_t offset = startOffset;
+    uint64_t end = startOffset + length;
+    std::vector<SparseMap::Extent> spans;
+
+    file.clear();
+    while (offset < end)
+    {
+        size_t size = static_cast<size_t>(std::min<uint64_t>(blockSize, end - offset));
+        sparse.dataIn(offset, size, spans);
+        if (!spans.empty())
+        {
+            file.seekg(static_cast<std::streamoff>(offset));
+            file.read(buffer.data(), size);
+            if (!file)
+            {
+                throw std::runtime_error("Error reading chunk during rollback");
+            }
+            if (rekeySource.technique)
+                rekeyBlock(buffer.data(), size, offset, false, spans);
+            else
+                applySpans(current, !isEncryption, buffer.data(), offset, spans);
+            for (const SparseMap::Extent &span : spans)
+            {
+                file.seekp(static_cast<std::streamoff>(span.offset));
+                file.write(buffer.data() + (span.offset - offset), static_cast<std::streamsize>(span.length));
+            }
+            if (!file)
+            {
+                throw std::runtime_error("Error writing chunk during rollback");
+            }
+        }
+        offset += size;
+        // Heartbeat so the parent can tell a slow rollback from a hung worker
+        slot.updatedNs.store(progressClockNs(), std::memory_order_release);
     }
+    file.flush();
 }
 
 void *TaskManager::threadWorker(void *arg)
@@ -67,6 +393,11 @@ void *TaskManager::threadWorker(void *arg)
     manager->semaphore_count--;
     pthread_mutex_unlock(&manager->semaphore_mutex);
 
+    // Held until the rollback below is done with its buffer too
+    MemoryReservation reservation;
+    manager->reserveBuffers(reservation, BufferPool::classSize(static_cast<size_t>(
+                                             std::min<uint64_t>(data->chunkSize, manager->blockSize))));
+
     try
     {
         std::fstream file(data->filePath, std::ios::in | std::ios::out | std::ios::binary);
@@ -75,58 +406,23 @@ void *TaskManager::threadWorker(void *arg)
             throw std::runtime_error("Could not open file: " + data->filePath);
         }
 
-        // Get file size
-        file.seekg(0, std::ios::end);
-        std::streampos fileSize = file.tellg();
-        file.seekg(0, std::ios::beg);
-
-        // Calculate actual chunk size and offset
-        size_t actualChunkSize = data->chunkSize;
-        if (data->startOffset + actualChunkSize > static_cast<size_t>(fileSize))
-        {
-            actualChunkSize = static_cast<size_t>(fileSize) - data->startOffset;
-        }
-
-        // Read and process the chunk
-        std::vector<char> buffer(actualChunkSize);
-
-        SyncStats::recordMutexLock(data->threadId);
-        pthread_mutex_lock(&manager->mutex);
-        file.seekg(data->startOffset);
-        file.read(buffer.data(), actualChunkSize);
-        pthread_mutex_unlock(&manager->mutex);
-        SyncStats::recordMutexUnlock(data->threadId);
-
-        if (!file)
-        {
-            throw std::runtime_error("Error reading file chunk");
-        }
-
-        // Process the chunk
-        encryptDecryptChunk(buffer.data(), actualChunkSize, data->isEncryption, manager->currentTechnique.get());
-
-        // Write back the processed chunk
-        SyncStats::recordMutexLock(data->threadId);
-        pthread_mutex_lock(&manager->mutex);
-        file.seekp(data->startOffset);
-        file.write(buffer.data(), actualChunkSize);
-        pthread_mutex_unlock(&manager->mutex);
-        SyncStats::recordMutexUnlock(data->threadId);
-
-        if (!file)
+        // Process the chunk block by block
+        if (!manager->processRange(file, data->threadId, data->startOffset, data->chunkSize,
+                                   data->isEncryption, true) &&
+            manager->rollbackOnCancel && !manager->journal)
         {
-            throw std::runtime_error("Error writing file chunk");
+            size_t done = data->progress->bytesDone.load(std::memory_order_relaxed);
+            manager->rollbackRange(file, data->threadId, data->startOffset, done, data->isEncryption);
         }
-
-        // Update progress to 100%
-        *(data->progress) = 1.0f;
     }
     catch (const std::exception &e)
     {
+        data->progress->failed.store(true, std::memory_order_relaxed);
         pthread_mutex_lock(&manager->mutex);
         manager->statusMessage = "Error in thread " + std::to_string(data->threadId) + ": " + e.what();
         pthread_mutex_unlock(&manager->mutex);
     }
+    data->progress->finished.store(true, std::memory_order_release);
 
     // Release semaphore
     SyncStats::recordSemaphoreRelease(data->threadId);
@@ -137,18 +433,82 @@ void *TaskManager::threadWorker(void *arg)
     return nullptr;
 }
 
+void TaskManager::resetProgress(size_t workerCount, uint64_t fileSize, uint64_t chunkSize)
+{
+    std::vector<uint64_t> bounds(workerCount + 1);
+    for (size_t i = 0; i <= workerCount; i++)
+        bounds[i] = std::min<uint64_t>(fileSize, i * chunkSize);
+    resetProgress(bounds);
+}
+
+void TaskManager::resetProgress(const std::vector<uint64_t> &bounds)
+{
+    // Publish zero before the new count so readers never see stale slots as live
+    size_t workerCount = bounds.size() - 1;
+    progress->workerCount.store(0, std::memory_order_release);
+    for (size_t i = 0; i < workerCount; i++)
+    {
+        WorkerProgress &slot = progress->workers[i];
+        uint64_t length = bounds[i + 1] - bounds[i];
+        slot.bytesTotal.store(length, std::memory_order_relaxed);
+        slot.bytesDone.store(0, std::memory_order_relaxed);
+        slot.blocksTotal.store((length + blockSize - 1) / blockSize, std::memory_order_relaxed);
+        slot.blocksDone.store(0, std::memory_order_relaxed);
+        slot.startedNs.store(0, std::memory_order_relaxed);
+        slot.updatedNs.store(0, std::memory_order_relaxed);
+        slot.osId.store(0, std::memory_order_relaxed);
+        slot.cpu.store(-1, std::memory_order_relaxed);
+        slot.homeNode.store(-1, std::memory_order_relaxed);
+        slot.finished.store(length == 0, std::memory_order_relaxed);
+        slot.failed.store(false, std::memory_order_relaxed);
+        slot.perfCounted.store(false, std::memory_order_relaxed);
+        slot.perfCycles.store(0, std::memory_order_relaxed);
+        slot.perfInstructions.store(0, std::memory_order_relaxed);
+        slot.perfLlcMisses.store(0, std::memory_order_relaxed);
+        slot.perfBranchMisses.store(0, std::memory_order_relaxed);
+        slot.perfBytes.store(0, std::memory_order_relaxed);
+    }
+    progress->workerCount.store(workerCount, std::memory_order_release);
+}
+
+uint64_t TaskManager::workerShare(uint64_t fileSize, size_t workers) const
+{
+    // Rounded to whole blocks so that only the last worker ever sees a
+    // partial block
+    uint64_t chunkSize = (fileSize + workers - 1) / workers;
+    return (chunkSize + blockSize - 1) / blockSize * blockSize;
+}
+
+std::vector<uint64_t> TaskManager::shareBounds(uint64_t fileSize, size_t workers) const
+{
+    std::vector<uint64_t> bounds(workers + 1, fileSize);
+    uint64_t share = workerShare(fileSize, workers);
+    for (size_t i = 0; i < workers; i++)
+        bounds[i] = std::min<uint64_t>(fileSize, i * share);
+    if (!sparse.isSparse())
+        return bounds;
+
+    // Equal amounts of data rather than of file, still in whole blocks, so a
+    // worker whose share is mostly hole does not finish first and sit idle
+    uint64_t data = sparse.dataBytes();
+    for (size_t i = 1; i < workers; i++)
+    {
+        uint64_t at = sparse.offsetOfData(data / workers * i);
+        bounds[i] = std::max(bounds[i - 1], std::min(fileSize, (at + blockSize - 1) / blockSize * blockSize));
+    }
+    return bounds;
+}
+
 bool TaskManager::runWithThreads(const std::string &filePath, bool isEncryption, size_t numThreads)
 {
-    std::ifstream checkFile(filePath);
-    if (!checkFile)
+    // stat rather than tellg, so sizes stay 64-bit on every platform
+    struct stat info;
+    if (stat(filePath.c_str(), &info) != 0)
     {
         statusMessage = "File does not exist: " + filePath;
         return false;
     }
-
-    checkFile.seekg(0, std::ios::end);
-    std::streampos fileSize = checkFile.tellg();
-    checkFile.close();
+    uint64_t fileSize = static_cast<uint64_t>(info.st_size);
 
     if (fileSize == 0)
     {
@@ -156,31 +516,46 @@ bool TaskManager::runWithThreads(const std::string &filePath, bool isEncryption,
         return false;
     }
 
-    threadProgress.resize(numThreads, 0.0f);
+    if (!beginRun(filePath, fileSize, isEncryption))
+    {
+        return false;
+    }
+
+    // Workers are sized for the data only; holes cost nothing
+    if (numThreads == 0)
+    {
+        numThreads = autoWorkerCount(filePath, sparse.dataBytes());
+    }
+    numThreads = std::min(std::max<size_t>(numThreads, 1), MAX_WORKERS);
     threadIds.resize(numThreads);
 
-    // Calculate chunk size based on actual file size
-    size_t chunkSize = (static_cast<size_t>(fileSize) + numThreads - 1) / numThreads;
+    std::vector<uint64_t> bounds = shareBounds(fileSize, numThreads);
+    resetProgress(bounds);
+    preparePlacement(numThreads);
 
     // Create threads
     for (size_t i = 0; i < numThreads; i++)
     {
         auto *data = new ThreadData{
-            this,              // manager
-            i,                 // threadId
-            i * chunkSize,     // startOffset
-            chunkSize,         // chunkSize
-            filePath,          // filePath
-            isEncryption,      // isEncryption
-            &threadProgress[i] // progress pointer
+            this,                        // manager
+            i,                           // threadId
+            bounds[i],                   // startOffset
+            bounds[i + 1] - bounds[i],   // chunkSize
+            filePath,                    // filePath
+            isEncryption,                // isEncryption
+            &progress->workers[i]        // progress slot
         };
 
         int result = pthread_create(&threadIds[i], nullptr, threadWorker, data);
         if (result != 0)
         {
+            delete data;
             statusMessage = "Failed to create thread " + std::to_string(i);
+            for (size_t j = 0; j < i; j++)
+                pthread_join(threadIds[j], nullptr);
             return false;
         }
+        progress->workers[i].osId.store(threadToken(threadIds[i]), std::memory_order_relaxed);
     }
 
     // Wait for all threads to complete
@@ -189,21 +564,36 @@ bool TaskManager::runWithThreads(const std::string &filePath, bool isEncryption,
         pthread_join(threadIds[i], nullptr);
     }
 
-    return true;
+    collectRunStats(true);
+    finishRun(filePath);
+    // A worker that failed has already put its error in statusMessage
+    return !lastRunCancelled && !getOverallProgress().failed;
+}
+
+bool TaskManager::rekeyWithThreads(const std::string &filePath, std::unique_ptr<EncryptionTechnique> from,
+                                   size_t numThreads)
+{
+    if (!from)
+    {
+        statusMessage = "No technique to decrypt with";
+        return false;
+    }
+    fillSlot(rekeySource, std::move(from));
+    bool ok = runWithThreads(filePath, true, numThreads);
+    fillSlot(rekeySource, nullptr);
+    return ok;
 }
 
 bool TaskManager::runWithProcesses(const std::string &filePath, bool isEncryption, size_t numProcesses)
 {
-    std::ifstream checkFile(filePath);
-    if (!checkFile)
+    // stat rather than tellg, so sizes stay 64-bit on every platform
+    struct stat info;
+    if (stat(filePath.c_str(), &info) != 0)
     {
         statusMessage = "File does not exist: " + filePath;
         return false;
     }
-
-    checkFile.seekg(0, std::ios::end);
-    std::streampos fileSize = checkFile.tellg();
-    checkFile.close();
+    uint64_t fileSize = static_cast<uint64_t>(info.st_size);
 
     if (fileSize == 0)
     {
@@ -211,30 +601,44 @@ bool TaskManager::runWithProcesses(const std::string &filePath, bool isEncryptio
         return false;
     }
 
-    // Create pipe for IPC
-    if (pipe(pipefd) == -1)
+    if (!beginRun(filePath, fileSize, isEncryption))
     {
-        statusMessage = "Failed to create pipe";
         return false;
     }
 
-    // Calculate optimal number of processes based on file size
-    // For large files (>10MB), use more processes for better performance
+    // An explicit count is honoured; otherwise size it for this host and file
     size_t optimalProcesses = numProcesses;
-    if (fileSize > 10 * 1024 * 1024) // 10MB
+    if (optimalProcesses == 0)
     {
-        optimalProcesses = std::min(static_cast<size_t>(8), static_cast<size_t>(fileSize / (2 * 1024 * 1024))); // Max 8 processes, 1 per 2MB
-        optimalProcesses = std::max(optimalProcesses, static_cast<size_t>(4));                                  // At least 4 processes
+        optimalProcesses = autoWorkerCount(filePath, sparse.dataBytes());
     }
+    optimalProcesses = std::min(std::max<size_t>(optimalProcesses, 1), MAX_WORKERS);
 
     // Log the process creation info
     std::cout << "File size: " << fileSize << " bytes, Creating " << optimalProcesses << " processes" << std::endl;
 
     processIds.clear();
     processIds.resize(optimalProcesses);
-    threadProgress.resize(optimalProcesses, 0.0f);
 
-    size_t chunkSize = (static_cast<size_t>(fileSize) + optimalProcesses - 1) / optimalProcesses;
+    std::vector<uint64_t> bounds = shareBounds(fileSize, optimalProcesses);
+    resetProgress(bounds);
+    preparePlacement(optimalProcesses);
+
+    // Children cannot reach this process's budget, so the run reserves all
+    // of their buffers before any is forked
+    uint64_t bufferBytes = 0;
+    for (size_t i = 0; i < optimalProcesses; i++)
+        bufferBytes += BufferPool::classSize(static_cast<size_t>(std::min<uint64_t>(bounds[i + 1] - bounds[i], blockSize)));
+    MemoryReservation reservation;
+    reserveBuffers(reservation, bufferBytes);
+    statusMessage.clear();
+
+    // Create pipe for IPC
+    if (pipe(pipefd) == -1)
+    {
+        statusMessage = "Failed to create pipe";
+        return false;
+    }
 
     // Create child processes
     for (size_t i = 0; i < optimalProcesses; i++)
@@ -244,12 +648,18 @@ bool TaskManager::runWithProcesses(const std::string &filePath, bool isEncryptio
         if (pid == -1)
         {
             statusMessage = "Failed to create process " + std::to_string(i);
+            close(pipefd[0]);
+            close(pipefd[1]);
+            for (size_t j = 0; j < i; j++)
+                waitpid(processIds[j], nullptr, 0);
             return false;
         }
 
         if (pid == 0)
         {                     // Child process
             close(pipefd[0]); // Close read end
+            WorkerProgress &slot = progress->workers[i];
+            slot.osId.store(static_cast<uint64_t>(getpid()), std::memory_order_relaxed);
 
             try
             {
@@ -259,38 +669,14 @@ bool TaskManager::runWithProcesses(const std::string &filePath, bool isEncryptio
                     throw std::runtime_error("Could not open file");
                 }
 
-                size_t startOffset = i * chunkSize;
-                size_t actualChunkSize = chunkSize;
-                if (startOffset + actualChunkSize > static_cast<size_t>(fileSize))
-                {
-                    actualChunkSize = static_cast<size_t>(fileSize) - startOffset;
-                }
-
-                // Read and process chunk
-                std::vector<char> buffer(actualChunkSize);
-                file.seekg(startOffset);
-                file.read(buffer.data(), actualChunkSize);
-
-                if (!file)
-                {
-                    throw std::runtime_error("Error reading file chunk");
-                }
-
-                // Process the chunk - Note: in child process, we need to use default XOR
-                // as we can't share the technique pointer across processes
-                const char key = 0x2A;
-                for (size_t j = 0; j < actualChunkSize; ++j)
-                    buffer[j] ^= key;
-
-                // Write back
-                file.seekp(startOffset);
-                file.write(buffer.data(), actualChunkSize);
-
-                if (!file)
+                // The child has its own copy of the address space, including
+                // the technique object and the sparse map
+                if (!processRange(file, i, bounds[i], bounds[i + 1] - bounds[i], isEncryption, false) &&
+                    rollbackOnCancel && !journal)
                 {
-                    throw std::runtime_error("Error writing file chunk");
+                    size_t done = slot.bytesDone.load(std::memory_order_relaxed);
+                    rollbackRange(file, i, bounds[i], done, isEncryption);
                 }
-
                 file.close();
 
                 // Send 100% completion status
@@ -299,29 +685,35 @@ bool TaskManager::runWithProcesses(const std::string &filePath, bool isEncryptio
             }
             catch (const std::exception &e)
             {
+                slot.failed.store(true, std::memory_order_relaxed);
                 std::string errorMsg = std::to_string(i) + ",error:" + e.what() + "\n";
                 write(pipefd[1], errorMsg.c_str(), errorMsg.length());
             }
 
+            slot.finished.store(true, std::memory_order_release);
             close(pipefd[1]);
-            exit(0);
+            _exit(0);
         }
         else
         { // Parent process
             processIds[i] = pid;
+            progress->workers[i].osId.store(static_cast<uint64_t>(pid), std::memory_order_relaxed);
         }
     }
 
     // Update process hierarchy to include all related processes
     updateProcessHierarchy();
 
-    // Parent process: read progress updates
+    // Parent process: read status messages until every child has closed its
+    // end of the pipe. Per-block progress arrives through shared memory.
     close(pipefd[1]); // Close write end in parent
 
     fd_set readfds;
     struct timeval tv;
     char buffer[256];
+    std::string pending;
     bool processingDone = false;
+    const int64_t killGraceNs = 5LL * 1000 * 1000 * 1000;
 
     while (!processingDone)
     {
@@ -332,75 +724,71 @@ bool TaskManager::runWithProcesses(const std::string &filePath, bool isEncryptio
 
         int result = select(pipefd[0] + 1, &readfds, NULL, NULL, &tv);
 
-        if (result > 0)
+        // Children stop on their own between blocks once cancelled. Only one
+        // that has shown no sign of life for the grace period gets killed.
+        if (progress->control.load(std::memory_order_acquire) == JOB_CANCELLED)
         {
-            ssize_t bytesRead = read(pipefd[0], buffer, sizeof(buffer));
-            if (bytesRead > 0)
+            int64_t now = progressClockNs();
+            for (size_t i = 0; i < optimalProcesses; i++)
             {
-                std::string message(buffer, bytesRead);
-                size_t comma = message.find(',');
-                if (comma != std::string::npos)
+                WorkerProgress &slot = progress->workers[i];
+                int64_t lastSeen = std::max(slot.updatedNs.load(std::memory_order_acquire),
+                                            slot.startedNs.load(std::memory_order_relaxed));
+                if (!slot.finished.load(std::memory_order_acquire) && lastSeen > 0 &&
+                    now - lastSeen > killGraceNs)
                 {
-                    size_t processIndex = std::stoul(message.substr(0, comma));
-                    std::string progressStr = message.substr(comma + 1);
-
-                    if (progressStr.find("error:") == 0)
-                    {
-                        statusMessage = "Process " + std::to_string(processIndex) + " error: " +
-                                        progressStr.substr(6);
-                    }
-                    else
-                    {
-                        float progress = std::stof(progressStr) / 100.0f;
-                        if (processIndex < threadProgress.size())
-                        {
-                            threadProgress[processIndex] = progress;
-                        }
-                    }
+                    kill(processIds[i], SIGKILL);
+                    slot.failed.store(true, std::memory_order_relaxed);
+                    slot.finished.store(true, std::memory_order_release);
                 }
             }
         }
-        else if (result == 0)
+
+        if (result <= 0)
+            continue;
+
+        ssize_t bytesRead = read(pipefd[0], buffer, sizeof(buffer));
+        if (bytesRead <= 0)
+        {
+            processingDone = true;
+            continue;
+        }
+
+        // A single read can hold several messages or only part of one
+        pending.append(buffer, bytesRead);
+        size_t newline;
+        while ((newline = pending.find('\n')) != std::string::npos)
         {
-            // Check if all processes are done by verifying both progress and process state
-            bool allProgressComplete = std::all_of(threadProgress.begin(), threadProgress.end(),
-                                                   [](float progress)
-                                                   { return progress >= 1.0f; });
+            std::string message = pending.substr(0, newline);
+            pending.erase(0, newline + 1);
 
-            if (allProgressComplete)
+            size_t comma = message.find(',');
+            if (comma == std::string::npos)
+                continue;
+
+            size_t processIndex = std::stoul(message.substr(0, comma));
+            std::string progressStr = message.substr(comma + 1);
+            if (progressStr.find("error:") == 0)
             {
-                // Verify all processes have actually finished
-                processingDone = true;
-                for (pid_t pid : processIds)
-                {
-                    int status;
-                    pid_t result = waitpid(pid, &status, WNOHANG);
-                    if (result == 0) // Process still running
-                    {
-                        processingDone = false;
-                        break;
-                    }
-                    else if (result > 0) // Process finished
-                    {
-                        // Check if process exited normally
-                        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
-                        {
-                            statusMessage = "Process " + std::to_string(pid) + " failed with status " + std::to_string(WEXITSTATUS(status));
-                            processingDone = true; // Mark as done even if failed
-                            break;
-                        }
-                    }
-                }
+                statusMessage = "Process " + std::to_string(processIndex) + " error: " +
+                                progressStr.substr(6);
             }
         }
     }
 
     close(pipefd[0]);
 
-    // Wait for any remaining processes
-    for (pid_t pid : processIds)
+    // Wait for all processes and check they exited normally
+    for (size_t i = 0; i < processIds.size(); i++)
     {
-        waitpid(pid, nullptr, 0);
+        pid_t pid = processIds[i];
+        int status;
+        if (waitpid(pid, &status, 0) == pid && (!WIFEXITED(status) || WEXITSTATUS(status) != 0))
+        {
+            // A child that died mid-range never got to flag its slot
+            progress->workers[i].failed.store(true, std::memory_order_relaxed);
+            statusMessage = "Process " + std::to_string(pid) + " failed with status " + std::to_string(WEXITSTATUS(status));
+        }
     }
 
     if (statusMessage.empty() || statusMessage.find("Process") != 0)
@@ -408,59 +796,1202 @@ bool TaskManager::runWithProcesses(const std::string &filePath, bool isEncryptio
         statusMessage = "All processes completed successfully!";
     }
 
+    collectRunStats(false);
+    finishRun(filePath);
+    return !lastRunCancelled && !getOverallProgress().failed;
+}
+
+void TaskManager::resetRunState()
+{
+    // A resumed journal only sets the block size of its own run
+    blockSize = configuredBlockSize;
+    statusMessage.clear();
+    runStartNs = progressClockNs();
+    poolAtStart = BufferPool::shared().getStats();
+    reservationWaitNs.store(0, std::memory_order_relaxed);
+    journal.reset();
+    hasher.reset();
+    lastDigests = RunDigests();
+}
+
+bool TaskManager::beginRun(const std::string &filePath, uint64_t fileSize, bool isEncryption)
+{
+    resetRunState();
+    int fd = ::open(filePath.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        statusMessage = "Could not open file: " + filePath;
+        return false;
+    }
+    sparse.build(fd, fileSize);
+    ::close(fd);
+
+    if (hashing)
+    {
+        hasher = std::make_unique<RunHasher>();
+        if (!hasher->open(fileSize))
+        {
+            hasher.reset();
+            statusMessage = "Failed to map digest memory";
+            return false;
+        }
+    }
+    if (!checkpointing)
+        return true;
+
+    auto opened = std::make_unique<CheckpointJournal>();
+    int source = rekeySource.technique ? static_cast<int>(rekeySource.technique->getType()) : -1;
+    if (!opened->open(filePath, static_cast<uint8_t>(getCurrentTechniqueType()), isEncryption, fileSize, blockSize,
+                      source))
+    {
+        statusMessage = opened->getStatusMessage();
+        return false;
+    }
+
+    // A resumed job keeps the block size it was started with, for this run
+    blockSize = opened->getBlockSize();
+    journal = std::move(opened);
     return true;
 }
 
-float TaskManager::getProgress(size_t threadId) const
+size_t TaskManager::autoWorkerCount(const std::string &filePath, uint64_t fileSize)
+{
+    if (!current.technique)
+        return 4;
+    lastPlan = AutoTuner::shared().plan(filePath, static_cast<size_t>(fileSize), *current.technique);
+    return lastPlan.workers;
+}
+
+TuningPlan TaskManager::planFor(const std::string &filePath)
 {
-    if (threadId < threadProgress.size())
+    std::error_code error;
+    size_t fileSize = std::filesystem::file_size(filePath, error);
+    if (error || !current.technique)
     {
-        return threadProgress[threadId];
+        // Nothing to measure; runWithThreads reports the actual problem
+        TuningPlan fallback;
+        fallback.workers = 4;
+        fallback.blockSize = blockSize;
+        return fallback;
     }
-    return 0.0f;
+    return AutoTuner::shared().plan(filePath, fileSize, *current.technique);
 }
 
-std::string TaskManager::getStatusMessage() const
+bool TaskManager::runTuned(const std::string &filePath, bool isEncryption)
 {
-    return statusMessage;
+    lastPlan = planFor(filePath);
+    setBlockSize(lastPlan.blockSize);
+    if (lastPlan.useThreads)
+        return runWithThreads(filePath, isEncryption, lastPlan.workers);
+    return runWithProcesses(filePath, isEncryption, lastPlan.workers);
 }
 
-std::vector<pthread_t> TaskManager::getActiveThreadIds() const
+const TuningPlan &TaskManager::getLastPlan() const
 {
-    return threadIds;
+    return lastPlan;
 }
 
-std::vector<pid_t> TaskManager::getActiveProcessIds() const
+void TaskManager::preparePlacement(size_t workerCount)
 {
-    return processIds;
+    if (pinWorkers)
+        placement = CpuTopology::host().place(workerCount);
+    else
+        placement.assign(workerCount, WorkerPlacement());
 }
 
-bool TaskManager::isProcessingComplete() const
+// Runs on the worker itself, in a thread or a forked child. Returns the node
+// its buffers should live on, or -1 when the worker floats.
+int TaskManager::applyPlacement(size_t workerId)
+{
+    if (workerId >= placement.size() || placement[workerId].cpu < 0)
+        return -1;
+
+    const WorkerPlacement &where = placement[workerId];
+    if (!CpuTopology::pinCurrentThread(where.cpu))
+        return -1;
+    progress->workers[workerId].homeNode.store(where.node, std::memory_order_relaxed);
+    return where.node;
+}
+
+void TaskManager::reserveBuffers(MemoryReservation &reservation, uint64_t bytes)
+{
+    int64_t waitedNs = 0;
+    reservation.reserve(bytes, waitedNs, [this]()
+                        { return progress->control.load(std::memory_order_acquire) == JOB_CANCELLED; });
+    reservationWaitNs.fetch_add(waitedNs, std::memory_order_relaxed);
+}
+
+// ru_maxrss is in KiB on Linux and in bytes on macOS
+static uint64_t peakRss(int who)
 {
-    // Check if all progress values are at 100%
-    for (float progress : threadProgress)
+    struct rusage usage;
+    if (getrusage(who, &usage) != 0)
+        return 0;
+#ifdef __APPLE__
+    return static_cast<uint64_t>(usage.ru_maxrss);
+#else
+    return static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+#endif
+}
+
+void TaskManager::collectRunStats(bool threads)
+{
+    RunStats stats;
+    stats.threads = threads;
+    stats.workers = getWorkerCount();
+    stats.blockSize = blockSize;
+    stats.numaNodes = CpuTopology::host().getNodeCount();
+    stats.placement = placement;
+    stats.seconds = (progressClockNs() - runStartNs) / 1e9;
+
+    const CpuTopology &topology = CpuTopology::host();
+    for (size_t i = 0; i < stats.workers; i++)
     {
-        if (progress < 1.0f)
+        const WorkerProgress &slot = progress->workers[i];
+        int cpu = slot.cpu.load(std::memory_order_relaxed);
+        int home = slot.homeNode.load(std::memory_order_relaxed);
+        stats.bytes += slot.bytesDone.load(std::memory_order_relaxed);
+        stats.lastCpu.push_back(cpu);
+
+        PerfSample sample;
+        if (slot.perfCounted.load(std::memory_order_acquire))
         {
-            return false;
+            sample.cycles = slot.perfCycles.load(std::memory_order_relaxed);
+            sample.instructions = slot.perfInstructions.load(std::memory_order_relaxed);
+            sample.llcMisses = slot.perfLlcMisses.load(std::memory_order_relaxed);
+            sample.branchMisses = slot.perfBranchMisses.load(std::memory_order_relaxed);
+            sample.bytes = slot.perfBytes.load(std::memory_order_relaxed);
+            stats.perf.add(sample);
+            stats.perfWorkers++;
         }
+        stats.workerPerf.push_back(sample);
+        if (home >= 0)
+        {
+            stats.pinned = true;
+            if (cpu >= 0 && topology.nodeOf(cpu) != home)
+                stats.offNodeWorkers++;
+        }
+    }
+    if (stats.seconds > 0)
+        stats.throughputMBps = stats.bytes / (1024.0 * 1024.0) / stats.seconds;
+
+    // Counters as deltas over the run, sizes as they are now
+    BufferPoolStats pool = BufferPool::shared().getStats();
+    stats.pool = pool;
+    stats.pool.acquires -= poolAtStart.acquires;
+    stats.pool.threadCacheHits -= poolAtStart.threadCacheHits;
+    stats.pool.sharedHits -= poolAtStart.sharedHits;
+    stats.pool.freshMappings -= poolAtStart.freshMappings;
+    stats.pool.hugePageMappings -= poolAtStart.hugePageMappings;
+    stats.reservationWaitSeconds = reservationWaitNs.load(std::memory_order_relaxed) / 1e9;
+    // Forked workers have all been waited for by now
+    stats.peakRssBytes = std::max(peakRss(RUSAGE_SELF), threads ? 0 : peakRss(RUSAGE_CHILDREN));
+    lastRunStats = stats;
+}
+
+const RunStats &TaskManager::getRunStats() const
+{
+    return lastRunStats;
+}
+
+void TaskManager::setWorkerPinning(bool enabled)
+{
+    pinWorkers = enabled;
+}
+
+void TaskManager::finishRun(const std::string &filePath)
+{
+    // Exchange so a cancel that arrives after this point applies to the next run
+    lastRunCancelled = progress->control.exchange(JOB_RUNNING, std::memory_order_acq_rel) == JOB_CANCELLED;
+
+    if (hasher)
+    {
+        if (!lastRunCancelled && !getOverallProgress().failed)
+            recordDigests(filePath);
+        hasher.reset();
     }
 
-    // For processes, also check that no active processes remain
-    if (!processIds.empty())
+    if (journal)
     {
-        for (pid_t pid : processIds)
-        {
-            int status;
-            pid_t result = waitpid(pid, &status, WNOHANG);
-            if (result == 0) // Process still running
-            {
-                return false;
-            }
-        }
+        // A finished job deletes its journal, anything else keeps it for a resume
+        bool complete = journal->finish();
+        std::string kept = journal->getStatusMessage();
+        journal.reset();
+        if (lastRunCancelled)
+            statusMessage = "Cancelled; " + kept + ", run the same job again to resume";
+        else if (!complete)
+            statusMessage += " (" + kept + ")";
+        return;
     }
 
-    return !threadProgress.empty();
+    if (!lastRunCancelled)
+        return;
+
+    ProgressSnapshot overall = getOverallProgress();
+    if (rollbackOnCancel && !overall.failed)
+        statusMessage = "Cancelled, no changes were left in " + filePath;
+    else
+        statusMessage = "Cancelled after " + std::to_string(overall.bytesDone) + " of " +
+                        std::to_string(overall.bytesTotal) + " bytes of " + filePath;
+}
+
+void TaskManager::recordDigests(const std::string &filePath)
+{
+    if (!hasher->isComplete(RunHasher::PLAINTEXT) || !hasher->isComplete(RunHasher::CIPHERTEXT))
+    {
+        statusMessage += " (no digests: blocks finished by an earlier run were not hashed)";
+        return;
+    }
+
+    lastDigests.valid = true;
+    lastDigests.plaintext = hasher->digest(RunHasher::PLAINTEXT);
+    lastDigests.ciphertext = hasher->digest(RunHasher::CIPHERTEXT);
+
+    FileDigest record;
+    record.size = getOverallProgress().bytesTotal;
+    record.technique = static_cast<int>(getCurrentTechniqueType());
+    record.plaintext = lastDigests.plaintext;
+    record.ciphertext = lastDigests.ciphertext;
+    if (!record.save(filePath))
+        statusMessage += " (could not write " + FileDigest::pathFor(filePath) + ")";
+}
+
+void TaskManager::setHashing(bool enabled)
+{
+    hashing = enabled;
+}
+
+bool TaskManager::setPerfCounters(bool enabled)
+{
+    perfCounting = false;
+    if (!enabled)
+        return true;
+    // Workers open their own; this only finds out early that they cannot
+    PerfCounters probe;
+    if (!probe.open())
+    {
+        statusMessage = probe.getStatusMessage();
+        return false;
+    }
+    perfCounting = true;
+    return true;
+}
+
+const RunDigests &TaskManager::getLastDigests() const
+{
+    return lastDigests;
+}
+
+bool TaskManager::hashFile(const std::string &filePath, bool decrypt, std::string &digest, size_t numThreads)
+{
+    int fd = ::open(filePath.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        statusMessage = "Could not open file: " + filePath;
+        return false;
+    }
+    struct stat info;
+    fstat(fd, &info);
+    uint64_t fileSize = static_cast<uint64_t>(info.st_size);
+
+    RunHasher fileHasher;
+    if (!fileHasher.open(fileSize))
+    {
+        ::close(fd);
+        statusMessage = "Failed to map digest memory";
+        return false;
+    }
+
+    // Contiguous whole blocks per worker, like a run
+    uint64_t blocks = (fileSize + blockSize - 1) / blockSize;
+    if (numThreads == 0)
+        numThreads = CpuTopology::host().getCpus().size();
+    size_t workers = static_cast<size_t>(std::min<uint64_t>(std::min(std::max<size_t>(numThreads, 1), MAX_WORKERS),
+                                                            std::max<uint64_t>(blocks, 1)));
+    uint64_t share = (blocks + workers - 1) / workers;
+    std::vector<std::string> errors(workers);
+
+    auto worker = [&](size_t i)
+    {
+        try
+        {
+            MemoryReservation reservation;
+            reserveBuffers(reservation, BufferPool::classSize(blockSize));
+            PooledBuffer buffer = BufferPool::shared().acquire(blockSize);
+            for (uint64_t block = i * share; block < std::min(blocks, (i + 1) * share); block++)
+            {
+                uint64_t offset = block * blockSize;
+                size_t size = static_cast<size_t>(std::min<uint64_t>(blockSize, fileSize - offset));
+                if (decrypt)
+                    decryptSlice(fd, fileSize, offset, size, buffer.data());
+                else if (!readFully(fd, buffer.data(), size, static_cast<off_t>(offset)))
+                    throw std::runtime_error("Error reading file chunk");
+                fileHasher.hashRange(buffer.data(), size, offset, RunHasher::PLAINTEXT);
+            }
+        }
+        catch (const std::exception &e)
+        {
+            errors[i] = e.what();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < workers; i++)
+        threads.emplace_back(worker, i);
+    worker(0);
+    for (std::thread &thread : threads)
+        thread.join();
+    ::close(fd);
+
+    for (const std::string &error : errors)
+    {
+        if (!error.empty())
+        {
+            statusMessage = error;
+            return false;
+        }
+    }
+    digest = fileHasher.digest(RunHasher::PLAINTEXT);
+    return true;
+}
+
+void TaskManager::cancel()
+{
+    progress->control.store(JOB_CANCELLED, std::memory_order_release);
+}
+
+void TaskManager::pause()
+{
+    int expected = JOB_RUNNING;
+    progress->control.compare_exchange_strong(expected, JOB_PAUSED, std::memory_order_acq_rel);
+}
+
+void TaskManager::resume()
+{
+    int expected = JOB_PAUSED;
+    progress->control.compare_exchange_strong(expected, JOB_RUNNING, std::memory_order_acq_rel);
+}
+
+bool TaskManager::isPaused() const
+{
+    return progress->control.load(std::memory_order_acquire) == JOB_PAUSED;
+}
+
+bool TaskManager::wasCancelled() const
+{
+    return lastRunCancelled;
+}
+
+void TaskManager::resetControl()
+{
+    progress->control.store(JOB_RUNNING, std::memory_order_release);
+}
+
+void TaskManager::setLimits(const RunLimits &limits)
+{
+    Throttle::store(progress->throttle, limits);
+}
+
+RunLimits TaskManager::getLimits() const
+{
+    return Throttle::load(progress->throttle);
+}
+
+void TaskManager::setRollbackOnCancel(bool enabled)
+{
+    rollbackOnCancel = enabled;
+}
+
+void TaskManager::setContainerCompression(bool enabled)
+{
+    compressContainers = enabled;
+}
+
+void TaskManager::setCheckpointing(bool enabled)
+{
+    checkpointing = enabled;
+}
+
+bool TaskManager::runChunkWorkers(const ChunkContainer &container, uint64_t first, uint64_t last, size_t workers,
+                                  const std::function<void(uint64_t chunk, char *buffer)> &work)
+{
+    uint64_t chunkCount = last - first;
+    workers = std::min<uint64_t>(std::min(std::max<size_t>(workers, 1), MAX_WORKERS), std::max<uint64_t>(chunkCount, 1));
+    uint64_t share = (chunkCount + workers - 1) / workers;
+    uint32_t chunkSize = container.getHeader().chunkSize;
+
+    // Every chunk but the last is full, so shares map onto byte ranges exactly
+    uint64_t coveredStart = container.plainOffsetOf(first);
+    uint64_t coveredEnd = chunkCount == 0 ? coveredStart : container.plainOffsetOf(last - 1) + container.plainSizeOf(last - 1);
+    resetProgress(workers, coveredEnd - coveredStart, share * chunkSize);
+    for (size_t i = 0; i < workers; i++)
+    {
+        uint64_t begin = std::min(last, first + i * share);
+        progress->workers[i].blocksTotal.store(std::min(last, begin + share) - begin, std::memory_order_relaxed);
+    }
+    preparePlacement(workers);
+
+    auto worker = [&](size_t i)
+    {
+        WorkerProgress &slot = progress->workers[i];
+        slot.osId.store(threadToken(pthread_self()), std::memory_order_relaxed);
+        slot.startedNs.store(progressClockNs(), std::memory_order_relaxed);
+        try
+        {
+            MemoryReservation reservation;
+            reserveBuffers(reservation, BufferPool::classSize(chunkSize));
+            int node = applyPlacement(i);
+            PooledBuffer buffer = BufferPool::shared().acquire(chunkSize, node);
+            uint64_t begin = std::min(last, first + i * share);
+            uint64_t end = std::min(last, begin + share);
+            for (uint64_t chunk = begin; chunk < end && waitWhilePaused(); chunk++)
+            {
+                work(chunk, buffer.data());
+                slot.bytesDone.fetch_add(container.plainSizeOf(chunk), std::memory_order_relaxed);
+                slot.blocksDone.fetch_add(1, std::memory_order_relaxed);
+                slot.cpu.store(CpuTopology::currentCpu(), std::memory_order_relaxed);
+                slot.updatedNs.store(progressClockNs(), std::memory_order_release);
+            }
+        }
+        catch (const std::exception &e)
+        {
+            slot.failed.store(true, std::memory_order_relaxed);
+            pthread_mutex_lock(&mutex);
+            statusMessage = "Error in thread " + std::to_string(i) + ": " + e.what();
+            pthread_mutex_unlock(&mutex);
+        }
+        slot.finished.store(true, std::memory_order_release);
+    };
+
+    // A single worker runs on the calling thread, which keeps small range
+    // reads free of thread start-up
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < workers; i++)
+        threads.emplace_back(worker, i);
+    worker(0);
+    for (std::thread &thread : threads)
+        thread.join();
+
+    collectRunStats(true);
+    lastRunCancelled = progress->control.exchange(JOB_RUNNING, std::memory_order_acq_rel) == JOB_CANCELLED;
+    if (lastRunCancelled)
+        statusMessage = "Cancelled";
+    return !lastRunCancelled && !getOverallProgress().failed;
+}
+
+void TaskManager::loadChunk(const ChunkContainer &container, uint64_t chunk, char *buffer)
+{
+    const ContainerChunk &entry = container.getChunk(chunk);
+    uint64_t offset = container.plainOffsetOf(chunk);
+    if (!(entry.flags & ChunkContainer::CHUNK_COMPRESSED))
+    {
+        container.readChunk(chunk, buffer);
+        transformRange(buffer, entry.plainSize, offset, false);
+        return;
+    }
+
+    PooledBuffer packed = BufferPool::shared().acquire(entry.storedSize);
+    container.readChunk(chunk, packed.data());
+    transformRange(packed.data(), entry.storedSize, offset, false);
+    if (!BlockCodec::decompress(packed.data(), entry.storedSize, buffer, entry.plainSize))
+        throw std::runtime_error("Chunk " + std::to_string(chunk) + " does not decompress");
+}
+
+bool TaskManager::checkContainerTechnique(const ChunkContainer &container)
+{
+    uint8_t recorded = container.getHeader().technique;
+    if (recorded == static_cast<uint8_t>(getCurrentTechniqueType()))
+        return true;
+    statusMessage = "Container was written with technique " + std::to_string(recorded) +
+                    " but technique " + std::to_string(static_cast<int>(getCurrentTechniqueType())) + " is selected";
+    return false;
+}
+
+bool TaskManager::packContainer(const std::string &inputPath, const std::string &containerPath, size_t numThreads)
+{
+    resetRunState();
+    std::error_code error;
+    size_t fileSize = std::filesystem::file_size(inputPath, error);
+    if (error)
+    {
+        statusMessage = "File does not exist: " + inputPath;
+        return false;
+    }
+    if (std::filesystem::equivalent(inputPath, containerPath, error))
+    {
+        statusMessage = "A container cannot replace its own input";
+        return false;
+    }
+
+    int input = ::open(inputPath.c_str(), O_RDONLY);
+    if (input < 0)
+    {
+        statusMessage = "Could not open file: " + inputPath;
+        return false;
+    }
+
+    ChunkContainer container;
+    if (!container.create(containerPath, static_cast<uint8_t>(getCurrentTechniqueType()), fileSize,
+                          static_cast<uint32_t>(blockSize), compressContainers ? ChunkContainer::FLAG_COMPRESSED : 0))
+    {
+        statusMessage = container.getStatusMessage();
+        ::close(input);
+        return false;
+    }
+
+    if (numThreads == 0)
+        numThreads = autoWorkerCount(inputPath, fileSize);
+    bool ok = runChunkWorkers(container, 0, container.getHeader().chunkCount, numThreads,
+                              [&](uint64_t chunk, char *buffer)
+                              {
+                                  uint64_t offset = container.plainOffsetOf(chunk);
+                                  uint32_t size = container.plainSizeOf(chunk);
+                                  if (!readFully(input, buffer, size, static_cast<off_t>(offset)))
+                                      throw std::runtime_error("Error reading file chunk");
+
+                                  // Compress first; encrypted bytes do not compress
+                                  if (compressContainers)
+                                  {
+                                      PooledBuffer packed = BufferPool::shared().acquire(size);
+                                      size_t packedSize = BlockCodec::compress(buffer, size, packed.data(), size - 1);
+                                      if (packedSize > 0)
+                                      {
+                                          transformRange(packed.data(), packedSize, offset, true);
+                                          container.writeChunk(chunk, packed.data(), static_cast<uint32_t>(packedSize),
+                                                               ChunkContainer::CHUNK_COMPRESSED);
+                                          return;
+                                      }
+                                  }
+                                  transformRange(buffer, size, offset, true);
+                                  container.writeChunk(chunk, buffer, size);
+                              });
+    ::close(input);
+
+    if (ok && !container.finish())
+    {
+        statusMessage = container.getStatusMessage();
+        ok = false;
+    }
+    if (!ok)
+    {
+        container.close();
+        std::filesystem::remove(containerPath, error);
+        if (lastRunCancelled)
+            statusMessage = "Cancelled; " + containerPath + " was not written";
+    }
+    return ok;
+}
+
+bool TaskManager::refreshEncrypted(const std::string &inputPath, const std::string &outputPath, size_t numThreads)
+{
+    resetRunState();
+    lastRefresh = RefreshStats();
+    uint64_t sourceSize = 0;
+    int64_t sourceMtime = 0;
+    std::error_code error;
+    if (!BlockManifest::stampOf(inputPath, sourceSize, sourceMtime))
+    {
+        statusMessage = "File does not exist: " + inputPath;
+        return false;
+    }
+    if (std::filesystem::equivalent(inputPath, outputPath, error))
+    {
+        statusMessage = "An output cannot replace its own input; encrypt in place instead";
+        return false;
+    }
+
+    // The manifest only counts while it is for this technique and key, and
+    // the output is exactly as the last refresh left it
+    uint8_t technique = static_cast<uint8_t>(getCurrentTechniqueType());
+    uint8_t check[BlockManifest::DIGEST_LEN];
+    keyCheck(check);
+    BlockManifest previous;
+    uint64_t outputSize = 0;
+    int64_t outputMtime = 0;
+    bool trusted = previous.load(outputPath) && previous.technique == technique &&
+                   std::memcmp(previous.keyCheck, check, sizeof(check)) == 0 &&
+                   BlockManifest::stampOf(outputPath, outputSize, outputMtime) &&
+                   outputSize == previous.outputSize && outputMtime == previous.outputMtime;
+    if (trusted && previous.sourceMtime != 0 && previous.sourceSize == sourceSize &&
+        previous.sourceMtime == sourceMtime)
+    {
+        lastRefresh.unchanged = true;
+        lastRefresh.blocks = previous.blockCount();
+        statusMessage = "Unchanged since the last refresh";
+        return true;
+    }
+
+    // Digests only line up at the block size they were taken with; the
+    // configured size is left for the next run
+    size_t unit = trusted ? static_cast<size_t>(previous.blockSize) : blockSize;
+    BlockManifest next;
+    next.reset(technique, unit, sourceSize);
+    std::memcpy(next.keyCheck, check, sizeof(check));
+    uint64_t blocks = next.blockCount();
+    if (trusted)
+    {
+        // Blocks this run does not reach keep what the output still holds
+        uint64_t kept = std::min(blocks, previous.blockCount());
+        std::copy(previous.digests.begin(), previous.digests.begin() + kept * BlockManifest::DIGEST_LEN,
+                  next.digests.begin());
+    }
+    lastRefresh.blocks = blocks;
+    lastRefresh.fullRewrite = !trusted;
+
+    int input = ::open(inputPath.c_str(), O_RDONLY);
+    int output = ::open(outputPath.c_str(), O_RDWR | O_CREAT, 0644);
+    if (input < 0 || output < 0 || ftruncate(output, static_cast<off_t>(sourceSize)) != 0)
+    {
+        statusMessage = "Could not open " + (input < 0 ? inputPath : outputPath) + ": " + std::strerror(errno);
+        if (input >= 0)
+            ::close(input);
+        if (output >= 0)
+            ::close(output);
+        return false;
+    }
+
+    if (numThreads == 0)
+        numThreads = autoWorkerCount(inputPath, sourceSize);
+    size_t workers = static_cast<size_t>(std::min<uint64_t>(std::min(std::max<size_t>(numThreads, 1), MAX_WORKERS),
+                                                            std::max<uint64_t>(blocks, 1)));
+    // As workerShare, in the manifest's blocks
+    size_t chunkSize = static_cast<size_t>(((sourceSize + workers - 1) / workers + unit - 1) / unit * unit);
+    resetProgress(workers, sourceSize, chunkSize);
+    preparePlacement(workers);
+    std::atomic<uint64_t> changedBlocks(0);
+    std::atomic<uint64_t> bytesRewritten(0);
+
+    // Same shares as an in-place run; every block is hashed, only changed
+    // ones are encrypted and written
+    auto worker = [&](size_t i)
+    {
+        WorkerProgress &slot = progress->workers[i];
+        slot.osId.store(threadToken(pthread_self()), std::memory_order_relaxed);
+        slot.startedNs.store(progressClockNs(), std::memory_order_relaxed);
+        try
+        {
+            MemoryReservation reservation;
+            reserveBuffers(reservation, BufferPool::classSize(unit));
+            int node = applyPlacement(i);
+            PooledBuffer buffer = BufferPool::shared().acquire(unit, node);
+            uint64_t start = std::min<uint64_t>(sourceSize, i * chunkSize);
+            uint64_t end = std::min<uint64_t>(sourceSize, start + chunkSize);
+            uint8_t digest[BlockManifest::DIGEST_LEN];
+            for (uint64_t offset = start; offset < end && waitWhilePaused(); offset += unit)
+            {
+                size_t size = static_cast<size_t>(std::min<uint64_t>(unit, end - offset));
+                uint64_t block = offset / unit;
+                if (!readFully(input, buffer.data(), size, static_cast<off_t>(offset)))
+                    throw std::runtime_error("Error reading file chunk");
+                BlockManifest::digestBlock(buffer.data(), size, digest);
+                if (!trusted || std::memcmp(digest, next.digest(block), sizeof(digest)) != 0)
+                {
+                    transformRange(buffer.data(), size, offset, true);
+                    if (!writeFully(output, buffer.data(), size, static_cast<off_t>(offset)))
+                        throw std::runtime_error("Error writing file chunk");
+                    std::memcpy(next.digest(block), digest, sizeof(digest));
+                    changedBlocks.fetch_add(1, std::memory_order_relaxed);
+                    bytesRewritten.fetch_add(size, std::memory_order_relaxed);
+                }
+                slot.bytesDone.fetch_add(size, std::memory_order_relaxed);
+                slot.blocksDone.fetch_add(1, std::memory_order_relaxed);
+                slot.cpu.store(CpuTopology::currentCpu(), std::memory_order_relaxed);
+                slot.updatedNs.store(progressClockNs(), std::memory_order_release);
+            }
+        }
+        catch (const std::exception &e)
+        {
+            slot.failed.store(true, std::memory_order_relaxed);
+            pthread_mutex_lock(&mutex);
+            statusMessage = "Error in thread " + std::to_string(i) + ": " + e.what();
+            pthread_mutex_unlock(&mutex);
+        }
+        slot.finished.store(true, std::memory_order_release);
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < workers; i++)
+        threads.emplace_back(worker, i);
+    worker(0);
+    for (std::thread &thread : threads)
+        thread.join();
+    ::close(input);
+
+    collectRunStats(true);
+    lastRunCancelled = progress->control.exchange(JOB_RUNNING, std::memory_order_acq_rel) == JOB_CANCELLED;
+    bool complete = !lastRunCancelled && !getOverallProgress().failed;
+    lastRefresh.changedBlocks = changedBlocks.load();
+    lastRefresh.bytesRewritten = bytesRewritten.load();
+
+    // The manifest is written even after a cancel: it lists every block that
+    // reached the output, so the next refresh carries on from there. A run
+    // that did not finish leaves no source stamp, so the next one rehashes.
+    bool synced = syncData(output) == 0;
+    ::close(output);
+    if (!synced)
+    {
+        statusMessage = "Could not sync " + outputPath;
+        return false;
+    }
+    if (complete)
+        next.sourceMtime = sourceMtime;
+    if (!BlockManifest::stampOf(outputPath, next.outputSize, next.outputMtime) || !next.save(outputPath))
+        statusMessage += " (could not write " + BlockManifest::pathFor(outputPath) + ", the next refresh rewrites everything)";
+    if (lastRunCancelled)
+        statusMessage = "Cancelled; run the same refresh again to finish " + outputPath;
+    return complete;
+}
+
+const RefreshStats &TaskManager::getLastRefresh() const
+{
+    return lastRefresh;
+}
+
+bool TaskManager::unpackContainer(const std::string &containerPath, const std::string &outputPath, size_t numThreads)
+{
+    resetRunState();
+    ChunkContainer container;
+    if (!container.open(containerPath))
+    {
+        statusMessage = container.getStatusMessage();
+        return false;
+    }
+    if (!checkContainerTechnique(container))
+        return false;
+    // Truncating the output would otherwise empty the container before it is read
+    std::error_code error;
+    if (std::filesystem::equivalent(containerPath, outputPath, error))
+    {
+        statusMessage = "A container cannot be unpacked over itself";
+        return false;
+    }
+
+    const ContainerHeader &header = container.getHeader();
+    int output = ::open(outputPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (output < 0 || ftruncate(output, static_cast<off_t>(header.plainSize)) != 0)
+    {
+        statusMessage = "Could not create " + outputPath + ": " + std::strerror(errno);
+        if (output >= 0)
+            ::close(output);
+        return false;
+    }
+
+    if (numThreads == 0)
+        numThreads = autoWorkerCount(containerPath, header.plainSize);
+    bool ok = runChunkWorkers(container, 0, header.chunkCount, numThreads,
+                              [&](uint64_t chunk, char *buffer)
+                              {
+                                  uint64_t offset = container.plainOffsetOf(chunk);
+                                  uint32_t size = container.plainSizeOf(chunk);
+                                  loadChunk(container, chunk, buffer);
+                                  if (!writeFully(output, buffer, size, static_cast<off_t>(offset)))
+                                      throw std::runtime_error("Error writing file chunk");
+                              });
+    if (ok && syncData(output) != 0)
+    {
+        statusMessage = "Could not sync " + outputPath;
+        ok = false;
+    }
+    ::close(output);
+
+    if (!ok)
+    {
+        std::error_code error;
+        std::filesystem::remove(outputPath, error);
+        if (lastRunCancelled)
+            statusMessage = "Cancelled; " + outputPath + " was not written";
+    }
+    return ok;
+}
+
+bool TaskManager::readContainerRange(const std::string &containerPath, uint64_t offset, uint64_t length,
+                                     std::vector<char> &out, size_t numThreads)
+{
+    resetRunState();
+    out.clear();
+    ChunkContainer container;
+    if (!container.open(containerPath))
+    {
+        statusMessage = container.getStatusMessage();
+        return false;
+    }
+    if (!checkContainerTechnique(container))
+        return false;
+
+    // Reads past the end are cut short, like read(2)
+    const ContainerHeader &header = container.getHeader();
+    if (offset >= header.plainSize || length == 0)
+        return true;
+    uint64_t end = offset + std::min(length, header.plainSize - offset);
+    out.resize(end - offset);
+
+    uint64_t first, last;
+    container.chunksCovering(offset, end - offset, first, last);
+    if (numThreads == 0)
+        numThreads = last - first == 1 ? 1 : autoWorkerCount(containerPath, end - offset);
+    return runChunkWorkers(container, first, last, numThreads,
+                           [&](uint64_t chunk, char *buffer)
+                           {
+                               uint64_t chunkStart = container.plainOffsetOf(chunk);
+                               uint32_t size = container.plainSizeOf(chunk);
+                               loadChunk(container, chunk, buffer);
+
+                               // Copy out only the part of the chunk inside the range
+                               uint64_t from = std::max(offset, chunkStart);
+                               uint64_t to = std::min(end, chunkStart + size);
+                               std::memcpy(out.data() + (from - offset), buffer + (from - chunkStart), to - from);
+                           });
+}
+
+size_t TaskManager::seekGranularity(EncryptionType type)
+{
+    // REVERSE mirrors each transform unit; the others map every byte alone
+    return type == EncryptionType::REVERSE ? TRANSFORM_UNIT : 1;
+}
+
+size_t TaskManager::currentGranularity() const
+{
+    return current.positional ? current.positional->unitSize() : seekGranularity(getCurrentTechniqueType());
+}
+
+// Decrypts [offset, offset + length), which must end inside the file. Whole
+// units are decrypted in the caller's buffer; only a unit cut by either end
+// of the range goes through a scratch buffer.
+void TaskManager::decryptSlice(int fd, uint64_t fileSize, uint64_t offset, size_t length, char *out)
+{
+    // Units that are all hole were never encrypted and stand for zeros
+    std::vector<SparseMap::Extent> spans;
+    SparseMap::scan(fd, offset, offset + length, spans);
+    if (spans.size() != 1 || spans[0].length != length)
+        std::memset(out, 0, length);
+    for (const SparseMap::Extent &span : spans)
+        decryptData(fd, fileSize, span.offset, static_cast<size_t>(span.length), out + (span.offset - offset));
+}
+
+void TaskManager::decryptData(int fd, uint64_t fileSize, uint64_t offset, size_t length, char *out)
+{
+    size_t granularity = currentGranularity();
+    uint64_t end = offset + length;
+    if (granularity == 1)
+    {
+        if (!readFully(fd, out, length, static_cast<off_t>(offset)))
+            throw std::runtime_error("Error reading file range");
+        transformRange(out, length, offset, false);
+        return;
+    }
+
+    PooledBuffer scratch;
+    for (uint64_t unit = offset / granularity * granularity; unit < end; unit += granularity)
+    {
+        uint64_t unitEnd = std::min<uint64_t>(unit + granularity, fileSize);
+        uint64_t from = std::max(offset, unit);
+        uint64_t to = std::min(end, unitEnd);
+        char *target = out + (from - offset);
+        if (from == unit && to == unitEnd)
+        {
+            if (!readFully(fd, target, unitEnd - unit, static_cast<off_t>(unit)))
+                throw std::runtime_error("Error reading file range");
+            transformRange(target, unitEnd - unit, unit, false);
+            continue;
+        }
+
+        if (!scratch.data())
+            scratch = BufferPool::shared().acquire(granularity);
+        if (!readFully(fd, scratch.data(), unitEnd - unit, static_cast<off_t>(unit)))
+            throw std::runtime_error("Error reading file range");
+        transformRange(scratch.data(), unitEnd - unit, unit, false);
+        std::memcpy(target, scratch.data() + (from - unit), to - from);
+    }
+}
+
+bool TaskManager::decryptRange(const std::string &filePath, uint64_t offset, size_t length, char *out,
+                               size_t &produced)
+{
+    produced = 0;
+    int fd = ::open(filePath.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        statusMessage = "Could not open file: " + filePath;
+        return false;
+    }
+    struct stat info;
+    fstat(fd, &info);
+    uint64_t fileSize = static_cast<uint64_t>(info.st_size);
+    if (offset >= fileSize || length == 0)
+    {
+        ::close(fd);
+        return true;
+    }
+    length = static_cast<size_t>(std::min<uint64_t>(length, fileSize - offset));
+
+    // Small reads stay on the calling thread: no spawn, no progress, no locks
+    size_t workers = std::min<size_t>(length / blockSize, std::min(CpuTopology::host().getCpus().size(), MAX_WORKERS));
+    try
+    {
+        if (workers < 2)
+        {
+            decryptSlice(fd, fileSize, offset, length, out);
+        }
+        else
+        {
+            // Same split as a full run: whole blocks per worker, so no unit is
+            // shared and only the two outer slices can start or end mid-unit
+            uint64_t end = offset + length;
+            uint64_t firstBlock = offset / blockSize;
+            uint64_t share = ((end + blockSize - 1) / blockSize - firstBlock + workers - 1) / workers;
+            std::vector<std::thread> threads;
+            std::vector<std::string> errors(workers);
+            for (size_t i = 0; i < workers; i++)
+            {
+                uint64_t sliceStart = std::max(offset, (firstBlock + i * share) * blockSize);
+                uint64_t sliceEnd = std::min(end, (firstBlock + (i + 1) * share) * blockSize);
+                if (sliceStart >= sliceEnd)
+                    break;
+                threads.emplace_back([&, i, sliceStart, sliceEnd]()
+                                     {
+                                         try
+                                         {
+                                             decryptSlice(fd, fileSize, sliceStart, sliceEnd - sliceStart,
+                                                          out + (sliceStart - offset));
+                                         }
+                                         catch (const std::exception &e)
+                                         {
+                                             errors[i] = e.what();
+                                         }
+                                     });
+            }
+            for (std::thread &thread : threads)
+                thread.join();
+            for (const std::string &error : errors)
+            {
+                if (!error.empty())
+                    throw std::runtime_error(error);
+            }
+        }
+    }
+    catch (const std::exception &e)
+    {
+        statusMessage = e.what();
+        ::close(fd);
+        return false;
+    }
+
+    ::close(fd);
+    produced = length;
+    return true;
+}
+
+void TaskManager::fillHoles(int fd, uint64_t fileSize, uint64_t offset, uint64_t end)
+{
+    // A unit that is all hole stands for plaintext zeros. Before a patch
+    // turns part of it into data, the rest has to become encrypted zeros.
+    uint64_t from = offset / TRANSFORM_UNIT * TRANSFORM_UNIT;
+    uint64_t to = std::min(fileSize, (end + TRANSFORM_UNIT - 1) / TRANSFORM_UNIT * TRANSFORM_UNIT);
+    std::vector<SparseMap::Extent> spans;
+    SparseMap::scan(fd, from, to, spans);
+    spans.push_back({to, 0});
+
+    PooledBuffer zeros;
+    uint64_t position = from;
+    for (const SparseMap::Extent &span : spans)
+    {
+        for (; position < span.offset; position += TRANSFORM_UNIT)
+        {
+            if (!zeros.data())
+                zeros = BufferPool::shared().acquire(TRANSFORM_UNIT);
+            size_t size = static_cast<size_t>(std::min(static_cast<uint64_t>(TRANSFORM_UNIT), span.offset - position));
+            std::memset(zeros.data(), 0, size);
+            transformRange(zeros.data(), size, position, true);
+            if (!writeFully(fd, zeros.data(), size, static_cast<off_t>(position)))
+                throw std::runtime_error("Error writing file range");
+        }
+        position = span.offset + span.length;
+    }
+}
+
+bool TaskManager::encryptRange(const std::string &filePath, uint64_t offset, const char *data, size_t length)
+{
+    int fd = ::open(filePath.c_str(), O_RDWR);
+    if (fd < 0)
+    {
+        statusMessage = "Could not open file: " + filePath;
+        return false;
+    }
+    struct stat info;
+    fstat(fd, &info);
+    uint64_t fileSize = static_cast<uint64_t>(info.st_size);
+    if (offset > fileSize || length > fileSize - offset)
+    {
+        ::close(fd);
+        statusMessage = "Range ends past the end of the file";
+        return false;
+    }
+
+    // Per-byte ciphers need no old bytes and go through in whole blocks;
+    // otherwise a unit the range only partly covers is decrypted, patched
+    // and encrypted again
+    size_t granularity = currentGranularity();
+    bool perByte = granularity == 1;
+    if (perByte)
+        granularity = blockSize;
+    uint64_t end = offset + length;
+    try
+    {
+        fillHoles(fd, fileSize, offset, end);
+        PooledBuffer scratch = BufferPool::shared().acquire(granularity);
+        for (uint64_t unit = offset / granularity * granularity; unit < end; unit += granularity)
+        {
+            uint64_t from = std::max(offset, unit);
+            uint64_t to = std::min(end, unit + granularity);
+            uint64_t spanStart = perByte ? from : unit;
+            uint64_t spanEnd = perByte ? to : std::min<uint64_t>(unit + granularity, fileSize);
+            size_t spanSize = static_cast<size_t>(spanEnd - spanStart);
+            if (from != spanStart || to != spanEnd)
+            {
+                if (!readFully(fd, scratch.data(), spanSize, static_cast<off_t>(spanStart)))
+                    throw std::runtime_error("Error reading file range");
+                transformRange(scratch.data(), spanSize, spanStart, false);
+            }
+            std::memcpy(scratch.data() + (from - spanStart), data + (from - offset), to - from);
+            transformRange(scratch.data(), spanSize, spanStart, true);
+            if (!writeFully(fd, scratch.data(), spanSize, static_cast<off_t>(spanStart)))
+                throw std::runtime_error("Error writing file range");
+        }
+        if (syncData(fd) != 0)
+            throw std::runtime_error("Error flushing file range");
+    }
+    catch (const std::exception &e)
+    {
+        statusMessage = e.what();
+        ::close(fd);
+        return false;
+    }
+
+    ::close(fd);
+    return true;
+}
+
+void TaskManager::processBuffer(char *data, size_t size, bool isEncryption)
+{
+    transformRange(data, size, 0, isEncryption);
+}
+
+void TaskManager::processAt(char *data, size_t size, uint64_t fileOffset, bool isEncryption)
+{
+    transformRange(data, size, fileOffset, isEncryption);
+}
+
+void TaskManager::setBlockSize(size_t bytes)
+{
+    // Blocks are whole transform units so block boundaries never split one
+    size_t units = std::max<size_t>(1, (bytes + TRANSFORM_UNIT - 1) / TRANSFORM_UNIT);
+    blockSize = units * TRANSFORM_UNIT;
+    configuredBlockSize = blockSize;
+}
+
+size_t TaskManager::getBlockSize() const
+{
+    return blockSize;
+}
+
+static ProgressSnapshot snapshotOf(const WorkerProgress &slot, int64_t nowNs)
+{
+    ProgressSnapshot snapshot;
+    snapshot.finished = slot.finished.load(std::memory_order_acquire);
+    snapshot.failed = slot.failed.load(std::memory_order_relaxed);
+    snapshot.bytesTotal = slot.bytesTotal.load(std::memory_order_relaxed);
+    snapshot.bytesDone = slot.bytesDone.load(std::memory_order_relaxed);
+    snapshot.blocksTotal = slot.blocksTotal.load(std::memory_order_relaxed);
+    snapshot.blocksDone = slot.blocksDone.load(std::memory_order_relaxed);
+    snapshot.osId = slot.osId.load(std::memory_order_relaxed);
+    snapshot.cpu = slot.cpu.load(std::memory_order_relaxed);
+    snapshot.homeNode = slot.homeNode.load(std::memory_order_relaxed);
+
+    if (snapshot.bytesTotal > 0)
+        snapshot.fraction = static_cast<float>(static_cast<double>(snapshot.bytesDone) / snapshot.bytesTotal);
+    else if (snapshot.finished)
+        snapshot.fraction = 1.0f;
+
+    int64_t started = slot.startedNs.load(std::memory_order_relaxed);
+    int64_t updated = snapshot.finished ? slot.updatedNs.load(std::memory_order_relaxed) : nowNs;
+    if (started > 0 && updated > started && snapshot.bytesDone > 0)
+    {
+        double seconds = (updated - started) / 1e9;
+        snapshot.throughputMBps = snapshot.bytesDone / (1024.0 * 1024.0) / seconds;
+        double bytesPerSecond = snapshot.bytesDone / seconds;
+        snapshot.etaSeconds = (snapshot.bytesTotal - snapshot.bytesDone) / bytesPerSecond;
+    }
+    return snapshot;
+}
+
+size_t TaskManager::getWorkerCount() const
+{
+    return progress->workerCount.load(std::memory_order_acquire);
+}
+
+ProgressSnapshot TaskManager::getWorkerProgress(size_t workerId) const
+{
+    if (workerId >= getWorkerCount())
+        return ProgressSnapshot();
+    return snapshotOf(progress->workers[workerId], progressClockNs());
+}
+
+ProgressSnapshot TaskManager::getOverallProgress() const
+{
+    ProgressSnapshot overall;
+    size_t count = getWorkerCount();
+    int64_t now = progressClockNs();
+    overall.finished = count > 0;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        ProgressSnapshot worker = snapshotOf(progress->workers[i], now);
+        overall.bytesDone += worker.bytesDone;
+        overall.bytesTotal += worker.bytesTotal;
+        overall.blocksDone += worker.blocksDone;
+        overall.blocksTotal += worker.blocksTotal;
+        overall.throughputMBps += worker.throughputMBps;
+        overall.etaSeconds = std::max(overall.etaSeconds, worker.etaSeconds);
+        overall.finished = overall.finished && worker.finished;
+        overall.failed = overall.failed || worker.failed;
+    }
+
+    if (overall.bytesTotal > 0)
+        overall.fraction = static_cast<float>(static_cast<double>(overall.bytesDone) / overall.bytesTotal);
+    return overall;
+}
+
+float TaskManager::getProgress(size_t threadId) const
+{
+    return getWorkerProgress(threadId).fraction;
+}
+
+std::string TaskManager::getStatusMessage() const
+{
+    return statusMessage;
+}
+
+std::vector<pthread_t> TaskManager::getActiveThreadIds() const
+{
+    return threadIds;
+}
+
+std::vector<pid_t> TaskManager::getActiveProcessIds() const
+{
+    return processIds;
+}
+
+bool TaskManager::isProcessingComplete() const
+{
+    size_t count = getWorkerCount();
+    for (size_t i = 0; i < count; i++)
+    {
+        if (!progress->workers[i].finished.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+    }
+    return count > 0;
 }
 
 void TaskManager::clearCompletedProcesses()
@@ -519,10 +2050,10 @@ std::string TaskManager::getProcessInfo(pid_t pid) const
 
 void TaskManager::setEncryptionTechnique(std::unique_ptr<EncryptionTechnique> technique)
 {
-    currentTechnique = std::move(technique);
+    fillSlot(current, std::move(technique));
 }
 
 EncryptionType TaskManager::getCurrentTechniqueType() const
 {
-    return currentTechnique ? currentTechnique->getType() : EncryptionType::XOR;
+    return current.technique ? current.technique->getType() : EncryptionType::XOR;
 }
\ No newline at end of file
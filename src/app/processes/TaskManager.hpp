@@ -7,9 +7,23 @@
 #include <queue>
 #include <memory>
 #include <string>
+#include <functional>
 #include "Task.hpp"
 #include "SyncStats.hpp"
 #include "EncryptionTechnique.hpp"
+#include "PositionalTechnique.hpp"
+#include "JobProgress.hpp"
+#include "CheckpointJournal.hpp"
+#include "AutoTuner.hpp"
+#include "CpuTopology.hpp"
+#include "BufferPool.hpp"
+#include "MemoryBudget.hpp"
+#include "PerfCounters.hpp"
+#include "ChunkContainer.hpp"
+#include "RunHasher.hpp"
+#include "FileDigest.hpp"
+#include "SparseMap.hpp"
+#include "Throttle.hpp"
 
 class TaskManager; // Forward declaration
 
@@ -17,27 +31,180 @@ struct ThreadData
 {
     TaskManager *manager;
     size_t threadId;
-    size_t startOffset;
-    size_t chunkSize;
+    uint64_t startOffset;
+    uint64_t chunkSize;
     std::string filePath;
     bool isEncryption;
-    float *progress;
+    WorkerProgress *progress;
+};
+
+// Summary of the last run, for logs and benchmark reports
+struct RunStats
+{
+    bool threads = true;
+    bool pinned = false;
+    size_t workers = 0;
+    size_t blockSize = 0;
+    size_t numaNodes = 1;
+    uint64_t bytes = 0;
+    double seconds = 0.0;
+    double throughputMBps = 0.0;
+    std::vector<WorkerPlacement> placement; // CPU and node chosen per worker
+    std::vector<int> lastCpu;               // CPU each worker was last seen on
+    size_t offNodeWorkers = 0;              // pinned workers last seen off their node
+    // Buffer pool activity during the run in this process; forked workers
+    // allocate from their own copy of the pool and are not counted
+    BufferPoolStats pool;
+    // Time the workers, or the run itself for forked workers, waited for
+    // their buffers to fit in the MemoryBudget
+    double reservationWaitSeconds = 0.0;
+    // Peak resident set of this process so far, or of its largest forked
+    // worker if that is larger
+    uint64_t peakRssBytes = 0;
+    // Hardware counters over the transforms of in-place runs, per worker and
+    // summed over the perfWorkers that could open them
+    std::vector<PerfSample> workerPerf;
+    PerfSample perf;
+    size_t perfWorkers = 0;
+};
+
+// BLAKE3 digests of the input and output of the last hashed run
+struct RunDigests
+{
+    bool valid = false;
+    std::string plaintext;
+    std::string ciphertext;
+};
+
+// What the last incremental refresh did
+struct RefreshStats
+{
+    bool unchanged = false;   // the source's size and mtime matched, nothing was read
+    bool fullRewrite = false; // there was no usable manifest
+    uint64_t blocks = 0;
+    uint64_t changedBlocks = 0;
+    uint64_t bytesRewritten = 0;
 };
 
 class TaskManager
 {
 public:
+    // Techniques are applied to aligned units of this size so the output does
+    // not depend on the block size or the number of workers
+    static const size_t TRANSFORM_UNIT = 64 * 1024;
+    // Holes are skipped in whole transform units
+    static_assert(SparseMap::UNIT == TRANSFORM_UNIT, "SparseMap::UNIT must match TRANSFORM_UNIT");
+    static_assert(ChunkContainer::CHUNK_UNIT == TRANSFORM_UNIT, "ChunkContainer::CHUNK_UNIT must match TRANSFORM_UNIT");
+    static const size_t DEFAULT_BLOCK_SIZE = 1024 * 1024;
+
     TaskManager();
     ~TaskManager();
 
-    bool runWithThreads(const std::string &filePath, bool isEncryption, size_t numThreads = 4);
-    bool runWithProcesses(const std::string &filePath, bool isEncryption, size_t numProcesses = 4);
+    // A worker count of 0 lets AutoTuner choose one for the file and technique
+    bool runWithThreads(const std::string &filePath, bool isEncryption, size_t numThreads = 0);
+    bool runWithProcesses(const std::string &filePath, bool isEncryption, size_t numProcesses = 0);
+    // Moves a file encrypted with from over to the current technique in one
+    // in-place pass: each block is read once, decrypted and re-encrypted
+    // while it is in cache and written once, so no plaintext reaches the
+    // disk. Checkpointing, hashing, cancel and rollback work as in a run.
+    bool rekeyWithThreads(const std::string &filePath, std::unique_ptr<EncryptionTechnique> from,
+                          size_t numThreads = 0);
+    // Lets AutoTuner pick the mode and block size as well
+    bool runTuned(const std::string &filePath, bool isEncryption);
+    TuningPlan planFor(const std::string &filePath);
+    const TuningPlan &getLastPlan() const;
+    // Encrypts inputPath into a new chunk container at containerPath, leaving
+    // the input as it is. Chunks are the block size and are encrypted by
+    // parallel workers that read and write with positional I/O.
+    bool packContainer(const std::string &inputPath, const std::string &containerPath, size_t numThreads = 0);
+    // Keeps outputPath an encrypted copy of inputPath. Holes are encrypted
+    // like any other zeros, so only a file without holes comes out the way
+    // encrypting it in place would. A block manifest next to the output
+    // records the key's check value and each plaintext block's digest; a
+    // later refresh under the same key hashes the input in parallel and
+    // encrypts and writes only the blocks that changed, or does nothing when
+    // the input's size and mtime are the same.
+    bool refreshEncrypted(const std::string &inputPath, const std::string &outputPath, size_t numThreads = 0);
+    const RefreshStats &getLastRefresh() const;
+    // Decrypts a whole container into outputPath. The current technique has
+    // to be the one recorded in the container header.
+    bool unpackContainer(const std::string &containerPath, const std::string &outputPath, size_t numThreads = 0);
+    // Decrypts plaintext bytes [offset, offset + length) of a container into
+    // out, reading only the chunks that cover the range
+    bool readContainerRange(const std::string &containerPath, uint64_t offset, uint64_t length,
+                            std::vector<char> &out, size_t numThreads = 0);
+    // Compress each chunk with BlockCodec before it is encrypted. Chunks stay
+    // independent, so unpacking and range reads still run in parallel.
+    void setContainerCompression(bool enabled);
+    // Decrypts bytes [offset, offset + length) of a file that was encrypted in
+    // place with the current technique straight into out, reading only the
+    // transform units that cover them. produced is short at the end of the
+    // file. Large ranges are split over threads at block boundaries.
+    bool decryptRange(const std::string &filePath, uint64_t offset, size_t length, char *out, size_t &produced);
+    // Overwrites plaintext bytes [offset, offset + length) of a file that was
+    // encrypted in place with the current technique, re-encrypting only the
+    // units the range touches. The range has to end inside the file. Digests
+    // recorded in FILE.b3 no longer match afterwards.
+    bool encryptRange(const std::string &filePath, uint64_t offset, const char *data, size_t length);
+    // Smallest aligned span a technique has to see whole: 1 for per-byte
+    // ciphers, TRANSFORM_UNIT for ones that reorder bytes within a unit.
+    // Positional techniques report their own unit (the XTS sector).
+    static size_t seekGranularity(EncryptionType type);
+    // Transform an in-memory buffer with the current technique
+    void processBuffer(char *data, size_t size, bool isEncryption);
+    // Transform bytes that sit at fileOffset of a file. Safe to call from
+    // several threads at once as long as the technique is not being changed.
+    void processAt(char *data, size_t size, uint64_t fileOffset, bool isEncryption);
+    void setBlockSize(size_t bytes);
+    size_t getBlockSize() const;
+
+    // Cooperative control of the current run, safe to call from any thread.
+    // Workers react between blocks. A cancel issued before a run starts
+    // cancels that run; the state is cleared when a run finishes.
+    void cancel();
+    void pause();
+    void resume();
+    bool isPaused() const;
+    bool wasCancelled() const;
+    // Drops a pause or cancel that was not consumed by a run
+    void resetControl();
+    // Rate, CPU and priority limits for in-place runs, kept until changed.
+    // Safe to change from any thread while a run goes; its workers, threads
+    // or processes, pick the new limits up at their next block.
+    void setLimits(const RunLimits &limits);
+    RunLimits getLimits() const;
+    // When enabled (the default) cancelled workers undo the blocks they had
+    // already transformed, so the file is left exactly as it was
+    void setRollbackOnCancel(bool enabled);
+    // Keep a checkpoint journal next to the file so that an interrupted run
+    // of the same job redoes only the unfinished blocks. A cancelled run then
+    // keeps its journal instead of rolling back.
+    void setCheckpointing(bool enabled);
+    // Pin each worker to its own core, spread over the NUMA nodes, with its
+    // buffers allocated on that node and its chunk next to its node peers'
+    void setWorkerPinning(bool enabled);
+    // Hash every block's plaintext and ciphertext while the worker holds it
+    // and, after a complete run, record both BLAKE3 digests in FILE.b3
+    void setHashing(bool enabled);
+    // Count cycles, instructions, LLC and branch misses of every worker's
+    // transforms in in-place runs. False, and left off, if this process
+    // cannot open the counters; getStatusMessage() says why.
+    bool setPerfCounters(bool enabled);
+    const RunDigests &getLastDigests() const;
+    // BLAKE3 digest of a file, or of its decryption with the current technique,
+    // hashed in parallel over all cores without writing anything
+    bool hashFile(const std::string &filePath, bool decrypt, std::string &digest, size_t numThreads = 0);
+    const RunStats &getRunStats() const;
     
     // Set encryption technique
     void setEncryptionTechnique(std::unique_ptr<EncryptionTechnique> technique);
     EncryptionType getCurrentTechniqueType() const;
 
     float getProgress(size_t threadId) const;
+    // Lock-free progress surface, safe to poll from any thread at frame rate
+    size_t getWorkerCount() const;
+    ProgressSnapshot getWorkerProgress(size_t workerId) const;
+    ProgressSnapshot getOverallProgress() const;
     std::string getStatusMessage() const;
     std::vector<pthread_t> getActiveThreadIds() const;
     std::vector<pid_t> getActiveProcessIds() const;
@@ -57,14 +224,105 @@ private:
     void processChunk(ThreadData *data);
     void initializeThreads(size_t count);
     void cleanupThreads();
+    bool processRange(std::fstream &file, size_t workerId, uint64_t startOffset, uint64_t length,
+                      bool isEncryption, bool threaded);
+    void rollbackRange(std::fstream &file, size_t workerId, uint64_t startOffset, uint64_t length,
+                       bool isEncryption);
+    bool waitWhilePaused() const;
+    void resetRunState();
+    // Resets the run state and maps the file's holes
+    bool beginRun(const std::string &filePath, uint64_t fileSize, bool isEncryption);
+    bool checkContainerTechnique(const ChunkContainer &container);
+    // Reads, decrypts and if needed decompresses one chunk into buffer
+    void loadChunk(const ChunkContainer &container, uint64_t chunk, char *buffer);
+    // Decrypts a range; units that are all hole come back as zeros
+    void decryptSlice(int fd, uint64_t fileSize, uint64_t offset, size_t length, char *out);
+    void decryptData(int fd, uint64_t fileSize, uint64_t offset, size_t length, char *out);
+    // Encrypts zeros into the all-hole units around [offset, end)
+    void fillHoles(int fd, uint64_t fileSize, uint64_t offset, uint64_t end);
+    size_t currentGranularity() const;
+    // Runs work on chunks [first, last) of a container, split into contiguous
+    // shares over threads with the usual progress, control and placement
+    bool runChunkWorkers(const ChunkContainer &container, uint64_t first, uint64_t last, size_t workers,
+                         const std::function<void(uint64_t chunk, char *buffer)> &work);
+    size_t autoWorkerCount(const std::string &filePath, uint64_t fileSize);
+    void preparePlacement(size_t workerCount);
+    int applyPlacement(size_t workerId);
+    // Waits until bytes of worker buffers fit in the memory budget. Returns
+    // without the reservation if the run is cancelled meanwhile, which the
+    // worker's next cancel check then sees.
+    void reserveBuffers(MemoryReservation &reservation, uint64_t bytes);
+    void publishPerf(WorkerProgress &slot, const PerfCounters &counters, uint64_t bytes);
+    void collectRunStats(bool threads);
+    void finishRun(const std::string &filePath);
+    void recordDigests(const std::string &filePath);
+    // Span kernels, one instantiation per kind of technique and direction.
+    // The pair for a technique is picked when it is set, so transformRange
+    // is a single indirect call with no branches.
+    struct TechniqueSlot;
+    typedef void (*SpanKernel)(const TechniqueSlot &slot, char *data, size_t size, uint64_t fileOffset);
+    struct TechniqueSlot
+    {
+        std::unique_ptr<EncryptionTechnique> technique;
+        PositionalTechnique *positional = nullptr; // technique, when it is one
+        SpanKernel kernels[2] = {};                // indexed by isEncryption
+    };
+    template <bool Encrypt>
+    static void chunkKernel(const TechniqueSlot &slot, char *data, size_t size, uint64_t fileOffset);
+    template <bool Encrypt>
+    static void positionalKernel(const TechniqueSlot &slot, char *data, size_t size, uint64_t fileOffset);
+    static void fallbackKernel(const TechniqueSlot &slot, char *data, size_t size, uint64_t fileOffset);
+    static void fillSlot(TechniqueSlot &slot, std::unique_ptr<EncryptionTechnique> technique);
+    void transformRange(char *data, size_t size, uint64_t fileOffset, bool isEncryption);
+    // BLAKE3 of the current technique's output for a unit of zeros: changes
+    // with the key, and tells no more about it than any ciphertext does
+    void keyCheck(uint8_t out[Blake3::DIGEST_LEN]);
+    static void applySpans(const TechniqueSlot &slot, bool encrypt, char *data, uint64_t fileOffset,
+                           const std::vector<SparseMap::Extent> &spans);
+    // One block of an in-place run, transformed only where spans say it
+    // holds data, and hashed whole when the run is hashed
+    void transformBlock(char *data, size_t size, uint64_t fileOffset, bool isEncryption,
+                        const std::vector<SparseMap::Extent> &spans);
+    // rekeySource to current when forward, back again for a rollback
+    void rekeyBlock(char *data, size_t size, uint64_t fileOffset, bool forward,
+                    const std::vector<SparseMap::Extent> &spans);
+    void resetProgress(size_t workerCount, uint64_t fileSize, uint64_t chunkSize);
+    // bounds[i] to bounds[i + 1] is worker i's share
+    void resetProgress(const std::vector<uint64_t> &bounds);
+    // Bytes each of workers contiguous shares of a file covers
+    uint64_t workerShare(uint64_t fileSize, size_t workers) const;
+    // Share boundaries of an in-place run, in whole blocks, balanced by the
+    // data they hold when the file is sparse
+    std::vector<uint64_t> shareBounds(uint64_t fileSize, size_t workers) const;
 
-    std::vector<float> threadProgress;
+    SharedProgress *progress;
+    SparseMap sparse; // data extents of the file being run on
+    size_t blockSize;
+    size_t configuredBlockSize; // blockSize again at the start of every run
+    bool rollbackOnCancel;
+    bool lastRunCancelled;
+    bool checkpointing;
+    bool compressContainers;
+    std::unique_ptr<CheckpointJournal> journal; // open only while a run is checkpointed
+    bool hashing;
+    std::unique_ptr<RunHasher> hasher;          // open only while a run is hashed
+    bool perfCounting;
+    RunDigests lastDigests;
+    RefreshStats lastRefresh;
+    TuningPlan lastPlan;
+    bool pinWorkers;
+    std::vector<WorkerPlacement> placement; // per worker of the current run
+    int64_t runStartNs;
+    BufferPoolStats poolAtStart;
+    std::atomic<int64_t> reservationWaitNs;
+    RunStats lastRunStats;
     std::vector<pthread_t> threadIds;
     std::vector<pid_t> processIds;
     std::vector<pid_t> allChildProcesses;
     std::string statusMessage;
     int pipefd[2];
-    std::unique_ptr<EncryptionTechnique> currentTechnique;
+    TechniqueSlot current;
+    TechniqueSlot rekeySource; // set only while a rekey runs
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,173 @@
+#include "Throttle.hpp"
+#include <algorithm>
+#include <thread>
+#include <time.h>
+#ifdef __linux__
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    // Unused allowance a bucket keeps, so a short stall can be made up
+    const int64_t BURST_NS = 100LL * 1000 * 1000;
+    // Longest single sleep, so cancels and limit changes are seen quickly
+    const int64_t SLICE_NS = 50LL * 1000 * 1000;
+    // A CPU window this old is restarted, so idle time does not bank credit
+    const int64_t CPU_WINDOW_NS = 1000LL * 1000 * 1000;
+    const int IOPRIO_CLASS_SHIFT = 13;
+
+    int64_t threadCpuNs()
+    {
+        timespec now;
+        if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now) != 0)
+            return 0;
+        return static_cast<int64_t>(now.tv_sec) * 1000000000LL + now.tv_nsec;
+    }
+}
+
+Throttle::Throttle(ThrottleState &state, const std::atomic<int> &control, size_t workers)
+    : state(state), control(control), workers(std::max<size_t>(workers, 1))
+{
+    seenGeneration = state.generation.load(std::memory_order_acquire);
+    applyPriority();
+    restartCpuWindow();
+}
+
+void Throttle::store(ThrottleState &state, const RunLimits &limits)
+{
+    state.readBytesPerSecond.store(limits.readBytesPerSecond, std::memory_order_relaxed);
+    state.writeBytesPerSecond.store(limits.writeBytesPerSecond, std::memory_order_relaxed);
+    state.cpuPercent.store(limits.cpuPercent, std::memory_order_relaxed);
+    state.nice.store(limits.nice, std::memory_order_relaxed);
+    int ioPriority = limits.ioClass > 0 ? (limits.ioClass << IOPRIO_CLASS_SHIFT) | (limits.ioLevel & 7) : 0;
+    state.ioPriority.store(ioPriority, std::memory_order_relaxed);
+    // Debt run up under the old rates does not carry over
+    state.readReadyNs.store(0, std::memory_order_relaxed);
+    state.writeReadyNs.store(0, std::memory_order_relaxed);
+    state.generation.fetch_add(1, std::memory_order_release);
+}
+
+RunLimits Throttle::load(const ThrottleState &state)
+{
+    RunLimits limits;
+    limits.readBytesPerSecond = state.readBytesPerSecond.load(std::memory_order_relaxed);
+    limits.writeBytesPerSecond = state.writeBytesPerSecond.load(std::memory_order_relaxed);
+    limits.cpuPercent = state.cpuPercent.load(std::memory_order_relaxed);
+    limits.nice = state.nice.load(std::memory_order_relaxed);
+    int ioPriority = state.ioPriority.load(std::memory_order_relaxed);
+    if (ioPriority != 0)
+    {
+        limits.ioClass = ioPriority >> IOPRIO_CLASS_SHIFT;
+        limits.ioLevel = ioPriority & 7;
+    }
+    return limits;
+}
+
+bool Throttle::beforeRead(uint64_t bytes)
+{
+    return take(state.readReadyNs, state.readBytesPerSecond, bytes);
+}
+
+void Throttle::beforeWrite(uint64_t bytes)
+{
+    take(state.writeReadyNs, state.writeBytesPerSecond, bytes);
+}
+
+void Throttle::afterBlock()
+{
+    uint32_t generation = state.generation.load(std::memory_order_acquire);
+    if (generation != seenGeneration)
+    {
+        seenGeneration = generation;
+        applyPriority();
+        restartCpuWindow();
+        return;
+    }
+
+    uint32_t percent = state.cpuPercent.load(std::memory_order_relaxed);
+    // A worker never uses more than one core, so a part of 100% is no limit
+    double share = static_cast<double>(percent) / workers;
+    if (percent == 0 || share >= 100.0)
+        return;
+
+    int64_t used = threadCpuNs() - windowCpuNs;
+    int64_t due = windowWallNs + static_cast<int64_t>(used * 100.0 / share);
+    int64_t now = progressClockNs();
+    if (due > now)
+    {
+        sleepUntil(due, generation);
+        restartCpuWindow();
+    }
+    else if (now - windowWallNs > CPU_WINDOW_NS)
+    {
+        restartCpuWindow();
+    }
+}
+
+// Generic cell rate form of a token bucket: readyNs is when the bucket is
+// next out of debt, and every caller moves it on by the time its bytes cost
+bool Throttle::take(std::atomic<int64_t> &readyNs, const std::atomic<uint64_t> &rate, uint64_t bytes)
+{
+    while (true)
+    {
+        uint32_t generation = state.generation.load(std::memory_order_acquire);
+        uint64_t bytesPerSecond = rate.load(std::memory_order_relaxed);
+        if (bytesPerSecond == 0 || bytes == 0)
+            return true;
+
+        int64_t cost = static_cast<int64_t>(static_cast<double>(bytes) * 1e9 / bytesPerSecond);
+        int64_t now = progressClockNs();
+        int64_t ready = readyNs.load(std::memory_order_relaxed);
+        int64_t start;
+        do
+        {
+            start = std::max(ready, now - BURST_NS);
+        } while (!readyNs.compare_exchange_weak(ready, start + cost, std::memory_order_relaxed));
+
+        if (start <= now)
+            return true;
+        Wake wake = sleepUntil(start, generation);
+        if (wake != CHANGED)
+            return wake == ELAPSED;
+        // New limits reset the buckets; take again at the new rate
+    }
+}
+
+Throttle::Wake Throttle::sleepUntil(int64_t deadlineNs, uint32_t generation) const
+{
+    while (true)
+    {
+        if (control.load(std::memory_order_acquire) == JOB_CANCELLED)
+            return CANCELLED;
+        if (state.generation.load(std::memory_order_acquire) != generation)
+            return CHANGED;
+        int64_t left = deadlineNs - progressClockNs();
+        if (left <= 0)
+            return ELAPSED;
+        std::this_thread::sleep_for(std::chrono::nanoseconds(std::min(left, SLICE_NS)));
+    }
+}
+
+void Throttle::applyPriority() const
+{
+#ifdef __linux__
+    // Both are per thread on Linux, so only this worker is affected
+    pid_t thread = static_cast<pid_t>(syscall(SYS_gettid));
+    int nice = state.nice.load(std::memory_order_relaxed);
+    if (nice != 0)
+        setpriority(PRIO_PROCESS, static_cast<id_t>(thread), nice);
+#ifdef SYS_ioprio_set
+    int ioPriority = state.ioPriority.load(std::memory_order_relaxed);
+    if (ioPriority != 0)
+        syscall(SYS_ioprio_set, 1 /* IOPRIO_WHO_PROCESS */, thread, ioPriority);
+#endif
+#endif
+}
+
+void Throttle::restartCpuWindow()
+{
+    windowWallNs = progressClockNs();
+    windowCpuNs = threadCpuNs();
+}
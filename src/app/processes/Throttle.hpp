@@ -0,0 +1,67 @@
+#ifndef THROTTLE_HPP
+#define THROTTLE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include "JobProgress.hpp"
+
+// Limits for the runs of a TaskManager, so a background job can share a host
+// with latency-sensitive work. Zero means no limit.
+struct RunLimits
+{
+    uint64_t readBytesPerSecond = 0;
+    uint64_t writeBytesPerSecond = 0;
+    unsigned cpuPercent = 0; // of one core over all workers, so 150 is one and a half cores
+    int nice = 0;            // 1..19 lowers the workers' CPU priority; 0 leaves it
+    int ioClass = 0;         // 1 realtime, 2 best effort, 3 idle; 0 leaves it
+    int ioLevel = 4;         // 0 (highest) to 7, for realtime and best effort
+
+    bool any() const { return readBytesPerSecond || writeBytesPerSecond || cpuPercent || nice || ioClass; }
+};
+
+// One worker's side of a ThrottleState.
+//
+// Reads and writes draw on token buckets shared by every worker of the run,
+// threads or forked processes alike, so the byte rates hold for the run as a
+// whole. The CPU cap is split evenly over the workers and each one sleeps off
+// the thread CPU time it used above its part. Nice and I/O priority are set
+// per worker thread (Linux only) and, like the rest, picked up again at the
+// next block when the limits change. An unprivileged process can only lower
+// its priorities, not raise them back.
+class Throttle
+{
+public:
+    Throttle(ThrottleState &state, const std::atomic<int> &control, size_t workers);
+
+    static void store(ThrottleState &state, const RunLimits &limits);
+    static RunLimits load(const ThrottleState &state);
+
+    // Wait until bytes may be read; false if the run was cancelled meanwhile
+    bool beforeRead(uint64_t bytes);
+    // Wait until bytes may be written; a cancel only cuts the wait short
+    void beforeWrite(uint64_t bytes);
+    // Once per block: picks up changed limits and sleeps off CPU over the cap
+    void afterBlock();
+
+private:
+    enum Wake
+    {
+        ELAPSED,
+        CHANGED,
+        CANCELLED
+    };
+
+    bool take(std::atomic<int64_t> &readyNs, const std::atomic<uint64_t> &rate, uint64_t bytes);
+    Wake sleepUntil(int64_t deadlineNs, uint32_t generation) const;
+    void applyPriority() const;
+    void restartCpuWindow();
+
+    ThrottleState &state;
+    const std::atomic<int> &control;
+    size_t workers;
+    uint32_t seenGeneration;
+    int64_t windowWallNs;
+    int64_t windowCpuNs;
+};
+
+#endif
@@ -0,0 +1,221 @@
+#include "XtsEncryption.hpp"
+#include "KeyStore.hpp"
+#include "../fileHandling/EnvConfig.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace
+{
+    // Blocks whose tweaks are computed and applied per pass
+    const size_t BATCH = 256;
+
+    struct Tweak
+    {
+        uint64_t lo;
+        uint64_t hi;
+
+        // Multiply by x in GF(2^128), little-endian as IEEE 1619 lays it out
+        void advance()
+        {
+            uint64_t carry = hi >> 63;
+            hi = (hi << 1) | (lo >> 63);
+            lo = (lo << 1) ^ (carry * 0x87);
+        }
+    };
+
+    // Whole-word moves: the tweak is XORed in twice per block, and byte
+    // loops here cost more than the AES rounds themselves
+    inline uint64_t loadLE(const uint8_t *p)
+    {
+        uint64_t v;
+        std::memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        v = __builtin_bswap64(v);
+#endif
+        return v;
+    }
+
+    inline void storeLE(uint8_t *p, uint64_t v)
+    {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        v = __builtin_bswap64(v);
+#endif
+        std::memcpy(p, &v, sizeof(v));
+    }
+
+    inline void xorTweak(uint8_t *block, const Tweak &tweak)
+    {
+        storeLE(block, loadLE(block) ^ tweak.lo);
+        storeLE(block + 8, loadLE(block + 8) ^ tweak.hi);
+    }
+}
+
+XtsEncryption::XtsEncryption(const uint8_t dataKey[KEY_LEN], const uint8_t tweakKey[KEY_LEN], size_t sector)
+    : sectorSize(sector)
+{
+    if (!validSectorSize(sectorSize))
+        throw std::invalid_argument("XTS sector size must be a power of two from 512 bytes to 64 KiB");
+    dataCipher.setKey(dataKey, KEY_LEN);
+    tweakCipher.setKey(tweakKey, KEY_LEN);
+}
+
+XtsEncryption::XtsEncryption(std::shared_ptr<const KeyMaterial> key, size_t sector)
+    : material(std::move(key)), sectorSize(sector)
+{
+    if (!validSectorSize(sectorSize))
+        throw std::invalid_argument("XTS sector size must be a power of two from 512 bytes to 64 KiB");
+    dataCipher.useSchedule(material->keySchedule, KEY_LEN);
+    tweakCipher.useSchedule(material->tweakSchedule, KEY_LEN);
+}
+
+bool XtsEncryption::validSectorSize(size_t size)
+{
+    return size >= MIN_SECTOR_SIZE && size <= MAX_SECTOR_SIZE && (size & (size - 1)) == 0;
+}
+
+namespace
+{
+    std::unique_ptr<XtsEncryption> fromPassphrase(const std::string &passphrase, const char *name, std::string &error)
+    {
+        const EnvConfig &config = EnvConfig::get();
+        if (passphrase.empty())
+        {
+            error = std::string("AES-XTS needs ") + name + " in .env or the environment";
+            return nullptr;
+        }
+        if (!XtsEncryption::validSectorSize(config.xtsSectorSize))
+        {
+            error = "CRYPTOCORE_XTS_SECTOR must be a power of two from 512 to 65536";
+            return nullptr;
+        }
+        std::shared_ptr<const KeyMaterial> key = KeyStore::shared().forPassphrase(passphrase);
+        if (!key)
+        {
+            error = "Could not derive the key: " + KeyStore::shared().getStatusMessage();
+            return nullptr;
+        }
+        return std::make_unique<XtsEncryption>(std::move(key), config.xtsSectorSize);
+    }
+}
+
+std::unique_ptr<XtsEncryption> XtsEncryption::fromConfig(std::string &error)
+{
+    return fromPassphrase(EnvConfig::get().passphrase, "CRYPTOCORE_PASSPHRASE", error);
+}
+
+std::unique_ptr<XtsEncryption> XtsEncryption::fromOldPassphrase(std::string &error)
+{
+    return fromPassphrase(EnvConfig::get().oldPassphrase, "CRYPTOCORE_OLD_PASSPHRASE", error);
+}
+
+void XtsEncryption::encryptChunk(char *data, size_t size)
+{
+    encryptAt(data, size, 0);
+}
+
+void XtsEncryption::decryptChunk(char *data, size_t size)
+{
+    decryptAt(data, size, 0);
+}
+
+void XtsEncryption::encryptAt(char *data, size_t size, uint64_t fileOffset)
+{
+    transformRun<true>(reinterpret_cast<uint8_t *>(data), size, fileOffset);
+}
+
+void XtsEncryption::decryptAt(char *data, size_t size, uint64_t fileOffset)
+{
+    transformRun<false>(reinterpret_cast<uint8_t *>(data), size, fileOffset);
+}
+
+void XtsEncryption::encryptSector(char *data, size_t size, uint64_t sector) const
+{
+    transformSector<true>(reinterpret_cast<uint8_t *>(data), size, sector);
+}
+
+void XtsEncryption::decryptSector(char *data, size_t size, uint64_t sector) const
+{
+    transformSector<false>(reinterpret_cast<uint8_t *>(data), size, sector);
+}
+
+template <bool Encrypt>
+void XtsEncryption::transformRun(uint8_t *data, size_t size, uint64_t fileOffset) const
+{
+    if (fileOffset % sectorSize != 0)
+        throw std::runtime_error("XTS data must start on a sector boundary");
+    uint64_t sector = fileOffset / sectorSize;
+    for (size_t done = 0; done < size; done += sectorSize, sector++)
+        transformSector<Encrypt>(data + done, std::min(sectorSize, size - done), sector);
+}
+
+template <bool Encrypt>
+void XtsEncryption::transformSector(uint8_t *data, size_t size, uint64_t sector) const
+{
+    uint8_t block[Aes::BLOCK_LEN] = {};
+    storeLE(block, sector);
+    tweakCipher.encryptBlocks(block, block, 1);
+    Tweak tweak = {loadLE(block), loadLE(block + 8)};
+
+    size_t blocks = size / Aes::BLOCK_LEN;
+    size_t tail = size % Aes::BLOCK_LEN;
+    if (blocks == 0)
+    {
+        // Too short for XTS: XOR with the tweak encrypted under the data key
+        dataCipher.encryptBlocks(block, block, 1);
+        for (size_t i = 0; i < tail; i++)
+            data[i] ^= block[i];
+        std::memset(block, 0, sizeof(block));
+        return;
+    }
+
+    // With a partial tail the last whole block takes part in the stealing
+    size_t plain = tail ? blocks - 1 : blocks;
+    Tweak tweaks[BATCH];
+    for (size_t first = 0; first < plain; first += BATCH)
+    {
+        size_t count = std::min(BATCH, plain - first);
+        for (size_t i = 0; i < count; i++)
+        {
+            tweaks[i] = tweak;
+            tweak.advance();
+        }
+        uint8_t *batch = data + first * Aes::BLOCK_LEN;
+        for (size_t i = 0; i < count; i++)
+            xorTweak(batch + i * Aes::BLOCK_LEN, tweaks[i]);
+        if (Encrypt)
+            dataCipher.encryptBlocks(batch, batch, count);
+        else
+            dataCipher.decryptBlocks(batch, batch, count);
+        for (size_t i = 0; i < count; i++)
+            xorTweak(batch + i * Aes::BLOCK_LEN, tweaks[i]);
+    }
+    if (!tail)
+        return;
+
+    // Ciphertext stealing (IEEE 1619 section 5.3)
+    Tweak last = tweak;
+    Tweak next = tweak;
+    next.advance();
+    uint8_t *full = data + plain * Aes::BLOCK_LEN;
+    uint8_t *partial = full + Aes::BLOCK_LEN;
+    auto blockOp = [&](uint8_t *target, const Tweak &t)
+    {
+        xorTweak(target, t);
+        if (Encrypt)
+            dataCipher.encryptBlocks(target, target, 1);
+        else
+            dataCipher.decryptBlocks(target, target, 1);
+        xorTweak(target, t);
+    };
+
+    // Encryption steals from the block under the earlier tweak, decryption
+    // undoes the later one first
+    std::memcpy(block, full, Aes::BLOCK_LEN);
+    blockOp(block, Encrypt ? last : next);
+    std::memcpy(full, partial, tail);
+    std::memcpy(full + tail, block + tail, Aes::BLOCK_LEN - tail);
+    std::memcpy(partial, block, tail);
+    blockOp(full, Encrypt ? next : last);
+    std::memset(block, 0, sizeof(block));
+}
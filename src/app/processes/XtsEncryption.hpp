@@ -0,0 +1,74 @@
+#ifndef XTS_ENCRYPTION_HPP
+#define XTS_ENCRYPTION_HPP
+
+#include <memory>
+#include <string>
+#include "EncryptionTechnique.hpp"
+#include "PositionalTechnique.hpp"
+#include "Aes.hpp"
+#include "KeyStore.hpp"
+
+// EncryptionType value of AES-XTS; the named techniques end at ROT13
+const EncryptionType AES_XTS = static_cast<EncryptionType>(5);
+
+// AES-256-XTS (IEEE 1619) for disk and VM images: length-preserving, and
+// each sector is encrypted under its own tweak (its index in the file), so
+// any sector can be read or rewritten without touching its neighbours.
+//
+// Per sector, all block tweaks are computed first in 64-bit arithmetic and
+// XORed over the sector in one pass, leaving AES to run on a full batch of
+// independent blocks. A partial last sector uses ciphertext stealing; a final
+// fragment shorter than one block, which XTS cannot encrypt, is XORed with
+// the encrypted tweak instead.
+class XtsEncryption : public EncryptionTechnique, public PositionalTechnique
+{
+public:
+    static const size_t KEY_LEN = 32;
+    static const size_t DEFAULT_SECTOR_SIZE = 4096;
+    static const size_t MIN_SECTOR_SIZE = 512;
+    static const size_t MAX_SECTOR_SIZE = 64 * 1024;
+
+    XtsEncryption(const uint8_t dataKey[KEY_LEN], const uint8_t tweakKey[KEY_LEN],
+                  size_t sectorSize = DEFAULT_SECTOR_SIZE);
+    // Runs on the round keys expanded in the KeyStore's locked memory, and
+    // holds the entry for as long as it lives
+    XtsEncryption(std::shared_ptr<const KeyMaterial> key, size_t sectorSize = DEFAULT_SECTOR_SIZE);
+    // Keys derived from CRYPTOCORE_PASSPHRASE through the KeyStore, sector
+    // size from CRYPTOCORE_XTS_SECTOR; nullptr with error set if unusable
+    static std::unique_ptr<XtsEncryption> fromConfig(std::string &error);
+    // The same for CRYPTOCORE_OLD_PASSPHRASE, the key a rekey decrypts with
+    static std::unique_ptr<XtsEncryption> fromOldPassphrase(std::string &error);
+    static bool validSectorSize(size_t sectorSize);
+
+    EncryptionType getType() const override { return AES_XTS; }
+    // Without an offset the data is taken to start at sector 0
+    void encryptChunk(char *data, size_t size) override;
+    void decryptChunk(char *data, size_t size) override;
+    std::string getName() const override { return "AES-XTS"; }
+    std::string getDescription() const override { return "AES-256-XTS sector encryption for disk and VM images"; }
+    bool isSuitableFor(const std::string &) const override { return true; }
+    int getSecurityLevel() const override { return 5; }
+    int getSpeedRating() const override { return Aes::hardwareAccelerated() ? 4 : 2; }
+
+    void encryptAt(char *data, size_t size, uint64_t fileOffset) override;
+    void decryptAt(char *data, size_t size, uint64_t fileOffset) override;
+    size_t unitSize() const override { return sectorSize; }
+
+    // One data unit: size is at most the sector size
+    void encryptSector(char *data, size_t size, uint64_t sector) const;
+    void decryptSector(char *data, size_t size, uint64_t sector) const;
+
+private:
+    // One instantiation per direction, so the block loop has no branches
+    template <bool Encrypt>
+    void transformRun(uint8_t *data, size_t size, uint64_t fileOffset) const;
+    template <bool Encrypt>
+    void transformSector(uint8_t *data, size_t size, uint64_t sector) const;
+
+    std::shared_ptr<const KeyMaterial> material; // when keyed from the KeyStore
+    Aes dataCipher;
+    Aes tweakCipher;
+    size_t sectorSize;
+};
+
+#endif
@@ -1,4 +1,5 @@
 #include "CryptoCoreGUI.hpp"
+#include "../app/processes/XtsEncryption.hpp"
 #include "imgui.h"
 #include "imgui_impl_glfw.h"
 #include "imgui_impl_opengl3.h"
@@ -7,10 +8,17 @@
 
 CryptoCoreGUI::CryptoCoreGUI()
     : window(nullptr), showFileDialog(false), showProcessingPanel(false),
-      progress(0.0f), useThreads(true), isProcessing(false), isCompleted(false),
+      progress(0.0f), useThreads(true), autoTune(false), jobUsesThreads(true), useCheckpoint(false), pinWorkers(false), recordDigests(false), isProcessing(false), isCompleted(false),
       completionTime(std::chrono::microseconds(0)) {}
 CryptoCoreGUI::~CryptoCoreGUI()
 {
+    // Stop an in-flight job so the file is rolled back rather than left half done
+    if (processingThread.joinable())
+    {
+        taskManager->cancel();
+        processingThread.join();
+    }
+
     if (ImGui::GetCurrentContext() != nullptr)
     {
         ImGui_ImplOpenGL3_Shutdown();
@@ -88,6 +96,7 @@ void CryptoCoreGUI::run()
         ImGui::NewFrame();
 
         // Render GUI elements
+        updateProgress();
         renderMainWindow();
         if (showFileDialog)
             renderFileDialog();
@@ -175,7 +184,16 @@ void CryptoCoreGUI::renderMainWindow()
     ImGui::RadioButton("Threads", &mode, 0);
     ImGui::SameLine();
     ImGui::RadioButton("Processes", &mode, 1);
+    ImGui::SameLine();
+    ImGui::RadioButton("Auto", &mode, 2);
     useThreads = (mode == 0);
+    autoTune = (mode == 2);
+    ImGui::SameLine();
+    ImGui::Checkbox("Resumable", &useCheckpoint);
+    ImGui::SameLine();
+    ImGui::Checkbox("Pin workers", &pinWorkers);
+    ImGui::SameLine();
+    ImGui::Checkbox("Record digests", &recordDigests);
     ImGui::Spacing();
 
     // File selection area
@@ -191,9 +209,29 @@ void CryptoCoreGUI::renderMainWindow()
     ImGui::PushStyleVar(ImGuiStyleVar_FramePadding, ImVec2(20, 10));
     if (ImGui::Button("Select File", ImVec2(150, 40)))
         showFileDialog = true;
+    ImGui::SameLine();
+    if (ImGui::Button("Recommend", ImVec2(150, 40)) && !selectedFile.empty())
+        recommendSettings();
     ImGui::PopStyleVar();
     ImGui::EndChild();
 
+    // Applied by Auto mode; the reasons say what each pick is based on
+    if (!recommendedFile.empty() && recommendedFile == selectedFile)
+    {
+        if (recommendation.skip)
+            ImGui::TextColored(ImVec4(0.9f, 0.7f, 0.3f, 1.0f), "Recommended: leave this file as it is");
+        else
+            ImGui::TextColored(ImVec4(0.4f, 0.8f, 1.0f, 1.0f), "Recommended: %s, %zu %s, %zu KiB blocks%s",
+                               recommendation.techniqueName.c_str(), recommendation.plan.workers,
+                               recommendation.plan.useThreads ? "thread(s)" : "process(es)",
+                               recommendation.plan.blockSize / 1024,
+                               recommendation.packCompressed ? " (better packed with compression)" : "");
+        ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(0.7f, 0.7f, 0.7f, 1.0f));
+        for (const std::string &reason : recommendation.reasons)
+            ImGui::BulletText("%s", reason.c_str());
+        ImGui::PopStyleColor();
+    }
+
     ImGui::Spacing();
     ImGui::Spacing();
 
@@ -300,7 +338,7 @@ void CryptoCoreGUI::renderFileDialog()
         {
             selectedFile = buf;
             showFileDialog = false;
-            statusMessage = "File selected: " + selectedFile;
+            setStatusMessage("File selected: " + selectedFile);
         }
 
         ImGui::SameLine();
@@ -308,7 +346,7 @@ void CryptoCoreGUI::renderFileDialog()
         if (ImGui::Button("Cancel", ImVec2(130, 35)))
         {
             showFileDialog = false;
-            statusMessage = "";
+            setStatusMessage("");
         }
         ImGui::PopStyleVar();
     }
@@ -327,15 +365,20 @@ void CryptoCoreGUI::renderStatusBar()
                  ImGuiWindowFlags_NoTitleBar | ImGuiWindowFlags_NoResize |
                      ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoScrollbar);
 
-    if (!statusMessage.empty())
+    std::string message;
+    {
+        std::lock_guard<std::mutex> lock(logMutex);
+        message = statusMessage;
+    }
+    if (!message.empty())
     {
         ImVec4 statusColor = ImVec4(0.2f, 0.8f, 0.2f, 1.0f); // Success color
-        if (statusMessage.find("Failed") != std::string::npos)
+        if (message.find("Failed") != std::string::npos)
         {
             statusColor = ImVec4(0.8f, 0.2f, 0.2f, 1.0f); // Error color
         }
         ImGui::PushStyleColor(ImGuiCol_Text, statusColor);
-        ImGui::Text("%s", statusMessage.c_str());
+        ImGui::Text("%s", message.c_str());
         ImGui::PopStyleColor();
     }
 
@@ -343,13 +386,59 @@ void CryptoCoreGUI::renderStatusBar()
     ImGui::PopStyleVar(2);
 }
 
+void CryptoCoreGUI::appendLog(const std::string &message)
+{
+    std::lock_guard<std::mutex> lock(logMutex);
+    logMessages.push_back(message);
+}
+
+void CryptoCoreGUI::setStatusMessage(const std::string &message)
+{
+    std::lock_guard<std::mutex> lock(logMutex);
+    statusMessage = message;
+}
+
+void CryptoCoreGUI::updateProgress()
+{
+    // Lock-free read of the worker counters, cheap enough to do every frame
+    if (isProcessing && taskManager)
+        progress = taskManager->getOverallProgress().fraction;
+    else
+        progress = 0.0f;
+}
+
+void CryptoCoreGUI::recommendSettings()
+{
+    if (!benchmarkManager)
+        benchmarkManager = std::make_unique<BenchmarkManager>();
+    if (!recommender)
+        recommender = std::make_unique<Recommender>(*benchmarkManager);
+
+    // Local and cheap once the kernels are calibrated, so it runs on the UI thread
+    if (!recommender->recommend(selectedFile, recommendation))
+    {
+        recommendedFile.clear();
+        setStatusMessage("Error: " + recommender->getStatusMessage());
+        return;
+    }
+    recommendedFile = selectedFile;
+    setStatusMessage("Recommendation ready in " + std::to_string(static_cast<long>(recommendation.decideMicros)) +
+                     " us; select Auto to use it");
+}
+
 void CryptoCoreGUI::processFile(const std::string &path, Action action)
 {
+    if (isProcessing)
+    {
+        setStatusMessage("Another file is still being processed");
+        return;
+    }
+
     // Validate file exists and is accessible
     std::ifstream checkFile(path);
     if (!checkFile)
     {
-        statusMessage = "Error: File not found or not accessible - " + path;
+        setStatusMessage("Error: File not found or not accessible - " + path);
         return;
     }
     checkFile.close();
@@ -358,8 +447,14 @@ void CryptoCoreGUI::processFile(const std::string &path, Action action)
     {
         taskManager = std::make_unique<TaskManager>();
     }
+    taskManager->setCheckpointing(useCheckpoint);
+    taskManager->setWorkerPinning(pinWorkers);
+    taskManager->setHashing(recordDigests);
 
-    logMessages.clear();
+    {
+        std::lock_guard<std::mutex> lock(logMutex);
+        logMessages.clear();
+    }
     startTime = std::chrono::steady_clock::now();
     showProcessingPanel = true;
     isCompleted = false;
@@ -367,28 +462,67 @@ void CryptoCoreGUI::processFile(const std::string &path, Action action)
     completionTime = std::chrono::microseconds(0);
 
     std::string actionStr = (action == Action::ENCRYPT) ? "Encrypting" : "Decrypting";
-    statusMessage = actionStr + " file: " + path;
-    logMessages.push_back(statusMessage);
+    setStatusMessage(actionStr + " file: " + path);
+    appendLog(actionStr + " file: " + path);
 
-    // Start processing in a separate thread to keep GUI responsive
-    std::thread([this, path, action, actionStr]()
+    // Start processing in a separate thread to keep GUI responsive. The previous
+    // job has already finished (isProcessing is false), so the join is immediate.
+    if (processingThread.joinable())
+    {
+        processingThread.join();
+    }
+    bool threads = useThreads;
+    size_t workers = 0;
+    if (autoTune && recommendedFile == path && !recommendation.skip)
+    {
+        // Encrypting switches to the recommended technique; the manager
+        // keeps it, so decrypting the file afterwards uses the same one
+        if (action == Action::ENCRYPT && taskManager->getCurrentTechniqueType() != recommendation.technique)
+        {
+            std::unique_ptr<EncryptionTechnique> technique;
+            std::string error;
+            if (recommendation.technique == AES_XTS)
+                technique = XtsEncryption::fromConfig(error);
+            else
+                technique = benchmarkManager->getTechnique(recommendation.technique);
+            if (technique)
+                taskManager->setEncryptionTechnique(std::move(technique));
+            else
+                appendLog("Keeping the current technique: " + error);
+        }
+        taskManager->setBlockSize(recommendation.plan.blockSize);
+        threads = recommendation.plan.useThreads;
+        workers = recommendation.plan.workers;
+        appendLog("Recommended: " + recommendation.techniqueName + ", " + recommendation.plan.reason);
+    }
+    else if (autoTune)
+    {
+        // Calibration is cached per host, so only the first job pays for it
+        TuningPlan plan = taskManager->planFor(path);
+        taskManager->setBlockSize(plan.blockSize);
+        threads = plan.useThreads;
+        workers = plan.workers;
+        appendLog("Auto-tuned: " + plan.reason);
+    }
+    jobUsesThreads = threads;
+    processingThread = std::thread([this, path, action, actionStr, threads, workers]()
                 {
         bool success = false;
         try
         {
-            if (useThreads)
+            if (threads)
             {
                 std::string msg = std::string("Starting thread-based ") +
                                   (action == Action::ENCRYPT ? "encryption..." : "decryption...");
-                logMessages.push_back(msg);
-                success = taskManager->runWithThreads(path, action == Action::ENCRYPT);
+                appendLog(msg);
+                success = taskManager->runWithThreads(path, action == Action::ENCRYPT, workers);
             }
             else
             {
                 std::string msg = std::string("Starting process-based ") +
                                   (action == Action::ENCRYPT ? "encryption..." : "decryption...");
-                logMessages.push_back(msg);
-                success = taskManager->runWithProcesses(path, action == Action::ENCRYPT);
+                appendLog(msg);
+                success = taskManager->runWithProcesses(path, action == Action::ENCRYPT, workers);
             }
 
             if (success)
@@ -397,24 +531,51 @@ void CryptoCoreGUI::processFile(const std::string &path, Action action)
                 completionTime = std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime);
                 isCompleted = true;
                 isProcessing = false;
-                statusMessage = actionStr + " completed successfully!";
-                logMessages.push_back(statusMessage);
+                setStatusMessage(actionStr + " completed successfully!");
+                appendLog(actionStr + " completed successfully!");
+                const RunStats &stats = taskManager->getRunStats();
+                if (stats.pinned)
+                    appendLog("Pinned " + std::to_string(stats.workers) + " workers over " +
+                              std::to_string(stats.numaNodes) + " NUMA node(s), " +
+                              std::to_string(stats.offNodeWorkers) + " seen off their node");
+                if (stats.pool.acquires > 0)
+                    appendLog("Buffer pool: " + std::to_string(stats.pool.acquires) + " buffers, " +
+                              std::to_string(stats.pool.threadCacheHits + stats.pool.sharedHits) + " reused, " +
+                              std::to_string(stats.pool.freshMappings) + " newly mapped (" +
+                              std::to_string(stats.pool.hugePageMappings) + " huge), peak " +
+                              std::to_string(stats.pool.peakBytesInUse / 1024) + " KiB");
+                if (MemoryBudget::shared().getLimit() > 0)
+                    appendLog("Peak RSS " + std::to_string(stats.peakRssBytes / (1024 * 1024)) + " MiB, " +
+                              std::to_string(static_cast<int>(stats.reservationWaitSeconds * 1000)) +
+                              " ms waiting for the memory budget");
+                const RunDigests &digests = taskManager->getLastDigests();
+                if (digests.valid)
+                {
+                    appendLog("Plaintext BLAKE3: " + digests.plaintext);
+                    appendLog("Ciphertext BLAKE3: " + digests.ciphertext);
+                }
+            }
+            else if (taskManager->wasCancelled())
+            {
+                isProcessing = false;
+                setStatusMessage(taskManager->getStatusMessage());
+                appendLog(taskManager->getStatusMessage());
             }
             else
             {
                 isProcessing = false;
-                std::string error = taskManager->getStatusMessage();
-                statusMessage = "Error: " + error;
-                logMessages.push_back(statusMessage);
+                std::string error = "Error: " + taskManager->getStatusMessage();
+                setStatusMessage(error);
+                appendLog(error);
             }
         }
         catch (const std::exception &e)
         {
             isProcessing = false;
-            statusMessage = "Error: " + std::string(e.what());
-            logMessages.push_back(statusMessage);
-        } })
-        .detach();
+            std::string error = "Error: " + std::string(e.what());
+            setStatusMessage(error);
+            appendLog(error);
+        } });
 }
 
 void CryptoCoreGUI::renderProcessingPanel()
@@ -441,6 +602,25 @@ void CryptoCoreGUI::renderProcessingPanel()
             auto now = std::chrono::steady_clock::now();
             float secs = std::chrono::duration_cast<std::chrono::microseconds>(now - startTime).count() / 1000000.0f;
             ImGui::Text("Execution Time: %.2f s", secs);
+
+            // Workers pick these up between blocks
+            ImGui::SameLine(ImGui::GetWindowWidth() - 190);
+            bool paused = taskManager->isPaused();
+            if (ImGui::Button(paused ? "Resume" : "Pause", ImVec2(80, 0)))
+            {
+                if (paused)
+                    taskManager->resume();
+                else
+                    taskManager->pause();
+                appendLog(paused ? "Resumed" : "Paused");
+            }
+            ImGui::SameLine();
+            if (ImGui::Button("Cancel", ImVec2(80, 0)))
+            {
+                taskManager->cancel();
+                appendLog(useCheckpoint ? "Cancelling, finished blocks stay checkpointed..."
+                                        : "Cancelling, rolling back completed blocks...");
+            }
         }
         else
         {
@@ -451,8 +631,22 @@ void CryptoCoreGUI::renderProcessingPanel()
         ImGui::Separator();
         ImGui::Spacing();
 
+        // Overall progress from the lock-free counters
+        ProgressSnapshot overall = taskManager ? taskManager->getOverallProgress() : ProgressSnapshot();
+        if (overall.bytesTotal > 0)
+        {
+            char overlay[96];
+            snprintf(overlay, sizeof(overlay), "%d%%  %.1f MB/s  ETA %.1f s",
+                     static_cast<int>(overall.fraction * 100), overall.throughputMBps, overall.etaSeconds);
+            ImGui::Text("Overall: %llu / %llu blocks", static_cast<unsigned long long>(overall.blocksDone),
+                        static_cast<unsigned long long>(overall.blocksTotal));
+            ImGui::ProgressBar(overall.fraction, ImVec2(-1, 14), overlay);
+            ImGui::Spacing();
+        }
+
         // Show threads or processes depending on mode
-        if (useThreads)
+        size_t workerCount = taskManager ? taskManager->getWorkerCount() : 0;
+        if (jobUsesThreads)
         {
             ImGui::Text("Active Threads:");
             char tidInfo[64];
@@ -460,40 +654,40 @@ void CryptoCoreGUI::renderProcessingPanel()
             snprintf(tidInfo, sizeof(tidInfo), "Main Thread ID: %p", (void *)mainThread);
             ImGui::TextColored(ImVec4(0.6f, 0.9f, 0.6f, 1.0f), "%s", tidInfo);
 
-            auto threadIds = taskManager ? taskManager->getActiveThreadIds() : std::vector<pthread_t>{};
-            if (threadIds.empty())
+            if (workerCount == 0)
             {
                 ImGui::TextDisabled("No worker threads active");
             }
-            else
-            {
-                for (size_t i = 0; i < threadIds.size(); ++i)
-                {
-                    float p = taskManager ? taskManager->getProgress(i) : 0.0f;
-                    ImGui::Text("Thread %zu (ID: %p)", i, (void *)threadIds[i]);
-                    std::string overlay = std::to_string(static_cast<int>(p * 100)) + "%";
-                    ImGui::ProgressBar(p, ImVec2(-1, 8), overlay.c_str());
-                }
-            }
         }
         else
         {
             ImGui::Text("Active Processes:");
-            auto pids = taskManager ? taskManager->getActiveProcessIds() : std::vector<pid_t>{};
-            if (pids.empty())
+            if (workerCount == 0)
             {
                 ImGui::TextDisabled("No worker processes active");
             }
+        }
+
+        for (size_t i = 0; i < workerCount; ++i)
+        {
+            ProgressSnapshot worker = taskManager->getWorkerProgress(i);
+            if (jobUsesThreads)
+                ImGui::Text("Thread %zu (ID: 0x%llx)", i, static_cast<unsigned long long>(worker.osId));
             else
+                ImGui::Text("Process %zu (PID: %llu)", i, static_cast<unsigned long long>(worker.osId));
+            if (worker.cpu >= 0)
             {
-                for (size_t i = 0; i < pids.size(); ++i)
-                {
-                    float p = taskManager ? taskManager->getProgress(i) : 0.0f;
-                    ImGui::Text("Process %zu (PID: %d)", i, pids[i]);
-                    std::string overlay = std::to_string(static_cast<int>(p * 100)) + "%";
-                    ImGui::ProgressBar(p, ImVec2(-1, 8), overlay.c_str());
-                }
+                ImGui::SameLine();
+                if (worker.homeNode >= 0)
+                    ImGui::TextDisabled("CPU %d, node %d", worker.cpu, worker.homeNode);
+                else
+                    ImGui::TextDisabled("CPU %d", worker.cpu);
             }
+
+            char overlay[96];
+            snprintf(overlay, sizeof(overlay), "%d%%  %.1f MB/s  ETA %.1f s",
+                     static_cast<int>(worker.fraction * 100), worker.throughputMBps, worker.etaSeconds);
+            ImGui::ProgressBar(worker.fraction, ImVec2(-1, 8), overlay);
         }
 
         ImGui::Spacing();
@@ -503,8 +697,11 @@ void CryptoCoreGUI::renderProcessingPanel()
         // Log
         ImGui::Text("Log Messages:");
         ImGui::BeginChild("LogMessages", ImVec2(0, 120), true);
-        for (const auto &m : logMessages)
-            ImGui::TextWrapped("%s", m.c_str());
+        {
+            std::lock_guard<std::mutex> lock(logMutex);
+            for (const auto &m : logMessages)
+                ImGui::TextWrapped("%s", m.c_str());
+        }
         ImGui::EndChild();
 
         ImGui::End();
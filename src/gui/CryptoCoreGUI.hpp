@@ -14,7 +14,7 @@
 // Thread synchronization stats
 #include "../app/processes/SyncStats.hpp"
 #include "../app/processes/BenchmarkManager.hpp"
-#include "../app/processes/GroqAnalyzer.hpp"
+#include "../app/processes/Recommender.hpp"
 #include "../app/processes/EncryptionTechnique.hpp"
 
 class CryptoCoreGUI
@@ -33,9 +33,13 @@ private:
     void renderProcessingPanel();
     void renderBenchmarkPanel();
     void processFile(const std::string &path, Action action);
+    void recommendSettings();
     void runBenchmark();
     void setupModernStyle();
     void updateProgress();
+    // Both may be called from the processing thread
+    void appendLog(const std::string &message);
+    void setStatusMessage(const std::string &message);
 
     GLFWwindow *window;
     std::string selectedFile;
@@ -47,13 +51,19 @@ private:
     ProcessManagement processManager;
     std::unique_ptr<TaskManager> taskManager;
     std::unique_ptr<BenchmarkManager> benchmarkManager;
-    std::unique_ptr<GroqAnalyzer> groqAnalyzer;
+    std::unique_ptr<Recommender> recommender;
     bool useThreads; // true for threads, false for processes
+    bool autoTune;   // let AutoTuner choose mode, workers and block size
+    bool jobUsesThreads; // mode of the job shown in the processing panel
+    bool useCheckpoint; // keep a resumable journal next to the file
+    bool pinWorkers;    // pin workers to cores on their NUMA node
+    bool recordDigests; // hash both forms during the run into FILE.b3
     std::atomic<bool> isProcessing;
+    std::thread processingThread; // joined before the next job and on shutdown
     std::atomic<bool> isCompleted;
     std::atomic<bool> isBenchmarking;
     std::vector<std::string> logMessages;
-    std::mutex logMutex;
+    std::mutex logMutex; // guards logMessages and statusMessage
     bool hasDynamicLog = false;
     std::chrono::steady_clock::time_point startTime;
     // Store completion time in microseconds for higher precision display
@@ -62,7 +72,8 @@ private:
     
     // Benchmark results
     std::vector<BenchmarkResult> benchmarkResults;
-    GroqRecommendation groqRecommendation;
+    Recommendation recommendation;
+    std::string recommendedFile; // file the recommendation was made for
     EncryptionType selectedTechnique;
 
     // Window settings
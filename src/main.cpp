@@ -1,9 +1,33 @@
 #include <iostream>
 #include <string>
 #include <limits>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "app/processes/ProcessManagement.hpp"
 #include "app/processes/Task.hpp"
 #include "app/fileHandling/IO.hpp"
+#include "app/fileHandling/CommandLine.hpp"
+#include "app/fileHandling/FileSniffer.hpp"
+#include "app/fileHandling/FolderWatcher.hpp"
+
+static std::atomic<bool> stopWatching(false);
+
+static void handleStopSignal(int)
+{
+    stopWatching = true;
+}
 
 void clearScreen()
 {
@@ -24,9 +48,25 @@ void displayMenu()
     std::cout << "║ 3. View File Status            ║\n";
     std::cout << "║ 4. Exit                        ║\n";
     std::cout << "╚════════════════════════════════╝\n";
+    std::cout << "Files are only obfuscated here, with a repeating pad; for real encryption use\n";
+    std::cout << "cryptocore with --technique xts.\n";
     std::cout << "Enter your choice (1-4): ";
 }
 
+void printFileType(const std::string &filePath)
+{
+    FileType type;
+    if (!FileSniffer::sniff(filePath, type))
+    {
+        std::cout << "unreadable\n";
+        return;
+    }
+    char entropy[32];
+    std::snprintf(entropy, sizeof(entropy), "%.2f", type.entropy);
+    std::cout << type.description << " (entropy " << entropy << " bits/byte over the first " << type.sampled
+              << " bytes)\n";
+}
+
 void processFile(const std::string &filePath, Action action)
 {
     ProcessManagement pm;
@@ -45,15 +85,15 @@ void processFile(const std::string &filePath, Action action)
 
     if (action == Action::ENCRYPT)
     {
-        std::cout << "\n🔒 File is now encrypted. Checking file type...\n";
+        std::cout << "\n🔒 File is now obfuscated (not securely encrypted). Checking file type...\n";
     }
     else
     {
-        std::cout << "\n🔓 File is now decrypted. Checking file type...\n";
+        std::cout << "\n🔓 File is now restored. Checking file type...\n";
     }
 
-    std::string cmd = "file " + filePath;
-    system(cmd.c_str());
+    std::cout << "📋 Type: ";
+    printFileType(filePath);
 }
 
 void viewFileStatus(const std::string &filePath)
@@ -78,13 +118,248 @@ void viewFileStatus(const std::string &filePath)
     std::cout << "📦 Size: " << size << " bytes\n";
 
     // Show file type
-    std::string cmd = "file " + filePath;
     std::cout << "📋 Type: ";
-    system(cmd.c_str());
+    printFileType(filePath);
+}
+
+void printWatchUsage()
+{
+    std::cout << "Usage: encrypt_decrypt watch [--decrypt] [--workers N] [--queue N] [--settle MS] --out DIR SPOOL...\n";
+    std::cout << "  Encrypts (or decrypts) every file closed after writing in, or moved into, a SPOOL\n";
+    std::cout << "  directory once it has been quiet for --settle ms (default 100), on N workers, and\n";
+    std::cout << "  moves it to DIR. DIR has to be on the same filesystem as the spools. Files are\n";
+    std::cout << "  renamed into DIR as .NAME.N.partial while they are worked on, and end up as NAME,\n";
+    std::cout << "  or NAME.failed, with a numeric suffix if DIR already has that name.\n";
+    std::cout << "  Like the menu this only obfuscates, with a pad that repeats every 4 KiB; it is no\n";
+    std::cout << "  protection against anyone who wants the contents.\n";
+}
+
+// Links from to dir/name without replacing anything there, adding .1, .2, ...
+// to the name until it is free, then removes from
+static bool placeWithoutClobber(const std::string &from, const std::string &dir, const std::string &name,
+                                std::string &placed)
+{
+    placed = dir + "/" + name;
+    for (int suffix = 1; link(from.c_str(), placed.c_str()) != 0; suffix++)
+    {
+        if (errno != EEXIST)
+            return false;
+        placed = dir + "/" + name + "." + std::to_string(suffix);
+    }
+    unlink(from.c_str());
+    return true;
+}
+
+// Files are claimed by renaming them out of the spool before they are opened.
+// The spool then only ever holds files nobody has touched, so the close-write
+// events of the workers' own writes, an overflow rescan or a restart can never
+// hand a file over twice. That needs DIR to be a directory apart from every
+// spool, on the same filesystem, which is checked before watching starts.
+int runWatch(const std::vector<std::string> &args)
+{
+    Action action = Action::ENCRYPT;
+    size_t workers = std::max(1u, std::thread::hardware_concurrency());
+    size_t queueDepth = 0;
+    int settleMs = 100;
+    std::string outDir;
+    std::vector<std::string> spools;
+
+    for (size_t i = 0; i < args.size(); i++)
+    {
+        if (args[i] == "--decrypt")
+            action = Action::DECRYPT;
+        else if (args[i] == "--workers" && i + 1 < args.size())
+            workers = CommandLine::number(args, i, 1, 1024);
+        else if (args[i] == "--queue" && i + 1 < args.size())
+            queueDepth = CommandLine::number(args, i, 0, 1 << 20);
+        else if (args[i] == "--settle" && i + 1 < args.size())
+            settleMs = static_cast<int>(CommandLine::number(args, i, 0, 3600 * 1000));
+        else if (args[i] == "--out" && i + 1 < args.size())
+            outDir = args[++i];
+        else
+            spools.push_back(args[i]);
+    }
+    if (spools.empty() || outDir.empty())
+    {
+        printWatchUsage();
+        return 1;
+    }
+    // A claim is a rename into DIR, and DIR must not be watched itself
+    struct stat outInfo;
+    if (stat(outDir.c_str(), &outInfo) != 0 || !S_ISDIR(outInfo.st_mode))
+    {
+        std::cout << "❌ " << outDir << " is not a directory" << std::endl;
+        return 1;
+    }
+    for (const std::string &spool : spools)
+    {
+        struct stat spoolInfo;
+        std::error_code ignored;
+        if (stat(spool.c_str(), &spoolInfo) != 0 || !S_ISDIR(spoolInfo.st_mode))
+        {
+            std::cout << "❌ " << spool << " is not a directory" << std::endl;
+            return 1;
+        }
+        if (std::filesystem::equivalent(outDir, spool, ignored))
+        {
+            std::cout << "❌ " << outDir << " is one of the spools; finished files would be picked up again"
+                      << std::endl;
+            return 1;
+        }
+        if (spoolInfo.st_dev != outInfo.st_dev)
+        {
+            std::cout << "❌ " << spool << " and " << outDir << " are on different filesystems" << std::endl;
+            return 1;
+        }
+    }
+
+    // Enough queued to keep the workers busy between polls, no more open files than that
+    if (queueDepth == 0)
+        queueDepth = workers * 4;
+
+    FolderWatcher watcher;
+    if (!watcher.open(spools, settleMs))
+    {
+        std::cout << "❌ " << watcher.getStatusMessage() << std::endl;
+        return 1;
+    }
+
+    struct Finished
+    {
+        std::string claimed;
+        bool ok;
+        std::string error;
+    };
+    std::mutex finishedMutex;
+    std::vector<Finished> finished;
+    ProcessManagement pm;
+    pm.startWorkers(workers, queueDepth, [&](const std::string &claimed, bool ok, const std::string &error)
+                    {
+                        {
+                            std::lock_guard<std::mutex> lock(finishedMutex);
+                            finished.push_back({claimed, ok, error});
+                        }
+                        // A slot in the queue is free for the backlog
+                        watcher.wake(); });
+
+    signal(SIGINT, handleStopSignal);
+    signal(SIGTERM, handleStopSignal);
+    std::cout << "👀 Watching " << spools.size() << " spool(s) with " << workers << " worker(s), moving files to "
+              << outDir << std::endl;
+
+    std::deque<std::string> backlog;                  // settled, not claimed yet
+    std::unordered_map<std::string, std::string> names; // claimed path -> original name
+    uint64_t claimCount = 0;
+    uint64_t done = 0;
+    uint64_t failed = 0;
+    uint64_t reported = 0;
+    auto lastReport = std::chrono::steady_clock::now();
+
+    auto settle = [&](std::vector<Finished> &batch)
+    {
+        for (const Finished &result : batch)
+        {
+            std::string name = names[result.claimed];
+            names.erase(result.claimed);
+            std::string placed;
+            if (result.ok && placeWithoutClobber(result.claimed, outDir, name, placed))
+            {
+                done++;
+                continue;
+            }
+            failed++;
+            std::cout << "❌ " << name << ": " << (result.ok ? std::strerror(errno) : result.error) << std::endl;
+            placeWithoutClobber(result.claimed, outDir, name + ".failed", placed);
+        }
+    };
+
+    bool watching = true;
+    while (watching && !stopWatching)
+    {
+        // Finished tasks wake the poll, so a backlog waits for no longer
+        // than the queue takes to make room
+        std::vector<std::string> ready;
+        if (!watcher.poll(250, ready))
+        {
+            std::cout << "❌ " << watcher.getStatusMessage() << std::endl;
+            watching = false;
+        }
+        backlog.insert(backlog.end(), ready.begin(), ready.end());
+
+        std::vector<Finished> batch;
+        {
+            std::lock_guard<std::mutex> lock(finishedMutex);
+            batch.swap(finished);
+        }
+        settle(batch);
+
+        // Claim only what the queue can take, so the rest stays in the spool
+        // as a name and not an open file
+        while (!backlog.empty() && pm.queuedTasks() < queueDepth)
+        {
+            std::string path = backlog.front();
+            backlog.pop_front();
+            std::string name = std::filesystem::path(path).filename().string();
+            std::string claimed = outDir + "/." + name + "." + std::to_string(claimCount++) + ".partial";
+            if (rename(path.c_str(), claimed.c_str()) != 0)
+            {
+                // A repeat that was claimed before is gone from the spool; if
+                // the file is still there, DIR is what went missing
+                int error = errno;
+                if (error != ENOENT || access(path.c_str(), F_OK) == 0)
+                {
+                    failed++;
+                    std::cout << "❌ " << path << ": " << std::strerror(error) << std::endl;
+                }
+                continue;
+            }
+
+            IO io(claimed);
+            std::fstream stream = io.getFileStream();
+            if (!stream.is_open())
+            {
+                failed++;
+                std::string placed;
+                placeWithoutClobber(claimed, outDir, name + ".failed", placed);
+                continue;
+            }
+            names[claimed] = name;
+            pm.submitToQueue(std::make_unique<Task>(std::move(stream), action, claimed));
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        if (done + failed != reported && now - lastReport >= std::chrono::seconds(1))
+        {
+            std::cout << "📥 " << done << " done, " << failed << " failed, " << pm.queuedTasks() << " queued, "
+                      << backlog.size() + watcher.settlingCount() << " waiting" << std::endl;
+            reported = done + failed;
+            lastReport = now;
+        }
+    }
+
+    // Claimed files are finished; the backlog is picked up by the next run
+    pm.stopWorkers();
+    settle(finished);
+    std::cout << "📥 " << done << " done, " << failed << " failed" << std::endl;
+    return watching ? 0 : 1;
 }
 
-int main()
+int main(int argc, char *argv[])
 {
+    if (argc > 1 && std::string(argv[1]) == "watch")
+    {
+        try
+        {
+            return runWatch(std::vector<std::string>(argv + 2, argv + argc));
+        }
+        catch (const CommandLine::UsageError &e)
+        {
+            std::cerr << e.what() << "\n\n";
+            printWatchUsage();
+            return 1;
+        }
+    }
+
     std::string filePath;
     int choice;
 
@@ -0,0 +1,1452 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <csignal>
+#include <filesystem>
+#include <cstdio>
+#include <fstream>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+#include "app/daemon/CryptoDaemon.hpp"
+#include "app/daemon/DaemonClient.hpp"
+#include "app/daemon/ShardCoordinator.hpp"
+#include "app/processes/AutoTuner.hpp"
+#include "app/processes/CpuTopology.hpp"
+#include "app/processes/BufferPool.hpp"
+#include "app/processes/MemoryBudget.hpp"
+#include "app/processes/PerfCounters.hpp"
+#include "app/processes/ChunkContainer.hpp"
+#include "app/processes/FileDigest.hpp"
+#include "app/fileHandling/FileSniffer.hpp"
+#include "app/fileHandling/EnvConfig.hpp"
+#include "app/fileHandling/CommandLine.hpp"
+#include "app/processes/KeyStore.hpp"
+#include "app/processes/XtsEncryption.hpp"
+#include "app/processes/Aes.hpp"
+#include "app/processes/Recommender.hpp"
+#include "app/processes/SparseMap.hpp"
+
+static CryptoDaemon *activeDaemon = nullptr;
+
+static void handleShutdownSignal(int)
+{
+    if (activeDaemon)
+        activeDaemon->stop();
+}
+
+void printUsage()
+{
+    std::cout << "Usage: cryptocore <command> [options]\n\n";
+    std::cout << "Commands:\n";
+    std::cout << "  daemon [--socket PATH] [--runners N] [--async N] [--listen HOST:PORT] [--memory-budget MB]\n";
+    std::cout << "      Run a long-lived server that accepts jobs over a Unix domain socket;\n";
+    std::cout << "      --async N runs plain file jobs as per-block tasks on N executor threads with\n";
+    std::cout << "      io_uring I/O, so thousands of jobs can be in progress without a thread each;\n";
+    std::cout << "      --listen also takes byte ranges over TCP as a shard node (CRYPTOCORE_NODE_TOKEN\n";
+    std::cout << "      is required, loopback included); --memory-budget caps the buffers of all its\n";
+    std::cout << "      jobs together, jobs wait for room instead of going over\n";
+    std::cout << "  submit [--socket PATH] [--priority P] [--technique NAME] [--workers N] [--resumable] [--pin] [--hash] [--skip-encrypted] [LIMITS] encrypt|decrypt FILE...\n";
+    std::cout << "      Send file jobs to a running daemon and wait for all of them\n";
+    std::cout << "      --resumable keeps a FILE.ccjournal checkpoint; resubmitting an interrupted job resumes it\n";
+    std::cout << "      --pin pins workers to cores spread over the NUMA nodes\n";
+    std::cout << "      --hash records BLAKE3 digests of the plaintext and ciphertext in FILE.b3\n";
+    std::cout << "      --skip-encrypted leaves out containers and files whose first bytes look random\n";
+    std::cout << "  throttle [--socket PATH] [LIMITS]\n";
+    std::cout << "      Change the limits of every job of a running daemon, and its default for new ones;\n";
+    std::cout << "      no LIMITS lifts them. Running jobs pick the change up at their next block\n";
+    std::cout << "  shard --nodes HOST:PORT,... [--technique NAME] [--range-size KIB] [--window N] encrypt|decrypt FILE...\n";
+    std::cout << "      Encrypt or decrypt files in place by sending their ranges to daemons started with\n";
+    std::cout << "      --listen; faster nodes get more ranges and ranges of a lost node are sent again\n";
+    std::cout << "  tune [--technique NAME] [--sweep] [--perf] FILE\n";
+    std::cout << "      Show the auto-tuned mode, worker count and block size for FILE;\n";
+    std::cout << "      --sweep times every combination on a scratch copy to check the choice,\n";
+    std::cout << "      --perf adds cycles per byte and IPC of the transforms from hardware counters\n";
+    std::cout << "  pack [--technique NAME] [--workers N] [--block-size KIB] [--compress] INPUT CONTAINER\n";
+    std::cout << "      Encrypt INPUT into a chunked container that records its technique and chunk index;\n";
+    std::cout << "      --compress compresses each chunk (LZ4 block format) before encrypting it,\n";
+    std::cout << "      unless INPUT is a compressed format or looks random\n";
+    std::cout << "  refresh [--technique NAME] [--workers N] [--block-size KIB] INPUT OUTPUT\n";
+    std::cout << "      Keep OUTPUT an encrypted copy of INPUT; after the first run only blocks whose\n";
+    std::cout << "      plaintext changed are encrypted and written (manifest in OUTPUT.ccmanifest);\n";
+    std::cout << "      a different key or technique rewrites it all\n";
+    std::cout << "  unpack [--workers N] [--offset N] [--length N] CONTAINER OUTPUT|-\n";
+    std::cout << "      Decrypt a container, or only the chunks covering --offset/--length; - writes to stdout\n";
+    std::cout << "  range [--technique NAME] [--out PATH] FILE OFFSET LENGTH\n";
+    std::cout << "      Decrypt only bytes OFFSET..OFFSET+LENGTH of an encrypted file or container to stdout or PATH\n";
+    std::cout << "  verify [--decrypted] [--workers N] FILE\n";
+    std::cout << "      Hash FILE in parallel and check it against the digests in FILE.b3;\n";
+    std::cout << "      --decrypted checks what FILE decrypts to, using the recorded technique\n";
+    std::cout << "  sniff [--workers N] PATH...\n";
+    std::cout << "      Classify files (directories recursively) by magic bytes and entropy of their first 4 KiB\n";
+    std::cout << "  recommend FILE...\n";
+    std::cout << "      Suggest technique, layout, mode, workers and block size from the file's kind, size,\n";
+    std::cout << "      storage and the calibrated kernel speeds, without any network access\n";
+    std::cout << "  kdf [--time MS] [--lanes P] [--block-size R] [--cost N]\n";
+    std::cout << "      Time scrypt key derivation; --time finds the largest cost within MS milliseconds.\n";
+    std::cout << "      Defaults come from CRYPTOCORE_KDF_N/_R/_P in .env\n";
+    std::cout << "  patch [--technique NAME] [--in PATH] FILE OFFSET\n";
+    std::cout << "      Overwrite plaintext at OFFSET of an encrypted file with stdin or PATH,\n";
+    std::cout << "      re-encrypting only the sectors or units it touches\n";
+    std::cout << "  rekey [--from NAME] [--to NAME] [--workers N] [--resumable] [--hash] [--perf] FILE...\n";
+    std::cout << "      Re-encrypt files in place from one technique or key to another in a single pass;\n";
+    std::cout << "      from xts to xts rotates CRYPTOCORE_OLD_PASSPHRASE to CRYPTOCORE_PASSPHRASE;\n";
+    std::cout << "      --perf reports each worker's cycles per byte, IPC and LLC and branch misses\n";
+    std::cout << "  kernels [--mb N]\n";
+    std::cout << "      Time each technique through a per-unit virtual call against the kernels the\n";
+    std::cout << "      dispatch table selects, and the generic AES rounds against the specialized ones\n";
+    std::cout << "\nLimits: --read-limit MB --write-limit MB (per second, over all workers of a job)\n";
+    std::cout << "  --cpu PERCENT (of one core, over all workers) --nice N --ioprio idle|be[:LEVEL]|rt[:LEVEL]\n";
+    std::cout << "\nCRYPTOCORE_MEMORY_BUDGET_MB caps the buffer memory of all runs in one process; workers\n";
+    std::cout << "  wait for room, and commands that run workers report the wait and the peak RSS\n";
+    std::cout << "\nTechniques: xor, substitution, caesar, reverse, rot13, xts\n";
+    std::cout << "  xts is AES-256-XTS keyed from CRYPTOCORE_PASSPHRASE, in sectors of CRYPTOCORE_XTS_SECTOR bytes\n";
+}
+
+bool parseTechnique(const std::string &name, EncryptionType &type)
+{
+    if (name == "xor")
+        type = EncryptionType::XOR;
+    else if (name == "substitution")
+        type = EncryptionType::SIMPLE_SUBSTITUTION;
+    else if (name == "caesar")
+        type = EncryptionType::CAESAR_CIPHER;
+    else if (name == "reverse")
+        type = EncryptionType::REVERSE;
+    else if (name == "rot13")
+        type = EncryptionType::ROT13;
+    else if (name == "xts")
+        type = AES_XTS;
+    else
+        return false;
+    return true;
+}
+
+// Consumes a limit option at args[i]; false if args[i] is not one. A bad
+// value sets error.
+bool parseLimit(const std::vector<std::string> &args, size_t &i, RunLimits &limits, std::string &error)
+{
+    if (i + 1 >= args.size())
+        return false;
+    const std::string &option = args[i];
+    const std::string &value = args[i + 1];
+    if (option == "--read-limit")
+        limits.readBytesPerSecond = static_cast<uint64_t>(CommandLine::decimal(option, value, 0, 1e6) * 1024 * 1024);
+    else if (option == "--write-limit")
+        limits.writeBytesPerSecond = static_cast<uint64_t>(CommandLine::decimal(option, value, 0, 1e6) * 1024 * 1024);
+    else if (option == "--cpu")
+        limits.cpuPercent = static_cast<unsigned>(CommandLine::number(option, value, 0, 100 * MAX_WORKERS));
+    else if (option == "--nice")
+        limits.nice = static_cast<int>(CommandLine::number(option, value, 0, 19));
+    else if (option == "--ioprio")
+    {
+        std::string name = value.substr(0, value.find(':'));
+        limits.ioClass = name == "rt" ? 1 : name == "be" ? 2 : name == "idle" ? 3 : 0;
+        if (limits.ioClass == 0)
+            error = "--ioprio takes idle, be[:0-7] or rt[:0-7]";
+        else if (value.find(':') != std::string::npos)
+            limits.ioLevel = static_cast<int>(CommandLine::number(option, value.substr(value.find(':') + 1), 0, 7));
+    }
+    else
+        return false;
+    i++;
+    return true;
+}
+
+// AES-XTS is keyed from .env rather than built by the factory
+std::unique_ptr<EncryptionTechnique> makeTechnique(BenchmarkManager &factory, EncryptionType type)
+{
+    if (type != AES_XTS)
+        return factory.getTechnique(type);
+    std::string error;
+    std::unique_ptr<XtsEncryption> instance = XtsEncryption::fromConfig(error);
+    if (!instance)
+        std::cerr << error << std::endl;
+    return instance;
+}
+
+bool useTechnique(TaskManager &manager, BenchmarkManager &factory, EncryptionType type)
+{
+    std::unique_ptr<EncryptionTechnique> instance = makeTechnique(factory, type);
+    if (!instance)
+        return false;
+    manager.setEncryptionTechnique(std::move(instance));
+    return true;
+}
+
+// One line on memory after a run, only when a budget is set
+void printMemory(const RunStats &stats)
+{
+    uint64_t limit = MemoryBudget::shared().getLimit();
+    if (limit == 0)
+        return;
+    std::printf("  peak RSS %llu MiB, waited %.3f s for the %llu MiB memory budget\n",
+                static_cast<unsigned long long>(stats.peakRssBytes / (1024 * 1024)), stats.reservationWaitSeconds,
+                static_cast<unsigned long long>(limit / (1024 * 1024)));
+}
+
+// Hardware counters of a run made with TaskManager::setPerfCounters
+void printPerf(const RunStats &stats)
+{
+    if (stats.perfWorkers == 0)
+    {
+        std::printf("  no worker could read hardware counters\n");
+        return;
+    }
+    auto perKiB = [](uint64_t count, uint64_t bytes) { return bytes > 0 ? 1024.0 * count / bytes : 0.0; };
+    std::printf("  %.2f cycles/B, IPC %.2f, %.2f LLC and %.2f branch misses per KiB over %zu worker(s)\n",
+                stats.perf.cyclesPerByte(), stats.perf.instructionsPerCycle(),
+                perKiB(stats.perf.llcMisses, stats.perf.bytes), perKiB(stats.perf.branchMisses, stats.perf.bytes),
+                stats.perfWorkers);
+    for (size_t i = 0; i < stats.workerPerf.size(); i++)
+    {
+        const PerfSample &worker = stats.workerPerf[i];
+        if (worker.bytes > 0)
+            std::printf("    worker %zu: %.2f cycles/B, IPC %.2f, %.2f LLC misses per KiB\n", i,
+                        worker.cyclesPerByte(), worker.instructionsPerCycle(), perKiB(worker.llcMisses, worker.bytes));
+    }
+}
+
+int runDaemon(const std::vector<std::string> &args)
+{
+    std::string socketPath = DaemonProtocol::DEFAULT_SOCKET_PATH;
+    size_t runners = 0;
+    size_t asyncExecutors = 0;
+    std::string listenAddress;
+
+    for (size_t i = 0; i < args.size(); i++)
+    {
+        if (args[i] == "--socket" && i + 1 < args.size())
+            socketPath = args[++i];
+        else if (args[i] == "--runners" && i + 1 < args.size())
+            runners = CommandLine::number(args, i, 0, 256);
+        else if (args[i] == "--async" && i + 1 < args.size())
+            asyncExecutors = CommandLine::number(args, i, 0, 1024);
+        else if (args[i] == "--listen" && i + 1 < args.size())
+            listenAddress = args[++i];
+        else if (args[i] == "--memory-budget" && i + 1 < args.size())
+            MemoryBudget::shared().setLimit(CommandLine::number(args, i, 0, 1ULL << 30) * 1024 * 1024);
+        else
+        {
+            printUsage();
+            return 1;
+        }
+    }
+
+    CryptoDaemon daemon(socketPath, runners, asyncExecutors);
+    if (!listenAddress.empty())
+        daemon.setNodeListener(listenAddress);
+    if (!daemon.start())
+    {
+        std::cerr << daemon.getStatusMessage() << std::endl;
+        return 1;
+    }
+
+    activeDaemon = &daemon;
+    signal(SIGINT, handleShutdownSignal);
+    signal(SIGTERM, handleShutdownSignal);
+
+    std::cout << daemon.getStatusMessage() << std::endl;
+    daemon.run();
+    activeDaemon = nullptr;
+    return 0;
+}
+
+int runSubmit(const std::vector<std::string> &args)
+{
+    std::string socketPath = DaemonProtocol::DEFAULT_SOCKET_PATH;
+    uint8_t priority = 0;
+    uint16_t workers = 0;
+    uint8_t flags = 0;
+    bool skipEncrypted = false;
+    EncryptionType technique = EncryptionType::XOR;
+    RunLimits limits;
+    std::string limitError;
+    std::vector<std::string> positional;
+
+    for (size_t i = 0; i < args.size(); i++)
+    {
+        if (parseLimit(args, i, limits, limitError))
+        {
+            if (!limitError.empty())
+            {
+                std::cerr << limitError << std::endl;
+                return 1;
+            }
+        }
+        else if (args[i] == "--socket" && i + 1 < args.size())
+            socketPath = args[++i];
+        else if (args[i] == "--priority" && i + 1 < args.size())
+            priority = static_cast<uint8_t>(CommandLine::number(args, i, 0, UINT8_MAX));
+        else if (args[i] == "--workers" && i + 1 < args.size())
+            workers = static_cast<uint16_t>(CommandLine::number(args, i, 0, MAX_WORKERS));
+        else if (args[i] == "--resumable")
+            flags |= DaemonProtocol::FLAG_CHECKPOINT;
+        else if (args[i] == "--pin")
+            flags |= DaemonProtocol::FLAG_PIN_WORKERS;
+        else if (args[i] == "--hash")
+            flags |= DaemonProtocol::FLAG_HASH;
+        else if (args[i] == "--skip-encrypted")
+            skipEncrypted = true;
+        else if (args[i] == "--technique" && i + 1 < args.size())
+        {
+            if (!parseTechnique(args[++i], technique))
+            {
+                std::cerr << "Unknown technique: " << args[i] << std::endl;
+                return 1;
+            }
+        }
+        else
+            positional.push_back(args[i]);
+    }
+
+    if (positional.size() < 2 || (positional[0] != "encrypt" && positional[0] != "decrypt"))
+    {
+        printUsage();
+        return 1;
+    }
+
+    DaemonClient client;
+    if (!client.connectTo(socketPath))
+    {
+        std::cerr << client.getStatusMessage() << std::endl;
+        return 1;
+    }
+
+    // Limits go first, as the connection default for every job below
+    if (limits.any() && !client.setLimits(0, limits))
+    {
+        std::cerr << client.getStatusMessage() << std::endl;
+        return 1;
+    }
+
+    // Submit everything up front so the daemon can run the jobs concurrently.
+    // Paths are made absolute because the daemon has its own working directory.
+    bool isEncryption = positional[0] == "encrypt";
+    size_t outstanding = 0;
+    for (size_t i = 1; i < positional.size(); i++)
+    {
+        FileType type;
+        if (skipEncrypted && isEncryption && FileSniffer::sniff(positional[i], type) && type.likelyEncrypted())
+        {
+            std::cout << positional[i] << ": skipped (" << type.description << ")" << std::endl;
+            continue;
+        }
+        std::string absolutePath = std::filesystem::absolute(positional[i]).string();
+        if (!client.submitFile(i, absolutePath, isEncryption, technique, workers, priority, flags))
+        {
+            std::cerr << client.getStatusMessage() << std::endl;
+            return 1;
+        }
+        outstanding++;
+    }
+
+    int exitCode = 0;
+    DaemonReply reply;
+    while (outstanding > 0 && client.readReply(reply))
+    {
+        if (reply.opcode == DaemonProtocol::Opcode::ACCEPTED || reply.jobId == 0 || reply.jobId >= positional.size())
+            continue;
+
+        const std::string &path = positional[reply.jobId];
+        if (reply.opcode == DaemonProtocol::Opcode::COMPLETED)
+        {
+            std::cout << path << ": done" << std::endl;
+        }
+        else
+        {
+            std::string message(reply.payload.begin(), reply.payload.end());
+            std::cout << path << ": " << (message.empty() ? "cancelled" : message) << std::endl;
+            exitCode = 1;
+        }
+        outstanding--;
+    }
+
+    if (outstanding > 0)
+    {
+        std::cerr << client.getStatusMessage() << std::endl;
+        return 1;
+    }
+    return exitCode;
+}
+
+int runThrottle(const std::vector<std::string> &args)
+{
+    std::string socketPath = DaemonProtocol::DEFAULT_SOCKET_PATH;
+    RunLimits limits;
+    std::string limitError;
+
+    for (size_t i = 0; i < args.size(); i++)
+    {
+        if (parseLimit(args, i, limits, limitError))
+        {
+            if (!limitError.empty())
+            {
+                std::cerr << limitError << std::endl;
+                return 1;
+            }
+        }
+        else if (args[i] == "--socket" && i + 1 < args.size())
+            socketPath = args[++i];
+        else
+        {
+            printUsage();
+            return 1;
+        }
+    }
+
+    DaemonClient client;
+    DaemonReply reply;
+    if (!client.connectTo(socketPath) || !client.setLimits(0, limits, true) || !client.readReply(reply))
+    {
+        std::cerr << client.getStatusMessage() << std::endl;
+        return 1;
+    }
+    if (reply.opcode != DaemonProtocol::Opcode::ACCEPTED)
+    {
+        std::cerr << std::string(reply.payload.begin(), reply.payload.end()) << std::endl;
+        return 1;
+    }
+    std::cout << (limits.any() ? "Limits set" : "Limits lifted") << std::endl;
+    return 0;
+}
+
+int runShard(const std::vector<std::string> &args)
+{
+    std::vector<std::string> nodes;
+    EncryptionType technique = EncryptionType::XOR;
+    size_t rangeSize = ShardCoordinator::DEFAULT_RANGE_SIZE;
+    size_t window = ShardCoordinator::DEFAULT_WINDOW;
+    std::vector<std::string> positional;
+
+    for (size_t i = 0; i < args.size(); i++)
+    {
+        if (args[i] == "--nodes" && i + 1 < args.size())
+        {
+            std::string list = args[++i];
+            size_t start = 0;
+            while (start <= list.size())
+            {
+                size_t comma = list.find(',', start);
+                if (comma == std::string::npos)
+                    comma = list.size();
+                if (comma > start)
+                    nodes.push_back(list.substr(start, comma - start));
+                start = comma + 1;
+            }
+        }
+        else if (args[i] == "--range-size" && i + 1 < args.size())
+            rangeSize = CommandLine::number(args, i, 4, 32 * 1024) * 1024;
+        else if (args[i] == "--window" && i + 1 < args.size())
+            window = CommandLine::number(args, i, 1, 256);
+        else if (args[i] == "--technique" && i + 1 < args.size())
+        {
+            if (!parseTechnique(args[++i], technique))
+            {
+                std::cerr << "Unknown technique: " << args[i] << std::endl;
+                return 1;
+            }
+        }
+        else
+            positional.push_back(args[i]);
+    }
+
+    if (nodes.empty() || positional.size() < 2 || (positional[0] != "encrypt" && positional[0] != "decrypt"))
+    {
+        printUsage();
+        return 1;
+    }
+
+    // Nodes only listen with a token, so none would accept us without one
+    if (EnvConfig::get().nodeToken.empty())
+    {
+        std::cerr << "Set CRYPTOCORE_NODE_TOKEN to the token the nodes were started with" << std::endl;
+        return 1;
+    }
+
+    ShardCoordinator coordinator(nodes, technique, rangeSize, window);
+    coordinator.setToken(EnvConfig::get().nodeToken);
+    std::vector<std::string> files(positional.begin() + 1, positional.end());
+    bool ok = coordinator.run(files, positional[0] == "encrypt");
+
+    for (const ShardFileResult &result : coordinator.getFileResults())
+        std::cout << result.path << ": " << (result.ok ? "done" : result.error) << std::endl;
+    for (const NodeStats &node : coordinator.getNodeStats())
+    {
+        std::printf("  node %s: %s, %llu ranges, %.1f MiB, %.1f MB/s, %llu failures\n", node.address.c_str(),
+                    node.reached ? "up" : "unreachable", static_cast<unsigned long long>(node.ranges),
+                    node.bytes / (1024.0 * 1024.0), node.throughputMBps,
+                    static_cast<unsigned long long>(node.failures));
+    }
+    if (!coordinator.getStatusMessage().empty())
+        std::cerr << coordinator.getStatusMessage() << std::endl;
+    return ok ? 0 : 1;
+}
+
+int runTune(const std::vector<std::string> &args)
+{
+    EncryptionType technique = EncryptionType::XOR;
+    bool runSweep = false;
+    bool countPerf = false;
+    std::string path;
+
+    for (size_t i = 0; i < args.size(); i++)
+    {
+        if (args[i] == "--sweep")
+            runSweep = true;
+        else if (args[i] == "--perf")
+            countPerf = true;
+        else if (args[i] == "--technique" && i + 1 < args.size())
+        {
+            if (!parseTechnique(args[++i], technique))
+            {
+                std::cerr << "Unknown technique: " << args[i] << std::endl;
+                return 1;
+            }
+        }
+        else if (path.empty())
+            path = args[i];
+        else
+        {
+            printUsage();
+            return 1;
+        }
+    }
+
+    std::error_code error;
+    size_t fileSize = path.empty() ? 0 : std::filesystem::file_size(path, error);
+    if (path.empty() || error || fileSize == 0)
+    {
+        std::cerr << "tune needs an existing, non-empty file" << std::endl;
+        return 1;
+    }
+
+    BenchmarkManager factory;
+    std::unique_ptr<EncryptionTechnique> instance = makeTechnique(factory, technique);
+    if (!instance)
+        return 1;
+    AutoTuner &tuner = AutoTuner::shared();
+    TuningPlan plan = tuner.plan(path, fileSize, *instance);
+    std::cout << "Topology: " << CpuTopology::host().describe() << "\n";
+    std::cout << "Calibration cache: " << tuner.getCachePath() << "\n";
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd >= 0)
+    {
+        SparseMap sparse;
+        sparse.build(fd, fileSize);
+        close(fd);
+        if (sparse.isSparse())
+            std::cout << "Sparse: " << sparse.dataBytes() << " of " << fileSize << " bytes in "
+                      << sparse.extentCount() << " data extents; holes are skipped\n";
+    }
+    std::cout << "Plan: " << plan.reason << std::endl;
+    if (!runSweep)
+        return 0;
+
+    if (countPerf)
+    {
+        PerfCounters probe;
+        if (!probe.open())
+        {
+            std::cerr << probe.getStatusMessage() << "; sweeping without counters" << std::endl;
+            countPerf = false;
+        }
+    }
+    std::vector<SweepResult> results = tuner.sweep(
+        path, true, [&]()
+        { return makeTechnique(factory, technique); },
+        countPerf);
+    if (results.empty())
+    {
+        std::cerr << "Sweep failed; is there room for a scratch copy next to the file?" << std::endl;
+        return 1;
+    }
+
+    std::cout << "\n  mode       workers  block KiB   seconds     MB/s" << (countPerf ? "  cycles/B    IPC" : "") << "\n";
+    const SweepResult *tuned = nullptr;
+    for (const SweepResult &result : results)
+    {
+        bool isPlan = result.useThreads == plan.useThreads && result.workers == plan.workers &&
+                      result.blockSize == plan.blockSize;
+        if (isPlan)
+            tuned = &result;
+        std::printf("%c %-10s %7zu %10zu %9.3f %8.1f", isPlan ? '*' : ' ',
+                    result.useThreads ? "threads" : "processes", result.workers, result.blockSize / 1024,
+                    result.seconds, result.throughputMBps);
+        if (countPerf && result.perf.cycles > 0)
+            std::printf(" %9.2f %6.2f", result.perf.cyclesPerByte(), result.perf.instructionsPerCycle());
+        else if (countPerf)
+            std::printf(" %9s %6s", "-", "-");
+        std::printf("\n");
+    }
+
+    // The plan's exact combination may fall outside the sweep grid
+    if (tuned)
+        std::cout << "\nTuned plan reaches " << static_cast<int>(100.0 * results.front().seconds / tuned->seconds)
+                  << "% of the fastest combination" << std::endl;
+    else
+        std::cout << "\nTuned plan is not on the sweep grid" << std::endl;
+
+    // Sweep runs share one pool, so later runs should be served from its caches
+    BufferPoolStats pool = BufferPool::shared().getStats();
+    std::cout << "Buffer pool: " << pool.acquires << " buffers, " << pool.threadCacheHits
+              << " from thread caches, " << pool.sharedHits << " from shared lists, " << pool.freshMappings
+              << " newly mapped (" << pool.hugePageMappings << " huge), peak "
+              << pool.peakBytesInUse / 1024 << " KiB in use" << std::endl;
+    return 0;
+}
+
+int runPack(const std::vector<std::string> &args)
+{
+    EncryptionType technique = EncryptionType::XOR;
+    size_t workers = 0;
+    size_t blockSize = TaskManager::DEFAULT_BLOCK_SIZE;
+    bool compress = false;
+    std::vector<std::string> positional;
+
+    for (size_t i = 0; i < args.size(); i++)
+    {
+        if (args[i] == "--workers" && i + 1 < args.size())
+            workers = CommandLine::number(args, i, 0, MAX_WORKERS);
+        else if (args[i] == "--block-size" && i + 1 < args.size())
+            blockSize = CommandLine::number(args, i, 4, 1024 * 1024) * 1024;
+        else if (args[i] == "--compress")
+            compress = true;
+        else if (args[i] == "--technique" && i + 1 < args.size())
+        {
+            if (!parseTechnique(args[++i], technique))
+            {
+                std::cerr << "Unknown technique: " << args[i] << std::endl;
+                return 1;
+            }
+        }
+        else
+            positional.push_back(args[i]);
+    }
+
+    if (positional.size() != 2)
+    {
+        printUsage();
+        return 1;
+    }
+
+    // Compressed and random-looking input would only cost time to try
+    FileType type;
+    if (compress && FileSniffer::sniff(positional[0], type) && !type.compressible() && type.kind != FileKind::EMPTY)
+    {
+        std::cerr << positional[0] << " is " << type.description << "; storing chunks uncompressed" << std::endl;
+        compress = false;
+    }
+
+    BenchmarkManager factory;
+    TaskManager manager;
+    if (!useTechnique(manager, factory, technique))
+        return 1;
+    manager.setBlockSize(blockSize);
+    manager.setContainerCompression(compress);
+    if (!manager.packContainer(positional[0], positional[1], workers))
+    {
+        std::cerr << manager.getStatusMessage() << std::endl;
+        return 1;
+    }
+
+    const RunStats &stats = manager.getRunStats();
+    std::error_code error;
+    uintmax_t stored = std::filesystem::file_size(positional[1], error);
+    std::printf("%s: %llu bytes in %zu KiB chunks, %zu worker(s), %.1f MB/s", positional[1].c_str(),
+                static_cast<unsigned long long>(stats.bytes), manager.getBlockSize() / 1024, stats.workers,
+                stats.throughputMBps);
+    if (compress && stats.bytes > 0)
+        std::printf(", stored in %.1f%% of the input", 100.0 * stored / stats.bytes);
+    std::printf("\n");
+    printMemory(stats);
+    return 0;
+}
+
+int runRefresh(const std::vector<std::string> &args)
+{
+    EncryptionType technique = EncryptionType::XOR;
+    size_t workers = 0;
+    size_t blockSize = TaskManager::DEFAULT_BLOCK_SIZE;
+    std::vector<std::string> positional;
+
+    for (size_t i = 0; i < args.size(); i++)
+    {
+        if (args[i] == "--workers" && i + 1 < args.size())
+            workers = CommandLine::number(args, i, 0, MAX_WORKERS);
+        else if (args[i] == "--block-size" && i + 1 < args.size())
+            blockSize = CommandLine::number(args, i, 4, 1024 * 1024) * 1024;
+        else if (args[i] == "--technique" && i + 1 < args.size())
+        {
+            if (!parseTechnique(args[++i], technique))
+            {
+                std::cerr << "Unknown technique: " << args[i] << std::endl;
+                return 1;
+            }
+        }
+        else
+            positional.push_back(args[i]);
+    }
+
+    if (positional.size() != 2)
+    {
+        printUsage();
+        return 1;
+    }
+
+    BenchmarkManager factory;
+    TaskManager manager;
+    if (!useTechnique(manager, factory, technique))
+        return 1;
+    manager.setBlockSize(blockSize);
+    auto start = std::chrono::steady_clock::now();
+    bool ok = manager.refreshEncrypted(positional[0], positional[1], workers);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (!ok)
+    {
+        std::cerr << manager.getStatusMessage() << std::endl;
+        return 1;
+    }
+
+    const RefreshStats &refresh = manager.getLastRefresh();
+    if (refresh.unchanged)
+    {
+        std::printf("%s: input unchanged, nothing to do (%.3f s)\n", positional[1].c_str(), seconds);
+        return 0;
+    }
+    std::printf("%s: %llu of %llu blocks rewritten (%.1f MB), %zu KiB blocks, %zu worker(s), %.3f s%s\n",
+                positional[1].c_str(), static_cast<unsigned long long>(refresh.changedBlocks),
+                static_cast<unsigned long long>(refresh.blocks), refresh.bytesRewritten / (1024.0 * 1024.0),
+                manager.getBlockSize() / 1024, manager.getRunStats().workers, seconds,
+                refresh.fullRewrite ? " (no usable manifest, full rewrite)" : "");
+    printMemory(manager.getRunStats());
+    return 0;
+}
+
+int runUnpack(const std::vector<std::string> &args)
+{
+    size_t workers = 0;
+    uint64_t offset = 0;
+    uint64_t length = 0;
+    bool ranged = false;
+    std::vector<std::string> positional;
+
+    for (size_t i = 0; i < args.size(); i++)
+    {
+        if (args[i] == "--workers" && i + 1 < args.size())
+            workers = CommandLine::number(args, i, 0, MAX_WORKERS);
+        else if (args[i] == "--offset" && i + 1 < args.size())
+        {
+            offset = CommandLine::number(args, i, 0, UINT64_MAX);
+            ranged = true;
+        }
+        else if (args[i] == "--length" && i + 1 < args.size())
+        {
+            length = CommandLine::number(args, i, 0, UINT64_MAX);
+            ranged = true;
+        }
+        else
+            positional.push_back(args[i]);
+    }
+
+    if (positional.size() != 2)
+    {
+        printUsage();
+        return 1;
+    }
+
+    // The container says which technique it needs
+    ChunkContainer container;
+    if (!container.open(positional[0]))
+    {
+        std::cerr << container.getStatusMessage() << std::endl;
+        return 1;
+    }
+    const ContainerHeader header = container.getHeader();
+    container.close();
+
+    BenchmarkManager factory;
+    TaskManager manager;
+    if (!useTechnique(manager, factory, static_cast<EncryptionType>(header.technique)))
+        return 1;
+
+    if (!ranged && positional[1] != "-")
+    {
+        if (!manager.unpackContainer(positional[0], positional[1], workers))
+        {
+            std::cerr << manager.getStatusMessage() << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    if (!ranged || length == 0)
+        length = header.plainSize;
+    std::vector<char> data;
+    if (!manager.readContainerRange(positional[0], offset, length, data, workers))
+    {
+        std::cerr << manager.getStatusMessage() << std::endl;
+        return 1;
+    }
+
+    if (positional[1] == "-")
+    {
+        std::fwrite(data.data(), 1, data.size(), stdout);
+        return std::fflush(stdout) == 0 ? 0 : 1;
+    }
+    std::ofstream out(positional[1], std::ios::binary | std::ios::trunc);
+    out.write(data.data(), static_cast<std::streamsize>(data.size()));
+    if (!out)
+    {
+        std::cerr << "Could not write " << positional[1] << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+int runRange(const std::vector<std::string> &args)
+{
+    EncryptionType technique = EncryptionType::XOR;
+    std::string outPath;
+    std::vector<std::string> positional;
+
+    for (size_t i = 0; i < args.size(); i++)
+    {
+        if (args[i] == "--out" && i + 1 < args.size())
+            outPath = args[++i];
+        else if (args[i] == "--technique" && i + 1 < args.size())
+        {
+            if (!parseTechnique(args[++i], technique))
+            {
+                std::cerr << "Unknown technique: " << args[i] << std::endl;
+                return 1;
+            }
+        }
+        else
+            positional.push_back(args[i]);
+    }
+
+    if (positional.size() != 3)
+    {
+        printUsage();
+        return 1;
+    }
+    const std::string &path = positional[0];
+    uint64_t offset = CommandLine::number("OFFSET", positional[1], 0, UINT64_MAX);
+    size_t length = CommandLine::number("LENGTH", positional[2], 0, SIZE_MAX);
+
+    // Containers carry their technique; raw files need it on the command line
+    BenchmarkManager factory;
+    TaskManager manager;
+    std::vector<char> data;
+    bool ok;
+    if (ChunkContainer::isContainer(path))
+    {
+        ChunkContainer container;
+        if (!container.open(path))
+        {
+            std::cerr << container.getStatusMessage() << std::endl;
+            return 1;
+        }
+        technique = static_cast<EncryptionType>(container.getHeader().technique);
+        container.close();
+        if (!useTechnique(manager, factory, technique))
+            return 1;
+        ok = manager.readContainerRange(path, offset, length, data);
+    }
+    else
+    {
+        if (!useTechnique(manager, factory, technique))
+            return 1;
+        size_t produced = 0;
+        data.resize(length);
+        ok = manager.decryptRange(path, offset, length, data.data(), produced);
+        data.resize(produced);
+    }
+    if (!ok)
+    {
+        std::cerr << manager.getStatusMessage() << std::endl;
+        return 1;
+    }
+
+    if (outPath.empty())
+    {
+        std::fwrite(data.data(), 1, data.size(), stdout);
+        return std::fflush(stdout) == 0 ? 0 : 1;
+    }
+    std::ofstream out(outPath, std::ios::binary | std::ios::trunc);
+    out.write(data.data(), static_cast<std::streamsize>(data.size()));
+    if (!out)
+    {
+        std::cerr << "Could not write " << outPath << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+int runPatch(const std::vector<std::string> &args)
+{
+    EncryptionType technique = EncryptionType::XOR;
+    std::string inPath;
+    std::vector<std::string> positional;
+
+    for (size_t i = 0; i < args.size(); i++)
+    {
+        if (args[i] == "--in" && i + 1 < args.size())
+            inPath = args[++i];
+        else if (args[i] == "--technique" && i + 1 < args.size())
+        {
+            if (!parseTechnique(args[++i], technique))
+            {
+                std::cerr << "Unknown technique: " << args[i] << std::endl;
+                return 1;
+            }
+        }
+        else
+            positional.push_back(args[i]);
+    }
+
+    if (positional.size() != 2)
+    {
+        printUsage();
+        return 1;
+    }
+    const std::string &path = positional[0];
+    uint64_t offset = CommandLine::number("OFFSET", positional[1], 0, UINT64_MAX);
+    if (ChunkContainer::isContainer(path))
+    {
+        std::cerr << "Containers cannot be patched in place; unpack and pack again" << std::endl;
+        return 1;
+    }
+
+    std::vector<char> data;
+    if (inPath.empty())
+    {
+        char buffer[65536];
+        size_t count;
+        while ((count = std::fread(buffer, 1, sizeof(buffer), stdin)) > 0)
+            data.insert(data.end(), buffer, buffer + count);
+    }
+    else
+    {
+        std::ifstream in(inPath, std::ios::binary);
+        if (!in)
+        {
+            std::cerr << "Could not read " << inPath << std::endl;
+            return 1;
+        }
+        data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+
+    BenchmarkManager factory;
+    TaskManager manager;
+    if (!useTechnique(manager, factory, technique))
+        return 1;
+    if (!manager.encryptRange(path, offset, data.data(), data.size()))
+    {
+        std::cerr << manager.getStatusMessage() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+int runRekey(const std::vector<std::string> &args)
+{
+    EncryptionType from = AES_XTS;
+    EncryptionType to = AES_XTS;
+    size_t workers = 0;
+    bool resumable = false;
+    bool hash = false;
+    bool countPerf = false;
+    std::vector<std::string> files;
+
+    for (size_t i = 0; i < args.size(); i++)
+    {
+        if (args[i] == "--workers" && i + 1 < args.size())
+            workers = CommandLine::number(args, i, 0, MAX_WORKERS);
+        else if (args[i] == "--resumable")
+            resumable = true;
+        else if (args[i] == "--hash")
+            hash = true;
+        else if (args[i] == "--perf")
+            countPerf = true;
+        else if ((args[i] == "--from" || args[i] == "--to") && i + 1 < args.size())
+        {
+            EncryptionType &type = args[i] == "--from" ? from : to;
+            if (!parseTechnique(args[++i], type))
+            {
+                std::cerr << "Unknown technique: " << args[i] << std::endl;
+                return 1;
+            }
+        }
+        else
+            files.push_back(args[i]);
+    }
+
+    if (files.empty())
+    {
+        printUsage();
+        return 1;
+    }
+    if (from == to && from != AES_XTS)
+    {
+        std::cerr << "Fixed-key techniques have no key to rotate; choose a different --to" << std::endl;
+        return 1;
+    }
+    const EnvConfig &config = EnvConfig::get();
+    if (from == AES_XTS && to == AES_XTS && config.oldPassphrase == config.passphrase)
+    {
+        std::cerr << "Set CRYPTOCORE_OLD_PASSPHRASE to the current key and CRYPTOCORE_PASSPHRASE to the new one"
+                  << std::endl;
+        return 1;
+    }
+
+    BenchmarkManager factory;
+    TaskManager manager;
+    if (!useTechnique(manager, factory, to))
+        return 1;
+    manager.setCheckpointing(resumable);
+    manager.setHashing(hash);
+    if (countPerf && !manager.setPerfCounters(true))
+    {
+        std::cerr << manager.getStatusMessage() << "; rekeying without counters" << std::endl;
+        countPerf = false;
+    }
+
+    int exitCode = 0;
+    for (const std::string &path : files)
+    {
+        std::unique_ptr<EncryptionTechnique> source;
+        if (from == AES_XTS)
+        {
+            std::string error;
+            source = XtsEncryption::fromOldPassphrase(error);
+            if (!source)
+                std::cerr << error << std::endl;
+        }
+        else
+            source = factory.getTechnique(from);
+        if (!source)
+            return 1;
+
+        if (!manager.rekeyWithThreads(path, std::move(source), workers))
+        {
+            std::cerr << path << ": " << manager.getStatusMessage() << std::endl;
+            exitCode = 1;
+            continue;
+        }
+        const RunStats &stats = manager.getRunStats();
+        std::printf("%s: rekeyed %llu bytes in one pass, %zu worker(s), %.1f MB/s\n", path.c_str(),
+                    static_cast<unsigned long long>(stats.bytes), stats.workers, stats.throughputMBps);
+        printMemory(stats);
+        if (countPerf)
+            printPerf(stats);
+    }
+    return exitCode;
+}
+
+int runVerify(const std::vector<std::string> &args)
+{
+    bool decrypted = false;
+    size_t workers = 0;
+    std::vector<std::string> positional;
+
+    for (size_t i = 0; i < args.size(); i++)
+    {
+        if (args[i] == "--decrypted")
+            decrypted = true;
+        else if (args[i] == "--workers" && i + 1 < args.size())
+            workers = CommandLine::number(args, i, 0, MAX_WORKERS);
+        else
+            positional.push_back(args[i]);
+    }
+
+    if (positional.size() != 1)
+    {
+        printUsage();
+        return 1;
+    }
+    const std::string &path = positional[0];
+
+    FileDigest record;
+    bool recorded = record.load(path);
+    if (decrypted && !recorded)
+    {
+        std::cerr << "No digests recorded in " << FileDigest::pathFor(path) << std::endl;
+        return 1;
+    }
+
+    BenchmarkManager factory;
+    TaskManager manager;
+    if (decrypted && !useTechnique(manager, factory, static_cast<EncryptionType>(record.technique)))
+        return 1;
+    std::string digest;
+    if (!manager.hashFile(path, decrypted, digest, workers))
+    {
+        std::cerr << manager.getStatusMessage() << std::endl;
+        return 1;
+    }
+
+    if (!recorded)
+    {
+        std::cout << digest << "  " << path << std::endl;
+        return 0;
+    }
+    if (decrypted)
+    {
+        bool match = digest == record.plaintext;
+        std::cout << path << ": " << (match ? "OK (decrypts to the recorded plaintext)" : "FAILED") << std::endl;
+        return match ? 0 : 1;
+    }
+    if (digest == record.ciphertext)
+        std::cout << path << ": OK (encrypted)" << std::endl;
+    else if (digest == record.plaintext)
+        std::cout << path << ": OK (decrypted)" << std::endl;
+    else
+    {
+        std::cout << path << ": FAILED" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+int runSniff(const std::vector<std::string> &args)
+{
+    size_t workers = 0;
+    std::vector<std::string> paths;
+
+    for (size_t i = 0; i < args.size(); i++)
+    {
+        if (args[i] == "--workers" && i + 1 < args.size())
+            workers = CommandLine::number(args, i, 0, MAX_WORKERS);
+        else if (std::filesystem::is_directory(args[i]))
+        {
+            std::error_code error;
+            for (auto it = std::filesystem::recursive_directory_iterator(
+                     args[i], std::filesystem::directory_options::skip_permission_denied, error);
+                 it != std::filesystem::recursive_directory_iterator(); it.increment(error))
+            {
+                if (error)
+                    break;
+                if (it->is_regular_file(error))
+                    paths.push_back(it->path().string());
+            }
+        }
+        else
+            paths.push_back(args[i]);
+    }
+
+    if (paths.empty())
+    {
+        printUsage();
+        return 1;
+    }
+
+    // One small read per file, so the walk is latency-bound: overlap the
+    // reads on several threads and print in input order
+    if (workers == 0)
+        workers = std::max<size_t>(4, CpuTopology::host().getCpus().size());
+    workers = std::min(workers, paths.size());
+    std::vector<FileType> types(paths.size());
+    std::vector<char> readable(paths.size(), 0);
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < workers; i++)
+    {
+        threads.emplace_back([&]
+                             {
+                                 for (size_t j = next++; j < paths.size(); j = next++)
+                                     readable[j] = FileSniffer::sniff(paths[j], types[j]);
+                             });
+    }
+    for (std::thread &thread : threads)
+        thread.join();
+
+    std::map<std::string, size_t> counts;
+    int exitCode = 0;
+    for (size_t i = 0; i < paths.size(); i++)
+    {
+        if (!readable[i])
+        {
+            std::cout << paths[i] << ": unreadable" << std::endl;
+            exitCode = 1;
+            continue;
+        }
+        const FileType &type = types[i];
+        std::printf("%-10s %4.2f %12llu  %s: %s\n", FileSniffer::kindName(type.kind), type.entropy,
+                    static_cast<unsigned long long>(type.size), paths[i].c_str(), type.description.c_str());
+        counts[FileSniffer::kindName(type.kind)]++;
+    }
+
+    std::printf("%zu file(s):", paths.size());
+    for (const auto &count : counts)
+        std::printf(" %zu %s", count.second, count.first.c_str());
+    std::printf("\n");
+    return exitCode;
+}
+
+int runKdf(const std::vector<std::string> &args)
+{
+    const EnvConfig &config = EnvConfig::get();
+    KdfParams params;
+    params.cost = config.kdfCost;
+    params.blockSize = config.kdfBlockSize;
+    params.lanes = config.kdfLanes;
+    double targetMs = 0;
+
+    for (size_t i = 0; i < args.size(); i++)
+    {
+        if (args[i] == "--time" && i + 1 < args.size())
+            targetMs = CommandLine::decimal(args, i, 1, 600000);
+        else if (args[i] == "--lanes" && i + 1 < args.size())
+            params.lanes = static_cast<uint32_t>(CommandLine::number(args, i, 1, 1024));
+        else if (args[i] == "--block-size" && i + 1 < args.size())
+            params.blockSize = static_cast<uint32_t>(CommandLine::number(args, i, 1, 1024));
+        else if (args[i] == "--cost" && i + 1 < args.size())
+            params.cost = CommandLine::number(args, i, 2, 1ULL << 40);
+        else
+        {
+            printUsage();
+            return 1;
+        }
+    }
+
+    if (targetMs > 0)
+    {
+        std::vector<std::pair<uint64_t, double>> samples;
+        params = KeyDerivation::calibrate(targetMs, params.lanes, params.blockSize, &samples);
+        for (const auto &sample : samples)
+            std::printf("N=%-9llu %8.1f ms\n", static_cast<unsigned long long>(sample.first), sample.second);
+    }
+    if (!KeyDerivation::validParams(params))
+    {
+        std::cerr << "Invalid parameters: N must be a power of two and 128*r*N at most 1 GiB" << std::endl;
+        return 1;
+    }
+
+    // The second lookup shows what every later job with the same key pays
+    KeyStore &store = KeyStore::shared();
+    auto start = std::chrono::steady_clock::now();
+    std::shared_ptr<const KeyMaterial> key = store.get("benchmark passphrase", "benchmark salt", params);
+    auto derived = std::chrono::steady_clock::now();
+    key = store.get("benchmark passphrase", "benchmark salt", params);
+    auto cached = std::chrono::steady_clock::now();
+    if (!key)
+    {
+        std::cerr << store.getStatusMessage() << std::endl;
+        return 1;
+    }
+
+    KeyStoreStats stats = store.getStats();
+    std::printf("N=%llu r=%u p=%u: %.1f ms to derive (%zu MiB per lane, %zu lane(s) at once), %.1f us from the cache\n",
+                static_cast<unsigned long long>(params.cost), params.blockSize, params.lanes,
+                std::chrono::duration<double, std::milli>(derived - start).count(), params.laneBytes() >> 20,
+                std::min<size_t>(params.lanes, CpuTopology::host().getCpus().size()),
+                std::chrono::duration<double, std::micro>(cached - derived).count());
+    std::printf("Key memory %s\n", stats.locked ? "locked in RAM" : "NOT locked (raise RLIMIT_MEMLOCK)");
+    if (targetMs > 0)
+        std::printf("For .env: CRYPTOCORE_KDF_N=%llu CRYPTOCORE_KDF_R=%u CRYPTOCORE_KDF_P=%u\n",
+                    static_cast<unsigned long long>(params.cost), params.blockSize, params.lanes);
+    return 0;
+}
+
+int runRecommend(const std::vector<std::string> &args)
+{
+    if (args.empty())
+    {
+        printUsage();
+        return 1;
+    }
+
+    BenchmarkManager factory;
+    Recommender recommender(factory);
+    int exitCode = 0;
+    for (const std::string &path : args)
+    {
+        Recommendation advice;
+        if (!recommender.recommend(path, advice))
+        {
+            std::cerr << recommender.getStatusMessage() << std::endl;
+            exitCode = 1;
+            continue;
+        }
+        if (advice.skip)
+            std::printf("%s: skip", path.c_str());
+        else
+            std::printf("%s: %s, %s, %zu %s, %zu KiB blocks", path.c_str(), advice.techniqueName.c_str(),
+                        advice.packCompressed ? "pack --compress" : "in place", advice.plan.workers,
+                        advice.plan.useThreads ? "thread(s)" : "process(es)", advice.plan.blockSize / 1024);
+        std::printf(" (decided in %.0f us)\n", advice.decideMicros);
+        for (const std::string &reason : advice.reasons)
+            std::printf("  - %s\n", reason.c_str());
+    }
+    return exitCode;
+}
+
+// Seconds per pass of fn over the buffer, best of a few passes
+template <typename Fn>
+static double timePasses(Fn fn)
+{
+    double best = 0;
+    for (int pass = 0; pass < 5; pass++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (pass == 0 || seconds < best)
+            best = seconds;
+    }
+    return best;
+}
+
+int runKernels(const std::vector<std::string> &args)
+{
+    size_t megabytes = 64;
+    for (size_t i = 0; i < args.size(); i++)
+    {
+        if (args[i] == "--mb" && i + 1 < args.size())
+            megabytes = CommandLine::number(args, i, 1, 4096);
+        else
+        {
+            printUsage();
+            return 1;
+        }
+    }
+
+    std::vector<char> buffer(megabytes * 1024 * 1024);
+    for (size_t i = 0; i < buffer.size(); i++)
+        buffer[i] = static_cast<char>(i * 131 + 7);
+    const double mb = static_cast<double>(megabytes);
+
+    // Techniques: the old path branched on the direction and called through
+    // the vtable for every unit; the table resolves both once per job
+    BenchmarkManager factory;
+    const uint8_t probeKey[XtsEncryption::KEY_LEN] = {1};
+    const EncryptionType types[] = {EncryptionType::XOR, EncryptionType::SIMPLE_SUBSTITUTION,
+                                    EncryptionType::CAESAR_CIPHER, EncryptionType::REVERSE,
+                                    EncryptionType::ROT13, AES_XTS};
+    std::printf("technique      direction   per-unit MB/s   dispatched MB/s\n");
+    for (EncryptionType type : types)
+    {
+        for (int encrypt = 1; encrypt >= 0; encrypt--)
+        {
+            std::unique_ptr<EncryptionTechnique> instance;
+            if (type == AES_XTS)
+                instance = std::make_unique<XtsEncryption>(probeKey, probeKey, EnvConfig::get().xtsSectorSize);
+            else
+                instance = factory.getTechnique(type);
+            if (!instance)
+                continue;
+            EncryptionTechnique *technique = instance.get();
+            double perUnit = timePasses([&]()
+                                        {
+                for (size_t offset = 0; offset < buffer.size(); offset += TaskManager::TRANSFORM_UNIT)
+                {
+                    size_t length = std::min(static_cast<size_t>(TaskManager::TRANSFORM_UNIT), buffer.size() - offset);
+                    if (encrypt)
+                        technique->encryptChunk(buffer.data() + offset, length);
+                    else
+                        technique->decryptChunk(buffer.data() + offset, length);
+                } });
+
+            TaskManager manager;
+            manager.setEncryptionTechnique(std::move(instance));
+            double dispatched = timePasses([&]()
+                                           { manager.processBuffer(buffer.data(), buffer.size(), encrypt); });
+            std::printf("%-14s %-9s %15.0f %17.0f\n", Recommender::nameOf(type), encrypt ? "encrypt" : "decrypt",
+                        mb / perUnit, mb / dispatched);
+        }
+    }
+
+    // AES: the loop over a run-time round count against the kernel built for
+    // this ISA, key size and direction
+    std::printf("\ncipher    direction   generic MB/s   specialized MB/s   kernel\n");
+    const size_t blocks = buffer.size() / Aes::BLOCK_LEN;
+    uint8_t *data = reinterpret_cast<uint8_t *>(buffer.data());
+    for (size_t keyLen : {size_t(16), size_t(32)})
+    {
+        Aes generic;
+        Aes specialized;
+        generic.setKey(probeKey, keyLen, false);
+        specialized.setKey(probeKey, keyLen);
+        for (int encrypt = 1; encrypt >= 0; encrypt--)
+        {
+            auto run = [&](const Aes &cipher)
+            {
+                return timePasses([&]()
+                                  {
+                    if (encrypt)
+                        cipher.encryptBlocks(data, data, blocks);
+                    else
+                        cipher.decryptBlocks(data, data, blocks); });
+            };
+            double genericSeconds = run(generic);
+            double specializedSeconds = run(specialized);
+            std::printf("AES-%-5zu %-9s %14.0f %18.0f   %s\n", keyLen * 8, encrypt ? "encrypt" : "decrypt",
+                        mb / genericSeconds, mb / specializedSeconds, specialized.kernelName());
+        }
+    }
+    return 0;
+}
+
+int runCommand(const std::string &command, const std::vector<std::string> &args)
+{
+    if (command == "daemon")
+        return runDaemon(args);
+    if (command == "submit")
+        return runSubmit(args);
+    if (command == "throttle")
+        return runThrottle(args);
+    if (command == "shard")
+        return runShard(args);
+    if (command == "tune")
+        return runTune(args);
+    if (command == "pack")
+        return runPack(args);
+    if (command == "refresh")
+        return runRefresh(args);
+    if (command == "unpack")
+        return runUnpack(args);
+    if (command == "range")
+        return runRange(args);
+    if (command == "patch")
+        return runPatch(args);
+    if (command == "rekey")
+        return runRekey(args);
+    if (command == "verify")
+        return runVerify(args);
+    if (command == "sniff")
+        return runSniff(args);
+    if (command == "recommend")
+        return runRecommend(args);
+    if (command == "kdf")
+        return runKdf(args);
+    if (command == "kernels")
+        return runKernels(args);
+
+    printUsage();
+    return 1;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        printUsage();
+        return 1;
+    }
+
+    try
+    {
+        return runCommand(argv[1], std::vector<std::string>(argv + 2, argv + argc));
+    }
+    catch (const CommandLine::UsageError &e)
+    {
+        std::cerr << e.what() << "\n\n";
+        printUsage();
+        return 1;
+    }
+}